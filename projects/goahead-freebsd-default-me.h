@@ -84,18 +84,51 @@
 #ifndef ME_DESCRIPTION
     #define ME_DESCRIPTION "Embedthis GoAhead Embedded Web Server"
 #endif
+#ifndef ME_GOAHEAD_ACCEPT_BATCH
+    #define ME_GOAHEAD_ACCEPT_BATCH 32
+#endif
 #ifndef ME_GOAHEAD_ACCESS_LOG
     #define ME_GOAHEAD_ACCESS_LOG 0
 #endif
+#ifndef ME_GOAHEAD_ACCESS_LOG_BACKUPS
+    #define ME_GOAHEAD_ACCESS_LOG_BACKUPS 4
+#endif
+#ifndef ME_GOAHEAD_ACCESS_LOG_FORMAT
+    #define ME_GOAHEAD_ACCESS_LOG_FORMAT "common"
+#endif
+#ifndef ME_GOAHEAD_ACCESS_LOG_SIZE
+    #define ME_GOAHEAD_ACCESS_LOG_SIZE 0
+#endif
+#ifndef ME_GOAHEAD_ALLOC_ARENAS
+    #define ME_GOAHEAD_ALLOC_ARENAS 8
+#endif
 #ifndef ME_GOAHEAD_AUTH
     #define ME_GOAHEAD_AUTH 1
 #endif
+#ifndef ME_GOAHEAD_AUTH_CACHE
+    #define ME_GOAHEAD_AUTH_CACHE 64
+#endif
+#ifndef ME_GOAHEAD_AUTH_CACHE_TTL
+    #define ME_GOAHEAD_AUTH_CACHE_TTL 300
+#endif
 #ifndef ME_GOAHEAD_AUTH_STORE
     #define ME_GOAHEAD_AUTH_STORE "file"
 #endif
 #ifndef ME_GOAHEAD_AUTO_LOGIN
     #define ME_GOAHEAD_AUTO_LOGIN 0
 #endif
+#ifndef ME_GOAHEAD_BUFFER_POOL
+    #define ME_GOAHEAD_BUFFER_POOL 64
+#endif
+#ifndef ME_GOAHEAD_CACHE_ITEM_SIZE
+    #define ME_GOAHEAD_CACHE_ITEM_SIZE 65536
+#endif
+#ifndef ME_GOAHEAD_CACHE_REVALIDATE
+    #define ME_GOAHEAD_CACHE_REVALIDATE 2
+#endif
+#ifndef ME_GOAHEAD_CACHE_SIZE
+    #define ME_GOAHEAD_CACHE_SIZE 524288
+#endif
 #ifndef ME_GOAHEAD_CGI
     #define ME_GOAHEAD_CGI 1
 #endif
@@ -108,12 +141,33 @@
 #ifndef ME_GOAHEAD_CLIENT_CACHE_LIFESPAN
     #define ME_GOAHEAD_CLIENT_CACHE_LIFESPAN 86400
 #endif
+#ifndef ME_GOAHEAD_COMPRESS
+    #define ME_GOAHEAD_COMPRESS 1
+#endif
+#ifndef ME_GOAHEAD_DEFER_ACCEPT
+    #define ME_GOAHEAD_DEFER_ACCEPT 0
+#endif
+#ifndef ME_GOAHEAD_DEFLATE
+    #define ME_GOAHEAD_DEFLATE 0
+#endif
 #ifndef ME_GOAHEAD_DIGEST
     #define ME_GOAHEAD_DIGEST 1
 #endif
 #ifndef ME_GOAHEAD_DOCUMENTS
     #define ME_GOAHEAD_DOCUMENTS "web"
 #endif
+#ifndef ME_GOAHEAD_EPOLL
+    #define ME_GOAHEAD_EPOLL 1
+#endif
+#ifndef ME_GOAHEAD_FASTCGI_MULTIPLEX
+    #define ME_GOAHEAD_FASTCGI_MULTIPLEX 1
+#endif
+#ifndef ME_GOAHEAD_FASTCGI_PROCESSES
+    #define ME_GOAHEAD_FASTCGI_PROCESSES 4
+#endif
+#ifndef ME_GOAHEAD_FASTCGI_QUEUE
+    #define ME_GOAHEAD_FASTCGI_QUEUE 64
+#endif
 #ifndef ME_GOAHEAD_JAVASCRIPT
     #define ME_GOAHEAD_JAVASCRIPT 1
 #endif
@@ -141,6 +195,9 @@
 #ifndef ME_GOAHEAD_LIMIT_NUM_HEADERS
     #define ME_GOAHEAD_LIMIT_NUM_HEADERS 64
 #endif
+#ifndef ME_GOAHEAD_LIMIT_OUTPUT
+    #define ME_GOAHEAD_LIMIT_OUTPUT 65536
+#endif
 #ifndef ME_GOAHEAD_LIMIT_PARSE_TIMEOUT
     #define ME_GOAHEAD_LIMIT_PARSE_TIMEOUT 5
 #endif
@@ -180,6 +237,9 @@
 #ifndef ME_GOAHEAD_LOGGING
     #define ME_GOAHEAD_LOGGING 1
 #endif
+#ifndef ME_GOAHEAD_METRICS
+    #define ME_GOAHEAD_METRICS 1
+#endif
 #ifndef ME_GOAHEAD_PUT_DIR
     #define ME_GOAHEAD_PUT_DIR "."
 #endif
@@ -189,6 +249,9 @@
 #ifndef ME_GOAHEAD_REPLACE_MALLOC
     #define ME_GOAHEAD_REPLACE_MALLOC 0
 #endif
+#ifndef ME_GOAHEAD_SESSION_STORE
+    #define ME_GOAHEAD_SESSION_STORE ""
+#endif
 #ifndef ME_GOAHEAD_SSL_AUTHORITY
     #define ME_GOAHEAD_SSL_AUTHORITY ""
 #endif
@@ -237,6 +300,9 @@
 #ifndef ME_GOAHEAD_UPLOAD_DIR
     #define ME_GOAHEAD_UPLOAD_DIR "tmp"
 #endif
+#ifndef ME_GOAHEAD_WORKERS
+    #define ME_GOAHEAD_WORKERS 0
+#endif
 #ifndef ME_GOAHEAD_XFRAME_HEADER
     #define ME_GOAHEAD_XFRAME_HEADER "SAMEORIGIN"
 #endif
@@ -394,3 +460,6 @@
 #ifndef ME_COM_VXWORKS
     #define ME_COM_VXWORKS 0
 #endif
+#ifndef ME_COM_ZLIB
+    #define ME_COM_ZLIB 0
+#endif
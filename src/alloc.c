@@ -7,8 +7,13 @@
     mechanisms. Large blocks greater than the maximum class size may be allocated from the O/S or run-time system via
     malloc. To permit the use of malloc, call wopen with flags set to WEBS_USE_MALLOC (this is the default).  It is
     recommended that wopen be called first thing in the application.  If it is not, it will be called with default
-    values on the first call to walloc(). Note that this code is not designed for multi-threading purposes and it
-    depends on newly declared variables being initialized to zero.
+    values on the first call to walloc(). Call wopenAlloc before creating threads.
+
+    The block class queues are held in arenas. Where the compiler supports thread-local storage and atomic builtins,
+    each thread claims a private arena so allocations and frees by the owning thread need no locking. Blocks freed by
+    another thread are pushed lock-free onto the owner's remote list and reclaimed by the owner on its next allocation.
+    Threads that cannot claim a private arena share arena zero under a lock. Per-class statistics are kept by each arena
+    and summed by wallocStats.
 
     Copyright (c) All Rights Reserved. See details at the end of the file.
  */
@@ -34,10 +39,48 @@ PUBLIC void websSetMemNotifier(WebsMemNotifier cback)
  */
 #define ROUNDUP4(size) ((size) % 4) ? (size) + (4 - ((size) % 4)) : (size)
 
+#if ME_UNIX_LIKE && ME_COMPILER_HAS_SYNC && (__GNUC__ || __clang__)
+    #define WALLOC_THREADS 1
+#else
+    #define WALLOC_THREADS 0
+#endif
+
+#if ME_GOAHEAD_ALLOC_ARENAS > 256
+    #error "ME_GOAHEAD_ALLOC_ARENAS must not exceed 256"
+#endif
+
+/*
+    The low bits of the block flags record the owning arena and the block class
+ */
+#define WALLOC_ARENA_MASK   0xFF
+#define WALLOC_CLASS_SHIFT  8
+#define WALLOC_CLASS_MASK   0xF00
+#define WALLOC_REMOTE       0x3C3C000   /* Integrity value for remotely freed blocks. Distinct from freed blocks */
+
+/*
+    Statistics are updated by the owning thread and read by any thread in wallocStats. Counters are loaded and stored
+    atomically so readers never see a torn value.
+ */
+#if WALLOC_THREADS
+    #define statGet(v)      __atomic_load_n(&(v), __ATOMIC_RELAXED)
+    #define statSet(v, n)   __atomic_store_n(&(v), (n), __ATOMIC_RELAXED)
+#else
+    #define statGet(v)      (v)
+    #define statSet(v, n)   ((v) = (n))
+#endif
+#define statAdd(v, n)       statSet(v, statGet(v) + (n))
+
+typedef struct WallocArena {
+    WebsAlloc       *qhead[WEBS_MAX_CLASS];         /* Per class block q head */
+    WebsAlloc       *remote;                        /* Blocks freed by other threads */
+    int             claimed;                        /* Arena is owned by a thread */
+    WebsAllocStats  stats[WEBS_MAX_CLASS + 1];      /* Per class statistics. Last is for large blocks */
+} WallocArena;
+
 /*
     qhead blocks are created as the original memory allocation is freed up. See wfree.
  */
-static WebsAlloc    *qhead[WEBS_MAX_CLASS];             /* Per class block q head */
+static WallocArena  arenas[max(ME_GOAHEAD_ALLOC_ARENAS, 1)];
 static char         *freeBuf;                           /* Pointer to free memory */
 static char         *freeNext;                          /* Pointer to next free mem */
 static int          freeSize;                           /* Size of free memory */
@@ -45,8 +88,27 @@ static int          freeLeft;                           /* Size of free left for
 static int          controlFlags = WEBS_USE_MALLOC;     /* Default to auto-malloc */
 static int          wopenCount = 0;                     /* Num tasks using walloc */
 
+#if WALLOC_THREADS
+static __thread WallocArena *threadArena;               /* Arena used by this thread */
+static pthread_key_t arenaKey;                          /* Releases the arena when the thread exits */
+static pthread_mutex_t sharedLock = PTHREAD_MUTEX_INITIALIZER;  /* Lock for arena zero */
+static pthread_mutex_t freeLock = PTHREAD_MUTEX_INITIALIZER;    /* Lock for the primary free block */
+#endif
+
+static WallocArena *getArena(void);
+static void drainRemote(WallocArena *ap);
+static void releaseBlock(WallocArena *ap, WebsAlloc *bp, int q);
 static int wallocGetSize(ssize size, int *q);
 
+#if WALLOC_THREADS
+static void lockArena(WallocArena *ap);
+static void releaseArena(void *arg);
+static void unlockArena(WallocArena *ap);
+#else
+#define lockArena(ap)
+#define unlockArena(ap)
+#endif
+
 #endif /* ME_GOAHEAD_REPLACE_MALLOC */
 
 /********************************** Code **************************************/
@@ -60,6 +122,8 @@ static int wallocGetSize(ssize size, int *q);
 PUBLIC int wopenAlloc(void *buf, int bufsize, int flags)
 {
 #if ME_GOAHEAD_REPLACE_MALLOC
+    /* Blocks follow the header, so the header size must preserve 8 byte alignment for int64 and double */
+    assert(sizeof(WebsAlloc) % 8 == 0);
     controlFlags = flags;
 
     /*
@@ -85,7 +149,11 @@ PUBLIC int wopenAlloc(void *buf, int bufsize, int flags)
     }
     freeSize = freeLeft = bufsize;
     freeBuf = freeNext = buf;
-    memset(qhead, 0, sizeof(qhead));
+    memset(arenas, 0, sizeof(arenas));
+#if WALLOC_THREADS
+    threadArena = 0;
+    pthread_key_create(&arenaKey, releaseArena);
+#endif
 #endif /* ME_GOAHEAD_REPLACE_MALLOC */
     return 0;
 }
@@ -96,7 +164,12 @@ PUBLIC void wcloseAlloc()
 #if ME_GOAHEAD_REPLACE_MALLOC
     if (--wopenCount <= 0 && !(controlFlags & WEBS_USER_BUF)) {
         free(freeBuf);
+        freeBuf = 0;
         wopenCount = 0;
+#if WALLOC_THREADS
+        pthread_key_delete(arenaKey);
+        threadArena = 0;
+#endif
     }
 #endif /* ME_GOAHEAD_REPLACE_MALLOC */
 }
@@ -108,14 +181,16 @@ PUBLIC void wcloseAlloc()
  */
 PUBLIC void *walloc(ssize size)
 {
+    WallocArena *ap;
     WebsAlloc   *bp;
-    int         q, memSize;
+    int64       count;
+    int         q, memSize, flags;
 
     /*
         Call wopen with default values if the application has not yet done so
      */
     if (freeBuf == NULL) {
-        if (wopenAlloc(NULL, WEBS_DEFAULT_MEM, 0) < 0) {
+        if (wopenAlloc(NULL, WEBS_DEFAULT_MEM, WEBS_USE_MALLOC) < 0) {
             return NULL;
         }
     }
@@ -123,41 +198,36 @@ PUBLIC void *walloc(ssize size)
         return NULL;
     }
     memSize = wallocGetSize(size, &q);
+    ap = getArena();
+    lockArena(ap);
+    if (ap->remote) {
+        drainRemote(ap);
+    }
+    flags = 0;
+    bp = NULL;
 
     if (q >= WEBS_MAX_CLASS) {
         /*
             Size if bigger than the maximum class. Malloc if use has been okayed
          */
+        q = WEBS_MAX_CLASS;
         if (controlFlags & WEBS_USE_MALLOC) {
             memSize = ROUNDUP4(memSize);
             bp = (WebsAlloc*) malloc(memSize);
-            if (bp == NULL) {
-                if (memNotifier) {
-                    (memNotifier)(memSize);
-                }
-                return NULL;
-            }
-        } else {
-            if (memNotifier) {
-                (memNotifier)(memSize);
-            }
-            return NULL;
+            flags = WEBS_MALLOCED;
         }
-        /*
-            the u.size is the actual size allocated for data
-         */
-        bp->u.size = memSize - sizeof(WebsAlloc);
-        bp->flags = WEBS_MALLOCED;
 
-    } else if ((bp = qhead[q]) != NULL) {
+    } else if ((bp = ap->qhead[q]) != NULL) {
         /*
             Take first block off the relevant q if non-empty
          */
-        qhead[q] = bp->u.next;
-        bp->u.size = memSize - sizeof(WebsAlloc);
-        bp->flags = 0;
+        ap->qhead[q] = bp->u.next;
+        statAdd(ap->stats[q].free, -1);
 
     } else {
+#if WALLOC_THREADS
+        pthread_mutex_lock(&freeLock);
+#endif
         if (freeLeft > memSize) {
             /*
                 The q was empty, and the free list has spare memory so create a new block out of the primary free block
@@ -165,31 +235,38 @@ PUBLIC void *walloc(ssize size)
             bp = (WebsAlloc*) freeNext;
             freeNext += memSize;
             freeLeft -= memSize;
-            bp->u.size = memSize - sizeof(WebsAlloc);
-            bp->flags = 0;
-
-        } else if (controlFlags & WEBS_USE_MALLOC) {
+        }
+#if WALLOC_THREADS
+        pthread_mutex_unlock(&freeLock);
+#endif
+        if (bp == NULL && (controlFlags & WEBS_USE_MALLOC)) {
             /*
                 Nothing left on the primary free list, so malloc a new block
              */
             memSize = ROUNDUP4(memSize);
-            if ((bp = (WebsAlloc*) malloc(memSize)) == NULL) {
-                if (memNotifier) {
-                    (memNotifier)(memSize);
-                }
-                return NULL;
-            }
-            bp->u.size = memSize - sizeof(WebsAlloc);
-            bp->flags = WEBS_MALLOCED;
-
-        } else {
-            if (memNotifier) {
-                (memNotifier)(memSize);
-            }
-            return NULL;
+            bp = (WebsAlloc*) malloc(memSize);
+            flags = WEBS_MALLOCED;
         }
     }
-    bp->flags |= WEBS_INTEGRITY;
+    if (bp == NULL) {
+        unlockArena(ap);
+        if (memNotifier) {
+            (memNotifier)(memSize);
+        }
+        return NULL;
+    }
+    /*
+        The u.size is the actual size allocated for data
+     */
+    bp->u.size = memSize - sizeof(WebsAlloc);
+    bp->flags = WEBS_INTEGRITY | flags | (q << WALLOC_CLASS_SHIFT) | (int) (ap - arenas);
+    statAdd(ap->stats[q].bytes, memSize);
+    count = statGet(ap->stats[q].allocated) + 1;
+    statSet(ap->stats[q].allocated, count);
+    if (count > statGet(ap->stats[q].peak)) {
+        statSet(ap->stats[q].peak, count);
+    }
+    unlockArena(ap);
     return (void*) ((char*) bp + sizeof(WebsAlloc));
 }
 
@@ -200,8 +277,8 @@ PUBLIC void *walloc(ssize size)
  */
 PUBLIC void wfree(void *mp)
 {
+    WallocArena *ap;
     WebsAlloc   *bp;
-    int         q;
 
     if (mp == 0) {
         return;
@@ -211,18 +288,130 @@ PUBLIC void wfree(void *mp)
     if ((bp->flags & WEBS_INTEGRITY_MASK) != WEBS_INTEGRITY) {
         return;
     }
-    wallocGetSize(bp->u.size, &q);
+    ap = getArena();
+#if WALLOC_THREADS
+    if (&arenas[bp->flags & WALLOC_ARENA_MASK] != ap) {
+        WallocArena *owner;
+        WebsAlloc   *head;
+        owner = &arenas[bp->flags & WALLOC_ARENA_MASK];
+        /*
+            Push onto the owner's remote list. The u.next link overwrites the block size. The size of pooled blocks
+            is given by the class. Large blocks save the size in their unused data.
+         */
+        if (((bp->flags & WALLOC_CLASS_MASK) >> WALLOC_CLASS_SHIFT) == WEBS_MAX_CLASS) {
+            *(int*) mp = bp->u.size;
+        }
+        bp->flags = (bp->flags & ~WEBS_INTEGRITY_MASK) | WALLOC_REMOTE;
+        do {
+            head = owner->remote;
+            bp->u.next = head;
+        } while (!__sync_bool_compare_and_swap(&owner->remote, head, bp));
+        return;
+    }
+#endif
+    lockArena(ap);
+    releaseBlock(ap, bp, (bp->flags & WALLOC_CLASS_MASK) >> WALLOC_CLASS_SHIFT);
+    unlockArena(ap);
+}
+
+
+/*
+    Return a block to its arena. Malloced blocks are freed, otherwise the block is simply linked onto the head of
+    the relevant q.
+ */
+static void releaseBlock(WallocArena *ap, WebsAlloc *bp, int q)
+{
+    statAdd(ap->stats[q].allocated, -1);
+    statAdd(ap->stats[q].bytes, -(int64) (bp->u.size + sizeof(WebsAlloc)));
     if (bp->flags & WEBS_MALLOCED) {
         free(bp);
         return;
     }
-    /*
-        Simply link onto the head of the relevant q
-     */
-    bp->u.next = qhead[q];
-    qhead[q] = bp;
+    bp->u.next = ap->qhead[q];
+    ap->qhead[q] = bp;
     bp->flags = WEBS_FILL_WORD;
+    statAdd(ap->stats[q].free, 1);
+}
+
+
+/*
+    Reclaim blocks freed by other threads
+ */
+static void drainRemote(WallocArena *ap)
+{
+#if WALLOC_THREADS
+    WebsAlloc   *bp, *next;
+    int         q;
+
+    for (bp = __sync_lock_test_and_set(&ap->remote, NULL); bp; bp = next) {
+        assert((bp->flags & WEBS_INTEGRITY_MASK) == WALLOC_REMOTE);
+        next = bp->u.next;
+        q = (bp->flags & WALLOC_CLASS_MASK) >> WALLOC_CLASS_SHIFT;
+        bp->u.size = (q < WEBS_MAX_CLASS) ? (1 << (WEBS_SHIFT + q)) : *(int*) ((char*) bp + sizeof(WebsAlloc));
+        releaseBlock(ap, bp, q);
+    }
+#endif
+}
+
+
+/*
+    Get the arena for the current thread. A thread claims a private arena on first use. If none remain, it shares
+    arena zero.
+ */
+static WallocArena *getArena()
+{
+#if WALLOC_THREADS
+    WallocArena *ap;
+
+    if ((ap = threadArena) != 0) {
+        return ap;
+    }
+    for (ap = &arenas[1]; ap < &arenas[ME_GOAHEAD_ALLOC_ARENAS]; ap++) {
+        if (__sync_bool_compare_and_swap(&ap->claimed, 0, 1)) {
+            threadArena = ap;
+            pthread_setspecific(arenaKey, ap);
+            return ap;
+        }
+    }
+    threadArena = arenas;
+#endif
+    return arenas;
+}
+
+
+#if WALLOC_THREADS
+/*
+    Arena zero is shared by threads without a private arena and must be locked
+ */
+static void lockArena(WallocArena *ap)
+{
+    if (ap == arenas) {
+        pthread_mutex_lock(&sharedLock);
+    }
+}
+
+
+static void unlockArena(WallocArena *ap)
+{
+    if (ap == arenas) {
+        pthread_mutex_unlock(&sharedLock);
+    }
+}
+
+
+/*
+    Release a private arena when its thread exits. Free blocks are retained for the next thread to claim the arena.
+    Blocks freed remotely after this point are reclaimed by that thread.
+ */
+static void releaseArena(void *arg)
+{
+    WallocArena     *ap;
+
+    ap = (WallocArena*) arg;
+    drainRemote(ap);
+    __sync_lock_release(&ap->claimed);
 }
+#endif
 
 
 /*
@@ -254,10 +443,54 @@ PUBLIC void *wrealloc(void *mp, ssize newsize)
 }
 
 
+PUBLIC int wallocStats(int cls, WebsAllocStats *stats)
+{
+    WallocArena     *ap;
+    WebsAllocStats  *sp;
+
+    assert(stats);
+    memset(stats, 0, sizeof(WebsAllocStats));
+    if (cls < 0 || cls > WEBS_MAX_CLASS) {
+        return -1;
+    }
+    for (ap = arenas; ap < &arenas[max(ME_GOAHEAD_ALLOC_ARENAS, 1)]; ap++) {
+        sp = &ap->stats[cls];
+        stats->allocated += statGet(sp->allocated);
+        stats->free += statGet(sp->free);
+        stats->peak += statGet(sp->peak);
+        stats->bytes += statGet(sp->bytes);
+    }
+    return 0;
+}
+
+
+/*
+    Get the size of the allocator pool if the allocator cannot grow via malloc
+ */
+PUBLIC ssize wallocLimit()
+{
+    if (freeBuf == NULL) {
+        /* walloc will open a default pool that may grow via malloc */
+        return 0;
+    }
+    return (controlFlags & WEBS_USE_MALLOC) ? 0 : freeSize;
+}
+
+
+#if ME_GOAHEAD_METRICS
+PUBLIC int64 wallocCount(int cls)
+{
+    WebsAllocStats  stats;
+
+    wallocStats(cls, &stats);
+    return stats.allocated;
+}
+#endif
+
+
 /*
     Find the size of the block to be walloc'ed.  It takes in a size, finds the smallest binary block it fits into, adds
-    an overhead amount and returns.  q is the binary size used to keep track of block sizes in use.  Called from both
-    walloc and wfree.
+    an overhead amount and returns.  q is the binary size used to keep track of block sizes in use.
  */
 static int wallocGetSize(ssize size, int *q)
 {
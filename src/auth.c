@@ -39,6 +39,22 @@ static char *masterSecret;
 static int autoLogin = ME_GOAHEAD_AUTO_LOGIN;
 static WebsVerify verifyPassword = websVerifyPasswordFromFile;
 
+#if ME_GOAHEAD_AUTH_CACHE > 0
+/*
+    Cache of verified Basic authentication credentials. Entries are keyed by a hash of the credentials with a random
+    secret so the credentials themselves are not retained. The slot is selected by the hash and replaced on collision.
+ */
+typedef struct AuthCache {
+    char        *hash;                      /* Keyed hash of the credentials */
+    char        *username;                  /* Verified user */
+    WebsVerify  verify;                     /* Verify callback that accepted the credentials */
+    WebsTime    expires;                    /* When the entry expires */
+} AuthCache;
+
+static AuthCache authCache[ME_GOAHEAD_AUTH_CACHE];
+static char     *authCacheSecret;           /* Random secret for hashing credentials */
+#endif
+
 #if ME_COMPILER_HAS_PAM
 typedef struct {
     char    *name;
@@ -56,11 +72,18 @@ typedef struct {
 
 static void computeAbilities(WebsHash abilities, cchar *role, int depth);
 static void computeUserAbilities(WebsUser *user);
+#if ME_GOAHEAD_AUTH_CACHE > 0
+static void cacheCredentials(char *hash, cchar *username, WebsVerify verify);
+static void clearCredentials(cchar *username);
+static char *hashCredentials(Webs *wp);
+static bool lookupCredentials(Webs *wp, cchar *hash, WebsVerify verify);
+#endif
 static WebsUser *createUser(cchar *username, cchar *password, cchar *roles);
 static void freeRole(WebsRole *rp);
 static void freeUser(WebsUser *up);
 static void logoutServiceProc(Webs *wp);
 static void loginServiceProc(Webs *wp);
+static bool parseBasicDetails(Webs *wp);
 
 #if ME_GOAHEAD_JAVASCRIPT && FUTURE
 static int jsCan(int jsid, Webs *wp, int argc, char **argv);
@@ -80,7 +103,7 @@ static int pamChat(int msgCount, const struct pam_message **msg, struct pam_resp
 PUBLIC bool websAuthenticate(Webs *wp)
 {
     WebsRoute   *route;
-    char        *username;
+    char        *username, *hash;
     int         cached;
 
     assert(wp);
@@ -107,25 +130,38 @@ PUBLIC bool websAuthenticate(Webs *wp)
             websError(wp, HTTP_CODE_UNAUTHORIZED, "Access denied. Wrong authentication protocol type.");
             return 0;
         }
+        hash = 0;
+#if ME_GOAHEAD_AUTH_CACHE > 0
+        if (wp->authDetails && route->parseAuth == parseBasicDetails) {
+            /*
+                Clients that do not retain the session cookie send the same credentials with each request.
+                Accept them if previously verified. A session is not created for these requests.
+             */
+            hash = hashCredentials(wp);
+            if (lookupCredentials(wp, hash, route->verify)) {
+                wfree(hash);
+                return 1;
+            }
+        }
+#endif
         if (wp->authDetails && route->parseAuth) {
             if (!(route->parseAuth)(wp)) {
                 wp->username = 0;
             }
         }
-        if (!wp->username || !*wp->username) {
+        if (!wp->username || !*wp->username || !(route->verify)(wp)) {
+            wfree(hash);
             if (route->askLogin) {
                 (route->askLogin)(wp);
             }
             websRedirectByStatus(wp, HTTP_CODE_UNAUTHORIZED);
             return 0;
         }
-        if (!(route->verify)(wp)) {
-            if (route->askLogin) {
-                (route->askLogin)(wp);
-            }
-            websRedirectByStatus(wp, HTTP_CODE_UNAUTHORIZED);
-            return 0;
+#if ME_GOAHEAD_AUTH_CACHE > 0
+        if (hash) {
+            cacheCredentials(hash, wp->username, route->verify);
         }
+#endif
         /*
             Store authentication state and user in session storage
          */
@@ -158,6 +194,14 @@ PUBLIC int websOpenAuth(int minimal)
         websDefineAction("login", loginServiceProc);
         websDefineAction("logout", logoutServiceProc);
     }
+#if ME_GOAHEAD_AUTH_CACHE > 0
+    if (!authCacheSecret) {
+        if (websGetRandomBytes(sbuf, 16, 0) < 0) {
+            fmt(sbuf, sizeof(sbuf), "%x:%x:%x", rand(), time(0), (int) websGetTicks());
+        }
+        authCacheSecret = websMD5Block(sbuf, 16, NULL);
+    }
+#endif
     if (smatch(ME_GOAHEAD_AUTH_STORE, "file")) {
         verifyPassword = websVerifyPasswordFromFile;
 #if ME_COMPILER_HAS_PAM
@@ -174,6 +218,11 @@ PUBLIC void websCloseAuth()
     WebsKey     *key, *next;
 
     wfree(masterSecret);
+#if ME_GOAHEAD_AUTH_CACHE > 0
+    clearCredentials(NULL);
+    wfree(authCacheSecret);
+    authCacheSecret = 0;
+#endif
     if (users >= 0) {
         for (key = hashFirst(users); key; key = next) {
             next = hashNext(users, key);
@@ -288,6 +337,9 @@ PUBLIC int websRemoveUser(cchar *username)
     WebsKey     *key;
 
     assert(username);
+#if ME_GOAHEAD_AUTH_CACHE > 0
+    clearCredentials(username);
+#endif
     if ((key = hashLookup(users, username)) != 0) {
         freeUser(key->content.value.symbol);
     }
@@ -314,6 +366,9 @@ PUBLIC int websSetUserPassword(cchar *username, cchar *password)
     if ((user = websLookupUser(username)) == 0) {
         return -1;
     }
+#if ME_GOAHEAD_AUTH_CACHE > 0
+    clearCredentials(username);
+#endif
     wfree(user->password);
     user->password = sclone(password);
     return 0;
@@ -732,6 +787,91 @@ static int jsCan(int jsid, Webs *wp, int argc, char **argv)
 #endif
 
 
+#if ME_GOAHEAD_AUTH_CACHE > 0
+/*
+    Hash the Authorization header details with the cache secret. Returns allocated string.
+ */
+static char *hashCredentials(Webs *wp)
+{
+    char    *buf, *hash;
+
+    buf = sfmt("%s:%s", authCacheSecret, wp->authDetails);
+    hash = websMD5(buf);
+    memset(buf, 0, slen(buf));
+    wfree(buf);
+    return hash;
+}
+
+
+static AuthCache *getCredentialSlot(cchar *hash)
+{
+    uint    index;
+    int     i;
+
+    for (index = 0, i = 0; i < 8 && hash[i]; i++) {
+        index = (index << 4) | (isdigit((uchar) hash[i]) ? hash[i] - '0' : hash[i] - 'a' + 10);
+    }
+    return &authCache[index % ME_GOAHEAD_AUTH_CACHE];
+}
+
+
+static bool lookupCredentials(Webs *wp, cchar *hash, WebsVerify verify)
+{
+    AuthCache   *cp;
+
+    cp = getCredentialSlot(hash);
+    if (!cp->hash || !smatch(cp->hash, hash) || cp->verify != verify) {
+        return 0;
+    }
+    if (cp->expires <= time(0)) {
+        wfree(cp->hash);
+        wfree(cp->username);
+        cp->hash = cp->username = 0;
+        return 0;
+    }
+    wfree(wp->username);
+    wp->username = sclone(cp->username);
+    wp->user = websLookupUser(wp->username);
+    trace(5, "User \"%s\" authenticated from cache", wp->username);
+    return 1;
+}
+
+
+/*
+    Cache verified credentials. Takes ownership of the hash.
+ */
+static void cacheCredentials(char *hash, cchar *username, WebsVerify verify)
+{
+    AuthCache   *cp;
+
+    cp = getCredentialSlot(hash);
+    wfree(cp->hash);
+    wfree(cp->username);
+    cp->hash = hash;
+    cp->username = sclone(username);
+    cp->verify = verify;
+    cp->expires = time(0) + ME_GOAHEAD_AUTH_CACHE_TTL;
+}
+
+
+/*
+    Remove cached credentials for a user. Set username to null to remove all.
+ */
+static void clearCredentials(cchar *username)
+{
+    AuthCache   *cp;
+
+    for (cp = authCache; cp < &authCache[ME_GOAHEAD_AUTH_CACHE]; cp++) {
+        if (cp->hash && (!username || smatch(cp->username, username))) {
+            wfree(cp->hash);
+            wfree(cp->username);
+            cp->hash = cp->username = 0;
+        }
+    }
+}
+#endif /* ME_GOAHEAD_AUTH_CACHE */
+
+
 static bool parseBasicDetails(Webs *wp)
 {
     char    *cp, *userAuth;
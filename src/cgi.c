@@ -5,8 +5,12 @@
     goforms processing in that each CGI request is executed as a separate
     process, rather than within the webserver process. For each CGI request the
     environment of the new process must be set to include all the CGI variables
-    and its standard input and output must be directed to the socket.  This
-    is done using temporary files.
+    and its standard input and output must be directed to the socket. On Unix,
+    this is done using non-blocking pipes that are serviced by the socket event
+    loop. On other systems, temporary files are used and polled for output.
+
+    On Unix, this module also implements the FastCGI handler which forwards requests to pools of persistent FastCGI
+    processes over Unix domain sockets.
 
     Copyright (c) All Rights Reserved. See details at the end of the file.
  */
@@ -15,33 +19,150 @@
 
 #include    "goahead.h"
 
+#if ME_GOAHEAD_CGI && (ME_UNIX_LIKE || QNX)
+    #include    <sys/un.h>
+#endif
+
 /*********************************** Defines **********************************/
 #if ME_GOAHEAD_CGI
 
+#if ME_UNIX_LIKE || QNX
+    #define CGI_PIPES 1
+#else
+    #define CGI_PIPES 0
+#endif
+
 #if ME_WIN_LIKE
     typedef HANDLE CgiPid;
 #else
     typedef pid_t CgiPid;
 #endif
 
-typedef struct Cgi {            /* Struct for CGI tasks which have completed */
-    Webs    *wp;                /* Connection object */
+typedef struct Cgi {            /* Struct for running CGI tasks */
+    Webs    *wp;                /* Connection object. Null once the request is complete */
+    CgiPid  handle;             /* Process handle of the task. Zero once reaped */
+#if CGI_PIPES
+    WebsBuf headers;            /* Response headers received from the task */
+    WebsBuf output;             /* Program output not yet accepted by the client connection */
+    int     inSid;              /* Socket handle for the task's stdin pipe */
+    int     outSid;             /* Socket handle for the task's stdout pipe */
+    struct FcgiPool *pool;      /* FastCGI pool servicing the request. Null for CGI */
+    struct Fcgi *fcgi;          /* FastCGI process servicing the request. Null while waiting */
+    int     id;                 /* FastCGI request ID */
+    int     ended;              /* The end of the request body has been sent to the FastCGI program */
+    int     suspended;          /* Reading output is paused until the client drains the response */
+#else
     char    *stdIn;             /* File desc. for task's temp input fd */
     char    *stdOut;            /* File desc. for task's temp output fd */
     char    *cgiPath;           /* Path to executable process file */
     char    **argp;             /* Pointer to buf containing argv tokens */
     char    **envp;             /* Pointer to array of environment strings */
-    CgiPid  handle;             /* Process handle of the task */
     off_t   fplacemark;         /* Seek location for CGI output file */
+#endif
 } Cgi;
 
-static Cgi      **cgiList;      /* walloc chain list of wp's to be closed */
+static Cgi      **cgiList;      /* walloc chain list of CGI tasks */
 static int      cgiMax;         /* Size of walloc list */
+static int64    cgiActive;      /* Requests being serviced by CGI or FastCGI programs */
+
+#if CGI_PIPES
+/*
+    FastCGI protocol definitions
+ */
+#define FCGI_VERSION            1
+#define FCGI_BEGIN_REQUEST      1
+#define FCGI_ABORT_REQUEST      2
+#define FCGI_END_REQUEST        3
+#define FCGI_PARAMS             4
+#define FCGI_STDIN              5
+#define FCGI_STDOUT             6
+#define FCGI_STDERR             7
+#define FCGI_RESPONDER          1
+#define FCGI_KEEP_CONN          1
+#define FCGI_HEADER_LEN         8
+#define FCGI_MAX_RECORD         32768   /* Maximum content length of records sent to a program */
+#define FCGI_MAX_TX             (FCGI_MAX_RECORD * 2)   /* Records queued before request body data is held back */
+#define FCGI_MAX_MULTIPLEX      65535   /* Request ids are 16 bits and zero is reserved */
+
+typedef struct FcgiPool {       /* Pool of processes running a FastCGI program */
+    char    *program;           /* Program path */
+    struct Fcgi **procs;        /* walloc list of processes */
+    int     procMax;            /* Size of walloc list */
+    int     procCount;          /* Number of running processes */
+    Cgi     **waiting;          /* Requests waiting for a free process slot in arrival order */
+    int     waitCount;          /* Number of waiting requests */
+    int     processes;          /* Maximum number of processes */
+    int     multiplex;          /* Maximum concurrent requests per process */
+    int     queue;              /* Maximum number of waiting requests */
+} FcgiPool;
+
+typedef struct Fcgi {           /* FastCGI process and its connection */
+    FcgiPool *pool;             /* Owning pool */
+    Cgi     **requests;         /* Active requests indexed by request ID - 1 */
+    WebsBuf rx;                 /* Records received from the process */
+    WebsBuf tx;                 /* Records to send to the process */
+    CgiPid  pid;                /* Process ID */
+    int     sid;                /* Socket handle for the connection */
+    int     index;              /* Index in the pool process list */
+    int     active;             /* Number of active requests */
+    int     suspended;          /* Number of requests waiting for their client to drain output */
+    int     dead;               /* Connection has failed and must be closed */
+} Fcgi;
+
+static WebsHash fcgiPools = -1; /* FastCGI pools indexed by program */
+static int      reapSid = -1;   /* Socket handle for the SIGCHLD notification pipe */
+static int      reapFd = -1;    /* Write side of the SIGCHLD notification pipe */
+static struct sigaction priorChildAction;
+#endif
 
 /************************************ Forwards ********************************/
 
+static bool cgiVarAllowed(char *name);
+static void freeCgiArgs(char *cgiPath, char **argp, char **envp);
+#if CGI_PIPES
+static void cancelFcgi(Cgi *cgip);
+static void childSignal(int signo, siginfo_t *info, void *arg);
+static void cgiInputEvent(int sid, int mask, void *data);
+static void cgiOutputEvent(int sid, int mask, void *data);
+static void closeCgiInput(Cgi *cgip);
+static void closeFastCgi();
+static void closeFcgi(Fcgi *fp);
+static void detachCgi(Cgi *cgip);
+static int dispatchFcgi(Cgi *cgip);
+static bool drainCgiOutput(Cgi *cgip, bool finished);
+static void failFcgi(Cgi *cgip, cchar *msg);
+static void fcgiEvent(int sid, int mask, void *data);
+static void finishCgi(Cgi *cgip);
+static void flushFcgi(Fcgi *fp);
+static void freeCgiBuffers(Cgi *cgip);
+static CgiPid launchCgi(char *cgiPath, char **argp, char **envp, int fdin, int fdout);
+static FcgiPool *lookupFcgiPool(WebsRoute *route);
+static void parseFcgi(Fcgi *fp);
+static void putFcgiLength(WebsBuf *buf, ssize len);
+static void putFcgiInput(Cgi *cgip);
+static void putFcgiParam(WebsBuf *buf, cchar *prefix, cchar *name, cchar *value);
+static void putFcgiRecord(Fcgi *fp, int type, int id, cchar *buf, ssize len);
+static void putFcgiStream(Fcgi *fp, int type, int id, cchar *buf, ssize len);
+static void reapEvent(int sid, int mask, void *data);
+static void reapLater(CgiPid pid);
+static void reapTasks();
+static void releaseFcgi(Cgi *cgip);
+static void resumeCgiOutput(Webs *wp);
+static void runFcgiQueue(FcgiPool *pool);
+static void sendCgiOutput(Cgi *cgip, cchar *buf, ssize len);
+static void sendFcgiRequest(Cgi *cgip);
+static CgiPid startCgi(Webs *wp, char *cgiPath, char **argp, char **envp);
+static Fcgi *startFcgi(FcgiPool *pool);
+static int startReaper();
+static void suspendCgiOutput(Cgi *cgip);
+static void unqueueFcgi(Cgi *cgip);
+static void updateFcgiInterest(Fcgi *fp);
+static void writeCgiOutput(Cgi *cgip, cchar *buf, ssize len, bool eof);
+#else
 static int checkCgi(CgiPid handle);
+static bool cgiOutputPending(Cgi *cgip);
 static CgiPid launchCgi(char *cgiPath, char **argp, char **envp, char *stdIn, char *stdOut);
+#endif
 
 /************************************* Code ***********************************/
 /*
@@ -50,15 +171,25 @@ static CgiPid launchCgi(char *cgiPath, char **argp, char **envp, char *stdIn, ch
  */
 PUBLIC bool cgiHandler(Webs *wp)
 {
+#if !CGI_PIPES
     Cgi         *cgip;
+    char        *stdIn, *stdOut;
+    int         cid;
+#endif
     WebsKey     *s;
-    char        cgiPrefix[ME_GOAHEAD_LIMIT_FILENAME], *stdIn, *stdOut, cwd[ME_GOAHEAD_LIMIT_FILENAME];
-    char        *cp, *cgiName, *cgiPath, **argp, **envp, **ep, *tok, *query, *dir, *extraPath, *exe, *vp;
+    char        cgiPrefix[ME_GOAHEAD_LIMIT_FILENAME], cwd[ME_GOAHEAD_LIMIT_FILENAME];
+    char        *cp, *cgiName, *cgiPath, **argp, **envp, *tok, *query, *dir, *extraPath, *exe;
     CgiPid      pHandle;
-    int         n, envpsize, argpsize, cid;
+    int         n, envpsize, argpsize;
 
     assert(websValid(wp));
 
+#if CGI_PIPES
+    if (wp->cgi) {
+        /* Already started by websCgiStart to receive the request body */
+        return 1;
+    }
+#endif
     websSetEnv(wp);
 
     /*
@@ -173,10 +304,7 @@ PUBLIC bool cgiHandler(Webs *wp)
     if (wp->vars) {
         for (n = 0, s = hashFirst(wp->vars); s != NULL; s = hashNext(wp->vars, s)) {
             if (s->content.valid && s->content.type == string) {
-                vp = strim(s->name.value.string, 0, WEBS_TRIM_START);
-                if (smatch(vp, "REMOTE_HOST") || smatch(vp, "HTTP_AUTHORIZATION") ||
-                    smatch(vp, "IFS") || smatch(vp, "CDPATH") ||
-                    smatch(vp, "PATH") || sstarts(vp, "LD_")) {
+                if (!cgiVarAllowed(s->name.value.string)) {
                     continue;
                 }
                 if (s->arg != 0 && *ME_GOAHEAD_CGI_VAR_PREFIX != '\0') {
@@ -195,6 +323,17 @@ PUBLIC bool cgiHandler(Webs *wp)
     }
     *(envp+n) = NULL;
 
+#if CGI_PIPES
+    pHandle = startCgi(wp, cgiPath, argp, envp);
+    /*
+        The child has exec'd (or failed), so the arguments and environment are no longer required
+     */
+    freeCgiArgs(cgiPath, argp, envp);
+    wfree(query);
+    if (pHandle == (CgiPid) -1) {
+        websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "failed to spawn CGI task");
+    }
+#else
     /*
         Create temporary file name(s) for the child's stdin and stdout. For POST data the stdin temp file (and name)
         should already exist.
@@ -215,12 +354,7 @@ PUBLIC bool cgiHandler(Webs *wp)
      */
     if ((pHandle = launchCgi(cgiPath, argp, envp, stdIn, stdOut)) == (CgiPid) -1) {
         websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "failed to spawn CGI task");
-        for (ep = envp; *ep != NULL; ep++) {
-            wfree(*ep);
-        }
-        wfree(cgiPath);
-        wfree(argp);
-        wfree(envp);
+        freeCgiArgs(cgiPath, argp, envp);
         wfree(stdOut);
         wfree(query);
 
@@ -238,8 +372,10 @@ PUBLIC bool cgiHandler(Webs *wp)
         cgip->envp = envp;
         cgip->wp = wp;
         cgip->fplacemark = 0;
+        cgiActive++;
         wfree(query);
     }
+#endif
     /*
         Restore the current working directory after spawning child CGI
      */
@@ -251,26 +387,49 @@ PUBLIC bool cgiHandler(Webs *wp)
 PUBLIC int websCgiOpen()
 {
     websDefineHandler("cgi", 0, cgiHandler, 0, 0);
+#if CGI_PIPES
+    websDefineHandler("fastcgi", 0, fastcgiHandler, closeFastCgi, 0);
+#else
+    websDefineHandler("fastcgi", 0, fastcgiHandler, 0, 0);
+#endif
+#if ME_GOAHEAD_METRICS
+    websDefineMetric("goahead_cgi_active", "Requests being serviced by CGI or FastCGI programs", WEBS_METRIC_GAUGE,
+        &cgiActive);
+#endif
     return 0;
 }
 
 
-PUBLIC bool websProcessCgiData(Webs *wp)
+/*
+    Test if a request variable may be passed to a CGI program. Variables that alter how the program runs or that
+    disclose credentials are not passed.
+ */
+static bool cgiVarAllowed(char *name)
 {
-    ssize   nbytes;
+    char    *vp;
 
-    nbytes = bufLen(&wp->input);
-    trace(5, "cgi: write %d bytes to CGI program", nbytes);
-    if (write(wp->cgifd, wp->input.servp, (int) nbytes) != nbytes) {
-        websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR| WEBS_CLOSE, "Cannot write to CGI gateway");
-    } else {
-        trace(5, "cgi: write %d bytes to CGI program", nbytes);
+    vp = strim(name, 0, WEBS_TRIM_START);
+    if (smatch(vp, "REMOTE_HOST") || smatch(vp, "HTTP_AUTHORIZATION") || smatch(vp, "IFS") || smatch(vp, "CDPATH") ||
+            smatch(vp, "PATH") || sstarts(vp, "LD_")) {
+        return 0;
     }
-    websConsumeInput(wp, nbytes);
     return 1;
 }
 
 
+static void freeCgiArgs(char *cgiPath, char **argp, char **envp)
+{
+    char    **ep;
+
+    for (ep = envp; ep != NULL && *ep != NULL; ep++) {
+        wfree(*ep);
+    }
+    wfree(cgiPath);
+    wfree(argp);
+    wfree(envp);
+}
+
+
 static void writeCgiHeaders(Webs *wp, int status, ssize contentLength, char *location, char *contentType)
 {
     trace(5, "cgi: Start response headers");
@@ -307,13 +466,13 @@ static ssize parseCgiHeaders(Webs *wp, char *buf)
     } else {
         len = 4;
     }
+    if (!memchr(buf, ':', end - buf)) {
+        /* No headers found. Don't modify the buffer as it will be output as the response body. */
+        return 0;
+    }
     *end = '\0';
     end += len;
     cp = buf;
-    if (!strchr(cp, ':')) {
-        /* No headers found */
-        return 0;
-    }
     if (strncmp(cp, "HTTP/1.", 7) == 0) {
         ssplit(cp, "\r\n", &cp);
     }
@@ -351,250 +510,1534 @@ static ssize parseCgiHeaders(Webs *wp, char *buf)
 }
 
 
-PUBLIC void websCgiGatherOutput(Cgi *cgip)
-{
-    Webs        *wp;
-    WebsStat    sbuf;
-    char        buf[ME_GOAHEAD_LIMIT_HEADERS + 2];
-    ssize       nbytes, skip;
-    int         fdout;
 
+#if CGI_PIPES
+/*
+    Start the CGI program before the request body has been received so the body can be streamed to its stdin.
+    FastCGI requests are likewise started so the body can be streamed as stdin records.
+    Return zero if successful. Otherwise, an error response has been created and -1 is returned.
+ */
+PUBLIC int websCgiStart(Webs *wp)
+{
+    if (wp->route->handler->service == fastcgiHandler && (wp->flags & WEBS_FORM)) {
+        /* Form bodies are passed to FastCGI programs as request variables, so the handler waits for the body */
+        return 0;
+    }
     /*
-        OPT - currently polling and doing a stat each poll. Also doing open/close each chunk.
-        If the CGI process writes partial headers, this repeatedly reads the data until complete
-        headers are written or more than ME_GOAHEAD_LIMIT_HEADERS of data is received.
+        The handler runs before websRunRequest, so define the query variables now. The body is not available to
+        define form variables, nor would it be, as the CGI program reads the body from stdin.
      */
-    if ((stat(cgip->stdOut, &sbuf) == 0) && (sbuf.st_size > cgip->fplacemark)) {
-        if ((fdout = open(cgip->stdOut, O_RDONLY | O_BINARY, 0444)) >= 0) {
+    if (!(wp->flags & WEBS_VARS_ADDED)) {
+        if (wp->query && *wp->query) {
+            websSetQueryVars(wp);
+        }
+        wp->flags |= WEBS_VARS_ADDED;
+    }
+    if (wp->route->handler->service == fastcgiHandler) {
+        fastcgiHandler(wp);
+    } else {
+        cgiHandler(wp);
+    }
+    return wp->cgi ? 0 : -1;
+}
+
+
+/*
+    Stream request body data to the CGI program. Data that cannot be written without blocking remains in the input
+    buffer and is written when the pipe becomes writable. For FastCGI, the data remains in the input buffer while the
+    request is queued or the process connection has a backlog of records.
+ */
+PUBLIC bool websProcessCgiData(Webs *wp)
+{
+    Cgi     *cgip;
+    ssize   nbytes, written;
+
+    if ((cgip = wp->cgi) == 0) {
+        return 1;
+    }
+    if (cgip->pool) {
+        if (cgip->fcgi && !cgip->fcgi->dead) {
+            flushFcgi(cgip->fcgi);
+        }
+        return 1;
+    }
+    if (wp->cgifd < 0) {
+        /* The program is not reading input */
+        websConsumeInput(wp, bufLen(&wp->input));
+        return 1;
+    }
+    while ((nbytes = bufLen(&wp->input)) > 0) {
+        if ((written = write(wp->cgifd, wp->input.servp, nbytes)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
             /*
-                Check to see if any data is available in the output file and send its contents to the socket.
-                Write the HTTP header on our first pass. The header must fit into ME_GOAHEAD_LIMIT_BUFFER.
+                The program has exited or closed its stdin. Discard the remaining body.
              */
-            wp = cgip->wp;
-            lseek(fdout, cgip->fplacemark, SEEK_SET);
-            while ((nbytes = read(fdout, buf, sizeof(buf))) > 0) {
-                skip = 0;
-                if (!(wp->flags & WEBS_HEADERS_CREATED)) {
-                    if ((skip = parseCgiHeaders(wp, buf)) == 0) {
-                        if (cgip->handle && sbuf.st_size < ME_GOAHEAD_LIMIT_HEADERS) {
-                            trace(5, "cgi: waiting for http headers");
-                            break;
-                        } else {
-                            trace(5, "cgi: missing http headers - create default headers");
-                            writeCgiHeaders(wp, HTTP_CODE_OK, -1, 0, 0);
-                        }
-                    }
-                }
-                trace(5, "cgi: write %d bytes to client", nbytes - skip);
-                websWriteBlock(wp, &buf[skip], nbytes - skip);
-                cgip->fplacemark += (off_t) nbytes;
-            }
-            close(fdout);
-        } else {
-            trace(5, "cgi: open failed");
+            trace(5, "cgi: CGI program is not reading input, errno %d", errno);
+            websConsumeInput(wp, nbytes);
+            closeCgiInput(cgip);
+            return 1;
+        }
+        trace(5, "cgi: write %d bytes to CGI program", written);
+        websConsumeInput(wp, written);
+    }
+    if (bufLen(&wp->input) > 0) {
+        socketRegisterInterest(cgip->inSid, SOCKET_WRITABLE);
+    } else {
+        socketRegisterInterest(cgip->inSid, 0);
+        if (wp->eof) {
+            closeCgiInput(cgip);
         }
     }
+    return 1;
 }
 
 
 /*
-    Any entry in the cgiList need to be checked to see if it has completed, and if so, process its output and clean up.
-    Return time till next poll.
+    Release the CGI resources of a request. If the request is closed before the CGI program has completed, the pipes
+    are closed and the program is reaped when it exits.
  */
-int websCgiPoll()
+PUBLIC void websCgiCleanup(Webs *wp)
 {
-    Webs    *wp;
     Cgi     *cgip;
-    char    **ep;
-    int     cid;
-
-    for (cid = 0; cid < cgiMax; cid++) {
-        if ((cgip = cgiList[cid]) != NULL) {
-            wp = cgip->wp;
-            websCgiGatherOutput(cgip);
-            if (checkCgi(cgip->handle) == 0) {
-                /*
-                    We get here if the CGI process has terminated. Clean up.
-                 */
-                cgip->handle = 0;
-                websCgiGatherOutput(cgip);
 
-#if WINDOWS
-                /*
-                     Windows can have delayed notification through the file system after process exit.
-                 */
-                {
-                    int nTries;
-                    for (nTries = 0; (cgip->fplacemark == 0) && (nTries < 100); nTries++) {
-                        websCgiGatherOutput(cgip);
-                        if (cgip->fplacemark == 0) {
-                            Sleep(10);
-                        }
-                    }
-                }
-#endif
-                if (cgip->fplacemark == 0) {
-                    websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "CGI generated no output");
-                } else {
-                    trace(5, "cgi: Request complete - calling websDone");
-                    websDone(wp);
-                }
-                /*
-                    Remove the temporary re-direction files
-                 */
-                unlink(cgip->stdIn);
-                unlink(cgip->stdOut);
-                /*
-                    Free all the memory buffers pointed to by cgip. The stdin file name (wp->cgiStdin) gets freed as
-                    part of websFree().
-                 */
-                cgiMax = wfreeHandle(&cgiList, cid);
-                for (ep = cgip->envp; ep != NULL && *ep != NULL; ep++) {
-                    wfree(*ep);
-                }
-                wfree(cgip->cgiPath);
-                wfree(cgip->stdOut);
-                wfree(cgip->argp);
-                wfree(cgip->envp);
-                wfree(cgip);
-                websPump(wp);
-                websFree(wp);
-                /* wp no longer valid */
-            }
+    if ((cgip = wp->cgi) != 0) {
+        if (cgip->pool) {
+            cancelFcgi(cgip);
+        } else {
+            detachCgi(cgip);
         }
     }
-    return cgiMax ? 10 : MAXINT;
+    wfree(wp->cgiStdin);
+    wp->cgiStdin = 0;
 }
 
 
 /*
-    Returns a pointer to an allocated qualified unique temporary file name. This filename must eventually be deleted with
-    wfree().
+    CGI programs are serviced by the socket event loop, so there is nothing to poll
  */
-PUBLIC char *websGetCgiCommName()
+PUBLIC int websCgiPoll()
 {
-    return websTempFile(NULL, "cgi");
+    return MAXINT;
 }
 
 
-#if WINCE
 /*
-     Launch the CGI process and return a handle to it.  CE note: This function is not complete.  The missing piece is
-     the ability to redirect stdout.
+    Start a CGI program with stdin and stdout connected to non-blocking pipes. If the request body is still to be
+    received, it is streamed to stdin as it arrives. Otherwise stdin is closed immediately.
  */
-static CgiPid launchCgi(char *cgiPath, char **argp, char **envp, char *stdIn, char *stdOut)
+static CgiPid startCgi(Webs *wp, char *cgiPath, char **argp, char **envp)
 {
-    PROCESS_INFORMATION procinfo;       /*  Information about created proc   */
-    DWORD               dwCreateFlags;
-    char                *fulldir;
-    BOOL                bReturn;
-    int                 i, nLen;
+    Cgi     *cgip;
+    CgiPid  pid;
+    int     input[2], output[2], cid, i, inSid, outSid;
 
+    if (reapSid < 0 && startReaper() < 0) {
+        return -1;
+    }
+    if (pipe(input) < 0) {
+        error("Cannot create CGI stdin pipe, errno %d", errno);
+        return -1;
+    }
+    if (pipe(output) < 0) {
+        error("Cannot create CGI stdout pipe, errno %d", errno);
+        close(input[0]);
+        close(input[1]);
+        return -1;
+    }
     /*
-        Replace directory delimiters with Windows-friendly delimiters
+        Prevent other CGI programs from inheriting these pipes. Otherwise, end of file is not seen on output until
+        they too have exited. The descriptors duplicated onto the child's stdin and stdout do not inherit this flag.
      */
-    nLen = strlen(cgiPath);
-    for (i = 0; i < nLen; i++) {
-        if (cgiPath[i] == '/') {
-            cgiPath[i] = '\\';
-        }
+    for (i = 0; i < 2; i++) {
+        fcntl(input[i], F_SETFD, FD_CLOEXEC);
+        fcntl(output[i], F_SETFD, FD_CLOEXEC);
+    }
+    pid = launchCgi(cgiPath, argp, envp, input[0], output[1]);
+    close(input[0]);
+    close(output[1]);
+    if (pid < 0) {
+        close(input[1]);
+        close(output[0]);
+        return -1;
     }
-    fulldir = NULL;
-    dwCreateFlags = CREATE_NEW_CONSOLE;
-
     /*
-         CreateProcess returns errors sometimes, even when the process was started correctly.  The cause is not evident.
-         For now: we detect an error by checking the value of procinfo.hProcess after the call.
+        Without socket handles the pipes are never serviced, so terminate the program and fail the request
      */
-    procinfo.hThread = NULL;
-    bReturn = CreateProcess(
-        cgiPath,            /*  Name of executable module        */
-        NULL,               /*  Command line string              */
-        NULL,               /*  Process security attributes      */
-        NULL,               /*  Thread security attributes       */
-        0,                  /*  Handle inheritance flag          */
-        dwCreateFlags,      /*  Creation flags                   */
-        NULL,               /*  New environment block            */
-        NULL,               /*  Current directory name           */
-        NULL,               /*  STARTUPINFO                      */
-        &procinfo);         /*  PROCESS_INFORMATION              */
-    if (bReturn == 0) {
+    if ((outSid = socketAttach(output[0])) < 0) {
+        close(output[0]);
+    }
+    inSid = -1;
+    if (wp->state != WEBS_CONTENT) {
+        close(input[1]);
+    } else if ((inSid = socketAttach(input[1])) < 0) {
+        close(input[1]);
+    }
+    if (outSid < 0 || (inSid < 0 && wp->state == WEBS_CONTENT)) {
+        error("Cannot attach CGI pipes");
+        if (outSid >= 0) {
+            socketFree(outSid);
+        }
+        if (inSid >= 0) {
+            socketFree(inSid);
+        }
+        kill(pid, SIGTERM);
+        reapLater(pid);
         return -1;
-    } else {
-        CloseHandle(procinfo.hThread);
     }
-    return (int) procinfo.dwProcessId;
+    cid = wallocObject(&cgiList, &cgiMax, sizeof(Cgi));
+    cgip = cgiList[cid];
+    cgip->wp = wp;
+    cgip->handle = pid;
+    bufCreate(&cgip->headers, ME_GOAHEAD_LIMIT_BUFFER, ME_GOAHEAD_LIMIT_HEADERS + 1);
+
+    cgip->outSid = outSid;
+    socketCreateHandler(cgip->outSid, SOCKET_READABLE, cgiOutputEvent, cgip);
+
+    cgip->inSid = inSid;
+    if (inSid >= 0) {
+        socketCreateHandler(cgip->inSid, 0, cgiInputEvent, cgip);
+        wp->cgifd = input[1];
+    }
+    wp->cgi = cgip;
+    cgiActive++;
+    return pid;
 }
 
 
-/*
-    Check the CGI process.  Return 0 if it does not exist; non 0 if it does.
- */
-static int checkCgi(CgiPid handle)
+static void cgiInputEvent(int sid, int mask, void *data)
 {
-    int     nReturn;
-    DWORD   exitCode;
+    Cgi     *cgip;
 
-    nReturn = GetExitCodeProcess((HANDLE)handle, &exitCode);
-    /*
-        We must close process handle to free up the window resource, but only when we're done with it.
-     */
-    if ((nReturn == 0) || (exitCode != STILL_ACTIVE)) {
-        CloseHandle((HANDLE) handle);
-        return 0;
+    cgip = data;
+    if (cgip->wp) {
+        websProcessCgiData(cgip->wp);
     }
-    return 1;
 }
-#endif /* WINCE */
 
 
-#if ME_UNIX_LIKE || QNX
 /*
-    Launch the CGI process and return a handle to it.
+    Read output from the CGI program and stream it to the client
  */
-static CgiPid launchCgi(char *cgiPath, char **argp, char **envp, char *stdIn, char *stdOut)
+static void cgiOutputEvent(int sid, int mask, void *data)
 {
-    int     fdin, fdout, pid;
+    Cgi     *cgip;
+    char    buf[ME_GOAHEAD_LIMIT_BUFFER];
+    ssize   nbytes;
 
-    trace(5, "cgi: run %s", cgiPath);
+    cgip = data;
+    if ((nbytes = read(socketGetHandle(sid), buf, sizeof(buf))) > 0) {
+        trace(5, "cgi: read %d bytes from CGI program", nbytes);
+        websNoteRequestActivity(cgip->wp);
+        writeCgiOutput(cgip, buf, nbytes, 0);
+        /* Send output to the client as it is produced. Any remainder is sent when the socket is writable. */
+        websFlush(cgip->wp, 0);
+        if (bufLen(&cgip->output) > 0 || websOutputFull(cgip->wp)) {
+            suspendCgiOutput(cgip);
+        }
 
-    if ((fdin = open(stdIn, O_RDWR | O_CREAT | O_BINARY, 0666)) < 0) {
-        error("Cannot open CGI stdin: ", cgiPath);
-        return -1;
-    }
-    if ((fdout = open(stdOut, O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0666)) < 0) {
-        error("Cannot open CGI stdout: ", cgiPath);
-        return -1;
+    } else if (nbytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        finishCgi(cgip);
     }
+}
 
-    pid = vfork();
-    if (pid == 0) {
-        /*
-            Child
-         */
-        if (dup2(fdin, 0) < 0) {
-            printf("content-type: text/html\n\nDup of stdin failed\n");
-            _exit(1);
 
-        } else if (dup2(fdout, 1) < 0) {
-            printf("content-type: text/html\n\nDup of stdout failed\n");
-            _exit(1);
+/*
+    Write CGI output to the client. Output is accumulated until the response headers are complete, or until the
+    headers limit is exceeded or the program exits, in which case default headers are created.
+ */
+static void writeCgiOutput(Cgi *cgip, cchar *buf, ssize len, bool eof)
+{
+    Webs    *wp;
+    WebsBuf *hp;
+    ssize   count, skip;
+
+    wp = cgip->wp;
+    if (!(wp->flags & WEBS_HEADERS_CREATED)) {
+        hp = &cgip->headers;
+        count = bufPutBlk(hp, buf, min(len, ME_GOAHEAD_LIMIT_HEADERS - bufLen(hp)));
+        bufAddNull(hp);
+        buf += count;
+        len -= count;
+        if ((skip = parseCgiHeaders(wp, hp->servp)) == 0) {
+            if (!eof && len == 0) {
+                trace(5, "cgi: waiting for http headers");
+                return;
+            }
+            trace(5, "cgi: missing http headers - create default headers");
+            writeCgiHeaders(wp, HTTP_CODE_OK, -1, 0, 0);
+            websWriteEndHeaders(wp);
+        }
+        bufAdjustStart(hp, skip);
+        if (bufLen(hp) > 0) {
+            sendCgiOutput(cgip, hp->servp, bufLen(hp));
+        }
+        bufFlush(hp);
+    }
+    if (len > 0) {
+        sendCgiOutput(cgip, buf, len);
+    }
+}
+
+
+/*
+    Write program output to the client connection. Output the connection will not accept is retained until the
+    client drains the response. The caller must then suspend reading program output.
+ */
+static void sendCgiOutput(Cgi *cgip, cchar *buf, ssize len)
+{
+    ssize   written;
+
+    if (bufLen(&cgip->output) == 0) {
+        if ((written = websStreamBlock(cgip->wp, buf, len)) < 0) {
+            return;
+        }
+        buf += written;
+        len -= written;
+    }
+    if (len > 0) {
+        if (!cgip->output.buf && bufCreate(&cgip->output, ME_GOAHEAD_LIMIT_BUFFER, MAXINT) < 0) {
+            return;
+        }
+        bufPutBlk(&cgip->output, buf, len);
+    }
+}
+
+
+/*
+    Write retained program output to the client connection. Returns true if all retained output has been written.
+    Once the program has finished, no more output will be read, so the remainder is buffered regardless of the output
+    limit. It is bounded by the program output read before reading was suspended.
+ */
+static bool drainCgiOutput(Cgi *cgip, bool finished)
+{
+    WebsBuf *bp;
+    ssize   len, written;
+
+    bp = &cgip->output;
+    while ((len = bufGetBlkMax(bp)) > 0) {
+        written = finished ? websWriteBlock(cgip->wp, bp->servp, len) : websStreamBlock(cgip->wp, bp->servp, len);
+        if (written < 0) {
+            bufFlush(bp);
+            break;
+        } else if (written == 0) {
+            return 0;
+        }
+        bufAdjustStart(bp, written);
+    }
+    bufCompact(bp);
+    return 1;
+}
+
+
+static void freeCgiBuffers(Cgi *cgip)
+{
+    bufFree(&cgip->headers);
+    if (cgip->output.buf) {
+        bufFree(&cgip->output);
+    }
+}
+
+
+/*
+    Stop reading program output until the client has drained the buffered response
+ */
+static void suspendCgiOutput(Cgi *cgip)
+{
+    if (cgip->suspended) {
+        return;
+    }
+    trace(6, "cgi: suspend output, client is slow");
+    cgip->suspended = 1;
+    if (cgip->fcgi) {
+        cgip->fcgi->suspended++;
+        updateFcgiInterest(cgip->fcgi);
+    } else {
+        socketRegisterInterest(cgip->outSid, 0);
+    }
+    /* This resumes immediately if the buffered response has already drained */
+    websSetBackgroundWriter(cgip->wp, resumeCgiOutput);
+}
+
+
+/*
+    Background writer invoked when the buffered response has drained. Resume reading program output.
+ */
+static void resumeCgiOutput(Webs *wp)
+{
+    Cgi     *cgip;
+
+    wp->writeData = 0;
+    if ((cgip = wp->cgi) == 0 || !cgip->suspended) {
+        return;
+    }
+    if (bufLen(&cgip->output) > 0 && !drainCgiOutput(cgip, 0)) {
+        /* Wait for the client to drain the response again */
+        wp->writeData = resumeCgiOutput;
+        return;
+    }
+    cgip->suspended = 0;
+    if (cgip->fcgi) {
+        cgip->fcgi->suspended--;
+        updateFcgiInterest(cgip->fcgi);
+    } else if (cgip->outSid >= 0) {
+        socketRegisterInterest(cgip->outSid, SOCKET_READABLE);
+    }
+}
+
+
+/*
+    The CGI program has closed its output or the FastCGI request has ended. Complete the request and release the
+    pipes or FastCGI process slot.
+ */
+static void finishCgi(Cgi *cgip)
+{
+    Webs    *wp;
+
+    wp = cgip->wp;
+    if (!(wp->flags & WEBS_HEADERS_CREATED)) {
+        if (bufLen(&cgip->headers) == 0) {
+            websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "CGI generated no output");
+        } else {
+            writeCgiOutput(cgip, "", 0, 1);
+        }
+    }
+    if (bufLen(&cgip->output) > 0) {
+        drainCgiOutput(cgip, 1);
+    }
+    if (!wp->eof) {
+        /* The request body has not been fully received. Close the connection rather than consume it. */
+        wp->flags &= ~WEBS_KEEP_ALIVE;
+    }
+    if (cgip->pool) {
+        releaseFcgi(cgip);
+    } else {
+        detachCgi(cgip);
+    }
+    /* cgip not valid here */
+
+    trace(5, "cgi: Request complete - calling websDone");
+    websDone(wp);
+    websPump(wp);
+    if (wp->flags & WEBS_CLOSED) {
+        websFree(wp);
+    }
+}
+
+
+static void closeCgiInput(Cgi *cgip)
+{
+    if (cgip->inSid >= 0) {
+        socketFree(cgip->inSid);
+        cgip->inSid = -1;
+    }
+    if (cgip->wp) {
+        cgip->wp->cgifd = -1;
+    }
+}
+
+
+/*
+    Detach a CGI task from its request and close the pipes. The task is freed once it has been reaped.
+ */
+static void detachCgi(Cgi *cgip)
+{
+    closeCgiInput(cgip);
+    if (cgip->outSid >= 0) {
+        socketFree(cgip->outSid);
+        cgip->outSid = -1;
+    }
+    freeCgiBuffers(cgip);
+    if (cgip->wp) {
+        if (cgip->suspended) {
+            cgip->wp->writeData = 0;
+        }
+        cgip->wp->cgi = 0;
+        cgiActive--;
+        cgip->wp = 0;
+    }
+    reapTasks();
+}
+
+
+/*
+    Reap exited CGI programs and free tasks that are both reaped and detached
+ */
+static void reapTasks()
+{
+    Cgi     *cgip;
+    CgiPid  pid;
+    int     cid;
+
+    for (cid = 0; cid < cgiMax; cid++) {
+        if ((cgip = cgiList[cid]) == NULL) {
+            continue;
+        }
+        if (cgip->handle) {
+            pid = waitpid(cgip->handle, NULL, WNOHANG);
+            if (pid == cgip->handle || (pid < 0 && errno == ECHILD)) {
+                trace(5, "cgi: waited for pid %d", cgip->handle);
+                cgip->handle = 0;
+            }
+        }
+        if (cgip->handle == 0 && cgip->wp == 0) {
+            cgiMax = wfreeHandle(&cgiList, cid);
+            wfree(cgip);
+        }
+    }
+}
+
+
+/*
+    Exited CGI programs are reaped when SIGCHLD is received. The signal handler writes to a pipe that is serviced by the
+    event loop. This is created on first use, so each worker process has a private pipe.
+ */
+static int startReaper()
+{
+    struct sigaction    act;
+    int                 fds[2];
+
+    if (pipe(fds) < 0) {
+        error("Cannot create CGI signal pipe, errno %d", errno);
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    if ((reapSid = socketAttach(fds[0])) < 0) {
+        error("Cannot attach CGI signal pipe");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    reapFd = fds[1];
+    socketCreateHandler(reapSid, SOCKET_READABLE, reapEvent, 0);
+
+    memset(&act, 0, sizeof(act));
+    act.sa_sigaction = childSignal;
+    act.sa_flags = SA_SIGINFO | SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGCHLD, &act, &priorChildAction);
+    return 0;
+}
+
+
+/*
+    Signal handler. Wake the event loop and chain to any prior handler.
+ */
+static void childSignal(int signo, siginfo_t *info, void *arg)
+{
+    int     saveErrno;
+
+    saveErrno = errno;
+    if (write(reapFd, "", 1) < 0) {
+        /* Pipe is full, so a wakeup is already pending */
+    }
+    errno = saveErrno;
+    if (priorChildAction.sa_flags & SA_SIGINFO) {
+        if (priorChildAction.sa_sigaction) {
+            (priorChildAction.sa_sigaction)(signo, info, arg);
+        }
+    } else if (priorChildAction.sa_handler != SIG_DFL && priorChildAction.sa_handler != SIG_IGN) {
+        (priorChildAction.sa_handler)(signo);
+    }
+}
+
+
+static void reapEvent(int sid, int mask, void *data)
+{
+    char    buf[16];
+
+    while (read(socketGetHandle(sid), buf, sizeof(buf)) > 0) {}
+    reapTasks();
+}
+
+/*
+    FastCGI handler. Requests are forwarded to a pool of persistent FastCGI processes per program. Each process is
+    started with a listening Unix domain socket as its stdin, and is connected to once. Requests are multiplexed over
+    the connection up to the route multiplex limit. When all processes are busy, requests wait in a bounded queue.
+ */
+PUBLIC bool fastcgiHandler(Webs *wp)
+{
+    WebsRoute   *route;
+    FcgiPool    *pool;
+    Cgi         *cgip;
+    char        *scriptName;
+    ssize       len;
+    int         rc;
+
+    assert(websValid(wp));
+
+    if (wp->cgi) {
+        /* Already started by websCgiStart to receive the request body */
+        return 1;
+    }
+    route = wp->route;
+    if (!route->program) {
+        websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "Missing FastCGI program for route");
+        return 1;
+    }
+    pool = lookupFcgiPool(route);
+    websSetEnv(wp);
+
+    /*
+        The route prefix is the script name and the remainder of the path is the path info
+     */
+    len = route->prefixLen;
+    if (len > 0 && route->prefix[len - 1] == '/') {
+        len--;
+    }
+    len = min(len, slen(wp->path));
+    scriptName = snclone(wp->path, len);
+    websSetVar(wp, "SCRIPT_NAME", scriptName);
+    websSetVar(wp, "PATH_INFO", &wp->path[len]);
+    websSetVar(wp, "SCRIPT_FILENAME", route->program);
+    wfree(scriptName);
+
+    if ((cgip = walloc(sizeof(Cgi))) == 0) {
+        websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "Cannot allocate FastCGI request");
+        return 1;
+    }
+    memset(cgip, 0, sizeof(Cgi));
+    cgip->wp = wp;
+    cgip->pool = pool;
+    cgip->inSid = cgip->outSid = -1;
+    bufCreate(&cgip->headers, ME_GOAHEAD_LIMIT_BUFFER, ME_GOAHEAD_LIMIT_HEADERS + 1);
+    wp->cgi = cgip;
+    cgiActive++;
+
+    if ((rc = dispatchFcgi(cgip)) < 0) {
+        releaseFcgi(cgip);
+        websError(wp, HTTP_CODE_BAD_GATEWAY, "Cannot start FastCGI program");
+
+    } else if (rc == 0) {
+        if (pool->waitCount >= pool->queue) {
+            releaseFcgi(cgip);
+            websError(wp, HTTP_CODE_SERVICE_UNAVAILABLE, "Too many FastCGI requests");
+        } else {
+            trace(5, "fcgi: queue request, %d waiting", pool->waitCount + 1);
+            pool->waiting[pool->waitCount++] = cgip;
+        }
+    }
+    return 1;
+}
+
+
+/*
+    Get the pool for the route program. The pool limits are defined by the first route to use the program.
+    Routes not configured via websSetRouteFastCgi use the default limits.
+ */
+static FcgiPool *lookupFcgiPool(WebsRoute *route)
+{
+    FcgiPool    *pool;
+    WebsKey     *key;
+
+    if (fcgiPools < 0) {
+        fcgiPools = hashCreate(-1);
+    }
+    if ((key = hashLookup(fcgiPools, route->program)) != 0) {
+        return key->content.value.symbol;
+    }
+    pool = walloc(sizeof(FcgiPool));
+    memset(pool, 0, sizeof(FcgiPool));
+    pool->program = sclone(route->program);
+    pool->processes = route->processes > 0 ? route->processes : ME_GOAHEAD_FASTCGI_PROCESSES;
+    pool->multiplex = route->multiplex > 0 ? min(route->multiplex, FCGI_MAX_MULTIPLEX) : ME_GOAHEAD_FASTCGI_MULTIPLEX;
+    pool->queue = route->queue > 0 ? route->queue : ME_GOAHEAD_FASTCGI_QUEUE;
+    pool->waiting = walloc(sizeof(Cgi*) * pool->queue);
+    hashEnter(fcgiPools, pool->program, valueSymbol(pool), 0);
+    return pool;
+}
+
+
+/*
+    Assign a request to the least loaded process, starting a new process if all are busy and the pool is not full.
+    Return 1 if dispatched, zero if all processes are at the multiplex limit and -1 if a process cannot be started.
+ */
+static int dispatchFcgi(Cgi *cgip)
+{
+    FcgiPool    *pool;
+    Fcgi        *fp, *best;
+    int         i, id;
+
+    pool = cgip->pool;
+    best = 0;
+    for (i = 0; i < pool->procMax; i++) {
+        if ((fp = pool->procs[i]) == 0 || fp->dead) {
+            continue;
+        }
+        if (best == 0 || fp->active < best->active) {
+            best = fp;
+        }
+    }
+    if ((best == 0 || best->active > 0) && pool->procCount < pool->processes) {
+        if ((fp = startFcgi(pool)) != 0) {
+            best = fp;
+        } else if (best == 0) {
+            return -1;
+        }
+    }
+    if (best == 0 || best->active >= pool->multiplex) {
+        return 0;
+    }
+    for (id = 0; best->requests[id]; id++) {}
+    best->requests[id] = cgip;
+    best->active++;
+    cgip->fcgi = best;
+    cgip->id = id + 1;
+    sendFcgiRequest(cgip);
+    return 1;
+}
+
+
+/*
+    Dispatch waiting requests while processes have free slots
+ */
+static void runFcgiQueue(FcgiPool *pool)
+{
+    Cgi     *cgip;
+    int     rc;
+
+    while (pool->waitCount > 0) {
+        cgip = pool->waiting[0];
+        if ((rc = dispatchFcgi(cgip)) == 0) {
+            break;
+        }
+        unqueueFcgi(cgip);
+        if (rc < 0) {
+            failFcgi(cgip, "Cannot start FastCGI program");
+        }
+    }
+}
+
+
+static void unqueueFcgi(Cgi *cgip)
+{
+    FcgiPool    *pool;
+    int         i;
+
+    pool = cgip->pool;
+    for (i = 0; i < pool->waitCount; i++) {
+        if (pool->waiting[i] == cgip) {
+            memmove(&pool->waiting[i], &pool->waiting[i + 1], (pool->waitCount - i - 1) * sizeof(Cgi*));
+            pool->waitCount--;
+            break;
+        }
+    }
+}
+
+
+/*
+    Start a FastCGI process listening on a new Unix domain socket and connect to it
+ */
+static Fcgi *startFcgi(FcgiPool *pool)
+{
+    struct sockaddr_un  addr;
+    Fcgi                *fp;
+    CgiPid              pid;
+    char                *argv[2], *prefix, *path;
+    int                 listenFd, fd, index, sid;
+
+    if (reapSid < 0 && startReaper() < 0) {
+        return 0;
+    }
+    if (access(pool->program, X_OK) != 0) {
+        error("Cannot find FastCGI program %s", pool->program);
+        return 0;
+    }
+    prefix = sfmt("fcgi-%d", getpid());
+    path = websTempFile(NULL, prefix);
+    wfree(prefix);
+    if (slen(path) >= sizeof(addr.sun_path)) {
+        error("FastCGI socket path is too long %s", path);
+        wfree(path);
+        return 0;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    scopy(addr.sun_path, sizeof(addr.sun_path), path);
+    unlink(path);
+
+    if ((listenFd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        error("Cannot create FastCGI socket, errno %d", errno);
+        wfree(path);
+        return 0;
+    }
+    fcntl(listenFd, F_SETFD, FD_CLOEXEC);
+    if (bind(listenFd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(listenFd, 4) < 0) {
+        error("Cannot listen on FastCGI socket %s, errno %d", path, errno);
+        close(listenFd);
+        unlink(path);
+        wfree(path);
+        return 0;
+    }
+    trace(5, "fcgi: run %s", pool->program);
+    argv[0] = pool->program;
+    argv[1] = 0;
+
+    /*
+        The program accepts connections on stdin (FCGI_LISTENSOCK_FILENO)
+     */
+    if ((pid = vfork()) == 0) {
+        if (dup2(listenFd, 0) >= 0) {
+            execv(pool->program, argv);
+        }
+        _exit(1);
+    }
+    fd = -1;
+    if (pid > 0 && (fd = socket(AF_UNIX, SOCK_STREAM, 0)) >= 0) {
+        /* Later CGI and FastCGI programs must not inherit the connection */
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    close(listenFd);
+    unlink(path);
+    wfree(path);
+
+    if (fd < 0 || (sid = socketAttach(fd)) < 0) {
+        error("Cannot start FastCGI program %s, errno %d", pool->program, errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (pid > 0) {
+            kill(pid, SIGTERM);
+            reapLater(pid);
+        }
+        return 0;
+    }
+    index = wallocObject(&pool->procs, &pool->procMax, sizeof(Fcgi));
+    fp = pool->procs[index];
+    fp->index = index;
+    fp->pool = pool;
+    fp->pid = pid;
+    fp->requests = walloc(sizeof(Cgi*) * pool->multiplex);
+    memset(fp->requests, 0, sizeof(Cgi*) * pool->multiplex);
+    bufCreate(&fp->rx, ME_GOAHEAD_LIMIT_BUFFER, MAXINT);
+    bufCreate(&fp->tx, ME_GOAHEAD_LIMIT_BUFFER, MAXINT);
+    fp->sid = sid;
+    socketCreateHandler(fp->sid, SOCKET_READABLE, fcgiEvent, fp);
+    pool->procCount++;
+    trace(4, "fcgi: started %s pid %d, %d processes", pool->program, pid, pool->procCount);
+    return fp;
+}
+
+
+/*
+    Queue the begin request and parameters records and start writing. The request body is sent as it is received.
+ */
+static void sendFcgiRequest(Cgi *cgip)
+{
+    Webs    *wp;
+    Fcgi    *fp;
+    WebsKey *s;
+    WebsBuf params;
+    char    begin[8];
+
+    wp = cgip->wp;
+    fp = cgip->fcgi;
+
+    memset(begin, 0, sizeof(begin));
+    begin[1] = FCGI_RESPONDER;
+    begin[2] = FCGI_KEEP_CONN;
+    putFcgiRecord(fp, FCGI_BEGIN_REQUEST, cgip->id, begin, sizeof(begin));
+
+    bufCreate(&params, ME_GOAHEAD_LIMIT_BUFFER, MAXINT);
+    for (s = hashFirst(wp->vars); s != NULL; s = hashNext(wp->vars, s)) {
+        if (s->content.valid && s->content.type == string && cgiVarAllowed(s->name.value.string)) {
+            putFcgiParam(&params, s->arg ? ME_GOAHEAD_CGI_VAR_PREFIX : "", s->name.value.string,
+                s->content.value.string);
+        }
+    }
+    putFcgiStream(fp, FCGI_PARAMS, cgip->id, params.servp, bufLen(&params));
+    putFcgiRecord(fp, FCGI_PARAMS, cgip->id, 0, 0);
+    bufFree(&params);
+
+    putFcgiInput(cgip);
+    trace(5, "fcgi: send request %d to pid %d", cgip->id, fp->pid);
+    flushFcgi(fp);
+}
+
+
+/*
+    Queue received request body data as stdin records while the connection backlog is below FCGI_MAX_TX. The stdin
+    stream is ended once the whole body has been queued.
+ */
+static void putFcgiInput(Cgi *cgip)
+{
+    Webs    *wp;
+    Fcgi    *fp;
+    ssize   len;
+
+    wp = cgip->wp;
+    fp = cgip->fcgi;
+    if (wp == 0 || cgip->ended) {
+        return;
+    }
+    while (bufLen(&fp->tx) < FCGI_MAX_TX && (len = bufGetBlkMax(&wp->input)) > 0) {
+        len = min(len, FCGI_MAX_RECORD);
+        putFcgiRecord(fp, FCGI_STDIN, cgip->id, wp->input.servp, len);
+        websConsumeInput(wp, len);
+    }
+    if (bufLen(&wp->input) == 0 && (wp->eof || wp->state != WEBS_CONTENT)) {
+        putFcgiRecord(fp, FCGI_STDIN, cgip->id, 0, 0);
+        cgip->ended = 1;
+    }
+}
+
+
+static void putFcgiRecord(Fcgi *fp, int type, int id, cchar *buf, ssize len)
+{
+    char    header[FCGI_HEADER_LEN];
+
+    header[0] = FCGI_VERSION;
+    header[1] = (char) type;
+    header[2] = (char) ((id >> 8) & 0xFF);
+    header[3] = (char) (id & 0xFF);
+    header[4] = (char) ((len >> 8) & 0xFF);
+    header[5] = (char) (len & 0xFF);
+    header[6] = 0;
+    header[7] = 0;
+    bufPutBlk(&fp->tx, header, FCGI_HEADER_LEN);
+    if (len > 0) {
+        bufPutBlk(&fp->tx, buf, len);
+    }
+}
+
+
+/*
+    Write stream data as a series of records. The caller terminates the stream with an empty record.
+ */
+static void putFcgiStream(Fcgi *fp, int type, int id, cchar *buf, ssize len)
+{
+    ssize   count;
+
+    while (len > 0) {
+        count = min(len, FCGI_MAX_RECORD);
+        putFcgiRecord(fp, type, id, buf, count);
+        buf += count;
+        len -= count;
+    }
+}
+
+
+static void putFcgiLength(WebsBuf *buf, ssize len)
+{
+    if (len < 0x80) {
+        bufPutc(buf, (char) len);
+    } else {
+        bufPutc(buf, (char) (((len >> 24) & 0x7F) | 0x80));
+        bufPutc(buf, (char) ((len >> 16) & 0xFF));
+        bufPutc(buf, (char) ((len >> 8) & 0xFF));
+        bufPutc(buf, (char) (len & 0xFF));
+    }
+}
+
+
+static void putFcgiParam(WebsBuf *buf, cchar *prefix, cchar *name, cchar *value)
+{
+    ssize   prefixLen, nameLen, valueLen;
+
+    prefixLen = slen(prefix);
+    nameLen = slen(name);
+    valueLen = slen(value);
+    putFcgiLength(buf, prefixLen + nameLen);
+    putFcgiLength(buf, valueLen);
+    bufPutBlk(buf, prefix, prefixLen);
+    bufPutBlk(buf, name, nameLen);
+    bufPutBlk(buf, value, valueLen);
+}
+
+
+/*
+    Write queued records without blocking. When the records have been written, queue more request body data.
+    Wait for the socket to be writable if the records cannot all be written.
+ */
+static void flushFcgi(Fcgi *fp)
+{
+    ssize   len, written;
+    int     i;
+
+    while (!fp->dead) {
+        if ((len = bufGetBlkMax(&fp->tx)) == 0) {
+            bufFlush(&fp->tx);
+            for (i = 0; i < fp->pool->multiplex; i++) {
+                if (fp->requests[i]) {
+                    putFcgiInput(fp->requests[i]);
+                }
+            }
+            if ((len = bufGetBlkMax(&fp->tx)) == 0) {
+                break;
+            }
+        }
+        if ((written = write(socketGetHandle(fp->sid), fp->tx.servp, len)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                trace(5, "fcgi: write error to pid %d, errno %d", fp->pid, errno);
+                fp->dead = 1;
+            }
+            break;
+        }
+        bufAdjustStart(&fp->tx, written);
+    }
+    updateFcgiInterest(fp);
+}
+
+
+/*
+    Read records unless a request is waiting for its client to drain output. Records for all requests on the
+    connection are paused, so a slow client only delays requests sharing its process connection.
+    A dead connection is closed from the event handler, as the caller may be servicing a request on it.
+ */
+static void updateFcgiInterest(Fcgi *fp)
+{
+    int     mask;
+
+    mask = fp->suspended ? 0 : SOCKET_READABLE;
+    if (bufLen(&fp->tx) > 0 || fp->dead) {
+        mask |= SOCKET_WRITABLE;
+    }
+    socketRegisterInterest(fp->sid, mask);
+}
+
+
+static void fcgiEvent(int sid, int mask, void *data)
+{
+    Fcgi    *fp;
+    ssize   nbytes;
+
+    fp = data;
+    if (mask & SOCKET_WRITABLE && !fp->dead) {
+        flushFcgi(fp);
+    }
+    if (mask & SOCKET_READABLE && !fp->dead) {
+        bufCompact(&fp->rx);
+        if (bufRoom(&fp->rx) < ME_GOAHEAD_LIMIT_BUFFER) {
+            bufGrow(&fp->rx, ME_GOAHEAD_LIMIT_BUFFER);
+        }
+        if ((nbytes = read(socketGetHandle(sid), fp->rx.endp, bufRoom(&fp->rx))) > 0) {
+            bufAdjustEnd(&fp->rx, nbytes);
+            parseFcgi(fp);
+
+        } else if (nbytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            trace(5, "fcgi: connection to pid %d closed", fp->pid);
+            fp->dead = 1;
+        }
+    }
+    if (fp->dead) {
+        closeFcgi(fp);
+    }
+}
+
+
+/*
+    Process complete records received from the program
+ */
+static void parseFcgi(Fcgi *fp)
+{
+    Webs    *wp;
+    Cgi     *cgip;
+    uchar   *cp;
+    char    *content, *msg;
+    ssize   contentLen, recordLen;
+    int     type, id;
+
+    while (bufLen(&fp->rx) >= FCGI_HEADER_LEN) {
+        cp = (uchar*) fp->rx.servp;
+        if (cp[0] != FCGI_VERSION) {
+            error("Bad FastCGI record version from %s", fp->pool->program);
+            fp->dead = 1;
+            return;
+        }
+        type = cp[1];
+        id = (cp[2] << 8) | cp[3];
+        contentLen = (cp[4] << 8) | cp[5];
+        recordLen = FCGI_HEADER_LEN + contentLen + cp[6];
+        if (bufLen(&fp->rx) < recordLen) {
+            break;
+        }
+        /*
+            The content remains valid until the next read
+         */
+        content = (char*) &cp[FCGI_HEADER_LEN];
+        bufAdjustStart(&fp->rx, recordLen);
+
+        if (id <= 0 || id > fp->pool->multiplex || (cgip = fp->requests[id - 1]) == 0) {
+            continue;
+        }
+        wp = cgip->wp;
+        if (type == FCGI_STDOUT) {
+            if (wp && contentLen > 0) {
+                trace(5, "fcgi: read %d bytes for request %d", contentLen, id);
+                websNoteRequestActivity(wp);
+                writeCgiOutput(cgip, content, contentLen, 0);
+                websFlush(wp, 0);
+                if (bufLen(&cgip->output) > 0 || websOutputFull(wp)) {
+                    suspendCgiOutput(cgip);
+                }
+            }
+        } else if (type == FCGI_STDERR) {
+            if (contentLen > 0) {
+                msg = walloc(contentLen + 1);
+                memcpy(msg, content, contentLen);
+                msg[contentLen] = '\0';
+                error("FastCGI %s: %s", fp->pool->program, strim(msg, "\r\n", WEBS_TRIM_END));
+                wfree(msg);
+            }
+        } else if (type == FCGI_END_REQUEST) {
+            trace(5, "fcgi: end request %d", id);
+            if (wp) {
+                finishCgi(cgip);
+            } else {
+                releaseFcgi(cgip);
+            }
+        }
+    }
+    if (bufLen(&fp->rx) == 0) {
+        bufFlush(&fp->rx);
+    }
+}
+
+
+/*
+    Free a FastCGI request and its process slot. The slot is made available to waiting requests.
+ */
+static void releaseFcgi(Cgi *cgip)
+{
+    Fcgi    *fp;
+
+    fp = cgip->fcgi;
+    if (cgip->wp) {
+        if (cgip->suspended) {
+            cgip->wp->writeData = 0;
+        }
+        cgip->wp->cgi = 0;
+        cgiActive--;
+        cgip->wp = 0;
+    }
+    if (cgip->suspended) {
+        cgip->suspended = 0;
+        if (fp) {
+            fp->suspended--;
+            if (!fp->dead) {
+                updateFcgiInterest(fp);
+            }
+        }
+    }
+    if (fp) {
+        fp->requests[cgip->id - 1] = 0;
+        fp->active--;
+    }
+    freeCgiBuffers(cgip);
+    if (fp && !fp->dead) {
+        runFcgiQueue(fp->pool);
+    }
+    wfree(cgip);
+}
+
+
+/*
+    Complete a request that cannot be serviced by the program
+ */
+static void failFcgi(Cgi *cgip, cchar *msg)
+{
+    Webs    *wp;
+
+    wp = cgip->wp;
+    if (!(wp->flags & WEBS_HEADERS_CREATED)) {
+        websError(wp, HTTP_CODE_BAD_GATEWAY, "%s", msg);
+    } else {
+        /* The response is incomplete, so the connection cannot be reused */
+        wp->flags &= ~WEBS_KEEP_ALIVE;
+    }
+    finishCgi(cgip);
+}
+
+
+/*
+    Cancel a FastCGI request when its connection is closed. The program is asked to abort the request and the slot is
+    released when the program ends the request.
+ */
+static void cancelFcgi(Cgi *cgip)
+{
+    Fcgi    *fp;
+
+    cgip->wp->cgi = 0;
+    cgiActive--;
+    cgip->wp = 0;
+    if (cgip->suspended) {
+        /* Output for the request will be discarded, so other requests on the connection may proceed */
+        cgip->suspended = 0;
+        cgip->fcgi->suspended--;
+        updateFcgiInterest(cgip->fcgi);
+    }
+    if ((fp = cgip->fcgi) == 0) {
+        unqueueFcgi(cgip);
+        releaseFcgi(cgip);
+    } else if (!fp->dead) {
+        trace(5, "fcgi: abort request %d", cgip->id);
+        putFcgiRecord(fp, FCGI_ABORT_REQUEST, cgip->id, 0, 0);
+        flushFcgi(fp);
+    }
+}
+
+
+/*
+    Close the connection to a process and terminate it. Active requests fail and a replacement process may be started
+    for waiting requests.
+ */
+static void closeFcgi(Fcgi *fp)
+{
+    FcgiPool    *pool;
+    Cgi         *cgip;
+    int         i;
+
+    pool = fp->pool;
+    trace(4, "fcgi: close %s pid %d", pool->program, fp->pid);
+    fp->dead = 1;
+    pool->procMax = wfreeHandle(&pool->procs, fp->index);
+    pool->procCount--;
+    socketFree(fp->sid);
+    kill(fp->pid, SIGTERM);
+    reapLater(fp->pid);
+
+    for (i = 0; i < pool->multiplex; i++) {
+        if ((cgip = fp->requests[i]) != 0) {
+            if (cgip->wp) {
+                failFcgi(cgip, "FastCGI program exited");
+            } else {
+                releaseFcgi(cgip);
+            }
+        }
+    }
+    bufFree(&fp->rx);
+    bufFree(&fp->tx);
+    wfree(fp->requests);
+    wfree(fp);
+    runFcgiQueue(pool);
+}
+
+
+/*
+    Reap a process once it has exited
+ */
+static void reapLater(CgiPid pid)
+{
+    int     cid;
+
+    cid = wallocObject(&cgiList, &cgiMax, sizeof(Cgi));
+    cgiList[cid]->handle = pid;
+    reapTasks();
+}
+
+
+/*
+    Close the FastCGI handler on shutdown. Processes are terminated and requests are detached.
+ */
+static void closeFastCgi()
+{
+    FcgiPool    *pool;
+    Fcgi        *fp;
+    Cgi         *cgip;
+    WebsKey     *key;
+    int         i, j;
+
+    if (fcgiPools < 0) {
+        return;
+    }
+    for (key = hashFirst(fcgiPools); key; key = hashNext(fcgiPools, key)) {
+        pool = key->content.value.symbol;
+        for (i = 0; i < pool->waitCount; i++) {
+            cgip = pool->waiting[i];
+            cgip->wp->cgi = 0;
+            cgiActive--;
+            freeCgiBuffers(cgip);
+            wfree(cgip);
+        }
+        for (i = 0; i < pool->procMax; i++) {
+            if ((fp = pool->procs[i]) == 0) {
+                continue;
+            }
+            for (j = 0; j < pool->multiplex; j++) {
+                if ((cgip = fp->requests[j]) != 0) {
+                    if (cgip->wp) {
+                        cgip->wp->cgi = 0;
+                        cgiActive--;
+                    }
+                    freeCgiBuffers(cgip);
+                    wfree(cgip);
+                }
+            }
+            kill(fp->pid, SIGTERM);
+            socketFree(fp->sid);
+            bufFree(&fp->rx);
+            bufFree(&fp->tx);
+            wfree(fp->requests);
+            wfree(fp);
+        }
+        wfree(pool->procs);
+        wfree(pool->waiting);
+        wfree(pool->program);
+        wfree(pool);
+    }
+    hashFree(fcgiPools);
+    fcgiPools = -1;
+}
+
+#else /* !CGI_PIPES */
+
+/*
+    FastCGI requires pipes and Unix domain sockets. The handler is defined so that route tables naming it still load.
+ */
+PUBLIC bool fastcgiHandler(Webs *wp)
+{
+    websError(wp, HTTP_CODE_SERVICE_UNAVAILABLE, "FastCGI is not supported on this platform");
+    return 1;
+}
+
 
-        } else if (execve(cgiPath, argp, envp) == -1) {
-            printf("content-type: text/html\n\nExecution of cgi process failed\n");
+/*
+    Create the temporary stdin file to receive the request body
+ */
+PUBLIC int websCgiStart(Webs *wp)
+{
+    if (wp->route->handler->service == fastcgiHandler) {
+        return 0;
+    }
+    wp->cgiStdin = websGetCgiCommName();
+    if ((wp->cgifd = open(wp->cgiStdin, O_CREAT | O_WRONLY | O_BINARY | O_TRUNC, 0666)) < 0) {
+        websError(wp, HTTP_CODE_NOT_FOUND | WEBS_CLOSE, "Cannot open CGI file");
+        return -1;
+    }
+    return 0;
+}
+
+
+PUBLIC bool websProcessCgiData(Webs *wp)
+{
+    ssize   nbytes;
+
+    nbytes = bufLen(&wp->input);
+    trace(5, "cgi: write %d bytes to CGI program", nbytes);
+    if (write(wp->cgifd, wp->input.servp, (int) nbytes) != nbytes) {
+        websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR| WEBS_CLOSE, "Cannot write to CGI gateway");
+    } else {
+        trace(5, "cgi: write %d bytes to CGI program", nbytes);
+    }
+    websConsumeInput(wp, nbytes);
+    return 1;
+}
+
+
+PUBLIC void websCgiCleanup(Webs *wp)
+{
+    if (wp->cgifd >= 0) {
+        close(wp->cgifd);
+        wp->cgifd = -1;
+    }
+    wfree(wp->cgiStdin);
+    wp->cgiStdin = 0;
+}
+
+
+PUBLIC void websCgiGatherOutput(Cgi *cgip)
+{
+    Webs        *wp;
+    WebsStat    sbuf;
+    char        buf[ME_GOAHEAD_LIMIT_HEADERS + 2];
+    ssize       nbytes, skip, written;
+    int         fdout;
+
+    /*
+        OPT - currently polling and doing a stat each poll. Also doing open/close each chunk.
+        If the CGI process writes partial headers, this repeatedly reads the data until complete
+        headers are written or more than ME_GOAHEAD_LIMIT_HEADERS of data is received.
+     */
+    if ((stat(cgip->stdOut, &sbuf) == 0) && (sbuf.st_size > cgip->fplacemark)) {
+        if ((fdout = open(cgip->stdOut, O_RDONLY | O_BINARY, 0444)) >= 0) {
+            /*
+                Check to see if any data is available in the output file and send its contents to the socket.
+                Write the HTTP header on our first pass. The header must fit into ME_GOAHEAD_LIMIT_BUFFER.
+             */
+            wp = cgip->wp;
+            lseek(fdout, cgip->fplacemark, SEEK_SET);
+            while ((nbytes = read(fdout, buf, sizeof(buf))) > 0) {
+                skip = 0;
+                if (!(wp->flags & WEBS_HEADERS_CREATED)) {
+                    if ((skip = parseCgiHeaders(wp, buf)) == 0) {
+                        if (cgip->handle && sbuf.st_size < ME_GOAHEAD_LIMIT_HEADERS) {
+                            trace(5, "cgi: waiting for http headers");
+                            break;
+                        } else {
+                            trace(5, "cgi: missing http headers - create default headers");
+                            writeCgiHeaders(wp, HTTP_CODE_OK, -1, 0, 0);
+                            websWriteEndHeaders(wp);
+                        }
+                    }
+                }
+                trace(5, "cgi: write %d bytes to client", nbytes - skip);
+                if ((written = websStreamBlock(wp, &buf[skip], nbytes - skip)) < 0) {
+                    written = nbytes - skip;
+                }
+                cgip->fplacemark += (off_t) (skip + written);
+                if (written < nbytes - skip) {
+                    /* The client is slow. Resume from the placemark on the next poll */
+                    break;
+                }
+            }
+            close(fdout);
+        } else {
+            trace(5, "cgi: open failed");
+        }
+    }
+}
+
+
+/*
+    Test if program output remains to be written to the client
+ */
+static bool cgiOutputPending(Cgi *cgip)
+{
+    WebsStat    sbuf;
+
+    return stat(cgip->stdOut, &sbuf) == 0 && sbuf.st_size > cgip->fplacemark;
+}
+
+
+/*
+    Any entry in the cgiList need to be checked to see if it has completed, and if so, process its output and clean up.
+    Return time till next poll.
+ */
+PUBLIC int websCgiPoll()
+{
+    Webs    *wp;
+    Cgi     *cgip;
+    int     cid;
+
+    for (cid = 0; cid < cgiMax; cid++) {
+        if ((cgip = cgiList[cid]) != NULL) {
+            wp = cgip->wp;
+            websCgiGatherOutput(cgip);
+            if (cgip->handle && checkCgi(cgip->handle) == 0) {
+                /*
+                    We get here if the CGI process has terminated
+                 */
+                cgip->handle = 0;
+                websCgiGatherOutput(cgip);
+
+#if WINDOWS
+                /*
+                     Windows can have delayed notification through the file system after process exit.
+                 */
+                {
+                    int nTries;
+                    for (nTries = 0; (cgip->fplacemark == 0) && (nTries < 100); nTries++) {
+                        websCgiGatherOutput(cgip);
+                        if (cgip->fplacemark == 0) {
+                            Sleep(10);
+                        }
+                    }
+                }
+#endif
+            }
+            if (cgip->handle == 0 && !cgiOutputPending(cgip)) {
+                /*
+                    All output has been written to the client. Clean up.
+                 */
+                if (cgip->fplacemark == 0) {
+                    websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "CGI generated no output");
+                } else {
+                    trace(5, "cgi: Request complete - calling websDone");
+                    websDone(wp);
+                }
+                /*
+                    Remove the temporary re-direction files
+                 */
+                unlink(cgip->stdIn);
+                unlink(cgip->stdOut);
+                /*
+                    Free all the memory buffers pointed to by cgip. The stdin file name (wp->cgiStdin) gets freed as
+                    part of websFree().
+                 */
+                cgiMax = wfreeHandle(&cgiList, cid);
+                cgiActive--;
+                freeCgiArgs(cgip->cgiPath, cgip->argp, cgip->envp);
+                wfree(cgip->stdOut);
+                wfree(cgip);
+                websPump(wp);
+                websFree(wp);
+                /* wp no longer valid */
+            }
         }
-        _exit(0);
     }
+    return cgiMax ? 10 : MAXINT;
+}
+#endif /* CGI_PIPES */
+
+
+/*
+    Returns a pointer to an allocated qualified unique temporary file name. This filename must eventually be deleted with
+    wfree().
+ */
+PUBLIC char *websGetCgiCommName()
+{
+    return websTempFile(NULL, "cgi");
+}
+
+
+#if WINCE
+/*
+     Launch the CGI process and return a handle to it.  CE note: This function is not complete.  The missing piece is
+     the ability to redirect stdout.
+ */
+static CgiPid launchCgi(char *cgiPath, char **argp, char **envp, char *stdIn, char *stdOut)
+{
+    PROCESS_INFORMATION procinfo;       /*  Information about created proc   */
+    DWORD               dwCreateFlags;
+    char                *fulldir;
+    BOOL                bReturn;
+    int                 i, nLen;
+
     /*
-        Parent
+        Replace directory delimiters with Windows-friendly delimiters
      */
-    if (fdout >= 0) {
-        close(fdout);
+    nLen = strlen(cgiPath);
+    for (i = 0; i < nLen; i++) {
+        if (cgiPath[i] == '/') {
+            cgiPath[i] = '\\';
+        }
     }
-    if (fdin >= 0) {
-        close(fdin);
+    fulldir = NULL;
+    dwCreateFlags = CREATE_NEW_CONSOLE;
+
+    /*
+         CreateProcess returns errors sometimes, even when the process was started correctly.  The cause is not evident.
+         For now: we detect an error by checking the value of procinfo.hProcess after the call.
+     */
+    procinfo.hThread = NULL;
+    bReturn = CreateProcess(
+        cgiPath,            /*  Name of executable module        */
+        NULL,               /*  Command line string              */
+        NULL,               /*  Process security attributes      */
+        NULL,               /*  Thread security attributes       */
+        0,                  /*  Handle inheritance flag          */
+        dwCreateFlags,      /*  Creation flags                   */
+        NULL,               /*  New environment block            */
+        NULL,               /*  Current directory name           */
+        NULL,               /*  STARTUPINFO                      */
+        &procinfo);         /*  PROCESS_INFORMATION              */
+    if (bReturn == 0) {
+        return -1;
+    } else {
+        CloseHandle(procinfo.hThread);
     }
-    return pid;
+    return (int) procinfo.dwProcessId;
 }
 
 
@@ -603,19 +2046,52 @@ static CgiPid launchCgi(char *cgiPath, char **argp, char **envp, char *stdIn, ch
  */
 static int checkCgi(CgiPid handle)
 {
-    int     pid;
+    int     nReturn;
+    DWORD   exitCode;
 
+    nReturn = GetExitCodeProcess((HANDLE)handle, &exitCode);
     /*
-        Check to see if the CGI child process has terminated or not yet.
+        We must close process handle to free up the window resource, but only when we're done with it.
      */
-    if ((pid = waitpid((CgiPid) handle, NULL, WNOHANG)) == handle) {
-        trace(5, "cgi: waited for pid %d", pid);
+    if ((nReturn == 0) || (exitCode != STILL_ACTIVE)) {
+        CloseHandle((HANDLE) handle);
         return 0;
-    } else {
-        return 1;
     }
+    return 1;
 }
+#endif /* WINCE */
+
+
+#if ME_UNIX_LIKE || QNX
+/*
+    Launch the CGI process with the given stdin and stdout descriptors and return a handle to it.
+ */
+static CgiPid launchCgi(char *cgiPath, char **argp, char **envp, int fdin, int fdout)
+{
+    int     pid;
+
+    trace(5, "cgi: run %s", cgiPath);
+
+    pid = vfork();
+    if (pid == 0) {
+        /*
+            Child
+         */
+        if (dup2(fdin, 0) < 0) {
+            printf("content-type: text/html\n\nDup of stdin failed\n");
+            _exit(1);
+
+        } else if (dup2(fdout, 1) < 0) {
+            printf("content-type: text/html\n\nDup of stdout failed\n");
+            _exit(1);
 
+        } else if (execve(cgiPath, argp, envp) == -1) {
+            printf("content-type: text/html\n\nExecution of cgi process failed\n");
+        }
+        _exit(0);
+    }
+    return pid;
+}
 #endif /* LINUX || LYNX || MACOSX || QNX4 */
 
 
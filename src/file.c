@@ -8,14 +8,106 @@
 
 #include    "goahead.h"
 
+/*********************************** Defines **********************************/
+
+#if LINUX && !__UCLIBC__ && !ME_ROM
+    #define FILE_SENDFILE 1             /* Use sendfile for non-TLS responses */
+#else
+    #define FILE_SENDFILE 0
+#endif
+
+#define FILE_MAX_RANGES 16             /* Maximum ranges in a Range request. More are ignored */
+
+#if ME_GOAHEAD_CACHE_SIZE > 0
+    #define FILE_CACHE 1                /* Cache file metadata and small documents in memory */
+#else
+    #define FILE_CACHE 0
+#endif
+
+#if FILE_CACHE
+/*
+    Cached file entry. Entries are indexed by filename in fileCache and ordered most recently used first
+    on the cacheHead list. Only documents up to cacheItemMax bytes have their body cached.
+ */
+typedef struct FileEntry {
+    char            *filename;              /* Resolved document filename (hash key) */
+    char            *modified;              /* Pre-formatted Last-Modified header value */
+    char            *body;                  /* Document content or NULL if only metadata is cached */
+    WebsFileInfo    info;                   /* File size and modification time */
+    Ticks           checked;                /* When the entry was last validated against the file system */
+    ssize           cost;                   /* Bytes charged against the cache budget */
+#if ME_GOAHEAD_COMPRESS
+    int             encodings;              /* Mask of precompressed variants or -1 if not yet probed */
+#endif
+    struct FileEntry *prev;                 /* Previous (more recently used) entry */
+    struct FileEntry *next;                 /* Next (less recently used) entry */
+} FileEntry;
+#endif
+
+#if ME_GOAHEAD_COMPRESS
+/*
+    Precompressed document variant
+ */
+typedef struct FileEncoding {
+    cchar           *ext;                   /* Filename extension of the variant */
+    cchar           *name;                  /* Content-Encoding name */
+    int             flag;                   /* WEBS_ENCODE_* flag */
+} FileEncoding;
+#endif
+
 /*********************************** Locals ***********************************/
 
 static char   *websIndex;                   /* Default page name */
 static char   *websDocuments;               /* Default Web page directory */
+static char   rangeBoundary[40];            /* Boundary for multipart/byteranges responses */
+
+#if FILE_CACHE
+static WebsHash  fileCache = -1;            /* Cached entries indexed by filename */
+static FileEntry *cacheHead;                /* Most recently used entry */
+static FileEntry *cacheTail;                /* Least recently used entry */
+static ssize     cacheSize;                 /* Total bytes charged to cached entries */
+static ssize     cacheMax = ME_GOAHEAD_CACHE_SIZE;          /* Cache memory budget. See websSetFileCache */
+static ssize     cacheItemMax = ME_GOAHEAD_CACHE_ITEM_SIZE; /* Largest document body to cache */
+#endif
+
+#if ME_GOAHEAD_COMPRESS
+/*
+    Precompressed variants in order of preference
+ */
+static FileEncoding fileEncodings[] = {
+    { ".br", "br", WEBS_ENCODE_BR },
+    { ".gz", "gzip", WEBS_ENCODE_GZIP },
+    { 0, 0, 0 },
+};
+#endif
 
 /**************************** Forward Declarations ****************************/
 
+static bool bufferOutput(Webs *wp, cchar *buf, ssize len);
 static void fileWriteEvent(Webs *wp);
+static void makeEtag(WebsFileInfo *info, char *buf, ssize size);
+static bool matchEtag(cchar *list, cchar *etag);
+static bool matchIfRange(Webs *wp, cchar *etag, WebsFileInfo *info);
+static bool nextRange(Webs *wp);
+static ssize partHeader(Webs *wp, WebsRange *rp, char *buf, ssize size);
+static int parseRanges(Webs *wp, Offset size);
+static int writeDocument(Webs *wp);
+#if FILE_SENDFILE
+static int sendFileData(Webs *wp);
+#endif
+#if ME_GOAHEAD_COMPRESS
+static cchar *selectEncoding(Webs *wp, WebsFileInfo *info, bool *vary);
+#endif
+#if FILE_CACHE
+static FileEntry *cacheAdd(Webs *wp, WebsFileInfo *info);
+static void cacheLoadBody(Webs *wp, FileEntry *fp);
+static FileEntry *cacheLookup(cchar *filename);
+static void cacheRemove(FileEntry *fp);
+#if !ME_ROM
+static void cacheRemoveFile(cchar *filename);
+#endif
+static void sendCachedBody(Webs *wp, cchar *body, ssize len);
+#endif
 
 /*********************************** Code *************************************/
 /*
@@ -25,9 +117,19 @@ static void fileWriteEvent(Webs *wp);
 static bool fileHandler(Webs *wp)
 {
     WebsFileInfo    info;
-    char            *tmp, *date;
+    WebsRange       *rp;
+    Offset          length;
+    char            *tmp, *date, *ext, etag[64], header[160];
     ssize           nchars;
-    int             code;
+    int             code, count;
+#if FILE_CACHE
+    FileEntry       *fp;
+#endif
+#if ME_GOAHEAD_COMPRESS
+    cchar           *encoding;
+    bool            vary;
+#endif
+    bool            exists;
 
     assert(websValid(wp));
     assert(wp->method);
@@ -35,6 +137,9 @@ static bool fileHandler(Webs *wp)
 
 #if !ME_ROM
     if (smatch(wp->method, "DELETE")) {
+#if FILE_CACHE
+        cacheRemoveFile(wp->filename);
+#endif
         if (unlink(wp->filename) < 0) {
             websError(wp, HTTP_CODE_NOT_FOUND, "Cannot delete the URI");
         } else {
@@ -42,6 +147,9 @@ static bool fileHandler(Webs *wp)
             websResponse(wp, 204, 0);
         }
     } else if (smatch(wp->method, "PUT")) {
+#if FILE_CACHE
+        cacheRemoveFile(wp->filename);
+#endif
         /* Code is already set for us by processContent() */
         websResponse(wp, wp->code, 0);
 
@@ -51,36 +159,138 @@ static bool fileHandler(Webs *wp)
         /*
             If the file is a directory, redirect using the nominated default page
          */
-        if (websPageIsDirectory(wp)) {
-            nchars = strlen(wp->path);
-            if (wp->path[nchars - 1] == '/' || wp->path[nchars - 1] == '\\') {
-                wp->path[--nchars] = '\0';
+        exists = 1;
+#if FILE_CACHE
+        if ((fp = cacheLookup(wp->filename)) == NULL)
+#endif
+        {
+            if ((exists = websPageStat(wp, &info) >= 0) && info.isDir) {
+                nchars = strlen(wp->path);
+                if (wp->path[nchars - 1] == '/' || wp->path[nchars - 1] == '\\') {
+                    wp->path[--nchars] = '\0';
+                }
+                tmp = sfmt("%s/%s", wp->path, websIndex);
+                websRedirect(wp, tmp);
+                wfree(tmp);
+                return 1;
             }
-            tmp = sfmt("%s/%s", wp->path, websIndex);
-            websRedirect(wp, tmp);
-            wfree(tmp);
-            return 1;
         }
-        if (websPageOpen(wp, O_RDONLY | O_BINARY, 0666) < 0) {
+#if ME_GOAHEAD_COMPRESS
+        /*
+            Serve a precompressed variant of the document if the client accepts the encoding
+         */
+        encoding = selectEncoding(wp, exists ? &info : 0, &vary);
+#if FILE_CACHE
+        if (encoding || !fp) {
+            /* The variant, or an entry added for the document by selectEncoding */
+            fp = cacheLookup(wp->filename);
+        }
+#endif
+#endif
+#if FILE_CACHE
+        if (fp) {
+            /*
+                Cache hit. Directories are never cached. The file only needs to be opened if the body is not cached.
+             */
+            if (!fp->body) {
+                if (websPageOpen(wp, O_RDONLY | O_BINARY, 0666) < 0) {
+                    cacheRemove(fp);
+                    websError(wp, HTTP_CODE_NOT_FOUND, "Cannot open document for: %s", wp->path);
+                    return 1;
+                }
+                cacheLoadBody(wp, fp);
+            }
+            info = fp->info;
+        } else
+#endif
+        {
+            if (websPageOpen(wp, O_RDONLY | O_BINARY, 0666) < 0) {
 #if ME_DEBUG
-            if (wp->referrer) {
-                trace(1, "From %s", wp->referrer);
+                if (wp->referrer) {
+                    trace(1, "From %s", wp->referrer);
+                }
+#endif
+                websError(wp, HTTP_CODE_NOT_FOUND, "Cannot open document for: %s", wp->path);
+                return 1;
+            }
+            if (websPageStat(wp, &info) < 0) {
+                websError(wp, HTTP_CODE_NOT_FOUND, "Cannot stat page for URL");
+                return 1;
+            }
+#if FILE_CACHE
+            if ((fp = cacheAdd(wp, &info)) != NULL && fp->body) {
+                /* Body is now served from memory */
+                websPageClose(wp);
             }
 #endif
-            websError(wp, HTTP_CODE_NOT_FOUND, "Cannot open document for: %s", wp->path);
-            return 1;
-        }
-        if (websPageStat(wp, &info) < 0) {
-            websError(wp, HTTP_CODE_NOT_FOUND, "Cannot stat page for URL");
-            return 1;
         }
-        code = 200;
-        if (wp->since && info.mtime <= wp->since) {
-            code = 304;
-            info.size = 0;
+        /*
+            Conditional requests. If-None-Match takes precedence over If-Modified-Since.
+         */
+        makeEtag(&info, etag, sizeof(etag));
+        code = HTTP_CODE_OK;
+        length = (Offset) info.size;
+        wp->docPos = 0;
+        wp->docEnd = length;
+        if (wp->ifNoneMatch ? matchEtag(wp->ifNoneMatch, etag) : (wp->since && info.mtime <= wp->since)) {
+            code = HTTP_CODE_NOT_MODIFIED;
+            length = 0;
+
+        } else if (wp->range && length > 0 && (!wp->ifRange || matchIfRange(wp, etag, &info))) {
+            if ((count = parseRanges(wp, length)) < 0) {
+                websSetStatus(wp, HTTP_CODE_RANGE_NOT_SATISFIABLE);
+                websWriteHeaders(wp, 0, 0);
+                websWriteHeader(wp, "Content-Range", "bytes */%Ld", length);
+                websWriteEndHeaders(wp);
+                websDone(wp);
+                return 1;
+
+            } else if (count > 0) {
+                code = HTTP_CODE_PARTIAL;
+                if (wp->ranges) {
+                    /* Multipart response. The file is required even if the body is cached */
+                    if (wp->docfd < 0 && websPageOpen(wp, O_RDONLY | O_BINARY, 0666) < 0) {
+                        websError(wp, HTTP_CODE_NOT_FOUND, "Cannot open document for: %s", wp->path);
+                        return 1;
+                    }
+                    length = slen(rangeBoundary) + 8;
+                    for (rp = wp->ranges; rp->start >= 0; rp++) {
+                        length += partHeader(wp, rp, header, sizeof(header)) + rp->end - rp->start;
+                    }
+                } else {
+                    length = wp->docEnd - wp->docPos;
+                }
+            }
         }
         websSetStatus(wp, code);
-        websWriteHeaders(wp, info.size, 0);
+        if (wp->ranges && code == HTTP_CODE_PARTIAL) {
+            /* Suppress the document Content-Type. Each part has its own type */
+            ext = wp->ext;
+            wp->ext = 0;
+            websWriteHeaders(wp, (ssize) length, 0);
+            wp->ext = ext;
+            websWriteHeader(wp, "Content-Type", "multipart/byteranges; boundary=%s", rangeBoundary);
+        } else {
+            websWriteHeaders(wp, (ssize) length, 0);
+            if (code == HTTP_CODE_PARTIAL) {
+                websWriteHeader(wp, "Content-Range", "bytes %Ld-%Ld/%Ld", wp->docPos, wp->docEnd - 1, (int64) info.size);
+            }
+        }
+        websWriteHeader(wp, "Accept-Ranges", "bytes");
+        websWriteHeader(wp, "ETag", "%s", etag);
+#if ME_GOAHEAD_COMPRESS
+        if (encoding) {
+            websWriteHeader(wp, "Content-Encoding", "%s", encoding);
+        }
+        if (vary) {
+            websWriteHeader(wp, "Vary", "Accept-Encoding");
+        }
+#endif
+#if FILE_CACHE
+        if (fp) {
+            websWriteHeader(wp, "Last-Modified", "%s", fp->modified);
+        } else
+#endif
         if ((date = websGetDateString(&info)) != NULL) {
             websWriteHeader(wp, "Last-Modified", "%s", date);
             wfree(date);
@@ -90,15 +300,20 @@ static bool fileHandler(Webs *wp)
         /*
             All done if the browser did a HEAD request
          */
-        if (smatch(wp->method, "HEAD")) {
+        if (smatch(wp->method, "HEAD") || length <= 0) {
             websDone(wp);
             return 1;
         }
-        if (info.size > 0) {
-            websSetBackgroundWriter(wp, fileWriteEvent);
-        } else {
-            websDone(wp);
+#if FILE_CACHE
+        if (fp && fp->body && !wp->ranges) {
+            sendCachedBody(wp, &fp->body[wp->docPos], (ssize) (wp->docEnd - wp->docPos));
+            return 1;
         }
+#endif
+        if (wp->docPos > 0) {
+            websPageSeek(wp, wp->docPos, SEEK_SET);
+        }
+        websSetBackgroundWriter(wp, fileWriteEvent);
     }
     return 1;
 }
@@ -110,40 +325,641 @@ static bool fileHandler(Webs *wp)
  */
 static void fileWriteEvent(Webs *wp)
 {
-    char    *buf;
-    ssize   len, wrote;
-    int     err;
+    int     rc;
 
     assert(wp);
     assert(websValid(wp));
 
+    for (;;) {
+        if (wp->docPos >= wp->docEnd) {
+            /*
+                Start the next part of a multipart/byteranges response. The part header must drain first.
+             */
+            if (!wp->ranges || !nextRange(wp)) {
+                break;
+            }
+            if ((rc = websFlush(wp, 0)) == 0) {
+                return;
+            } else if (rc < 0) {
+                break;
+            }
+        }
+        if ((rc = writeDocument(wp)) == 0) {
+            /* Wait for the next writable event */
+            return;
+        } else if (rc < 0) {
+            break;
+        }
+    }
+    websDone(wp);
+}
+
+
+/*
+    Write the document from docPos to docEnd. Returns 1 when written, 0 if the socket is full and -1 for errors.
+ */
+static int writeDocument(Webs *wp)
+{
+    char    *buf;
+    ssize   len, wrote;
+    int     err, rc;
+
+#if FILE_SENDFILE
+    if (!(wp->flags & WEBS_SECURE)) {
+        return sendFileData(wp);
+    }
+#endif
     if ((buf = walloc(ME_GOAHEAD_LIMIT_BUFFER)) == NULL) {
         websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "Cannot get memory");
-        return;
+        return -1;
     }
-    while ((len = websPageReadData(wp, buf, ME_GOAHEAD_LIMIT_BUFFER)) > 0) {
+    rc = 1;
+    while (wp->docPos < wp->docEnd) {
+        len = (ssize) min(wp->docEnd - wp->docPos, ME_GOAHEAD_LIMIT_BUFFER);
+        if ((len = websPageReadData(wp, buf, len)) <= 0) {
+            /* File truncated. The content length cannot be honored */
+            wp->flags &= ~WEBS_KEEP_ALIVE;
+            rc = -1;
+            break;
+        }
         if ((wrote = websWriteSocket(wp, buf, len)) < 0) {
             err = socketGetError(wp->sid);
             if (err == EWOULDBLOCK || err == EAGAIN) {
                 websPageSeek(wp, -len, SEEK_CUR);
+                rc = 0;
             } else {
                 /* Will call websDone below */
                 wp->state = WEBS_COMPLETE;
+                rc = -1;
             }
             break;
         }
+        wp->docPos += wrote;
         if (wrote != len) {
             websPageSeek(wp, - (len - wrote), SEEK_CUR);
+            rc = 0;
+            break;
+        }
+    }
+    wfree(buf);
+    return rc;
+}
+
+
+#if FILE_SENDFILE
+/*
+    Transmit the document directly from the file to the socket without copying via a user buffer.
+    The position is maintained in wp->docPos so a short write does not need to seek back.
+ */
+static int sendFileData(Webs *wp)
+{
+    off_t   pos;
+    ssize   written;
+    int     err;
+
+    while (wp->docPos < wp->docEnd) {
+        pos = (off_t) wp->docPos;
+        if ((written = sendfile(socketGetHandle(wp->sid), wp->docfd, &pos, (size_t) (wp->docEnd - wp->docPos))) < 0) {
+            err = socketGetError(wp->sid);
+            if (err == EINTR) {
+                continue;
+            } else if (err == EWOULDBLOCK || err == EAGAIN) {
+                /* Wait for the next writable event */
+                return 0;
+            }
+            wp->flags &= ~WEBS_KEEP_ALIVE;
+            wp->state = WEBS_COMPLETE;
+            return -1;
+
+        } else if (written == 0) {
+            /* File truncated. The content length cannot be honored */
+            wp->flags &= ~WEBS_KEEP_ALIVE;
+            return -1;
+        }
+        wp->docPos += written;
+        websNoteWritten(wp, written);
+    }
+    return 1;
+}
+#endif
+
+
+/*
+    Append data to the output buffer without blocking. The buffer is grown as required.
+ */
+static bool bufferOutput(Webs *wp, cchar *buf, ssize len)
+{
+    WebsBuf     *op;
+
+    op = &wp->output;
+    if (bufRoom(op) <= len && !bufGrow(op, len - bufRoom(op) + 1)) {
+        return 0;
+    }
+    bufPutBlk(op, buf, len);
+    bufAddNull(op);
+    return 1;
+}
+
+
+/*
+    Create an entity tag from the document size and modification time. The tag is weak if the document was modified
+    within the last second as it may change again without changing the modification time.
+ */
+static void makeEtag(WebsFileInfo *info, char *buf, ssize size)
+{
+    fmt(buf, size, "%s\"%Lx-%Lx\"", (time(0) - info->mtime) < 1 ? "W/" : "", (int64) info->size, (int64) info->mtime);
+}
+
+
+/*
+    Test an If-None-Match header against the document entity tag using the weak comparison function
+ */
+static bool matchEtag(cchar *list, cchar *etag)
+{
+    char    *buf, *tok, *next;
+    bool    match;
+
+    if (sstarts(etag, "W/")) {
+        etag += 2;
+    }
+    match = 0;
+    buf = sclone(list);
+    for (tok = stok(buf, ",", &next); tok && !match; tok = stok(NULL, ",", &next)) {
+        tok = strim(tok, " \t", WEBS_TRIM_BOTH);
+        if (sstarts(tok, "W/")) {
+            tok += 2;
+        }
+        match = smatch(tok, "*") || smatch(tok, etag);
+    }
+    wfree(buf);
+    return match;
+}
+
+
+/*
+    Test if the If-Range validator matches the document. Entity tags must match using the strong comparison function.
+    Otherwise the validator is a date that must equal the document modification time.
+ */
+static bool matchIfRange(Webs *wp, cchar *etag, WebsFileInfo *info)
+{
+    WebsTime    when;
+    cchar       *value;
+    ssize       len;
+
+    value = wp->ifRange;
+    while (isspace((uchar) *value)) {
+        value++;
+    }
+    if (*value == '"') {
+        /* The strong comparison function. The value must be exactly the entity tag, ignoring trailing white space */
+        len = slen(etag);
+        if (sstarts(etag, "W/") || sncmp(value, etag, len) != 0) {
+            return 0;
+        }
+        for (value += len; isspace((uchar) *value); value++) {}
+        return *value == '\0';
+    } else if (sstarts(value, "W/")) {
+        return 0;
+    }
+    if (websParseDateTime(&when, value, 0) < 0) {
+        return 0;
+    }
+    return when == info->mtime;
+}
+
+
+/*
+    Parse the Range header for a document of the given size. Returns the number of satisfiable ranges, zero to ignore
+    the header and -1 if no range can be satisfied. A single range is defined by docPos and docEnd. Multiple ranges are
+    saved in wp->ranges and are terminated by an entry with a start of -1 and an end set to the document size.
+ */
+static int parseRanges(Webs *wp, Offset size)
+{
+    WebsRange   ranges[FILE_MAX_RANGES];
+    Offset      start, end;
+    char        *buf, *tok, *next, *dash, *cp;
+    int         count, specs;
+
+    if (sncaselesscmp(wp->range, "bytes=", 6) != 0) {
+        return 0;
+    }
+    buf = sclone(&wp->range[6]);
+    count = specs = 0;
+    for (tok = stok(buf, ",", &next); tok; tok = stok(NULL, ",", &next)) {
+        tok = strim(tok, " \t", WEBS_TRIM_BOTH);
+        if (++specs > FILE_MAX_RANGES || (dash = strchr(tok, '-')) == NULL) {
+            /* Too many ranges or invalid syntax. Ignore the header and respond with the full document */
+            count = specs = 0;
             break;
         }
+        *dash++ = '\0';
+        if (*tok == '\0') {
+            /* Suffix range of the last N bytes */
+            if (!isdigit((uchar) *dash) || (end = (Offset) strtoll(dash, &cp, 10)) < 0 || *cp) {
+                count = specs = 0;
+                break;
+            }
+            start = max(size - end, 0);
+            end = (end > 0) ? size : 0;
+        } else {
+            if (!isdigit((uchar) *tok) || (start = (Offset) strtoll(tok, &cp, 10)) < 0 || *cp) {
+                count = specs = 0;
+                break;
+            }
+            if (*dash == '\0') {
+                end = size;
+            } else if (!isdigit((uchar) *dash) || (end = (Offset) strtoll(dash, &cp, 10)) < start || *cp) {
+                count = specs = 0;
+                break;
+            } else {
+                /* strtoll saturates an out of range value, so clamp before adding to avoid overflow */
+                end = (end >= size - 1) ? size : end + 1;
+            }
+        }
+        if (start >= size || start >= end) {
+            /* Unsatisfiable */
+            continue;
+        }
+        ranges[count].start = start;
+        ranges[count].end = end;
+        count++;
     }
     wfree(buf);
-    if (len <= 0) {
-        websDone(wp);
+
+    if (count == 0) {
+        return specs > 0 ? -1 : 0;
     }
+    if (count == 1) {
+        wp->docPos = ranges[0].start;
+        wp->docEnd = ranges[0].end;
+    } else {
+        if ((wp->ranges = walloc((count + 1) * sizeof(WebsRange))) == NULL) {
+            return 0;
+        }
+        memcpy(wp->ranges, ranges, count * sizeof(WebsRange));
+        wp->ranges[count].start = -1;
+        wp->ranges[count].end = size;
+        wp->currentRange = 0;
+        wp->docPos = wp->docEnd = 0;
+    }
+    return count;
+}
+
+
+/*
+    Format the multipart header preceding a range. Returns the header length.
+ */
+static ssize partHeader(Webs *wp, WebsRange *rp, char *buf, ssize size)
+{
+    WebsRange   *last;
+    cchar       *mimeType;
+
+    for (last = rp; last->start >= 0; last++) ;
+    if ((mimeType = websGetMimeType(wp->ext)) == 0) {
+        mimeType = "application/octet-stream";
+    }
+    fmt(buf, size, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: bytes %Ld-%Ld/%Ld\r\n\r\n",
+        rangeBoundary, mimeType, rp->start, rp->end - 1, last->end);
+    return slen(buf);
+}
+
+
+/*
+    Advance to the next range of a multipart response and buffer its part header. After the last range, the closing
+    boundary is buffered and false is returned.
+ */
+static bool nextRange(Webs *wp)
+{
+    WebsRange   *rp;
+    char        header[160];
+
+    if ((rp = wp->currentRange) != NULL && rp->start < 0) {
+        return 0;
+    }
+    rp = wp->currentRange = rp ? rp + 1 : wp->ranges;
+    if (rp->start < 0) {
+        fmt(header, sizeof(header), "\r\n--%s--\r\n", rangeBoundary);
+        bufferOutput(wp, header, slen(header));
+        return 0;
+    }
+    if (!bufferOutput(wp, header, partHeader(wp, rp, header, sizeof(header)))) {
+        return 0;
+    }
+    wp->docPos = rp->start;
+    wp->docEnd = rp->end;
+    websPageSeek(wp, wp->docPos, SEEK_SET);
+    return 1;
+}
+
+
+#if ME_GOAHEAD_COMPRESS
+/*
+    Return a mask of the precompressed variants present for a document
+ */
+static int probeEncodings(cchar *filename)
+{
+    FileEncoding    *ep;
+    WebsFileInfo    info;
+    char            *path;
+    int             mask;
+
+    mask = 0;
+    for (ep = fileEncodings; ep->ext; ep++) {
+        path = sfmt("%s%s", filename, ep->ext);
+        if (websStatFile(path, &info) == 0 && !info.isDir) {
+            mask |= ep->flag;
+        }
+        wfree(path);
+    }
+    return mask;
+}
+
+
+/*
+    Select the preferred precompressed variant accepted by the client and redirect wp->filename to it. The document
+    must not be a directory. Info is its file information if it exists and is not cached, otherwise null. The variants
+    are only probed if the client accepts an encoding. The result is kept in the cache entry for the document.
+    Returns the Content-Encoding name or NULL. Vary is set if the document is known to have variants.
+ */
+static cchar *selectEncoding(Webs *wp, WebsFileInfo *info, bool *vary)
+{
+    FileEncoding    *ep;
+    char            *tmp;
+    int             available;
+#if FILE_CACHE
+    FileEntry       *fp;
+
+    available = ((fp = cacheLookup(wp->filename)) != NULL) ? fp->encodings : -1;
+#else
+    available = -1;
+#endif
+    if (available < 0) {
+        if (!(wp->acceptEncoding & (WEBS_ENCODE_BR | WEBS_ENCODE_GZIP))) {
+            *vary = 0;
+            return 0;
+        }
+        available = probeEncodings(wp->filename);
+#if FILE_CACHE
+        if (fp || (info && (fp = cacheAdd(wp, info)) != NULL)) {
+            fp->encodings = available;
+        }
+#endif
+    }
+    *vary = available ? 1 : 0;
+    for (ep = fileEncodings; ep->ext; ep++) {
+        if (available & wp->acceptEncoding & ep->flag) {
+            tmp = sfmt("%s%s", wp->filename, ep->ext);
+            wfree(wp->filename);
+            wp->filename = tmp;
+            return ep->name;
+        }
+    }
+    return 0;
+}
+#endif
+
+
+#if FILE_CACHE
+/*
+    Move an entry to the head of the LRU list
+ */
+static void cacheLink(FileEntry *fp)
+{
+    fp->prev = 0;
+    fp->next = cacheHead;
+    if (cacheHead) {
+        cacheHead->prev = fp;
+    }
+    cacheHead = fp;
+    if (!cacheTail) {
+        cacheTail = fp;
+    }
+}
+
+
+static void cacheUnlink(FileEntry *fp)
+{
+    if (fp->prev) {
+        fp->prev->next = fp->next;
+    } else {
+        cacheHead = fp->next;
+    }
+    if (fp->next) {
+        fp->next->prev = fp->prev;
+    } else {
+        cacheTail = fp->prev;
+    }
+    fp->prev = fp->next = 0;
+}
+
+
+static void cacheRemove(FileEntry *fp)
+{
+    assert(fp);
+
+    cacheUnlink(fp);
+    hashDelete(fileCache, fp->filename);
+    cacheSize -= fp->cost;
+    wfree(fp->filename);
+    wfree(fp->modified);
+    wfree(fp->body);
+    wfree(fp);
 }
 
 
+#if !ME_ROM
+static void cacheRemoveFile(cchar *filename)
+{
+    WebsKey     *key;
+
+    if (fileCache >= 0 && (key = hashLookup(fileCache, filename)) != NULL) {
+        cacheRemove(key->content.value.symbol);
+    }
+}
+#endif
+
+
+/*
+    Find a valid cache entry for a file. Entries are revalidated against the file system at most every
+    ME_GOAHEAD_CACHE_REVALIDATE seconds and discarded if the file has been modified or removed.
+ */
+static FileEntry *cacheLookup(cchar *filename)
+{
+    WebsKey         *key;
+    FileEntry       *fp;
+    WebsFileInfo    info;
+    Ticks           now;
+
+    if (fileCache < 0 || (key = hashLookup(fileCache, filename)) == NULL) {
+        return 0;
+    }
+    fp = key->content.value.symbol;
+    now = websGetTicks();
+    if ((now - fp->checked) >= ME_GOAHEAD_CACHE_REVALIDATE * 1000) {
+        if (websStatFile(filename, &info) < 0 || info.isDir || info.size != fp->info.size ||
+                info.mtime != fp->info.mtime) {
+            cacheRemove(fp);
+            return 0;
+        }
+        fp->checked = now;
+#if ME_GOAHEAD_COMPRESS
+        fp->encodings = -1;
+#endif
+    }
+    if (fp != cacheHead) {
+        cacheUnlink(fp);
+        cacheLink(fp);
+    }
+    return fp;
+}
+
+
+/*
+    Read the entire document into memory. The document is open on wp->docfd.
+ */
+static char *cacheReadBody(Webs *wp, ssize size)
+{
+    char    *body;
+    ssize   len, nbytes;
+
+    if ((body = walloc(size)) == NULL) {
+        return 0;
+    }
+    for (len = 0; len < size; len += nbytes) {
+        if ((nbytes = websPageReadData(wp, &body[len], size - len)) <= 0) {
+            wfree(body);
+            return 0;
+        }
+    }
+    return body;
+}
+
+
+/*
+    Get the cache memory budget. If the allocator has a fixed pool that cannot grow via malloc, cached documents may
+    use no more than a quarter of the pool so they cannot starve connections of memory.
+ */
+static ssize cacheBudget()
+{
+#if ME_GOAHEAD_REPLACE_MALLOC
+    ssize   pool;
+
+    if ((pool = wallocLimit()) > 0) {
+        return min(cacheMax, pool / 4);
+    }
+#endif
+    return cacheMax;
+}
+
+
+/*
+    Evict least recently used entries other than the given entry to keep within the budget
+ */
+static void cacheTrim(FileEntry *keep)
+{
+    ssize   budget;
+
+    budget = cacheBudget();
+    while (cacheSize > budget && cacheTail && cacheTail != keep) {
+        cacheRemove(cacheTail);
+    }
+}
+
+
+/*
+    Read the body of a small document that was cached without one. The document is open on wp->docfd and is closed
+    if the body is read.
+ */
+static void cacheLoadBody(Webs *wp, FileEntry *fp)
+{
+    ssize   size;
+
+    size = (ssize) fp->info.size;
+    if (size <= 0 || size > cacheItemMax) {
+        return;
+    }
+    if ((fp->body = cacheReadBody(wp, size)) == NULL) {
+        websPageSeek(wp, 0, SEEK_SET);
+        return;
+    }
+    fp->cost += size;
+    cacheSize += size;
+    websPageClose(wp);
+    cacheTrim(fp);
+}
+
+
+/*
+    Add a cache entry for the document. If the document is open on wp->docfd, small documents are read into memory
+    so subsequent requests do not touch the file system. Least recently used entries are evicted to keep within the
+    budget.
+ */
+static FileEntry *cacheAdd(Webs *wp, WebsFileInfo *info)
+{
+    WebsKey     *key;
+    FileEntry   *fp;
+    ssize       budget, size;
+
+    size = (ssize) info->size;
+    budget = cacheBudget();
+    if (info->isDir || budget <= 0 || size > budget) {
+        return 0;
+    }
+    if (fileCache < 0 && (fileCache = hashCreate(WEBS_SMALL_HASH)) < 0) {
+        return 0;
+    }
+    if ((key = hashLookup(fileCache, wp->filename)) != NULL) {
+        cacheRemove(key->content.value.symbol);
+    }
+    if ((fp = walloc(sizeof(FileEntry))) == NULL) {
+        return 0;
+    }
+    memset(fp, 0, sizeof(FileEntry));
+    fp->filename = sclone(wp->filename);
+    fp->modified = websGetDateString(info);
+    fp->info = *info;
+    fp->checked = websGetTicks();
+#if ME_GOAHEAD_COMPRESS
+    fp->encodings = -1;
+#endif
+    fp->cost = sizeof(FileEntry) + slen(fp->filename) + slen(fp->modified);
+    if (wp->docfd >= 0 && size > 0 && size <= cacheItemMax) {
+        if ((fp->body = cacheReadBody(wp, size)) != NULL) {
+            fp->cost += size;
+        } else {
+            /* Fall back to streaming the file */
+            websPageSeek(wp, 0, SEEK_SET);
+        }
+    }
+    if (fp->modified == NULL || hashEnter(fileCache, fp->filename, valueSymbol(fp), 0) == NULL) {
+        wfree(fp->filename);
+        wfree(fp->modified);
+        wfree(fp->body);
+        wfree(fp);
+        return 0;
+    }
+    cacheLink(fp);
+    cacheSize += fp->cost;
+    cacheTrim(fp);
+    return fp;
+}
+
+
+/*
+    Write the response headers and cached document body. The headers and body are written with a single vectored
+    write. Any unwritten portion is copied to the output buffer and drained via the normal writable event.
+ */
+static void sendCachedBody(Webs *wp, cchar *body, ssize len)
+{
+    if (websSendBlock(wp, body, len) < 0 && wp->state < WEBS_COMPLETE) {
+        websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "Cannot get memory");
+        return;
+    }
+    websDone(wp);
+}
+#endif /* FILE_CACHE */
+
+
 #if !ME_ROM
 PUBLIC bool websProcessPutData(Webs *wp)
 {
@@ -169,6 +985,15 @@ PUBLIC bool websProcessPutData(Webs *wp)
 
 static void fileClose()
 {
+#if FILE_CACHE
+    while (cacheHead) {
+        cacheRemove(cacheHead);
+    }
+    if (fileCache >= 0) {
+        hashFree(fileCache);
+        fileCache = -1;
+    }
+#endif
     wfree(websIndex);
     websIndex = NULL;
     wfree(websDocuments);
@@ -178,7 +1003,16 @@ static void fileClose()
 
 PUBLIC void websFileOpen()
 {
+    char    bytes[16];
+    int     i;
+
     websIndex = sclone("index.html");
+    if (websGetRandomBytes(bytes, sizeof(bytes), 0) < 0) {
+        fmt(bytes, sizeof(bytes), "%x%x", (int) time(0), (int) websGetTicks());
+    }
+    for (i = 0; i < (int) sizeof(bytes); i++) {
+        fmt(&rangeBoundary[i * 2], 3, "%02x", (uchar) bytes[i]);
+    }
     websDefineHandler("file", 0, fileHandler, fileClose, 0);
 }
 
@@ -224,6 +1058,20 @@ PUBLIC void websSetDocuments(cchar *dir)
     websDocuments = sclone(dir);
 }
 
+
+PUBLIC void websSetFileCache(ssize size, ssize itemSize)
+{
+#if FILE_CACHE
+    if (size >= 0) {
+        cacheMax = size;
+    }
+    if (itemSize >= 0) {
+        cacheItemMax = itemSize;
+    }
+    cacheTrim(0);
+#endif
+}
+
 /*
     Copyright (c) Embedthis Software. All Rights Reserved.
     This software is distributed under commercial and open source licenses.
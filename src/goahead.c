@@ -10,6 +10,7 @@
         --route routeFile      # Route configuration file
         --verbose              # Same as --log stdout:2
         --version              # Output version information
+        --workers count        # Number of worker processes
 
     Copyright (c) All Rights Reserved. See details at the end of the file.
  */
@@ -35,6 +36,7 @@ static LRESULT CALLBACK websWindProc(HWND hwnd, UINT msg, UINT wp, LPARAM lp);
 #endif
 
 #if ME_UNIX_LIKE
+static void hupHandler(int signo);
 static void sigHandler(int signo);
 #endif
 
@@ -91,6 +93,12 @@ MAIN(goahead, int argc, char **argv, char **envp)
             printf("%s\n", ME_VERSION);
             exit(0);
 
+#if ME_UNIX_LIKE
+        } else if (smatch(argp, "--workers") || smatch(argp, "-w")) {
+            if (argind >= argc) usage();
+            websSetWorkers(atoi(argv[++argind]));
+#endif
+
         } else if (*argp == '-' && isdigit((uchar) argp[1])) {
             lspec = sfmt("stdout:%s", &argp[1]);
             logSetPath(lspec);
@@ -211,7 +219,11 @@ static void usage() {
         "    --log logFile:level    # Log to file file at verbosity level\n"
         "    --route routeFile      # Route configuration file\n"
         "    --verbose              # Same as --log stdout:2\n"
-        "    --version              # Output version information\n\n",
+        "    --version              # Output version information\n"
+#if ME_UNIX_LIKE
+        "    --workers count        # Number of worker processes\n"
+#endif
+        "\n",
         ME_TITLE, ME_NAME);
     exit(-1);
 }
@@ -221,6 +233,7 @@ static void initPlatform()
 {
 #if ME_UNIX_LIKE
     signal(SIGTERM, sigHandler);
+    signal(SIGHUP, hupHandler);
     #ifdef SIGPIPE
         signal(SIGPIPE, SIG_IGN);
     #endif
@@ -235,6 +248,15 @@ static void sigHandler(int signo)
 {
     finished = 1;
 }
+
+
+/*
+    Reopen the access log after it has been renamed by an external log rotation program
+ */
+static void hupHandler(int signo)
+{
+    websReopenAccessLog();
+}
 #endif
 
 
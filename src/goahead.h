@@ -34,6 +34,78 @@ extern "C" {
 #ifndef ME_GOAHEAD_TRACING
     #define ME_GOAHEAD_TRACING 1                /**< Default for tracing "on" */
 #endif
+#ifndef ME_GOAHEAD_ACCESS_LOG_FORMAT
+    #define ME_GOAHEAD_ACCESS_LOG_FORMAT "common" /**< Access log format: common, combined or json */
+#endif
+#ifndef ME_GOAHEAD_ACCESS_LOG_SIZE
+    #define ME_GOAHEAD_ACCESS_LOG_SIZE 0        /**< Access log size in bytes that triggers rotation. Zero to disable */
+#endif
+#ifndef ME_GOAHEAD_ACCESS_LOG_BACKUPS
+    #define ME_GOAHEAD_ACCESS_LOG_BACKUPS 4     /**< Number of rotated access logs to keep */
+#endif
+#ifndef ME_GOAHEAD_ACCESS_LOG_BUFFER
+    #define ME_GOAHEAD_ACCESS_LOG_BUFFER 16384  /**< Buffered access log bytes that trigger a write */
+#endif
+#ifndef ME_GOAHEAD_ACCESS_LOG_FLUSH
+    #define ME_GOAHEAD_ACCESS_LOG_FLUSH 1000    /**< Maximum msec access log lines are buffered before writing */
+#endif
+#ifndef ME_GOAHEAD_CACHE_SIZE
+    #define ME_GOAHEAD_CACHE_SIZE 524288        /**< File cache memory budget in bytes. Zero to disable */
+#endif
+#ifndef ME_GOAHEAD_CACHE_ITEM_SIZE
+    #define ME_GOAHEAD_CACHE_ITEM_SIZE 65536    /**< Maximum size of a document body held in the file cache */
+#endif
+#ifndef ME_GOAHEAD_CACHE_REVALIDATE
+    #define ME_GOAHEAD_CACHE_REVALIDATE 2       /**< Seconds between file cache revalidation of a document */
+#endif
+#ifndef ME_GOAHEAD_COMPRESS
+    #define ME_GOAHEAD_COMPRESS 1               /**< Serve precompressed .br and .gz documents when accepted */
+#endif
+#ifndef ME_GOAHEAD_DEFLATE
+    #define ME_GOAHEAD_DEFLATE 0                /**< Gzip compress chunked dynamic responses. Requires zlib */
+#endif
+#ifndef ME_GOAHEAD_EPOLL
+    #define ME_GOAHEAD_EPOLL 1                  /**< Use epoll for socket events on Linux. Otherwise select */
+#endif
+#ifndef ME_GOAHEAD_FASTCGI_PROCESSES
+    #define ME_GOAHEAD_FASTCGI_PROCESSES 4      /**< Default maximum FastCGI processes per program */
+#endif
+#ifndef ME_GOAHEAD_FASTCGI_MULTIPLEX
+    #define ME_GOAHEAD_FASTCGI_MULTIPLEX 1      /**< Default maximum concurrent requests per FastCGI process */
+#endif
+#ifndef ME_GOAHEAD_FASTCGI_QUEUE
+    #define ME_GOAHEAD_FASTCGI_QUEUE 64         /**< Default maximum requests waiting for a FastCGI process */
+#endif
+#ifndef ME_GOAHEAD_SESSION_STORE
+    #define ME_GOAHEAD_SESSION_STORE ""         /**< Session store filename. Empty to keep sessions only in memory */
+#endif
+#ifndef ME_GOAHEAD_ACCEPT_BATCH
+    #define ME_GOAHEAD_ACCEPT_BATCH 32          /**< Maximum connections to accept per listener event */
+#endif
+#ifndef ME_GOAHEAD_DEFER_ACCEPT
+    #define ME_GOAHEAD_DEFER_ACCEPT 0           /**< Seconds to defer accept until request data arrives. Zero to disable */
+#endif
+#ifndef ME_GOAHEAD_BUFFER_POOL
+    #define ME_GOAHEAD_BUFFER_POOL 64           /**< Request buffer sets retained for reuse by connections */
+#endif
+#ifndef ME_GOAHEAD_ALLOC_ARENAS
+    #define ME_GOAHEAD_ALLOC_ARENAS 8           /**< Per-thread arenas for the replacement allocator */
+#endif
+#ifndef ME_GOAHEAD_AUTH_CACHE
+    #define ME_GOAHEAD_AUTH_CACHE 64            /**< Verified Basic credentials to cache. Zero to disable */
+#endif
+#ifndef ME_GOAHEAD_AUTH_CACHE_TTL
+    #define ME_GOAHEAD_AUTH_CACHE_TTL 300       /**< Seconds to cache verified credentials */
+#endif
+#ifndef ME_GOAHEAD_METRICS
+    #define ME_GOAHEAD_METRICS 1                /**< Default for runtime metrics and the metrics handler is "on" */
+#endif
+#ifndef ME_GOAHEAD_LIMIT_OUTPUT
+    #define ME_GOAHEAD_LIMIT_OUTPUT 65536       /**< Buffered response output at which streaming handlers pause */
+#endif
+#ifndef ME_GOAHEAD_WORKERS
+    #define ME_GOAHEAD_WORKERS 0                /**< Default number of worker processes. Zero for single process */
+#endif
 #ifndef ME_GOAHEAD_DEBUG
     #if ME_DEBUG
         #define ME_GOAHEAD_DEBUG 1              /**< Debug logging on in debug builds by default */
@@ -41,6 +113,9 @@ extern "C" {
         #define ME_GOAHEAD_DEBUG 0
     #endif
 #endif
+#if ME_GOAHEAD_DEFLATE && !ME_COM_ZLIB
+    #error "Deflate output compression requires zlib. Build with ME_COM_ZLIB=1"
+#endif
 #if ECOS
     #if ME_GOAHEAD_CGI
         #error "Ecos does not support CGI. Disable ME_GOAHEAD_CGI"
@@ -699,6 +774,18 @@ PUBLIC ssize bufPut(WebsBuf *bp, cchar *fmt, ...) PRINTF_ATTRIBUTE(2,3);
  */
 PUBLIC ssize bufPutStr(WebsBuf *bp, cchar *str);
 
+/**
+    Empty the buffer for reuse
+    @description Discard all data and release any storage the buffer has grown beyond its initial size.
+        The maximum size is preserved.
+    @param bp Buffer reference
+    @param initSize Initial buffer size given to bufCreate
+    @return Zero if successful
+    @ingroup WebsBuf
+    @stability Evolving
+ */
+PUBLIC int bufRecycle(WebsBuf *bp, int initSize);
+
 /**
     Reset the buffer pointers to the start of the buffer if empty
     @param bp Buffer reference
@@ -757,6 +844,40 @@ typedef struct WebsAlloc {
 #define WEBS_USER_BUF          0x2             /* User supplied buffer for mem */
 #define WEBS_INTEGRITY         0x8124000       /* Integrity value */
 #define WEBS_INTEGRITY_MASK    0xFFFF000       /* Integrity mask */
+
+/**
+    Allocator statistics for a memory block class
+    @ingroup WebsAlloc
+    @stability Evolving
+ */
+typedef struct WebsAllocStats {
+    int64       allocated;                      /**< Blocks currently allocated */
+    int64       free;                           /**< Blocks on the free queues available for reuse */
+    int64       peak;                           /**< Peak allocated blocks. Summed over the per-thread arenas */
+    int64       bytes;                          /**< Bytes currently allocated including block headers */
+} WebsAllocStats;
+
+/**
+    Get the allocator statistics for a memory block class
+    @description Statistics are kept by each per-thread arena and summed. Each counter is read atomically, but the
+        sum may be inexact while other threads are allocating.
+    @param cls Block class from zero to WEBS_MAX_CLASS - 1. Set to WEBS_MAX_CLASS for blocks larger than the largest
+        class that are allocated via malloc.
+    @param stats Structure to receive the statistics
+    @return Zero if successful. Otherwise -1 for an invalid class.
+    @ingroup WebsAlloc
+    @stability Evolving
+ */
+PUBLIC int wallocStats(int cls, WebsAllocStats *stats);
+
+/**
+    Get the memory limit of the allocator
+    @return The size of the allocator pool if the allocator cannot grow via malloc. Otherwise zero if memory is
+        not limited by the allocator.
+    @ingroup WebsAlloc
+    @stability Evolving
+ */
+PUBLIC ssize wallocLimit();
 #endif /* ME_GOAHEAD_REPLACE_MALLOC */
 
 /**
@@ -811,6 +932,18 @@ PUBLIC void wfree(void *blk);
  */
 PUBLIC void *wrealloc(void *blk, ssize newsize);
 
+#if ME_GOAHEAD_REPLACE_MALLOC && ME_GOAHEAD_METRICS
+/**
+    Get the number of allocated blocks in a memory block class
+    @param cls Block class from zero to WEBS_MAX_CLASS - 1. Set to WEBS_MAX_CLASS for blocks larger than the largest
+        class that are allocated via malloc.
+    @return Count of blocks currently allocated
+    @ingroup WebsAlloc
+    @stability Evolving
+ */
+PUBLIC int64 wallocCount(int cls);
+#endif
+
 /**
     Duplicate memory
     @param ptr Original block reference
@@ -850,8 +983,10 @@ PUBLIC char  *awtom(wchar *src, ssize *len);
 /**
     Hash table entry structure.
     @description The hash structure supports growable hash tables with high performance, collision resistant hashes.
-    Each hash entry has a descriptor entry. This is used to manage the hash table link chains.
-    @see hashCreate hashFree hashLookup hashEnter hashDelete hashWalk hashFirst hashNext
+    Each hash entry has a descriptor entry. This is used to manage the hash table link chains. The key name is stored
+    inline after the descriptor and the table index doubles as entries are added. Entry addresses are stable until the
+    entry is deleted. Entries added while walking the table with hashFirst and hashNext may or may not be visited.
+    @see hashClear hashCreate hashFree hashLookup hashEnter hashDelete hashWalk hashFirst hashNext
     @defgroup WebsHash WebsHash
     @stability Stable
  */
@@ -861,6 +996,9 @@ typedef struct WebsKey {
     WebsValue       content;                /* Value of symbol */
     int             arg;                    /* Parameter value */
     int             bucket;                 /* Bucket index */
+    uint            hash;                   /* Hash of the name */
+    struct WebsKey  *next;                  /* Next symbol in insertion order for hashNext */
+    struct WebsKey  *prev;                  /* Prior symbol in insertion order */
 } WebsKey;
 
 /**
@@ -868,9 +1006,17 @@ typedef struct WebsKey {
  */
 typedef int WebsHash;                       /* Returned by symCreate */
 
+/**
+    Callback to populate a hash table on demand
+    @param data Data argument supplied to hashSetFill
+    @ingroup WebsHash
+    @stability Evolving
+ */
+typedef void (*WebsHashFill)(void *data);
+
 /**
     Create a hash table
-    @param size Minimum size of the hash index
+    @param size Initial size of the hash index. The index grows as keys are added. Set to -1 for a default size.
     @return Hash table ID. Negative if the hash cannot be created.
     @ingroup WebsHash
     @stability Stable
@@ -885,6 +1031,29 @@ PUBLIC WebsHash hashCreate(int size);
  */
 PUBLIC void hashFree(WebsHash id);
 
+/**
+    Remove all entries from a hash table
+    @description The hash index is retained so the table can be refilled without reallocating it. An index that has
+        grown beyond its initial size is shrunk back to that size.
+    @param id Hash table id returned by hashCreate
+    @ingroup WebsHash
+    @stability Evolving
+ */
+PUBLIC void hashClear(WebsHash id);
+
+/**
+    Define a callback to populate a hash table on demand
+    @description The callback is invoked once, before the table is first walked with hashFirst, and may add entries.
+        This permits entries that are costly to create to be added only when required. The callback is removed when
+        it is invoked or when the table is cleared.
+    @param id Hash table id returned by hashCreate
+    @param fill Callback procedure. Set to null to remove a callback.
+    @param data Data argument to pass to the callback
+    @ingroup WebsHash
+    @stability Evolving
+ */
+PUBLIC void hashSetFill(WebsHash id, WebsHashFill fill, void *data);
+
 /**
     Lookup a name in the hash table
     @param id Hash table id returned by hashCreate
@@ -962,6 +1131,9 @@ PUBLIC WebsKey *hashNext(WebsHash id, WebsKey *last);
 #define SOCKET_BUFFERED_READ    0x200   /**< Message pending on this socket */
 #define SOCKET_BUFFERED_WRITE   0x400   /**< Message pending on this socket */
 #define SOCKET_NODELAY          0x800   /**< Disable Nagle algorithm */
+#define SOCKET_REUSEPORT        0x1000  /**< Permit multiple listeners on the same endpoint */
+#define SOCKET_PIPE             0x2000  /**< Descriptor is a pipe, not a network socket */
+#define SOCKET_LINGER           0x4000  /**< Socket is half-closed and draining before close */
 
 #define SOCKET_PORT_MAX         0xffff  /**< Max Port size */
 
@@ -1008,13 +1180,28 @@ typedef void (*SocketHandler)(int sid, int mask, void *data);
  */
 typedef int (*SocketAccept)(int sid, cchar *ipaddr, int port, int listenSid);
 
+/**
+    I/O vector element for scatter-gather writes via socketWritev
+    @description On Unix systems this is the native struct iovec so vectors can be passed directly to writev.
+    @ingroup WebsSocket
+    @stability Evolving
+ */
+#if ME_UNIX_LIKE
+typedef struct iovec WebsIovec;
+#else
+typedef struct WebsIovec {
+    void    *iov_base;                  /**< Start of the data */
+    size_t  iov_len;                    /**< Length of the data */
+} WebsIovec;
+#endif
+
 /**
     Socket control structure
     @see socketAddress socketAddressIsV6 socketClose socketCloseConnection socketCreateHandler
     socketDeletehandler socketReservice socketEof socketGetPort socketInfo socketIsV6
-    socketOpen socketListen socketParseAddress socketProcess socketRead socketWrite socketWriteString
+    socketOpen socketListen socketParseAddress socketProcess socketRead socketWrite socketWritev socketWriteString
     socketSelect socketGetHandle socketSetBlock socketGetBlock socketAlloc socketFree socketGetError
-    socketSetError socketPtr socketWaitForEvent socketRegisterInterest
+    socketSetError socketPtr socketWaitForEvent socketRegisterInterest socketAttach
     @defgroup WebsSocket WebsSocket
     @stability Stable
  */
@@ -1037,6 +1224,7 @@ typedef struct WebsSocket {
     int             error;              /**< Last error */
     int             secure;             /**< Socket is using SSL */
     int             handshakes;         /**< Number of renegotiations */
+    int             lingerEvent;        /**< Event to close a lingering socket */
 } WebsSocket;
 
 
@@ -1074,6 +1262,17 @@ PUBLIC bool socketAddressIsV6(cchar *ip);
  */
 PUBLIC int socketAlloc(cchar *host, int port, SocketAccept accept, int flags);
 
+/**
+    Allocate a socket object for an existing descriptor
+    @description This permits non-socket descriptors such as pipes to be serviced by the socket event loop.
+        The descriptor is put into non-blocking mode and is closed by socketFree.
+    @param fd Open file descriptor
+    @return Socket ID handle to use with other APIs.
+    @ingroup WebsSocket
+    @stability Evolving
+ */
+PUBLIC int socketAttach(Socket fd);
+
 /**
     Close the socket module
     @ingroup WebsSocket
@@ -1313,6 +1512,16 @@ PUBLIC void socketRegisterInterest(int sid, int mask);
  */
 PUBLIC void socketReservice(int sid);
 
+/**
+    Recreate the socket event notification set.
+    @description This must be called in a child process after fork so that the parent and child do not share
+        the kernel event set. All current socket interests are re-registered.
+    @ingroup WebsSocket
+    @stability Evolving
+    @internal
+ */
+PUBLIC void socketRestartEvents();
+
 /**
     Wait for I/O on a socket
     @description This call uses the mask of events of interest defined by socketRegisterInterest. It blocks the caller
@@ -1377,6 +1586,21 @@ PUBLIC int socketWaitForEvent(WebsSocket *sp, int mask);
  */
 PUBLIC ssize socketWrite(int sid, void *buf, ssize len);
 
+/**
+    Write a vector of buffers to the socket
+    @description Gathers the buffers into a single writev system call where supported. Otherwise the buffers are
+        written in order until the socket will not accept more data.
+    @param sid Socket ID handle returned from socketConnect or socketAccept.
+    @param iov Array of I/O vector elements
+    @param count Number of elements in iov
+    @return Count of bytes written. May be less than the total length if the socket is in non-blocking mode.
+        Returns a negative error code for errors. If the transport is saturated, errno will be set to EAGAIN or
+        EWOULDBLOCK.
+    @ingroup WebsSocket
+    @stability Evolving
+ */
+PUBLIC ssize socketWritev(int sid, WebsIovec *iov, int count);
+
 /**
     Return the socket object for the socket ID.
     @param sid Socket ID handle returned from socketConnect or socketAccept.
@@ -1393,7 +1617,7 @@ PUBLIC WebsSocket *socketPtr(int sid);
     @description GoAhead provides a secure runtime environment for safe string manipulation and to
         help prevent buffer overflows and other potential security traps.
     @defgroup WebsRuntime WebsRuntime
-    @see fmt wallocHandle wallocObject wfreeHandle hextoi itosbuf scaselesscmp scaselessmatch
+    @see fmt fmtv wallocHandle wallocObject wfreeHandle hextoi itosbuf scaselesscmp scaselessmatch
         sclone scmp scopy sfmt sfmtv slen slower smatch sstarts sncaselesscmp sncmp sncopy stok strim supper
     @stability Stable
  */
@@ -1412,6 +1636,20 @@ PUBLIC WebsSocket *socketPtr(int sid);
  */
 PUBLIC char *fmt(char *buf, ssize maxSize, cchar *format, ...);
 
+/**
+    Format a string into a static buffer with varargs.
+    @description This call formats a string using printf style formatting arguments. A trailing null will
+        always be appended. Output that does not fit in the buffer is truncated.
+    @param buf Pointer to the buffer.
+    @param maxSize Size of the buffer.
+    @param format Printf style format string
+    @param args Varargs argument obtained from va_start.
+    @return Returns the buffer.
+    @ingroup WebsRuntime
+    @stability Evolving
+ */
+PUBLIC char *fmtv(char *buf, ssize maxSize, cchar *format, va_list args);
+
 /**
     Allocate a handle from a map
     @param map Reference to a location holding the map reference. On the first call, the map is allocated.
@@ -1726,7 +1964,7 @@ typedef void (*WebsEventProc)(void *data, int id);
 /**
     Start a callback event
     @description This schedules an event to run once. The event can be rescheduled in the callback by invoking
-    websRestartEvent.
+    websRestartEvent. Events are scheduled with millisecond resolution. The event must be freed via websStopEvent.
     @param delay Delay in milliseconds in which to run the callback
     @param proc Callback procedure function. Signature is: void (*fn)(void *data, int id)
     @param data Data reference to pass to the callback
@@ -1762,7 +2000,19 @@ PUBLIC void websRestartEvent(int id, int delay);
  */
 PUBLIC int websRunEvents();
 
+/**
+    Get the elapsed time in milliseconds
+    @description The time is measured from an arbitrary epoch. It is not affected by changes to the system clock on
+        platforms with a monotonic clock, including Windows.
+    @return Time in milliseconds
+    @ingroup WebsRuntime
+    @stability Evolving
+ */
+PUBLIC Ticks websGetTicks();
+
 /* Forward declare */
+struct Cgi;
+struct WebsArena;
 struct WebsRoute;
 struct WebsUser;
 struct WebsSession;
@@ -1813,7 +2063,7 @@ PUBLIC WebsUpload *websLookupUpload(struct Webs *wp, cchar *key);
 
 #define WEBS_MAX_PORT_LEN       16          /* Max digits in port number */
 #define WEBS_HASH_INIT          67          /* Hash size for form table */
-#define WEBS_SESSION_HASH       31          /* Hash size for session stores */
+#define WEBS_SESSION_HASH       32          /* Initial size of the session index */
 #define WEBS_SESSION_PRUNE      (60*1000)   /* Prune sessions every minute */
 
 /*
@@ -1844,6 +2094,16 @@ PUBLIC WebsUpload *websLookupUpload(struct Webs *wp, cchar *key);
 #if ME_GOAHEAD_LEGACY
 #define WEBS_LOCAL              0x8000      /**< Request from local system */
 #endif
+#define WEBS_ENCODED            0x10000     /**< Response has a Content-Encoding header */
+#define WEBS_DEFLATE            0x20000     /**< Compressing chunked output body data */
+#define WEBS_HEADER_VARS        0x40000     /**< HTTP_* request header variables defined */
+#define WEBS_REUSED             0x80000     /**< Connection has serviced a prior request */
+
+/*
+    Content encodings accepted by the client. See Webs.acceptEncoding.
+ */
+#define WEBS_ENCODE_GZIP        0x1         /**< Client accepts gzip content encoding */
+#define WEBS_ENCODE_BR          0x2         /**< Client accepts brotli content encoding */
 
 /*
     Incoming chunk encoding states. Used for tx and rx chunking.
@@ -1852,6 +2112,7 @@ PUBLIC WebsUpload *websLookupUpload(struct Webs *wp, cchar *key);
 #define WEBS_CHUNK_START        1           /**< Start of a new chunk */
 #define WEBS_CHUNK_HEADER       2           /**< Preparing tx chunk header */
 #define WEBS_CHUNK_DATA         3           /**< Start of chunk data */
+#define WEBS_CHUNK_TRAILER      4           /**< Writing the final tx chunk trailer */
 
 /*
     Webs state
@@ -1880,8 +2141,39 @@ PUBLIC WebsUpload *websLookupUpload(struct Webs *wp, cchar *key);
  */
 typedef void (*WebsWriteProc)(struct Webs *wp);
 
+/**
+    Byte range of a document requested via the Range header
+    @ingroup Webs
+    @stability Evolving
+ */
+typedef struct WebsRange {
+    Offset          start;              /**< Offset of the first byte. Set to -1 to terminate a range list */
+    Offset          end;                /**< Offset after the last byte */
+} WebsRange;
+
+/**
+    Parsed request header. The key is lower case. Both strings are held in the request arena.
+    @ingroup Webs
+    @stability Evolving
+ */
+typedef struct WebsHeader {
+    char            *key;               /**< Lower case header name */
+    char            *value;             /**< Header value without leading white space */
+} WebsHeader;
+
 /**
     GoAhead request structure. This is a per-socket connection structure.
+    @description The request structure, its buffers and variable table are recycled for each request on a keep-alive
+    connection. The request headers are parsed into the headers array.
+    \n\n
+    The following string fields are held in a per-connection arena that is reset when the request completes:
+    authDetails, authType, contentType, cookie, ext, host, ifNoneMatch, ifRange, method, protoVersion, range, referrer
+    and userAgent. These fields are marked "Arena" below. They are owned by the request and must not be freed or
+    assigned allocated memory. Use websSetRequestString to replace one. Debug builds report an arena field that has
+    been replaced with other memory when the request completes.
+    \n\n
+    The HTTP_* request variables are created when the vars table is first walked or when a HTTP_* variable is first
+    referenced via websGetVar, websTestVar or websSetVar.
     @defgroup Webs Webs
  */
 typedef struct Webs {
@@ -1892,7 +2184,9 @@ typedef struct Webs {
     WebsBuf         *txbuf;
     WebsTime        since;              /**< Parsed if-modified-since time */
     WebsTime        timestamp;          /**< Last transaction with browser */
+    Ticks           started;            /**< Time the request headers were received (msec) */
     WebsHash        vars;               /**< CGI standard variables */
+    struct WebsArena *arena;            /**< Per-connection arena for request header strings */
     int             timeout;            /**< Timeout handle */
     char            ipaddr[ME_MAX_IP];  /**< Connecting ipaddress */
     char            ifaddr[ME_MAX_IP];  /**< Local interface ipaddress */
@@ -1901,6 +2195,9 @@ typedef struct Webs {
     ssize           rxChunkSize;        /**< Rx chunk size */
     char            *rxEndp;            /**< Pointer to end of raw data in input beyond endp */
     ssize           lastRead;           /**< Number of bytes last read from the socket */
+    ssize           rxScanned;          /**< Bytes of rxbuf searched for the end of the headers */
+    WebsHeader      *headers;           /**< Parsed request headers */
+    int             headerCount;        /**< Number of entries in headers */
     bool            eof;                /**< If at the end of the request content */
 
     char            txChunkPrefix[16];  /**< Transmit chunk prefix */
@@ -1908,35 +2205,44 @@ typedef struct Webs {
     ssize           txChunkPrefixLen;   /**< Length of prefix */
     ssize           txChunkLen;         /**< Length of the chunk */
     int             txChunkState;       /**< Transmit chunk state */
+    cchar           *txBody;            /**< Block being written by websSendBlock */
+    ssize           txBodyLen;          /**< Unwritten length of txBody */
+#if ME_GOAHEAD_DEFLATE
+    void            *deflate;           /**< Compression stream for chunked output */
+#endif
 
-    char            *authDetails;       /**< Http header auth details */
+    char            *authDetails;       /**< Http header auth details. Arena */
     char            *authResponse;      /**< Outgoing auth header */
-    char            *authType;          /**< Authorization type (Basic/DAA) */
-    char            *contentType;       /**< Body content type */
-    char            *cookie;            /**< Request cookie string */
+    char            *authType;          /**< Authorization type (Basic/DAA). Arena */
+    char            *contentType;       /**< Body content type. Arena */
+    char            *cookie;            /**< Request cookie string. Arena */
     char            *decodedQuery;      /**< Decoded request query */
     char            *digest;            /**< Password digest */
-    char            *ext;               /**< Path extension */
+    char            *ext;               /**< Path extension. Arena */
     char            *filename;          /**< Document path name */
-    char            *host;              /**< Requested host */
-    char            *method;            /**< HTTP request method */
+    char            *host;              /**< Requested host. Arena */
+    char            *ifNoneMatch;       /**< If-None-Match request header. Arena */
+    char            *ifRange;           /**< If-Range request header. Arena */
+    char            *method;            /**< HTTP request method. Arena */
     char            *password;          /**< Authorization password */
     char            *path;              /**< Path name without query. This is decoded. */
-    char            *protoVersion;      /**< Protocol version (HTTP/1.1)*/
+    char            *protoVersion;      /**< Protocol version (HTTP/1.1). Arena */
     char            *protocol;          /**< Protocol scheme (normally http|https) */
     char            *putname;           /**< PUT temporary filename */
     char            *query;             /**< Request query. This is decoded. */
+    char            *range;             /**< Range request header. Arena */
     char            *realm;             /**< Realm field supplied in auth header */
-    char            *referrer;          /**< The referring page */
+    char            *referrer;          /**< The referring page. Arena */
     char            *responseCookie;    /**< Outgoing cookie */
     char            *url;               /**< Full request url. This is not decoded. */
-    char            *userAgent;         /**< User agent (browser) */
+    char            *userAgent;         /**< User agent (browser). Arena */
     char            *username;          /**< Authorization username */
     int             sid;                /**< Socket id (handler) */
     int             listenSid;          /**< Listen Socket id */
     int             port;               /**< Request port number */
     int             state;              /**< Current state */
     int             flags;              /**< Current flags -- see above */
+    int             acceptEncoding;     /**< Content encodings accepted by the client (WEBS_ENCODE_*) */
     int             code;               /**< Response status code */
     int             routeCount;         /**< Route count limiter */
     ssize           rxLen;              /**< Rx content length */
@@ -1944,13 +2250,18 @@ typedef struct Webs {
     ssize           txLen;              /**< Tx content length header value */
     int             wid;                /**< Index into webs */
 #if ME_GOAHEAD_CGI
-    char            *cgiStdin;          /**< Filename for CGI program input */
+    struct Cgi      *cgi;               /**< Running CGI program (Unix) */
+    char            *cgiStdin;          /**< Filename for CGI program input (when pipes are not supported) */
     int             cgifd;              /**< File handle for CGI program input */
 #endif
 #if !ME_ROM
     int             putfd;              /**< File handle to write PUT data */
 #endif
     int             docfd;              /**< File descriptor for document being served */
+    Offset          docPos;             /**< Position in docfd of the next byte to transmit */
+    Offset          docEnd;             /**< Position in docfd after the last byte to transmit */
+    WebsRange       *ranges;            /**< Ranges for a multipart/byteranges response */
+    WebsRange       *currentRange;      /**< Range currently being transmitted */
     ssize           written;            /**< Bytes actually transferred */
     ssize           putLen;             /**< Bytes read by a PUT request */
 
@@ -2007,6 +2318,23 @@ typedef bool (*WebsHandlerProc)(Webs *wp);
  */
 typedef void (*WebsHandlerClose)();
 
+#if ME_GOAHEAD_METRICS
+#define WEBS_METRIC_BUCKETS 13              /**< Latency histogram buckets including the overflow bucket */
+
+/**
+    Request latency histogram
+    @description Bucket upper bounds are 1, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000 and 10000 milliseconds.
+        The last bucket counts slower requests.
+    @ingroup Webs
+    @stability Evolving
+ */
+typedef struct WebsHistogram {
+    int64               count;              /**< Requests observed */
+    int64               sum;                /**< Total latency in milliseconds */
+    int64               buckets[WEBS_METRIC_BUCKETS];   /**< Requests per bucket (not cumulative) */
+} WebsHistogram;
+#endif
+
 /**
     GoAhead handler object
     @ingroup Webs
@@ -2018,6 +2346,9 @@ typedef struct WebsHandler {
     WebsHandlerProc     service;            /**< Handler service callback */
     WebsHandlerClose    close;              /**< Handler close callback  */
     int                 flags;              /**< Handler control flags */
+#if ME_GOAHEAD_METRICS
+    WebsHistogram       latency;            /**< Latency of requests serviced by the handler */
+#endif
 } WebsHandler;
 
 /**
@@ -2144,14 +2475,37 @@ PUBLIC int websCgiHandler(Webs *wp);
 
 /**
     Poll for output from CGI processes and output.
+    @description On Unix, CGI programs are connected via pipes that are serviced by the socket event loop and this
+        routine has nothing to poll.
     @return Time delay till next poll
     @ingroup Webs
     @stability Stable
  */
 PUBLIC int websCgiPoll();
 
+/**
+    Start the CGI program for a request before the request body is received
+    @description On Unix, this permits the body to be streamed to the program's standard input as it arrives.
+        Otherwise, a temporary file is created to receive the body.
+    @param wp Webs request object
+    @return Zero if successful. Otherwise -1 and an error response has been created.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC int websCgiStart(Webs *wp);
+
+/**
+    Release the CGI resources of a request
+    @description If the CGI program is still running, it is detached from the request and reaped when it exits.
+    @param wp Webs request object
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC void websCgiCleanup(Webs *wp);
+
 /* Internal */
 PUBLIC bool cgiHandler(Webs *wp);
+PUBLIC bool fastcgiHandler(Webs *wp);
 
 #endif /* ME_GOAHEAD_CGI */
 
@@ -2240,6 +2594,26 @@ PUBLIC void websDecodeUrl(char *decoded, char *input, ssize len);
  */
 PUBLIC int websDefineHandler(cchar *name, WebsHandlerProc match, WebsHandlerProc service, WebsHandlerClose close, int flags);
 
+#if ME_GOAHEAD_METRICS
+#define WEBS_METRIC_COUNTER 0               /**< Metric value only increases */
+#define WEBS_METRIC_GAUGE   1               /**< Metric value may go up and down */
+
+/**
+    Define an application metric
+    @description The metric value is reported by the "metrics" handler along with the built-in server metrics.
+        The caller owns the value and updates it directly, so recording a metric costs a single increment.
+        Requires ME_GOAHEAD_METRICS.
+    @param name Metric name. Should be a valid Prometheus metric name such as "myapp_orders_total".
+    @param help Description of the metric
+    @param type Set to WEBS_METRIC_COUNTER or WEBS_METRIC_GAUGE
+    @param value Reference to the metric value. This must remain valid until websClose.
+    @return Zero if successful, otherwise -1.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC int websDefineMetric(cchar *name, cchar *help, int type, int64 *value);
+#endif
+
 /**
     Complete a request.
     @description A handler should call websDone() to complete the request.
@@ -2361,6 +2735,7 @@ PUBLIC cchar *websGetCookie(Webs *wp);
 /**
     Get a date as a string
     @description If sbuf is supplied, it is used to calculate the date. Otherwise, the current time is used.
+        The date is formatted as an RFC 7231 IMF-fixdate.
     @param sbuf File info object
     @return An allocated date string. Caller should free.
     @ingroup Webs
@@ -2425,6 +2800,17 @@ PUBLIC cchar *websGetExt(Webs *wp);
  */
 PUBLIC cchar *websGetFilename(Webs *wp);
 
+/**
+    Get a request header value
+    @param wp Webs request object
+    @param key Header name. This is case insensitive.
+    @return Header value or null if the header is not present. If the header is repeated, the first value is
+        returned. Caller should not free.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC cchar *websGetHeader(Webs *wp, cchar *key);
+
 /**
     Get the request host
     @description The request host is set to the Host HTTP header value if it is present. Otherwise it is set to
@@ -2454,6 +2840,15 @@ PUBLIC cchar *websGetIfaddr(Webs *wp);
  */
 PUBLIC cchar *websGetIndex();
 
+/**
+    Get the mime type for a filename extension
+    @param ext Filename extension including the leading period. For example: ".html".
+    @return Mime type string or NULL if the extension is unknown. Caller should not free.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC cchar *websGetMimeType(cchar *ext);
+
 /**
     Get the request method
     @param wp Webs request object
@@ -2574,6 +2969,16 @@ PUBLIC cchar *websGetUserAgent(Webs *wp);
  */
 PUBLIC cchar *websGetUsername(Webs *wp);
 
+/**
+    Get the worker process index
+    @description When running with multiple worker processes via websSetWorkers, each worker is assigned an index
+        from zero to the number of workers less one.
+    @return The worker index. Returns -1 if not running as a worker process.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC int websGetWorker();
+
 /**
     Get a request variable
     @description Request variables are defined for HTTP headers of the form HTTP_*.
@@ -2637,6 +3042,17 @@ PUBLIC char *websNormalizeUriPath(cchar *path);
  */
 PUBLIC void websNoteRequestActivity(Webs *wp);
 
+/**
+    Account for response data written to the client.
+    @description This updates the request byte count and the server sent bytes metric and notes request activity.
+        Handlers that write directly to the socket should call this after each successful write.
+    @param wp Webs request object
+    @param written Number of bytes written
+    @ingroup Webs
+    @stability Prototype
+ */
+PUBLIC void websNoteWritten(Webs *wp, ssize written);
+
 /**
     Close the runtime code.
     @description Called from websClose
@@ -2704,6 +3120,20 @@ PUBLIC int websOpenFile(cchar *path, int flags, int mode);
  */
 PUBLIC int websOptionsOpen();
 
+#if ME_GOAHEAD_METRICS
+/**
+    Open the metrics handler
+    @description The "metrics" handler reports request, connection, byte, response code, session, CGI and memory
+        counters with per-route and per-handler latency histograms. The response is in the Prometheus text exposition
+        format, or JSON if the request query includes "format=json". Mount it via route.txt with a route such as
+        "route uri=/metrics handler=metrics" and restrict access with the route abilities.
+    @return Zero if successful, otherwise -1.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC int websMetricsOpen();
+#endif
+
 /**
     Close the document page
     @param wp Webs request object
@@ -2839,6 +3269,16 @@ PUBLIC void websRedirect(Webs *wp, cchar *url);
  */
 PUBLIC int websRedirectByStatus(Webs *wp, int status);
 
+/**
+    Reopen the access log
+    @description Requests that the access log be closed and reopened before the next buffered lines are written.
+        Use after an external program has renamed the log. This routine only sets a flag and is safe to invoke from
+        a signal handler. The GoAhead program invokes it on SIGHUP.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC void websReopenAccessLog(void);
+
 /**
     Create and send a request response
     @description This creates a response for the current request using the specified HTTP status code and
@@ -2919,6 +3359,25 @@ PUBLIC int websServer(cchar *endpoint, cchar *documents);
  */
 PUBLIC void websServiceEvents(int *finished);
 
+/**
+    Configure the access log
+    @description Request access log lines are buffered in memory and written when the buffer fills or after
+        ME_GOAHEAD_ACCESS_LOG_FLUSH milliseconds. This may be called before or after websOpen. If the log is already
+        open, it is reopened with the new settings before the next write. If the log cannot be opened or written,
+        lines are retained in memory up to a limit and the log is reopened on the next timed flush or
+        websReopenAccessLog. Requires ME_GOAHEAD_ACCESS_LOG.
+    @param path Log filename. Set to NULL to retain the current filename. Defaults to "access.log".
+    @param format Log line format. Set to "common" for the Common Log Format, "combined" to add the referrer and user
+        agent, or "json" for one JSON object per line including the request latency in milliseconds.
+        Set to NULL to retain the current format.
+    @param maxSize Log size in bytes at which the log is rotated. Set to zero to disable rotation.
+    @param backups Number of rotated logs to keep. Rotated logs are named path.1 (most recent) to path.backups.
+    @return Zero if successful, otherwise -1 if the format is unknown.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC int websSetAccessLog(cchar *path, cchar *format, ssize maxSize, int backups);
+
 /**
     Set the background processing flag
     @param on Value to set the background flag to.
@@ -2929,6 +3388,8 @@ PUBLIC void websSetBackground(int on);
 
 /**
     Define a background write I/O event callback
+    @description The callback is invoked when the socket is writable and all buffered output has been written.
+        Set wp->writeData to null to stop receiving callbacks.
     @param wp Webs request object
     @param proc Write callback
  */
@@ -2981,6 +3442,21 @@ PUBLIC void websSetDocuments(cchar *dir);
  */
 PUBLIC void websSetEnv(Webs *wp);
 
+/**
+    Configure the file handler document cache
+    @description The file handler caches file metadata and the bodies of small documents in memory. Least recently
+        used entries are evicted to keep within the memory budget. If the allocator has a fixed pool (see
+        wallocLimit), the budget is limited to a quarter of the pool. This may also be set via the "cache" directive
+        in the route configuration file. Requires ME_GOAHEAD_CACHE_SIZE to be non-zero.
+    @param size Cache memory budget in bytes. Set to zero to disable caching. Set to -1 to retain the current value.
+        Defaults to ME_GOAHEAD_CACHE_SIZE.
+    @param itemSize Size in bytes of the largest document body to cache. Set to -1 to retain the current value.
+        Defaults to ME_GOAHEAD_CACHE_ITEM_SIZE.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC void websSetFileCache(ssize size, ssize itemSize);
+
 /**
     Create request variables for query and POST body data
     @description This creates request variables if the request is a POST form (has a Content-Type of
@@ -2991,6 +3467,18 @@ PUBLIC void websSetEnv(Webs *wp);
  */
 PUBLIC void websSetFormVars(Webs *wp);
 
+/**
+    Create request variables for the request headers
+    @description This creates a HTTP_* variable for each request header. The variable name is the upper case header
+        name with "-" converted to "_". Repeated headers are joined with ", ". This is done automatically when the
+        request variables are first walked with hashFirst, when a HTTP_* variable is first referenced via websGetVar,
+        websTestVar or websSetVar and by websSetEnv. Calling it again has no effect.
+    @param wp Webs request object
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC void websSetHeaderVars(Webs *wp);
+
 /**
     Define the host name for the server
     @param host String host name
@@ -3034,6 +3522,20 @@ PUBLIC void websSetQueryVars(Webs *wp);
  */
 PUBLIC void websSetStatus(Webs *wp, int status);
 
+/**
+    Replace a request header string
+    @description The method, protoVersion, ext, host and request header string fields of the Webs object are held in
+        the per-request arena and must not be freed or assigned allocated memory. This copies the value into the arena
+        and updates the field. The previous value is reclaimed when the request completes.
+    @param wp Webs request object
+    @param field Address of the Webs string field to update. For example: &wp->host.
+    @param value New value. May be null to clear the field.
+    @return The arena copy of the value assigned to the field. Returns null if value is null or memory is exhausted.
+    @ingroup Webs
+    @stability Prototype
+ */
+PUBLIC char *websSetRequestString(Webs *wp, char **field, cchar *value);
+
 /**
     Set the response body content length
     @param wp Webs request object
@@ -3070,6 +3572,21 @@ PUBLIC WebsKey *websSetVarFmt(Webs *wp, cchar *name, cchar *fmt, ...);
  */
 PUBLIC WebsKey *websSetVar(Webs *wp, cchar *name, cchar *value);
 
+/**
+    Set the number of worker processes
+    @description If set to a non-zero value, websServiceEvents will fork the requested number of worker processes
+        to service requests and the calling process will supervise the workers, restarting any that exit unexpectedly.
+        Where supported, each worker listens on the endpoints using SO_REUSEPORT so the kernel distributes new
+        connections across the workers. Otherwise, the workers share the listening sockets.
+        This must be called before websListen. Workers do not share sessions. Each worker maintains its own
+        session store, so clients may need to re-authenticate if routed to a different worker. Use basic or digest
+        authentication which do not depend on sessions, or set count to zero to run in a single process.
+    @param count Number of worker processes. Set to zero to run in a single process.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC void websSetWorkers(int count);
+
 /**
     Test if  a request variable is defined
     @param wp Webs request object
@@ -3133,6 +3650,33 @@ PUBLIC void websTimeClose();
   */
 PUBLIC int websParseDateTime(WebsTime *time, cchar *date, struct tm *defaults);
 
+/**
+    Size of a buffer to hold an HTTP IMF-fixdate including the trailing null
+    @ingroup Webs
+ */
+#define WEBS_HTTP_DATE_SIZE 30
+
+/**
+    Format a time as an HTTP date
+    @description Formats the time using the RFC 7231 IMF-fixdate format. For example: "Sun, 06 Nov 1994 08:49:37 GMT".
+    @param buf Buffer to receive the date. Must be at least WEBS_HTTP_DATE_SIZE bytes.
+    @param size Size of buf
+    @param when Time to format
+    @return The length of the formatted date, or -1 if the buffer is too small.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC ssize websFormatHttpDate(char *buf, ssize size, WebsTime when);
+
+/**
+    Get the current time as an HTTP date
+    @description The date is formatted as an IMF-fixdate at most once per second and cached.
+    @return A shared date string. Caller must not free. The string is only valid until the next call.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC cchar *websGetHttpDate(void);
+
 /**
     Parse a URL into its components
     @param url URL to parse
@@ -3226,7 +3770,7 @@ PUBLIC int websWriteHeader(Webs *wp, cchar *key, cchar *fmt, ...);
 /**
     Write data to the response
     @description The data is buffered and will be sent to the client when the buffer is full or websFlush is
-        called.
+        called. Like #websWriteBlock, this never blocks and always buffers all the data.
     @param wp Webs request object
     @param fmt Printf style format string.
     @param ... Arguments to the format string.
@@ -3247,10 +3791,24 @@ PUBLIC ssize websWrite(Webs *wp, cchar *fmt, ...);
  */
 PUBLIC ssize websWriteFile(int fd, cchar *buf, ssize size);
 
+/**
+    Test if the response output buffer has reached the high-water mark
+    @description Response output is buffered without blocking. When the buffered output reaches the mark,
+        websStreamBlock accepts no more data. Handlers that stream output from another source should stop producing
+        output when this returns true and resume from a background writer (see #websSetBackgroundWriter) that is
+        invoked when the buffered output has drained. The mark is defined by ME_GOAHEAD_LIMIT_OUTPUT.
+    @param wp Webs request object
+    @return True if the buffered output is at or above the high-water mark
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC bool websOutputFull(Webs *wp);
+
 /**
     Write a block of data to the response
     @description The data is buffered and will be sent to the client when the buffer is full or websFlush is
-        called. This routine will never return "short", it will always write all the data unless there are errors.
+        called. This routine never blocks and will never return "short", it will always write all the data unless
+        there are errors. Handlers that stream output from another source should use #websStreamBlock.
     @param wp Webs request object
     @param buf Buffer of data to write
     @param size Length of buf
@@ -3260,6 +3818,37 @@ PUBLIC ssize websWriteFile(int fd, cchar *buf, ssize size);
  */
 PUBLIC ssize websWriteBlock(Webs *wp, cchar *buf, ssize size);
 
+/**
+    Write a block of streamed data to the response
+    @description This is used by handlers that stream output from another source and can pause, such as the CGI
+        and FastCGI handlers. The data is buffered and written when the socket becomes writable, up to
+        ME_GOAHEAD_LIMIT_OUTPUT. If the client is slow and the buffered output reaches this limit, the write will be
+        short and may accept no data. The caller must retain the remainder and write it from a background writer
+        (see #websSetBackgroundWriter) once the client has drained the response. This routine never blocks.
+    @param wp Webs request object
+    @param buf Buffer of data to write
+    @param size Length of buf
+    @return Count of bytes written or -1. This may be less than size if the client is slow.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC ssize websStreamBlock(Webs *wp, cchar *buf, ssize size);
+
+/**
+    Send a block of memory as the response body
+    @description This is used by handlers that hold the response body in memory, such as the file handler for
+        cached documents. The buffered output, typically the response headers, and the block are written with a single
+        vectored write. Any remainder the socket does not accept is copied to the output buffer, so the caller may
+        release the block on return. Like #websWriteBlock, the output limit is not applied.
+    @param wp Webs request object
+    @param buf Buffer of data to write
+    @param size Length of buf
+    @return Count of bytes written or buffered or -1 for errors.
+    @ingroup Webs
+    @stability Evolving
+ */
+PUBLIC ssize websSendBlock(Webs *wp, cchar *buf, ssize size);
+
 /**
     Write a block of data to the network
     @description This bypassed output buffering and is the lowest level write.
@@ -3560,6 +4149,15 @@ typedef struct WebsRoute {
     WebsAskLogin    askLogin;               /**< Route path prefix */
     WebsParseAuth   parseAuth;              /**< Parse authentication details callback*/
     WebsVerify      verify;                 /**< Verify password callback */
+#if ME_GOAHEAD_CGI
+    char            *program;               /**< FastCGI program to run for this route */
+    int             processes;              /**< Maximum FastCGI processes for the program */
+    int             multiplex;              /**< Maximum concurrent requests per FastCGI process */
+    int             queue;                  /**< Maximum requests waiting for a FastCGI process */
+#endif
+#if ME_GOAHEAD_METRICS
+    WebsHistogram   latency;                /**< Latency of requests completed on this route */
+#endif
     int             flags;                  /**< Route control flags */
 } WebsRoute;
 
@@ -3582,6 +4180,23 @@ PUBLIC WebsRoute *websAddRoute(cchar *uri, cchar *handler, int pos);
  */
 PUBLIC void websCloseRoute();
 
+/**
+    Get the route table
+    @param count Set to the number of routes
+    @return The list of routes in match order
+    @ingroup WebsRoute
+    @internal
+ */
+PUBLIC WebsRoute **websGetRoutes(int *count);
+
+/**
+    Get the handler table
+    @return Hash of handlers indexed by name. The hash entry values are WebsHandler references.
+    @ingroup WebsRoute
+    @internal
+ */
+PUBLIC WebsHash websGetHandlers();
+
 /**
     Load routing tables from the specified filename
     @param path Route configuration filename
@@ -3647,6 +4262,25 @@ PUBLIC bool websRunRequest(Webs *wp);
 PUBLIC int websSetRouteMatch(WebsRoute *route, cchar *dir, cchar *protocol, WebsHash methods, WebsHash extensions,
         WebsHash abilities, WebsHash redirects);
 
+#if ME_GOAHEAD_CGI
+/**
+    Configure a route to be serviced by a FastCGI program
+    @description Requests for the route are forwarded to a pool of persistent FastCGI processes running the
+        given program. Processes are started on demand and are shared by all routes using the same program.
+        The pool limits are taken from the first route that starts the program.
+    @param route Route to modify
+    @param program FastCGI program path
+    @param processes Maximum number of processes to run. Set to zero for ME_GOAHEAD_FASTCGI_PROCESSES.
+    @param multiplex Maximum concurrent requests per process. Set to zero for ME_GOAHEAD_FASTCGI_MULTIPLEX.
+        Limited to 65535 as FastCGI request IDs are 16 bits.
+    @param queue Maximum requests waiting for a process before responding 503. Set to zero for
+        ME_GOAHEAD_FASTCGI_QUEUE.
+    @ingroup WebsRoute
+    @stability Prototype
+ */
+PUBLIC void websSetRouteFastCgi(WebsRoute *route, cchar *program, int processes, int multiplex, int queue);
+#endif
+
 /**
     Set route authentication scheme
     @param route Route to modify
@@ -3885,15 +4519,37 @@ PUBLIC bool websVerifyPasswordFromPam(Webs *wp);
 
 #endif /* ME_GOAHEAD_AUTH */
 /************************************** Sessions *******************************/
+/**
+    Session variable
+    @ingroup WebsSession
+    @internal
+ */
+typedef struct WebsSessionVar {
+    char            *name;                  /**< Variable name. The value is held in the same allocation */
+    char            *value;                 /**< Variable value */
+} WebsSessionVar;
+
 /**
     Session state storage
+    @description A session is identified by the ID in the session cookie. Use websGetSession to get the session for
+        a request and websGetSessionVar, websSetSessionVar and websRemoveSessionVar to access session variables.
+        A session expires when it has not been used for "lifespan" seconds. Sessions are kept in memory unless a
+        session store is defined via websSetSessionStore. The fields following "expires" are internal.
     @defgroup WebsSession WebsSession
  */
 typedef struct WebsSession {
     char            *id;                    /**< Session ID key */
     int             lifespan;               /**< Session inactivity timeout (secs) */
     WebsTime        expires;                /**< When the session expires */
-    WebsHash        cache;                  /**< Cache of session variables */
+
+    /* Internal */
+    WebsSessionVar  *vars;                  /**< Session variables. Use websGetSessionVar to read */
+    int             varCount;               /**< Number of session variables */
+    int             varMax;                 /**< Size of the vars array */
+    WebsTime        deadline;               /**< Time the session is next checked for expiry */
+    WebsTime        logged;                 /**< Expiry time last written to the session store */
+    int             heapIndex;              /**< Position in the expiry heap */
+    struct WebsSession *next;               /**< Next session in the same index bucket */
 } WebsSession;
 
 /**
@@ -3975,6 +4631,20 @@ PUBLIC void websRemoveSessionVar(Webs *wp, cchar *name);
  */
 PUBLIC int websSetSessionVar(Webs *wp, cchar *name, cchar *value);
 
+/**
+    Define the session store
+    @description Session changes are appended to the store file so sessions survive a server restart. On startup, the
+        store is replayed and rewritten with only the sessions that have not expired. The store is also rewritten when
+        it holds many obsolete records. With worker processes, all workers append to the store and it is only
+        rewritten on startup. Changes are buffered and written at least once per second, so a crash may lose the most
+        recent changes. The store contains session IDs and is created readable only by the server user.
+        This may be called before or after websOpen. Not supported for ME_ROM builds.
+    @param path Store filename. Set to NULL or "" to keep sessions only in memory (default).
+    @ingroup WebsSession
+    @stability Evolving
+ */
+PUBLIC void websSetSessionStore(cchar *path);
+
 /************************************ Legacy **********************************/
 /*
     Legacy mappings for pre GoAhead 3.X applications
@@ -11,11 +11,21 @@
 
 #include    "goahead.h"
 
+#if ME_DEBUG
+    #include    <stddef.h>
+#endif
+#if ME_GOAHEAD_DEFLATE
+    #include    <zlib.h>
+#endif
+
 /********************************* Defines ************************************/
 
 #define WEBS_TIMEOUT (ME_GOAHEAD_LIMIT_TIMEOUT * 1000)
 #define PARSE_TIMEOUT (ME_GOAHEAD_LIMIT_PARSE_TIMEOUT * 1000)
-#define CHUNK_LOW   128                 /* Low water mark for chunking */
+#define MAX_IOVEC   6                   /* Output, chunk prefix, chunk data and trailer. Buffers may wrap */
+#define DEFLATE_SLICE (ME_GOAHEAD_LIMIT_BUFFER * 4) /* Input compressed before draining the chunk buffer */
+#define WORKER_MAX_DELAY 60             /* Maximum delay in seconds before restarting a failing worker */
+#define WORKER_READY_TIMEOUT 30         /* Maximum wait in seconds for started workers to listen */
 
 /************************************ Locals **********************************/
 
@@ -25,6 +35,21 @@ static int          defaultHttpPort;            /* Default port number for http
 static int          defaultSslPort;             /* Default port number for https */
 static int          listens[WEBS_MAX_LISTEN];   /* Listen endpoints */;
 static int          listenMax;                  /* Max entry in listens */
+static char         *listenEndpoints[WEBS_MAX_LISTEN];  /* Endpoint address for each listen */
+static int          workerCount = ME_GOAHEAD_WORKERS;   /* Number of worker processes. Zero for single process */
+static int          workerIndex = -1;           /* Index of this worker process */
+#if ME_UNIX_LIKE
+static int          *workerPids;                /* Process IDs of workers */
+static WebsTime     *workerStarted;             /* Time each worker was started */
+static WebsTime     *workerDue;                 /* Time to restart each worker that is not running */
+static int          *workerDelay;               /* Restart delay in seconds for each worker */
+#if defined(SO_REUSEPORT)
+static int          workerReady[2] = { -1, -1 }; /* Pipe closed by workers once they are listening */
+#endif
+static sigset_t     workerMask;                 /* Signal mask to restore in workers */
+static struct sigaction workerChildAction;      /* SIGCHLD action to restore in workers */
+static struct sigaction workerAlarmAction;      /* SIGALRM action to restore in workers */
+#endif
 static Webs         **webs;                     /* Open connection list head */
 static WebsHash     websMime;                   /* Set of mime types */
 static int          websMax;                    /* List size */
@@ -32,6 +57,13 @@ static char         websHost[ME_MAX_IP];        /* Host name for the server */
 static char         websIpAddr[ME_MAX_IP];      /* IP address for the server */
 static char         *websHostUrl = NULL;        /* URL to access server */
 static char         *websIpAddrUrl = NULL;      /* URL to access server */
+static char         *fixedHeaders;              /* Pre-rendered invariant response headers */
+static ssize        fixedHeadersLen;            /* Length of fixedHeaders */
+#if defined(ME_GOAHEAD_CLIENT_CACHE)
+static char         *clientCacheHeader;         /* Pre-rendered Cache-Control header for client cached extensions */
+static ssize        clientCacheHeaderLen;       /* Length of clientCacheHeader */
+static WebsHash     clientCacheExts = -1;       /* Extensions that may be cached by clients */
+#endif
 
 #define WEBS_ENCODE_HTML    0x1                 /* Bit setting in charMatch[] */
 
@@ -175,6 +207,7 @@ static WebsError websErrors[] = {
     { 406, "Not Acceptable" },
     { 408, "Request Timeout" },
     { 413, "Request too large" },
+    { 416, "Range Not Satisfiable" },
     { 500, "Internal Server Error" },
     { 501, "Not Implemented" },
     { 503, "Service Unavailable" },
@@ -182,35 +215,283 @@ static WebsError websErrors[] = {
 };
 
 #if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
-static char     accessLog[64] = "access.log";       /* Log filename */
-static int      accessFd;                           /* Log file handle */
+#define ACCESS_COMMON   0                           /* Common Log Format */
+#define ACCESS_COMBINED 1                           /* Combined Log Format with referrer and user agent */
+#define ACCESS_JSON     2                           /* JSON object per line */
+#define ACCESS_RETAIN   (ME_GOAHEAD_ACCESS_LOG_BUFFER * 4) /* Bytes retained while the log cannot be written */
+
+static char     *accessLog;                         /* Log filename */
+static int      accessFd = -1;                      /* Log file handle */
+static int      accessFormat = -1;                  /* Log line format */
+static ssize    accessMaxSize = ME_GOAHEAD_ACCESS_LOG_SIZE;     /* Size that triggers rotation */
+static int      accessBackups = ME_GOAHEAD_ACCESS_LOG_BACKUPS;  /* Rotated logs to keep */
+static ssize    accessSize;                         /* Current log file size */
+static WebsBuf  accessBuf;                          /* Buffered log lines awaiting write */
+static int      accessEvent = -1;                   /* Flush event */
+static int      accessScheduled;                    /* Flush event is scheduled */
+static volatile sig_atomic_t accessReopen;          /* Reopen requested via websReopenAccessLog */
+static WebsTime accessTime = -1;                    /* Time of the cached log times */
+static char     accessDate[32];                     /* Cached time for the common and combined formats */
+static char     accessIsoDate[32];                  /* Cached time for the json format */
 #endif
 
-static WebsHash sessions = -1;
+/*
+    Sessions are indexed by ID in a chained hash index that doubles in size as sessions are added. The expiry heap
+    orders sessions by the time they are next checked for expiry.
+ */
+#define SESSION_ID_BYTES    16                      /* Random bytes in a session ID */
+#define SESSION_RANDOM      256                     /* Random bytes read at a time for session IDs */
+#define SESSION_VARS        4                       /* Session variable slots to allocate at a time */
+#define SESSION_STORE_SLACK 1024                    /* Obsolete store records permitted before rewriting the store */
+#define SESSION_STORE_FLUSH 1000                    /* Maximum msec store records are buffered before writing */
+#define SESSION_STORE_BUFFER (ME_GOAHEAD_LIMIT_BUFFER * 16) /* Buffered store bytes that trigger a write */
+
+static WebsSession **sessionIndex;                  /* Session index buckets chained via WebsSession.next */
+static int      sessionBuckets;                     /* Number of index buckets. Always a power of two */
+static WebsSession **sessionHeap;                   /* Expiry min-heap ordered by WebsSession.deadline */
 static int      sessionCount = 0;
 static int      pruneId;                            /* Callback ID */
+#if !ME_ROM
+static char     *sessionStore;                      /* Session store filename */
+static int      storeFd = -1;                       /* Session store file handle */
+static int      storeRecords;                       /* Records appended since the store was rewritten */
+static Offset   storeSize;                          /* Size of the store when it was last rewritten */
+static WebsBuf  storeBuf;                           /* Session store record buffer */
+static int      storeEvent = -1;                    /* Flush event */
+static int      storeScheduled;                     /* Flush event is scheduled */
+#endif
+
+#if ME_GOAHEAD_METRICS
+#define METRIC_CODES    500                         /* Status codes from 100 to 599 */
+
+/*
+    Server metrics. These are updated directly on the request path.
+ */
+static struct {
+    int64           accepted;                       /* Connections accepted */
+    int64           active;                         /* Connections open */
+    int64           reused;                         /* Requests on kept-alive connections */
+    int64           received;                       /* Bytes read from clients */
+    int64           sent;                           /* Bytes written to clients */
+    int64           requests;                       /* Requests completed */
+    int64           sessions;                       /* Sessions at the time of the report */
+    int64           responses[METRIC_CODES];        /* Responses by status code */
+    int64           errors[METRIC_CODES];           /* Error responses via websError by status code */
+    WebsHistogram   latency;                        /* Latency of all requests */
+} metrics;
+
+typedef struct WebsMetric {
+    char            *name;                          /* Metric name */
+    char            *help;                          /* Metric description */
+    int             type;                           /* WEBS_METRIC_COUNTER or WEBS_METRIC_GAUGE */
+    int64           *value;                         /* Reference to the metric value */
+} WebsMetric;
+
+static WebsMetric serverMetrics[] = {
+    { "goahead_connections_accepted_total", "Connections accepted", WEBS_METRIC_COUNTER, &metrics.accepted },
+    { "goahead_connections_active", "Connections open", WEBS_METRIC_GAUGE, &metrics.active },
+    { "goahead_connections_reused_total", "Requests on kept-alive connections", WEBS_METRIC_COUNTER, &metrics.reused },
+    { "goahead_received_bytes_total", "Bytes read from clients", WEBS_METRIC_COUNTER, &metrics.received },
+    { "goahead_sent_bytes_total", "Bytes written to clients", WEBS_METRIC_COUNTER, &metrics.sent },
+    { "goahead_requests_total", "Requests completed", WEBS_METRIC_COUNTER, &metrics.requests },
+    { "goahead_sessions", "Sessions", WEBS_METRIC_GAUGE, &metrics.sessions },
+    { 0, 0, 0, 0 }
+};
+
+/*
+    Latency histogram bucket upper bounds in milliseconds. Requests slower than the last bound go in the final bucket.
+ */
+static int64 metricBounds[WEBS_METRIC_BUCKETS - 1] = { 1, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000 };
+
+#if ME_GOAHEAD_REPLACE_MALLOC
+#define MEMORY_ALLOCATED    0
+#define MEMORY_FREE         1
+#define MEMORY_PEAK         2
+#define MEMORY_BYTES        3
+
+/*
+    Allocator statistics reported by block class
+ */
+typedef struct MemoryMetric {
+    cchar           *name;                          /* Metric name */
+    cchar           *help;                          /* Metric description */
+    int             field;                          /* WebsAllocStats field */
+} MemoryMetric;
+
+static MemoryMetric memoryMetrics[] = {
+    { "goahead_memory_blocks", "Allocated memory blocks by size class", MEMORY_ALLOCATED },
+    { "goahead_memory_free_blocks", "Free memory blocks retained for reuse by size class", MEMORY_FREE },
+    { "goahead_memory_peak_blocks", "Peak allocated memory blocks by size class", MEMORY_PEAK },
+    { "goahead_memory_bytes", "Allocated memory bytes by size class", MEMORY_BYTES },
+    { 0, 0, 0 }
+};
+#endif
+
+static WebsMetric *appMetrics;                      /* Metrics defined via websDefineMetric */
+static int      appMetricCount;
+#endif
+
+/*
+    Per-connection arena for request header strings. The first block is retained across keep-alive requests so a
+    typical request is parsed without touching the heap. Overflow blocks are chained after the first and released
+    when the arena is reset. Block data immediately follows the block header.
+ */
+typedef struct WebsArena {
+    struct WebsArena *next;                         /* Overflow blocks */
+    ssize           size;                           /* Size of the block data */
+    ssize           used;                           /* Bytes allocated from the block */
+} WebsArena;
+
+#define ARENA_DATA(ap) ((char*) &(ap)[1])
+
+#if ME_DEBUG
+/*
+    Webs string fields held in the arena. Debug builds verify these have not been replaced with other memory.
+ */
+static struct {
+    cchar           *name;
+    ssize           offset;
+} arenaFields[] = {
+    { "authDetails", offsetof(Webs, authDetails) },
+    { "authType", offsetof(Webs, authType) },
+    { "contentType", offsetof(Webs, contentType) },
+    { "cookie", offsetof(Webs, cookie) },
+    { "ext", offsetof(Webs, ext) },
+    { "host", offsetof(Webs, host) },
+    { "ifNoneMatch", offsetof(Webs, ifNoneMatch) },
+    { "ifRange", offsetof(Webs, ifRange) },
+    { "method", offsetof(Webs, method) },
+    { "protoVersion", offsetof(Webs, protoVersion) },
+    { "range", offsetof(Webs, range) },
+    { "referrer", offsetof(Webs, referrer) },
+    { "userAgent", offsetof(Webs, userAgent) },
+    { 0, 0 },
+};
+#endif
+
+/*
+    Request buffers, variable table and arena. These are only held by connections receiving or servicing a request.
+    Idle keep-alive connections return them to a pool and reacquire them when request data arrives.
+ */
+typedef struct WebsBuffers {
+    WebsBuf         rxbuf;                          /* Raw receive buffer */
+    WebsBuf         input;                          /* Receive body data */
+    WebsBuf         output;                         /* Transmit buffer */
+    WebsBuf         chunkbuf;                       /* Pre-chunking data buffer */
+    WebsHash        vars;                           /* Request variables */
+    WebsArena       *arena;                         /* Header string arena */
+} WebsBuffers;
+
+static WebsBuffers bufferPool[max(ME_GOAHEAD_BUFFER_POOL, 1)];
+static int      bufferPoolCount;                    /* Buffer sets in the pool */
+
+/*
+    Known request headers returned by lookupHeader
+ */
+#define HDR_OTHER               0
+#define HDR_ACCEPT_ENCODING     1
+#define HDR_AUTHORIZATION       2
+#define HDR_CONNECTION          3
+#define HDR_CONTENT_LENGTH      4
+#define HDR_CONTENT_TYPE        5
+#define HDR_COOKIE              6
+#define HDR_HOST                7
+#define HDR_IF_MODIFIED_SINCE   8
+#define HDR_IF_NONE_MATCH       9
+#define HDR_IF_RANGE            10
+#define HDR_RANGE               11
+#define HDR_REFERER             12
+#define HDR_TRANSFER_ENCODING   13
+#define HDR_USER_AGENT          14
+
+#define IS_HEADER_VAR(var) ((var)[0] == 'H' && strncmp(var, "HTTP_", 5) == 0)
 
 /**************************** Forward Declarations ****************************/
 
+static char     *arenaAlloc(Webs *wp, ssize size);
+static char     *arenaClone(Webs *wp, cchar *str);
+static char     *arenaJoin(Webs *wp, cchar *prior, cchar *sep, cchar *str);
+static void     arenaReset(Webs *wp);
+#if ME_DEBUG
+static void     checkArenaFields(Webs *wp);
+#endif
+static int      acquireBuffers(Webs *wp);
+static void     attachBuffers(Webs *wp, WebsBuffers *bp);
+static void     detachBuffers(Webs *wp, WebsBuffers *bp);
+static void     freeBufferPool(void);
+static void     freeBufferSet(WebsBuffers *bp);
+static void     releaseBuffers(Webs *wp);
 static void     checkTimeout(void *arg, int id);
 static bool     filterChunkData(Webs *wp);
+static int      flushOutput(Webs *wp, bool block);
+static void     consumeOutput(Webs *wp, ssize written);
+static int      gatherOutput(Webs *wp, WebsIovec *iov, ssize *total);
+static bool     outputPending(Webs *wp);
+static void     closeHeaders(void);
+static void     openHeaders(void);
+static int      putHeader(Webs *wp, cchar *key, cchar *value);
+static int      putText(Webs *wp, cchar *text, ssize len);
+static void     traceHeaders(Webs *wp, ssize start);
+static ssize    writeSocketVector(Webs *wp, WebsIovec *iov, int count);
+static void     updateWriteInterest(Webs *wp);
+static ssize    writeBlock(Webs *wp, cchar *buf, ssize size, bool bounded);
 static int      getTimeSinceMark(Webs *wp);
+static int      parseAcceptEncoding(cchar *value);
+static void     fillHeaderVars(void *data);
 static char     *getToken(Webs *wp, char *delim);
 static void     parseFirstLine(Webs *wp);
-static void     parseHeaders(Webs *wp);
+static void     parseHeaders(Webs *wp, char *end);
 static bool     processContent(Webs *wp);
 static bool     parseIncoming(Webs *wp);
+static char     *findHeaderEnd(Webs *wp);
+static int      lookupHeader(cchar *key, ssize len);
 static void     pruneSessions();
+static void     destroySession(WebsSession *sp, bool log);
 static void     freeSession(WebsSession *sp);
 static void     freeSessions();
+static int      growSessions();
+static void     logSession(WebsSession *sp, int kind, cchar *name, cchar *value);
+#if !ME_ROM
+static void     closeSessionStore();
+static void     flushSessionStore();
+static int      compactSessionStore();
+static void     loadSessionStore();
+static int      openSessionStore();
+#if ME_UNIX_LIKE
+static void     compactSharedStore();
+static int      lockSessionStore();
+static void     reopenSessionStore();
+#endif
+#endif
 static void     readEvent(Webs *wp);
 static void     reuseConn(Webs *wp);
 static void     setFileLimits();
 static int      setLocalHost();
+#if ME_UNIX_LIKE
+static int      startWorker(int index);
+static int      superviseWorkers(int *finished);
+static void     scheduleWorker(int index);
+#if defined(SO_REUSEPORT)
+static void     releaseListeners();
+#endif
+static void     workerSignal(int signo);
+#endif
 static void     socketEvent(int sid, int mask, void *data);
 static void     writeEvent(Webs *wp);
-#if ME_GOAHEAD_ACCESS_LOG
+#if ME_GOAHEAD_DEFLATE
+static ssize    deflateBlock(Webs *wp, cchar *buf, ssize size, int mode);
+static void     endDeflate(Webs *wp);
+static bool     startDeflate(Webs *wp);
+#endif
+#if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
+static void     closeAccessLog(void);
+static void     flushAccessLog(void);
 static void     logRequest(Webs *wp, int code);
+static int      openAccessLog(void);
+#endif
+#if ME_GOAHEAD_METRICS
+static void     freeMetrics(void);
+static void     observeRequest(Webs *wp);
 #endif
 
 /*********************************** Code *************************************/
@@ -237,9 +518,15 @@ PUBLIC int websOpen(cchar *documents, cchar *routeFile)
         return -1;
     }
 #endif
-    if ((sessions = hashCreate(-1)) < 0) {
+    if (growSessions() < 0) {
         return -1;
     }
+#if !ME_ROM
+    if (!sessionStore && *ME_GOAHEAD_SESSION_STORE) {
+        sessionStore = sclone(ME_GOAHEAD_SESSION_STORE);
+    }
+    openSessionStore();
+#endif
     if (!websDebug) {
         pruneId = websStartEvent(WEBS_SESSION_PRUNE, (WebsEventProc) pruneSessions, 0);
     }
@@ -253,6 +540,9 @@ PUBLIC int websOpen(cchar *documents, cchar *routeFile)
     websCgiOpen();
 #endif
     websOptionsOpen();
+#if ME_GOAHEAD_METRICS
+    websMetricsOpen();
+#endif
     websActionOpen();
     websFileOpen();
 #if ME_GOAHEAD_UPLOAD
@@ -277,14 +567,11 @@ PUBLIC int websOpen(cchar *documents, cchar *routeFile)
     for (mt = websMimeList; mt->type; mt++) {
         hashEnter(websMime, mt->ext, valueString(mt->type, 0), 0);
     }
+    openHeaders();
 
 #if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
-    if ((accessFd = open(accessLog, O_CREAT | O_TRUNC | O_APPEND | O_WRONLY, 0666)) < 0) {
-        error("Cannot open access log %s", accessLog);
-        return -1;
-    }
-    /* Some platforms don't implement O_APPEND (VXWORKS) */
-    lseek(accessFd, 0, SEEK_END);
+    /* If the log cannot be opened, lines are retained and the open is retried */
+    openAccessLog();
 #endif
     return 0;
 }
@@ -303,7 +590,7 @@ PUBLIC void websClose()
         websStopEvent(pruneId);
         pruneId = -1;
     }
-    if (sessions >= 0) {
+    if (sessionIndex) {
         freeSessions();
     }
     for (i = 0; i < listenMax; i++) {
@@ -311,9 +598,21 @@ PUBLIC void websClose()
             socketCloseConnection(listens[i]);
             listens[i] = -1;
         }
+        wfree(listenEndpoints[i]);
+        listenEndpoints[i] = 0;
     }
     listenMax = 0;
-    for (i = websMax; webs && i >= 0; i--) {
+#if ME_UNIX_LIKE
+    wfree(workerPids);
+    wfree(workerStarted);
+    wfree(workerDue);
+    wfree(workerDelay);
+    workerPids = 0;
+    workerStarted = 0;
+    workerDue = 0;
+    workerDelay = 0;
+#endif
+    for (i = websMax - 1; webs && i >= 0; i--) {
         if ((wp = webs[i]) == NULL) {
             continue;
         }
@@ -330,14 +629,16 @@ PUBLIC void websClose()
 #if ME_COM_SSL
     sslClose();
 #endif
-#if ME_GOAHEAD_ACCESS_LOG
-    if (accessFd >= 0) {
-        close(accessFd);
-        accessFd = -1;
-    }
+#if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
+    closeAccessLog();
 #endif
+#if ME_GOAHEAD_METRICS
+    freeMetrics();
+#endif
+    freeBufferPool();
     websFsClose();
     hashFree(websMime);
+    closeHeaders();
     socketClose();
     logClose();
     websTimeClose();
@@ -348,7 +649,9 @@ PUBLIC void websClose()
 
 static void initWebs(Webs *wp, int flags, int reuse)
 {
-    WebsBuf     rxbuf;
+    WebsBuf     rxbuf, input, output, chunkbuf;
+    WebsArena   *arena;
+    WebsHash    vars;
     void        *ssl;
     char        ipaddr[ME_MAX_IP], ifaddr[ME_MAX_IP];
     int         wid, sid, timeout, listenSid;
@@ -357,6 +660,11 @@ static void initWebs(Webs *wp, int flags, int reuse)
 
     if (reuse) {
         rxbuf = wp->rxbuf;
+        input = wp->input;
+        output = wp->output;
+        chunkbuf = wp->chunkbuf;
+        arena = wp->arena;
+        vars = wp->vars;
         wid = wp->wid;
         sid = wp->sid;
         timeout = wp->timeout;
@@ -398,19 +706,144 @@ static void initWebs(Webs *wp, int flags, int reuse)
     } else {
         wp->timeout = -1;
     }
-    wp->vars = hashCreate(WEBS_HASH_INIT);
+    /*
+        On a keep-alive connection, the buffers, variable table and arena of the prior request are recycled.
+        Otherwise they are acquired by acquireBuffers when request data arrives.
+     */
+    if (reuse && rxbuf.buf) {
+        wp->rxbuf = rxbuf;
+        wp->input = input;
+        wp->output = output;
+        wp->chunkbuf = chunkbuf;
+        wp->arena = arena;
+        wp->vars = vars;
+        bufRecycle(&wp->output, ME_GOAHEAD_LIMIT_BUFFER + 1);
+        bufRecycle(&wp->chunkbuf, ME_GOAHEAD_LIMIT_BUFFER + 1);
+        bufRecycle(&wp->input, ME_GOAHEAD_LIMIT_BUFFER + 1);
+    } else {
+        wp->vars = -1;
+    }
+}
+
+
+/*
+    Attach request buffers to a connection. A buffer set is taken from the pool if available.
+ */
+static int acquireBuffers(Webs *wp)
+{
+    WebsBuffers     set;
+
+    if (wp->rxbuf.buf) {
+        return 0;
+    }
+    if (bufferPoolCount > 0) {
+        attachBuffers(wp, &bufferPool[--bufferPoolCount]);
+        return 0;
+    }
     /*
         Ring queues can never be totally full and are short one byte. Better to do even I/O and allocate
-        a little more memory than required. The chunkbuf has extra room to fit chunk headers and trailers.
+        a little more memory than required. The chunkbuf holds body data awaiting transfer chunk framing.
      */
     assert(ME_GOAHEAD_LIMIT_BUFFER >= 1024);
-    bufCreate(&wp->output, ME_GOAHEAD_LIMIT_BUFFER + 1, ME_GOAHEAD_LIMIT_BUFFER + 1);
-    bufCreate(&wp->chunkbuf, ME_GOAHEAD_LIMIT_BUFFER + 1, ME_GOAHEAD_LIMIT_BUFFER * 2);
-    bufCreate(&wp->input, ME_GOAHEAD_LIMIT_BUFFER + 1, ME_GOAHEAD_LIMIT_PUT + 1);
-    if (reuse) {
-        wp->rxbuf = rxbuf;
+    memset(&set, 0, sizeof(set));
+    if ((set.vars = hashCreate(WEBS_HASH_INIT)) < 0 ||
+            bufCreate(&set.output, ME_GOAHEAD_LIMIT_BUFFER + 1, ME_GOAHEAD_LIMIT_BUFFER + 1) < 0 ||
+            bufCreate(&set.chunkbuf, ME_GOAHEAD_LIMIT_BUFFER + 1, ME_GOAHEAD_LIMIT_BUFFER * 2) < 0 ||
+            bufCreate(&set.input, ME_GOAHEAD_LIMIT_BUFFER + 1, ME_GOAHEAD_LIMIT_PUT + 1) < 0 ||
+            bufCreate(&set.rxbuf, ME_GOAHEAD_LIMIT_HEADERS, ME_GOAHEAD_LIMIT_HEADERS + ME_GOAHEAD_LIMIT_PUT) < 0) {
+        freeBufferSet(&set);
+        return -1;
+    }
+    attachBuffers(wp, &set);
+    return 0;
+}
+
+
+/*
+    Detach the request buffers from a connection and return them to the pool. Buffers that have grown are trimmed
+    to their initial size. If the pool is full, the buffers are freed.
+ */
+static void releaseBuffers(Webs *wp)
+{
+    WebsBuffers     set;
+
+    if (wp->vars >= 0) {
+        hashClear(wp->vars);
+    }
+    arenaReset(wp);
+    detachBuffers(wp, &set);
+    if (set.rxbuf.buf && bufferPoolCount < ME_GOAHEAD_BUFFER_POOL &&
+            bufRecycle(&set.rxbuf, ME_GOAHEAD_LIMIT_HEADERS) == 0 &&
+            bufRecycle(&set.output, ME_GOAHEAD_LIMIT_BUFFER + 1) == 0 &&
+            bufRecycle(&set.chunkbuf, ME_GOAHEAD_LIMIT_BUFFER + 1) == 0 &&
+            bufRecycle(&set.input, ME_GOAHEAD_LIMIT_BUFFER + 1) == 0) {
+        bufferPool[bufferPoolCount++] = set;
     } else {
-        bufCreate(&wp->rxbuf, ME_GOAHEAD_LIMIT_HEADERS, ME_GOAHEAD_LIMIT_HEADERS + ME_GOAHEAD_LIMIT_PUT);
+        freeBufferSet(&set);
+    }
+}
+
+
+static void attachBuffers(Webs *wp, WebsBuffers *bp)
+{
+    wp->rxbuf = bp->rxbuf;
+    wp->input = bp->input;
+    wp->output = bp->output;
+    wp->chunkbuf = bp->chunkbuf;
+    wp->vars = bp->vars;
+    wp->arena = bp->arena;
+}
+
+
+static void detachBuffers(Webs *wp, WebsBuffers *bp)
+{
+    bp->rxbuf = wp->rxbuf;
+    bp->input = wp->input;
+    bp->output = wp->output;
+    bp->chunkbuf = wp->chunkbuf;
+    bp->vars = wp->vars;
+    bp->arena = wp->arena;
+    memset(&wp->rxbuf, 0, sizeof(WebsBuf));
+    memset(&wp->input, 0, sizeof(WebsBuf));
+    memset(&wp->output, 0, sizeof(WebsBuf));
+    memset(&wp->chunkbuf, 0, sizeof(WebsBuf));
+    wp->vars = -1;
+    wp->arena = 0;
+}
+
+
+static void freeBufferSet(WebsBuffers *bp)
+{
+    WebsArena   *ap, *next;
+
+    if (bp->rxbuf.buf) {
+        bufFree(&bp->rxbuf);
+    }
+    if (bp->input.buf) {
+        bufFree(&bp->input);
+    }
+    if (bp->output.buf) {
+        bufFree(&bp->output);
+    }
+    if (bp->chunkbuf.buf) {
+        bufFree(&bp->chunkbuf);
+    }
+    if (bp->vars >= 0) {
+        hashFree(bp->vars);
+        bp->vars = -1;
+    }
+    for (ap = bp->arena; ap; ap = next) {
+        next = ap->next;
+        wfree(ap);
+    }
+    bp->arena = 0;
+}
+
+
+static void freeBufferPool()
+{
+    while (bufferPoolCount > 0) {
+        freeBufferSet(&bufferPool[--bufferPoolCount]);
     }
 }
 
@@ -421,12 +854,12 @@ static void termWebs(Webs *wp, int reuse)
 
     /*
         Some of this is done elsewhere, but keep this here for when a shutdown is done and there are open connections.
+        The buffers are retained for reuse by initWebs on keep-alive connections.
      */
-    bufFree(&wp->input);
-    bufFree(&wp->output);
-    bufFree(&wp->chunkbuf);
+#if ME_GOAHEAD_DEFLATE
+    endDeflate(wp);
+#endif
     if (!reuse) {
-        bufFree(&wp->rxbuf);
         if (wp->sid >= 0) {
 #if ME_COM_SSL
             sslFree(wp);
@@ -447,11 +880,7 @@ static void termWebs(Webs *wp, int reuse)
     }
 #endif
 #if ME_GOAHEAD_CGI
-    if (wp->cgifd >= 0) {
-        close(wp->cgifd);
-        wp->cgifd = -1;
-    }
-    wfree(wp->cgiStdin);
+    websCgiCleanup(wp);
 #endif
 #if ME_GOAHEAD_UPLOAD
     wfree(wp->clientFilename);
@@ -460,27 +889,18 @@ static void termWebs(Webs *wp, int reuse)
     if (wp->timeout >= 0 && !reuse) {
         websCancelTimeout(wp);
     }
-    wfree(wp->authDetails);
     wfree(wp->authResponse);
-    wfree(wp->authType);
-    wfree(wp->contentType);
-    wfree(wp->cookie);
     wfree(wp->decodedQuery);
     wfree(wp->digest);
-    wfree(wp->ext);
     wfree(wp->filename);
-    wfree(wp->host);
-    wfree(wp->method);
     wfree(wp->password);
     wfree(wp->path);
-    wfree(wp->protoVersion);
     wfree(wp->putname);
     wfree(wp->query);
+    wfree(wp->ranges);
     wfree(wp->realm);
-    wfree(wp->referrer);
     wfree(wp->responseCookie);
     wfree(wp->url);
-    wfree(wp->userAgent);
     wfree(wp->username);
 #if ME_GOAHEAD_UPLOAD
     wfree(wp->boundary);
@@ -495,8 +915,15 @@ static void termWebs(Webs *wp, int reuse)
     wfree(wp->nonce);
     wfree(wp->qop);
 #endif
-    hashFree(wp->vars);
-
+    /*
+        Header variables may reference arena strings, so clear them before resetting the arena
+     */
+    if (!reuse) {
+        releaseBuffers(wp);
+    } else if (wp->vars >= 0) {
+        hashClear(wp->vars);
+        arenaReset(wp);
+    }
 #if ME_GOAHEAD_UPLOAD
     if (wp->files >= 0) {
         websFreeUpload(wp);
@@ -505,6 +932,136 @@ static void termWebs(Webs *wp, int reuse)
 }
 
 
+/*
+    Allocate memory from the connection arena. The memory is valid until the request completes.
+ */
+static char *arenaAlloc(Webs *wp, ssize size)
+{
+    WebsArena   *ap, *bp;
+    ssize       blockSize;
+
+    /*
+        Keep allocations pointer aligned so the arena can hold structures as well as strings
+     */
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    if ((ap = wp->arena) == 0) {
+        if ((ap = walloc(sizeof(WebsArena) + ME_GOAHEAD_LIMIT_HEADERS)) == 0) {
+            return 0;
+        }
+        ap->next = 0;
+        ap->size = ME_GOAHEAD_LIMIT_HEADERS;
+        ap->used = 0;
+        wp->arena = ap;
+    }
+    if ((ap->size - ap->used) >= size) {
+        bp = ap;
+    } else if (ap->next && (ap->next->size - ap->next->used) >= size) {
+        bp = ap->next;
+    } else {
+        /*
+            The most recent overflow block is kept next to the first block so it is tried first
+         */
+        blockSize = max(size, ME_GOAHEAD_LIMIT_HEADERS);
+        if ((bp = walloc(sizeof(WebsArena) + blockSize)) == 0) {
+            return 0;
+        }
+        bp->size = blockSize;
+        bp->used = 0;
+        bp->next = ap->next;
+        ap->next = bp;
+    }
+    bp->used += size;
+    return &ARENA_DATA(bp)[bp->used - size];
+}
+
+
+static char *arenaClone(Webs *wp, cchar *str)
+{
+    char    *cp;
+    ssize   len;
+
+    if (str == 0) {
+        str = "";
+    }
+    len = slen(str);
+    if ((cp = arenaAlloc(wp, len + 1)) != 0) {
+        memcpy(cp, str, len + 1);
+    }
+    return cp;
+}
+
+
+/*
+    Join two strings with a separator in the arena. Used to fold repeated request headers.
+ */
+static char *arenaJoin(Webs *wp, cchar *prior, cchar *sep, cchar *str)
+{
+    char    *cp;
+    ssize   plen, seplen, len;
+
+    plen = slen(prior);
+    seplen = slen(sep);
+    len = slen(str);
+    if ((cp = arenaAlloc(wp, plen + seplen + len + 1)) != 0) {
+        memcpy(cp, prior, plen);
+        memcpy(&cp[plen], sep, seplen);
+        memcpy(&cp[plen + seplen], str, len + 1);
+    }
+    return cp;
+}
+
+
+/*
+    Release overflow blocks and rewind the first block. All arena strings are invalidated.
+ */
+static void arenaReset(Webs *wp)
+{
+    WebsArena   *ap, *next;
+
+#if ME_DEBUG
+    checkArenaFields(wp);
+#endif
+    if ((ap = wp->arena) == 0) {
+        return;
+    }
+    for (next = ap->next; next; next = ap->next) {
+        ap->next = next->next;
+        wfree(next);
+    }
+    ap->used = 0;
+}
+
+
+#if ME_DEBUG
+/*
+    Report arena fields that a handler has replaced with memory outside the arena. Such memory would be leaked, and
+    freeing an arena field corrupts the heap. Use websSetRequestString to replace these fields.
+ */
+static void checkArenaFields(Webs *wp)
+{
+    WebsArena   *ap;
+    char        *str;
+    int         i;
+
+    for (i = 0; arenaFields[i].name; i++) {
+        if ((str = *(char**) ((char*) wp + arenaFields[i].offset)) == 0) {
+            continue;
+        }
+        for (ap = wp->arena; ap; ap = ap->next) {
+            if (str >= ARENA_DATA(ap) && str < &ARENA_DATA(ap)[ap->size]) {
+                break;
+            }
+        }
+        if (ap == 0) {
+            error("Request field \"%s\" does not reference the request arena. Use websSetRequestString.",
+                arenaFields[i].name);
+            assert(ap);
+        }
+    }
+}
+#endif
+
+
 PUBLIC int websAlloc(int sid)
 {
     Webs    *wp;
@@ -519,21 +1076,31 @@ PUBLIC int websAlloc(int sid)
     wp->wid = wid;
     wp->sid = sid;
     wp->timestamp = time(0);
+#if ME_GOAHEAD_METRICS
+    metrics.active++;
+#endif
     return wid;
 }
 
 
 static void reuseConn(Webs *wp)
 {
+    bool    idle;
+
     assert(wp);
     assert(websValid(wp));
 
     bufCompact(&wp->rxbuf);
-    if (bufLen(&wp->rxbuf)) {
+    idle = bufLen(&wp->rxbuf) == 0;
+    if (!idle) {
         socketReservice(wp->sid);
     }
     termWebs(wp, 1);
-    initWebs(wp, wp->flags & (WEBS_KEEP_ALIVE | WEBS_SECURE | WEBS_HTTP11), 1);
+    initWebs(wp, (wp->flags & (WEBS_KEEP_ALIVE | WEBS_SECURE | WEBS_HTTP11)) | WEBS_REUSED, 1);
+    if (idle) {
+        /* Hold only the Webs object while waiting for the next request */
+        releaseBuffers(wp);
+    }
 }
 
 
@@ -545,6 +1112,9 @@ PUBLIC void websFree(Webs *wp)
     termWebs(wp, 0);
     websMax = wfreeHandle(&webs, wp->wid);
     wfree(wp);
+#if ME_GOAHEAD_METRICS
+    metrics.active--;
+#endif
     assert(websMax >= 0);
 }
 
@@ -577,8 +1147,11 @@ PUBLIC void websDone(Webs *wp)
             socketCreateHandler(wp->sid, sp->handlerMask | SOCKET_WRITABLE, socketEvent, wp);
         }
     }
-#if ME_GOAHEAD_ACCESS_LOG
+#if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
     logRequest(wp, wp->code);
+#endif
+#if ME_GOAHEAD_METRICS
+    observeRequest(wp);
 #endif
     if (!(wp->flags & WEBS_RESPONSE_TRACED)) {
         trace(3 | WEBS_RAW_MSG, "Request complete: code %d", wp->code);
@@ -609,7 +1182,7 @@ PUBLIC int websListen(cchar *endpoint)
 {
     WebsSocket  *sp;
     char        *ip, *ipaddr;
-    int         port, secure, sid;
+    int         port, secure, sid, flags;
 
     assert(endpoint && *endpoint);
 
@@ -618,8 +1191,10 @@ PUBLIC int websListen(cchar *endpoint)
         return -1;
     }
     socketParseAddress(endpoint, &ip, &port, &secure, 80);
-    if ((sid = socketListen(ip, port, websAccept, 0)) < 0) {
+    flags = (workerCount > 0) ? SOCKET_REUSEPORT : 0;
+    if ((sid = socketListen(ip, port, websAccept, flags)) < 0) {
         error("Unable to open socket on port %d.", port);
+        wfree(ip);
         return -1;
     }
     sp = socketPtr(sid);
@@ -631,6 +1206,7 @@ PUBLIC int websListen(cchar *endpoint)
     } else if (!defaultHttpPort) {
         defaultHttpPort = port;
     }
+    listenEndpoints[listenMax] = sclone(endpoint);
     listens[listenMax++] = sid;
     if (ip) {
         ipaddr = smatch(ip, "::") ? "[::]" : ip;
@@ -682,6 +1258,9 @@ PUBLIC int websAccept(int sid, cchar *ipaddr, int port, int listenSid)
     wp = webs[wid];
     assert(wp);
     wp->listenSid = listenSid;
+#if ME_GOAHEAD_METRICS
+    metrics.accepted++;
+#endif
     strncpy(wp->ipaddr, ipaddr, min(sizeof(wp->ipaddr) - 1, strlen(ipaddr)));
 
     /*
@@ -792,6 +1371,10 @@ static void readEvent(Webs *wp)
     if (!websValid(wp)) {
         return;
     }
+    if (acquireBuffers(wp) < 0) {
+        wp->flags |= WEBS_CLOSED;
+        return;
+    }
     websNoteRequestActivity(wp);
     rxbuf = &wp->rxbuf;
 
@@ -804,6 +1387,9 @@ static void readEvent(Webs *wp)
     }
     if ((nbytes = websRead(wp, (char*) rxbuf->endp, ME_GOAHEAD_LIMIT_BUFFER)) > 0) {
         wp->lastRead = nbytes;
+#if ME_GOAHEAD_METRICS
+        metrics.received += nbytes;
+#endif
         bufAdjustEnd(rxbuf, nbytes);
         bufAddNull(rxbuf);
     }
@@ -864,24 +1450,55 @@ PUBLIC void websPump(Webs *wp)
 }
 
 
+/*
+    Find the "\r\n\r\n" ending the request headers. The search resumes where the previous read left off so the
+    headers are only scanned once regardless of how many reads are required to receive them.
+ */
+static char *findHeaderEnd(Webs *wp)
+{
+    WebsBuf     *rxbuf;
+    char        *cp, *end;
+
+    rxbuf = &wp->rxbuf;
+    end = rxbuf->endp;
+    cp = rxbuf->servp + max(wp->rxScanned - 3, 0);
+    for (; (end - cp) > 3 && (cp = memchr(cp, '\r', end - cp - 3)) != 0; cp++) {
+        if (cp[1] == '\n' && cp[2] == '\r' && cp[3] == '\n') {
+            return cp;
+        }
+    }
+    wp->rxScanned = bufLen(rxbuf);
+    return 0;
+}
+
+
 static bool parseIncoming(Webs *wp)
 {
     WebsBuf     *rxbuf;
     char        *end, c;
 
     rxbuf = &wp->rxbuf;
+    if (!rxbuf->buf) {
+        return 0;
+    }
     while (*rxbuf->servp == '\r' || *rxbuf->servp == '\n') {
         if (bufGetc(rxbuf) < 0) {
             break;
         }
     }
-    if ((end = strstr((char*) wp->rxbuf.servp, "\r\n\r\n")) == 0) {
+    if ((end = findHeaderEnd(wp)) == 0) {
         if (bufLen(&wp->rxbuf) >= ME_GOAHEAD_LIMIT_HEADER) {
             websError(wp, HTTP_CODE_REQUEST_TOO_LARGE | WEBS_CLOSE, "Header too large");
             return 1;
         }
         return 0;
     }
+    wp->started = websGetTicks();
+#if ME_GOAHEAD_METRICS
+    if (wp->flags & WEBS_REUSED) {
+        metrics.reused++;
+    }
+#endif
     trace(3 | WEBS_RAW_MSG, "\n<<< Request\n");
     c = *end;
     *end = '\0';
@@ -895,7 +1512,7 @@ static bool parseIncoming(Webs *wp)
     if (wp->state == WEBS_COMPLETE) {
         return 1;
     }
-    parseHeaders(wp);
+    parseHeaders(wp, end);
     if (wp->state == WEBS_COMPLETE) {
         return 1;
     }
@@ -907,13 +1524,10 @@ static bool parseIncoming(Webs *wp)
         return 1;
     }
 #if ME_GOAHEAD_CGI
-    if (wp->route && wp->route->handler && wp->route->handler->service == cgiHandler) {
-        if (smatch(wp->method, "POST")) {
-            wp->cgiStdin = websGetCgiCommName();
-            if ((wp->cgifd = open(wp->cgiStdin, O_CREAT | O_WRONLY | O_BINARY | O_TRUNC, 0666)) < 0) {
-                websError(wp, HTTP_CODE_NOT_FOUND | WEBS_CLOSE, "Cannot open CGI file");
-                return 1;
-            }
+    if (wp->route && wp->route->handler &&
+            (wp->route->handler->service == cgiHandler || wp->route->handler->service == fastcgiHandler)) {
+        if (wp->state == WEBS_CONTENT && smatch(wp->method, "POST") && websCgiStart(wp) < 0) {
+            return 1;
         }
     }
 #endif
@@ -954,7 +1568,7 @@ static void parseFirstLine(Webs *wp)
         websError(wp, HTTP_CODE_NOT_FOUND | WEBS_CLOSE, "Bad HTTP request");
         return;
     }
-    wp->method = supper(sclone(op));
+    wp->method = supper(arenaClone(wp, op));
 
     url = getToken(wp, 0);
     if (url == NULL || *url == '\0') {
@@ -988,11 +1602,11 @@ static void parseFirstLine(Webs *wp)
     }
     wp->url = sclone(url);
     if (ext) {
-        wp->ext = sclone(slower(ext));
+        wp->ext = arenaClone(wp, slower(ext));
     }
     wp->filename = sfmt("%s%s", websGetDocuments(), wp->path);
     wp->query = sclone(query);
-    wp->host = sclone(host);
+    wp->host = arenaClone(wp, host);
     wp->protocol = wp->flags & WEBS_SECURE ? "https" : "http";
     if (smatch(protoVer, "HTTP/1.1")) {
         wp->flags |= WEBS_KEEP_ALIVE | WEBS_HTTP11;
@@ -1002,7 +1616,7 @@ static void parseFirstLine(Webs *wp)
         protoVer = "HTTP/1.1";
         websError(wp, WEBS_CLOSE | HTTP_CODE_NOT_ACCEPTABLE, "Unsupported HTTP protocol");
     }
-    wp->protoVersion = sclone(protoVer);
+    wp->protoVersion = arenaClone(wp, protoVer);
     if ((listenPort = socketGetPort(wp->listenSid)) >= 0) {
         wp->port = listenPort;
     } else {
@@ -1013,84 +1627,126 @@ static void parseFirstLine(Webs *wp)
 
 
 /*
-    Parse a full request
+    Identify a known request header from its lower case key. Headers are matched on length first so most headers are
+    resolved with at most two comparisons.
+ */
+static int lookupHeader(cchar *key, ssize len)
+{
+    switch (len) {
+    case 4:
+        return memcmp(key, "host", 4) == 0 ? HDR_HOST : HDR_OTHER;
+    case 5:
+        return memcmp(key, "range", 5) == 0 ? HDR_RANGE : HDR_OTHER;
+    case 6:
+        return memcmp(key, "cookie", 6) == 0 ? HDR_COOKIE : HDR_OTHER;
+    case 7:
+        /*
+            Yes Veronica, the HTTP spec does misspell Referrer
+         */
+        return memcmp(key, "referer", 7) == 0 ? HDR_REFERER : HDR_OTHER;
+    case 8:
+        return memcmp(key, "if-range", 8) == 0 ? HDR_IF_RANGE : HDR_OTHER;
+    case 10:
+        if (memcmp(key, "user-agent", 10) == 0) {
+            return HDR_USER_AGENT;
+        }
+        return memcmp(key, "connection", 10) == 0 ? HDR_CONNECTION : HDR_OTHER;
+    case 12:
+        return memcmp(key, "content-type", 12) == 0 ? HDR_CONTENT_TYPE : HDR_OTHER;
+    case 13:
+        if (memcmp(key, "authorization", 13) == 0) {
+            return HDR_AUTHORIZATION;
+        }
+        return memcmp(key, "if-none-match", 13) == 0 ? HDR_IF_NONE_MATCH : HDR_OTHER;
+    case 14:
+        return memcmp(key, "content-length", 14) == 0 ? HDR_CONTENT_LENGTH : HDR_OTHER;
+    case 15:
+        return memcmp(key, "accept-encoding", 15) == 0 ? HDR_ACCEPT_ENCODING : HDR_OTHER;
+    case 17:
+        if (memcmp(key, "if-modified-since", 17) == 0) {
+            return HDR_IF_MODIFIED_SINCE;
+        }
+        return memcmp(key, "transfer-encoding", 17) == 0 ? HDR_TRANSFER_ENCODING : HDR_OTHER;
+    }
+    return HDR_OTHER;
+}
+
+
+/*
+    Parse the request headers up to "end" which points to the "\r\n\r\n" terminating the headers. The header block
+    is copied once into the request arena and tokenized in a single pass. Each header is recorded in wp->headers as
+    key and value slices of this copy, so the rxbuf may be compacted or grown while reading the body. The HTTP_*
+    request variables are created on demand by websSetHeaderVars, at the latest before the variables are first walked.
  */
-static void parseHeaders(Webs *wp)
+static void parseHeaders(Webs *wp, char *end)
 {
-    cchar   *prior;
-    char    *combined, *upperKey, *cp, *key, *value, *tok;
-    int     count;
+    WebsHeader  *hp;
+    char        *block, *blockEnd, *cp, *date, *eol, *key, *value, *tok;
+    ssize       len, keyLen;
 
     assert(websValid(wp));
 
-    /*
-        Parse the header and create the Http header keyword variables
-        We rewrite the header as we go for non-local requests.  NOTE: this
-        modifies the header string directly and tokenizes each line with '\0'.
-    */
-    for (count = 0; wp->rxbuf.servp[0] != '\r'; count++) {
-        if (count >= ME_GOAHEAD_LIMIT_NUM_HEADERS) {
+    len = (end + 2) - wp->rxbuf.servp;
+    if (len < 0) {
+        len = 0;
+    }
+    if ((block = arenaAlloc(wp, len + 1)) == 0 ||
+            (wp->headers = (WebsHeader*) arenaAlloc(wp, ME_GOAHEAD_LIMIT_NUM_HEADERS * sizeof(WebsHeader))) == 0) {
+        websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR | WEBS_CLOSE, "Cannot allocate headers");
+        return;
+    }
+    memcpy(block, wp->rxbuf.servp, len);
+    block[len] = '\0';
+    blockEnd = &block[len];
+    if (len > 0) {
+        wp->rxbuf.servp = end + 2;
+    }
+    for (cp = block; cp < blockEnd; cp = eol + 2) {
+        for (eol = memchr(cp, '\r', blockEnd - cp); eol && eol[1] != '\n'; eol = memchr(&eol[1], '\r', blockEnd - eol - 1)) {}
+        if (eol == 0) {
+            break;
+        }
+        *eol = '\0';
+        if (wp->headerCount >= ME_GOAHEAD_LIMIT_NUM_HEADERS) {
             websError(wp, HTTP_CODE_REQUEST_TOO_LARGE | WEBS_CLOSE, "Too many headers");
             return;
         }
-        if ((key = getToken(wp, ":")) == NULL) {
+        if ((value = memchr(cp, ':', eol - cp)) == 0 || value == cp) {
+            /* Ignore malformed header lines */
             continue;
         }
-        if ((value = getToken(wp, "\r\n")) == NULL) {
-            value = "";
-        }
-        if (!key || !value) {
-            websError(wp, HTTP_CODE_BAD_REQUEST | WEBS_CLOSE, "Bad header format");
-            return;
-        }
-        while (isspace((uchar) *value)) {
-            value++;
-        }
-        slower(key);
-
-        /*
-            Create a header variable for each line in the header
-         */
-        upperKey = sfmt("HTTP_%s", key);
-        for (cp = upperKey; *cp; cp++) {
-            if (*cp == '-') {
-                *cp = '_';
-            }
-        }
-        supper(upperKey);
-        if ((prior = websGetVar(wp, upperKey, 0)) != 0) {
-            combined = sfmt("%s, %s", prior, value);
-            websSetVar(wp, upperKey, combined);
-            wfree(combined);
-        } else {
-            websSetVar(wp, upperKey, value);
-        }
-        wfree(upperKey);
-
-        /*
-            Track the requesting agent (browser) type
-         */
-        if (strcmp(key, "user-agent") == 0) {
-            wfree(wp->userAgent);
-            wp->userAgent = sclone(value);
+        *value = '\0';
+        key = slower(cp);
+        keyLen = value - cp;
+        for (value++; isspace((uchar) *value); value++) {}
+        hp = &wp->headers[wp->headerCount++];
+        hp->key = key;
+        hp->value = value;
+
+        switch (lookupHeader(key, keyLen)) {
+        case HDR_USER_AGENT:
+            wp->userAgent = value;
+            break;
 
-        } else if (scaselesscmp(key, "authorization") == 0) {
-            wfree(wp->authType);
-            wp->authType = sclone(value);
+        case HDR_AUTHORIZATION:
+            /*
+                Split a copy so the header value itself is preserved
+             */
+            wp->authType = arenaClone(wp, value);
             ssplit(wp->authType, " \t", &tok);
-            wfree(wp->authDetails);
-            wp->authDetails = sclone(tok);
+            wp->authDetails = tok;
             slower(wp->authType);
+            break;
 
-        } else if (strcmp(key, "connection") == 0) {
-            slower(value);
-            if (strcmp(value, "keep-alive") == 0) {
+        case HDR_CONNECTION:
+            if (scaselessmatch(value, "keep-alive")) {
                 wp->flags |= WEBS_KEEP_ALIVE;
-            } else if (strcmp(value, "close") == 0) {
+            } else if (scaselessmatch(value, "close")) {
                 wp->flags &= ~WEBS_KEEP_ALIVE;
             }
+            break;
 
-        } else if (strcmp(key, "content-length") == 0) {
+        case HDR_CONTENT_LENGTH:
             if ((wp->rxLen = atoi(value)) < 0) {
                 websError(wp, HTTP_CODE_REQUEST_TOO_LARGE | WEBS_CLOSE, "Invalid content length");
                 return;
@@ -1109,10 +1765,10 @@ static void parseHeaders(Webs *wp)
             if (!smatch(wp->method, "HEAD")) {
                 wp->rxRemaining = wp->rxLen;
             }
+            break;
 
-        } else if (strcmp(key, "content-type") == 0) {
-            wfree(wp->contentType);
-            wp->contentType = sclone(value);
+        case HDR_CONTENT_TYPE:
+            wp->contentType = value;
             if (strstr(value, "application/x-www-form-urlencoded")) {
                 wp->flags |= WEBS_FORM;
             } else if (strstr(value, "application/json")) {
@@ -1120,44 +1776,64 @@ static void parseHeaders(Webs *wp)
             } else if (strstr(value, "multipart/form-data")) {
                 wp->flags |= WEBS_UPLOAD;
             }
+            break;
 
-        } else if (strcmp(key, "cookie") == 0) {
+        case HDR_COOKIE:
             wp->flags |= WEBS_COOKIE;
             if (wp->cookie) {
-                char *prior = wp->cookie;
-                wp->cookie = sfmt("%s; %s", prior, value);
-                wfree(prior);
+                wp->cookie = arenaJoin(wp, wp->cookie, "; ", value);
             } else {
-                wp->cookie = sclone(value);
+                wp->cookie = value;
             }
+            break;
 
-        } else if (strcmp(key, "host") == 0) {
+        case HDR_HOST:
             if ((int) strspn(value, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_-.[]:")
                     < (int) slen(value)) {
                 websError(wp, WEBS_CLOSE | HTTP_CODE_BAD_REQUEST, "Bad host header");
                 return;
             }
-            wfree(wp->host);
-            wp->host = sclone(value);
+            wp->host = value;
+            break;
+
+        case HDR_ACCEPT_ENCODING:
+            wp->acceptEncoding = parseAcceptEncoding(value);
+            break;
 
-        } else if (strcmp(key, "if-modified-since") == 0) {
-            if ((cp = strchr(value, ';')) != NULL) {
-                *cp = '\0';
+        case HDR_IF_MODIFIED_SINCE:
+            /*
+                Parse a copy truncated at any parameters so the header value itself is preserved
+             */
+            if ((date = arenaClone(wp, value)) != 0) {
+                if ((tok = strchr(date, ';')) != NULL) {
+                    *tok = '\0';
+                }
+                websParseDateTime(&wp->since, date, 0);
             }
-            websParseDateTime(&wp->since, value, 0);
+            break;
 
-        /*
-            Yes Veronica, the HTTP spec does misspell Referrer
-         */
-        } else if (strcmp(key, "referer") == 0) {
-            wfree(wp->referrer);
-            wp->referrer = sclone(value);
+        case HDR_IF_NONE_MATCH:
+            wp->ifNoneMatch = value;
+            break;
+
+        case HDR_IF_RANGE:
+            wp->ifRange = value;
+            break;
+
+        case HDR_RANGE:
+            wp->range = value;
+            break;
 
-        } else if (strcmp(key, "transfer-encoding") == 0) {
+        case HDR_REFERER:
+            wp->referrer = value;
+            break;
+
+        case HDR_TRANSFER_ENCODING:
             if (scaselesscmp(value, "chunked") == 0) {
                 wp->rxChunkState = WEBS_CHUNK_START;
                 wp->rxRemaining = MAXINT;
             }
+            break;
         }
     }
     if (!wp->rxChunkState) {
@@ -1169,6 +1845,51 @@ static void parseHeaders(Webs *wp)
         wp->rxbuf.servp += 2;
     }
     wp->eof = (wp->rxRemaining == 0);
+    if (wp->headerCount > 0) {
+        hashSetFill(wp->vars, fillHeaderVars, wp);
+    }
+}
+
+
+/*
+    Create the HTTP_* variables before the request variables are first walked
+ */
+static void fillHeaderVars(void *data)
+{
+    websSetHeaderVars((Webs*) data);
+}
+
+
+/*
+    Parse the Accept-Encoding header into a mask of WEBS_ENCODE_* content encodings. Encodings with q=0 are refused.
+ */
+static int parseAcceptEncoding(cchar *value)
+{
+    char    *buf, *tok, *next, *params;
+    int     mask;
+
+    mask = 0;
+    buf = sclone(value);
+    for (tok = stok(buf, ",", &next); tok; tok = stok(NULL, ",", &next)) {
+        tok = strim(tok, " \t", WEBS_TRIM_BOTH);
+        if ((params = strchr(tok, ';')) != NULL) {
+            *params++ = '\0';
+            tok = strim(tok, " \t", WEBS_TRIM_END);
+            params = strim(params, " \t", WEBS_TRIM_BOTH);
+            if (sncaselesscmp(params, "q=", 2) == 0 && atof(&params[2]) <= 0) {
+                continue;
+            }
+        }
+        if (scaselessmatch(tok, "gzip") || scaselessmatch(tok, "x-gzip")) {
+            mask |= WEBS_ENCODE_GZIP;
+        } else if (scaselessmatch(tok, "br")) {
+            mask |= WEBS_ENCODE_BR;
+        } else if (smatch(tok, "*")) {
+            mask |= WEBS_ENCODE_GZIP | WEBS_ENCODE_BR;
+        }
+    }
+    wfree(buf);
+    return mask;
 }
 
 
@@ -1197,7 +1918,7 @@ static bool processContent(Webs *wp)
     }
 #endif
 #if ME_GOAHEAD_CGI
-    if (wp->cgifd >= 0) {
+    if (wp->cgifd >= 0 || wp->cgi) {
         canProceed = websProcessCgiData(wp);
         if (!canProceed || wp->finalized) {
             return canProceed;
@@ -1342,10 +2063,25 @@ static bool filterChunkData(Webs *wp)
 PUBLIC void websServiceEvents(int *finished)
 {
     int     delay, nextEvent;
+#if ME_UNIX_LIKE
+    int     rc;
+#endif
 
     if (finished) {
         *finished = 0;
     }
+#if ME_UNIX_LIKE
+    if (workerCount > 0 && workerIndex < 0) {
+        if ((rc = superviseWorkers(finished)) == 0) {
+            return;
+        }
+        if (rc < 0) {
+            error("Cannot start workers, running as a single process");
+            workerCount = 0;
+        }
+        /* This is a worker process or the workers could not be started. Fall through to service events */
+    }
+#endif
     delay = 0;
     while (!finished || !*finished) {
         if (socketSelect(-1, delay)) {
@@ -1362,6 +2098,323 @@ PUBLIC void websServiceEvents(int *finished)
 }
 
 
+#if ME_UNIX_LIKE
+/*
+    Start and supervise the worker processes. Returns 1 in a worker process, zero in the supervisor when finished and
+    -1 if the workers cannot be started.
+ */
+static int superviseWorkers(int *finished)
+{
+    struct sigaction    act;
+    sigset_t            mask;
+    WebsTime            now;
+#if !ME_ROM
+    WebsTime            storeDue;
+#endif
+    int                 i, status, started, wait;
+    pid_t               pid;
+
+    workerPids = walloc(workerCount * sizeof(int));
+    workerStarted = walloc(workerCount * sizeof(WebsTime));
+    workerDue = walloc(workerCount * sizeof(WebsTime));
+    workerDelay = walloc(workerCount * sizeof(int));
+    if (workerPids == 0 || workerStarted == 0 || workerDue == 0 || workerDelay == 0) {
+        return -1;
+    }
+    memset(workerPids, 0, workerCount * sizeof(int));
+    memset(workerDue, 0, workerCount * sizeof(WebsTime));
+    memset(workerDelay, 0, workerCount * sizeof(int));
+#if defined(SO_REUSEPORT)
+    /*
+        Each worker opens its own listeners so the kernel can distribute connections over the workers. The supervisor
+        keeps its listeners until the workers signal they are listening by closing their end of this pipe.
+     */
+    if (pipe(workerReady) < 0) {
+        workerReady[0] = workerReady[1] = -1;
+    }
+#endif
+    /*
+        Block SIGCHLD, SIGALRM and the termination signals so they are only delivered while waiting in sigsuspend.
+        Otherwise a signal arriving between testing finished and waiting would not wake the supervisor.
+     */
+    memset(&act, 0, sizeof(act));
+    act.sa_handler = workerSignal;
+    act.sa_flags = SA_NOCLDSTOP;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGCHLD, &act, &workerChildAction);
+    sigaction(SIGALRM, &act, &workerAlarmAction);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGALRM);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, &mask, &workerMask);
+
+#if !ME_ROM
+    storeDue = time(0) + WEBS_SESSION_PRUNE / 1000;
+#endif
+    logmsg(2, "Starting %d workers. Sessions are not shared between workers", workerCount);
+    for (started = i = 0; i < workerCount; i++) {
+        if ((status = startWorker(i)) == 0) {
+            return 1;
+        } else if (status < 0) {
+            scheduleWorker(i);
+        } else {
+            started++;
+        }
+    }
+#if defined(SO_REUSEPORT)
+    if (started > 0 || workerReady[0] < 0) {
+        releaseListeners();
+    }
+#endif
+    while (!finished || !*finished) {
+#if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
+        if (accessReopen) {
+            /* The workers write the access log */
+            accessReopen = 0;
+            for (i = 0; i < workerCount; i++) {
+                if (workerPids[i] > 0) {
+                    kill(workerPids[i], SIGHUP);
+                }
+            }
+        }
+#endif
+        if ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (i = 0; i < workerCount; i++) {
+                if (workerPids[i] == pid) {
+                    break;
+                }
+            }
+            if (i >= workerCount) {
+                continue;
+            }
+            workerPids[i] = 0;
+            if (finished && *finished) {
+                break;
+            }
+            if (WIFSIGNALED(status)) {
+                error("Worker %d (pid %d) died from signal %d, restarting", i, pid, WTERMSIG(status));
+            } else {
+                error("Worker %d (pid %d) exited with status %d, restarting", i, pid, WEXITSTATUS(status));
+            }
+            if ((time(0) - workerStarted[i]) > WORKER_MAX_DELAY) {
+                /* The worker was stable so restart it without delay */
+                workerDelay[i] = 0;
+            }
+            scheduleWorker(i);
+            continue;
+        }
+        /*
+            Start workers that are due and wake for the next retry with SIGALRM
+         */
+        now = time(0);
+        wait = 0;
+        for (i = 0; i < workerCount; i++) {
+            if (workerPids[i] > 0) {
+                continue;
+            }
+            if (workerDue[i] <= now) {
+                if ((status = startWorker(i)) == 0) {
+                    return 1;
+                } else if (status < 0) {
+                    scheduleWorker(i);
+                }
+#if defined(SO_REUSEPORT)
+                else if (workerReady[0] >= 0) {
+                    releaseListeners();
+                }
+#endif
+            }
+            if (workerPids[i] == 0) {
+                wait = wait ? min(wait, (int) (workerDue[i] - now)) : (int) (workerDue[i] - now);
+                wait = max(wait, 1);
+            }
+        }
+#if !ME_ROM
+        /*
+            Workers append to the session store but do not rewrite it, so the supervisor does
+         */
+        if (sessionStore) {
+            if (storeDue <= now) {
+                compactSharedStore();
+                storeDue = now + WEBS_SESSION_PRUNE / 1000;
+            }
+            wait = wait ? min(wait, (int) (storeDue - now)) : (int) (storeDue - now);
+            wait = max(wait, 1);
+        }
+#endif
+        alarm(wait);
+        /* Wait for a worker to exit, a retry to fall due or a termination or reopen signal */
+        sigsuspend(&workerMask);
+    }
+    alarm(0);
+    for (i = 0; i < workerCount; i++) {
+        if (workerPids[i] > 0) {
+            kill(workerPids[i], SIGTERM);
+        }
+    }
+    for (i = 0; i < workerCount; i++) {
+        if (workerPids[i] > 0) {
+            while (waitpid(workerPids[i], &status, 0) < 0 && errno == EINTR) {}
+            workerPids[i] = 0;
+        }
+    }
+#if defined(SO_REUSEPORT)
+    if (workerReady[0] >= 0) {
+        releaseListeners();
+    }
+#endif
+    sigaction(SIGCHLD, &workerChildAction, 0);
+    sigaction(SIGALRM, &workerAlarmAction, 0);
+    sigprocmask(SIG_SETMASK, &workerMask, 0);
+    return 0;
+}
+
+
+/*
+    Schedule a worker restart. The first restart is immediate and each further restart doubles the delay.
+ */
+static void scheduleWorker(int index)
+{
+    workerDue[index] = time(0) + workerDelay[index];
+    workerDelay[index] = workerDelay[index] ? min(workerDelay[index] * 2, WORKER_MAX_DELAY) : 1;
+}
+
+
+#if defined(SO_REUSEPORT)
+/*
+    Wait for the started workers to listen and then close the supervisor's listeners. The wait is bounded so a worker
+    that hangs before listening cannot stall the supervisor.
+ */
+static void releaseListeners()
+{
+    struct timeval  tv;
+    fd_set          readFds;
+    WebsTime        deadline, now;
+    char            ch;
+    ssize           rc;
+    int             i;
+
+    if (workerReady[0] >= 0) {
+        close(workerReady[1]);
+        deadline = time(0) + WORKER_READY_TIMEOUT;
+        do {
+            if ((now = time(0)) >= deadline) {
+                error("Workers did not start listening within %d seconds", WORKER_READY_TIMEOUT);
+                break;
+            }
+            FD_ZERO(&readFds);
+            FD_SET(workerReady[0], &readFds);
+            tv.tv_sec = (long) (deadline - now);
+            tv.tv_usec = 0;
+            if ((rc = select(workerReady[0] + 1, &readFds, NULL, NULL, &tv)) > 0) {
+                rc = read(workerReady[0], &ch, 1);
+            } else if (rc == 0) {
+                /* Timed out. Checked at the top of the loop */
+                rc = 1;
+            }
+        } while (rc > 0 || (rc < 0 && errno == EINTR));
+        close(workerReady[0]);
+        workerReady[0] = workerReady[1] = -1;
+    }
+    for (i = 0; i < listenMax; i++) {
+        if (listens[i] >= 0) {
+            socketCloseConnection(listens[i]);
+            listens[i] = -1;
+        }
+    }
+}
+#endif
+
+
+/*
+    Signal handler for the supervisor. The signals only need to interrupt sigsuspend.
+ */
+static void workerSignal(int signo)
+{
+}
+
+
+/*
+    Fork a worker process. Returns zero in the worker, 1 in the supervisor and -1 on errors.
+ */
+static int startWorker(int index)
+{
+    char    *endpoint;
+    pid_t   pid;
+    int     i, count;
+
+    if ((pid = fork()) < 0) {
+        error("Cannot fork worker %d, errno %d", index, errno);
+        return -1;
+    }
+    if (pid > 0) {
+        workerPids[index] = pid;
+        workerStarted[index] = time(0);
+        return 1;
+    }
+    workerIndex = index;
+#if !ME_ROM
+    reopenSessionStore();
+#endif
+    sigaction(SIGCHLD, &workerChildAction, 0);
+    sigaction(SIGALRM, &workerAlarmAction, 0);
+    sigprocmask(SIG_SETMASK, &workerMask, 0);
+#if LINUX
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+#if defined(SO_REUSEPORT)
+    /*
+        Close the listeners inherited from the supervisor and open private listeners. The inherited sockets are shared
+        with the supervisor, so socketCloseConnection must not shut them down (see removeSocket).
+     */
+    for (i = 0; i < listenMax; i++) {
+        if (listens[i] >= 0) {
+            socketCloseConnection(listens[i]);
+            listens[i] = -1;
+        }
+    }
+    socketRestartEvents();
+    count = listenMax;
+    listenMax = 0;
+    for (i = 0; i < count; i++) {
+        endpoint = listenEndpoints[i];
+        listenEndpoints[i] = 0;
+        if (websListen(endpoint) < 0) {
+            exit(2);
+        }
+        wfree(endpoint);
+    }
+    if (workerReady[0] >= 0) {
+        close(workerReady[0]);
+        close(workerReady[1]);
+        workerReady[0] = workerReady[1] = -1;
+    }
+#else
+    socketRestartEvents();
+#endif
+    trace(2, "Worker %d started, pid %d", index, getpid());
+    return 0;
+}
+#endif /* ME_UNIX_LIKE */
+
+
+PUBLIC int websGetWorker()
+{
+    return workerIndex;
+}
+
+
+PUBLIC void websSetWorkers(int count)
+{
+#if ME_UNIX_LIKE
+    workerCount = max(count, 0);
+#endif
+}
+
+
 /*
     NOTE: the vars variable is modified
  */
@@ -1432,6 +2485,63 @@ PUBLIC void websSetEnv(Webs *wp)
     websSetVar(wp, "SERVER_PROTOCOL", wp->protoVersion);
     websSetVar(wp, "SERVER_URL", websHostUrl);
     websSetVarFmt(wp, "SERVER_SOFTWARE", "GoAhead/%s", ME_VERSION);
+    websSetHeaderVars(wp);
+}
+
+
+/*
+    Create the HTTP_* variables for the request headers. This is done on demand when a variable of this form is first
+    referenced or before the variables are first walked. Repeated headers are joined with ", ". The values reference
+    the request arena and are not copied.
+ */
+PUBLIC void websSetHeaderVars(Webs *wp)
+{
+    WebsHeader  *hp;
+    WebsKey     *sp;
+    char        *name, *cp, *value;
+    int         i;
+
+    assert(websValid(wp));
+
+    if (wp->flags & WEBS_HEADER_VARS) {
+        return;
+    }
+    wp->flags |= WEBS_HEADER_VARS;
+    hashSetFill(wp->vars, 0, 0);
+    for (i = 0; i < wp->headerCount; i++) {
+        hp = &wp->headers[i];
+        if ((name = arenaJoin(wp, "HTTP_", "", hp->key)) == 0) {
+            return;
+        }
+        for (cp = &name[5]; *cp; cp++) {
+            *cp = (*cp == '-') ? '_' : toupper((uchar) *cp);
+        }
+        value = hp->value;
+        if ((sp = hashLookup(wp->vars, name)) != 0 && sp->content.value.string) {
+            if ((value = arenaJoin(wp, sp->content.value.string, ", ", hp->value)) == 0) {
+                return;
+            }
+        }
+        hashEnter(wp->vars, name, valueString(value, 0), 0);
+    }
+}
+
+
+/*
+    Get a request header value. The key is case insensitive. Returns the first header of that name.
+ */
+PUBLIC cchar *websGetHeader(Webs *wp, cchar *key)
+{
+    int     i;
+
+    assert(websValid(wp));
+
+    for (i = 0; i < wp->headerCount; i++) {
+        if (scaselessmatch(wp->headers[i].key, key)) {
+            return wp->headers[i].value;
+        }
+    }
+    return 0;
 }
 
 
@@ -1475,6 +2585,9 @@ PUBLIC WebsKey *websSetVarFmt(Webs *wp, cchar *var, cchar *fmt, ...)
     assert(websValid(wp));
     assert(var && *var);
 
+    if (!(wp->flags & WEBS_HEADER_VARS) && IS_HEADER_VAR(var)) {
+        websSetHeaderVars(wp);
+    }
     if (fmt) {
         va_start(args, fmt);
         v = valueString(sfmtv(fmt, args), 0);
@@ -1494,6 +2607,9 @@ PUBLIC WebsKey *websSetVar(Webs *wp, cchar *var, cchar *value)
     assert(websValid(wp));
     assert(var && *var);
 
+    if (!(wp->flags & WEBS_HEADER_VARS) && IS_HEADER_VAR(var)) {
+        websSetHeaderVars(wp);
+    }
     if (value) {
         v = valueString(value, VALUE_ALLOCATE);
     } else {
@@ -1516,6 +2632,9 @@ PUBLIC bool websTestVar(Webs *wp, cchar *var)
     if (var == NULL || *var == '\0') {
         return 0;
     }
+    if (!(wp->flags & WEBS_HEADER_VARS) && IS_HEADER_VAR(var)) {
+        websSetHeaderVars(wp);
+    }
     if ((sp = hashLookup(wp->vars, var)) == NULL) {
         return 0;
     }
@@ -1534,6 +2653,9 @@ PUBLIC cchar *websGetVar(Webs *wp, cchar *var, cchar *defaultGetValue)
     assert(websValid(wp));
     assert(var && *var);
 
+    if (!(wp->flags & WEBS_HEADER_VARS) && IS_HEADER_VAR(var)) {
+        websSetHeaderVars(wp);
+    }
     if ((sp = hashLookup(wp->vars, var)) != NULL) {
         assert(sp->content.type == string);
         if (sp->content.value.string) {
@@ -1583,6 +2705,10 @@ PUBLIC void websResponse(Webs *wp, int code, cchar *message)
     ssize   len;
 
     assert(websValid(wp));
+    if (acquireBuffers(wp) < 0) {
+        wp->flags |= WEBS_CLOSED;
+        return;
+    }
     websSetStatus(wp, code);
 
     if (!smatch(wp->method, "HEAD") && message && *message) {
@@ -1771,10 +2897,16 @@ PUBLIC char *websEscapeHtml(cchar *html)
 }
 
 
+/*
+    Most header values are literals or a single string and are appended without formatting. Other values are formatted
+    into a local buffer and only allocated if they do not fit.
+ */
 PUBLIC int websWriteHeader(Webs *wp, cchar *key, cchar *fmt, ...)
 {
     va_list     vargs;
-    char        *buf;
+    cchar       *value;
+    char        *buf, local[256];
+    int         rc;
 
     assert(websValid(wp));
 
@@ -1782,56 +2914,153 @@ PUBLIC int websWriteHeader(Webs *wp, cchar *key, cchar *fmt, ...)
         wp->flags |= WEBS_RESPONSE_TRACED;
         trace(3 | WEBS_RAW_MSG, "\n>>> Response\n");
     }
-    if (key) {
-        if (websWriteBlock(wp, key, strlen(key)) < 0) {
-            return -1;
-        }
-        if (websWriteBlock(wp, ": ", 2) < 0) {
-            return -1;
-        }
-        trace(3 | WEBS_RAW_MSG, "%s: ", key);
+    if (key && scaselessmatch(key, "Content-Encoding")) {
+        wp->flags |= WEBS_ENCODED;
     }
+    buf = 0;
+    value = 0;
     if (fmt) {
         va_start(vargs, fmt);
-        if ((buf = sfmtv(fmt, vargs)) == 0) {
-            error("websWrite lost data, buffer overflow");
-            return -1;
+        if (strchr(fmt, '%') == 0) {
+            value = fmt;
+        } else if (smatch(fmt, "%s")) {
+            if ((value = va_arg(vargs, cchar*)) == 0) {
+                value = "null";
+            }
+        } else if (slen(value = fmtv(local, sizeof(local), fmt, vargs)) >= sizeof(local) - 1) {
+            /* May have been truncated */
+            va_end(vargs);
+            va_start(vargs, fmt);
+            if ((value = buf = sfmtv(fmt, vargs)) == 0) {
+                va_end(vargs);
+                error("websWrite lost data, buffer overflow");
+                return -1;
+            }
         }
         va_end(vargs);
-        assert(strstr(buf, "UNION") == 0);
-        trace(3 | WEBS_RAW_MSG, "%s", buf);
-        if (websWriteBlock(wp, buf, strlen(buf)) < 0) {
-            return -1;
-        }
-        wfree(buf);
-        if (websWriteBlock(wp, "\r\n", 2) != 2) {
-            return -1;
-        }
+        assert(strstr(value, "UNION") == 0);
     }
-    trace(3 | WEBS_RAW_MSG, "\r\n");
-    return 0;
+    trace(3 | WEBS_RAW_MSG, "%s%s%s\r\n", key ? key : "", key ? ": " : "", value ? value : "");
+    rc = putHeader(wp, key, value);
+    wfree(buf);
+    return rc;
 }
 
 
-PUBLIC void websSetStatus(Webs *wp, int code)
+/*
+    Append a header line to the output buffer
+ */
+static int putHeader(Webs *wp, cchar *key, cchar *value)
 {
-    wp->code = (code & WEBS_CODE_MASK);
-    if (code & WEBS_CLOSE) {
-        wp->flags &= ~WEBS_KEEP_ALIVE;
+    if (wp->state >= WEBS_COMPLETE) {
+        return -1;
+    }
+    if (key && (putText(wp, key, slen(key)) < 0 || putText(wp, ": ", 2) < 0)) {
+        return -1;
     }
+    if (value && (putText(wp, value, slen(value)) < 0 || putText(wp, "\r\n", 2) < 0)) {
+        return -1;
+    }
+    bufAddNull(&wp->output);
+    return 0;
 }
 
 
 /*
-    Write a set of headers. Does not write the trailing blank line so callers can add more headers.
-    Set length to -1 if unknown and transfer-chunk-encoding will be employed.
+    Append header text to the output buffer. Headers always precede any chunked or compressed body, so header text is
+    copied directly into the output buffer rather than via websWriteBlock. The caller adds the terminating null.
  */
-PUBLIC void websWriteHeaders(Webs *wp, ssize length, cchar *location)
+static int putText(Webs *wp, cchar *text, ssize len)
 {
-    WebsKey     *key;
-    char        *date, *protoVersion;
+    WebsBuf     *op;
+    ssize       room;
 
-    assert(websValid(wp));
+    op = &wp->output;
+    if ((room = bufRoom(op)) <= len) {
+        bufCompact(op);
+        if ((room = bufRoom(op)) <= len && !bufGrow(op, max(len - room + 1, op->buflen))) {
+            error("Cannot grow output buffer");
+            return -1;
+        }
+    }
+    bufPutBlk(op, text, len);
+    return 0;
+}
+
+
+PUBLIC void websSetStatus(Webs *wp, int code)
+{
+    wp->code = (code & WEBS_CODE_MASK);
+    if (code & WEBS_CLOSE) {
+        wp->flags &= ~WEBS_KEEP_ALIVE;
+    }
+}
+
+
+/*
+    Render the response headers that do not vary between requests once at startup
+ */
+static void openHeaders()
+{
+    cchar   *server, *xframe;
+
+    server = xframe = "";
+#if !ME_GOAHEAD_STEALTH
+    server = "Server: GoAhead-http\r\n";
+#endif
+#ifdef ME_GOAHEAD_XFRAME_HEADER
+    if (*ME_GOAHEAD_XFRAME_HEADER) {
+        xframe = "X-Frame-Options: " ME_GOAHEAD_XFRAME_HEADER "\r\n";
+    }
+#endif
+    fixedHeaders = sfmt("%s%s", server, xframe);
+    fixedHeadersLen = slen(fixedHeaders);
+
+#if defined(ME_GOAHEAD_CLIENT_CACHE)
+    {
+        char    *exts, *ext, *tok;
+
+        clientCacheHeader = sfmt("Cache-Control: public, max-age=%d\r\n", ME_GOAHEAD_CLIENT_CACHE_LIFESPAN);
+        clientCacheHeaderLen = slen(clientCacheHeader);
+        clientCacheExts = hashCreate(-1);
+        exts = sclone(ME_GOAHEAD_CLIENT_CACHE);
+        for (ext = stok(exts, ", \t", &tok); ext; ext = stok(NULL, ", \t", &tok)) {
+            hashEnter(clientCacheExts, ext, valueInteger(1), 0);
+        }
+        wfree(exts);
+    }
+#endif
+}
+
+
+static void closeHeaders()
+{
+    wfree(fixedHeaders);
+    fixedHeaders = 0;
+#if defined(ME_GOAHEAD_CLIENT_CACHE)
+    wfree(clientCacheHeader);
+    clientCacheHeader = 0;
+    if (clientCacheExts >= 0) {
+        hashFree(clientCacheExts);
+        clientCacheExts = -1;
+    }
+#endif
+}
+
+
+/*
+    Write a set of headers. Does not write the trailing blank line so callers can add more headers.
+    Set length to -1 if unknown and transfer-chunk-encoding will be employed. The standard headers are assembled by
+    copying pre-rendered and per-request strings into the output buffer without formatting.
+ */
+PUBLIC void websWriteHeaders(Webs *wp, ssize length, cchar *location)
+{
+    WebsKey     *key;
+    cchar       *protoVersion, *msg;
+    char        num[32];
+    ssize       start;
+
+    assert(websValid(wp));
 
     if (!(wp->flags & WEBS_HEADERS_CREATED)) {
         protoVersion = wp->protoVersion;
@@ -1839,61 +3068,90 @@ PUBLIC void websWriteHeaders(Webs *wp, ssize length, cchar *location)
             protoVersion = "HTTP/1.0";
             wp->flags &= ~WEBS_KEEP_ALIVE;
         }
-        websWriteHeader(wp, NULL, "%s %d %s", protoVersion, wp->code, websErrorMsg(wp->code));
-#if !ME_GOAHEAD_STEALTH
-        websWriteHeader(wp, "Server", "GoAhead-http");
-#endif
-        if ((date = websGetDateString(NULL)) != NULL) {
-            websWriteHeader(wp, "Date", "%s", date);
-            wfree(date);
-        }
+        start = bufLen(&wp->output);
+        msg = websErrorMsg(wp->code);
+        itosbuf(num, sizeof(num), wp->code, 10);
+        putText(wp, protoVersion, slen(protoVersion));
+        putText(wp, " ", 1);
+        putText(wp, num, slen(num));
+        putText(wp, " ", 1);
+        putText(wp, msg, slen(msg));
+        putText(wp, "\r\n", 2);
+        putText(wp, fixedHeaders, fixedHeadersLen);
+        putHeader(wp, "Date", websGetHttpDate());
         if (wp->authResponse) {
-            websWriteHeader(wp, "WWW-Authenticate", "%s", wp->authResponse);
+            putHeader(wp, "WWW-Authenticate", wp->authResponse);
         }
         if (length >= 0) {
-            if (smatch(wp->method, "HEAD")) {
-                websWriteHeader(wp, "Content-Length", "%d", (int) length);
-            } else if (!((100 <= wp->code && wp->code <= 199) || wp->code == 204 || wp->code == 304)) {
+            if (smatch(wp->method, "HEAD") || !((100 <= wp->code && wp->code <= 199) || wp->code == 204 ||
+                    wp->code == 304)) {
                 /* Server must not emit a content length header for 1XX, 204 and 304 status */
-                websWriteHeader(wp, "Content-Length", "%d", (int) length);
+                itosbuf(num, sizeof(num), length, 10);
+                putHeader(wp, "Content-Length", num);
             }
         }
         wp->txLen = length;
         if (wp->txLen < 0) {
-            websWriteHeader(wp, "Transfer-Encoding", "chunked");
+            putText(wp, "Transfer-Encoding: chunked\r\n", 28);
         }
         if (wp->flags & WEBS_KEEP_ALIVE) {
-            websWriteHeader(wp, "Connection", "keep-alive");
+            putText(wp, "Connection: keep-alive\r\n", 24);
         } else {
-            websWriteHeader(wp, "Connection", "close");
+            putText(wp, "Connection: close\r\n", 19);
         }
         if (location) {
-            websWriteHeader(wp, "Location", "%s", location);
+            putHeader(wp, "Location", location);
         } else if ((key = hashLookup(websMime, wp->ext)) != 0) {
-            websWriteHeader(wp, "Content-Type", "%s", key->content.value.string);
+            putHeader(wp, "Content-Type", key->content.value.string);
         }
         if (wp->responseCookie) {
-            websWriteHeader(wp, "Set-Cookie", "%s", wp->responseCookie);
-            websWriteHeader(wp, "Cache-Control", "%s", "no-cache=\"set-cookie\"");
+            putHeader(wp, "Set-Cookie", wp->responseCookie);
+            putText(wp, "Cache-Control: no-cache=\"set-cookie\"\r\n", 38);
         }
 #if defined(ME_GOAHEAD_CLIENT_CACHE)
-        if (wp->ext) {
-            char *etok = sfmt("%s,", &wp->ext[1]);
-            if (strstr(ME_GOAHEAD_CLIENT_CACHE ",", etok)) {
-                websWriteHeader(wp, "Cache-Control", "public, max-age=%d", ME_GOAHEAD_CLIENT_CACHE_LIFESPAN);
-            }
-            wfree(etok);
+        if (wp->ext && clientCacheExts >= 0 && hashLookup(clientCacheExts, &wp->ext[1])) {
+            putText(wp, clientCacheHeader, clientCacheHeaderLen);
         }
 #endif
-#ifdef ME_GOAHEAD_XFRAME_HEADER
-        if (*ME_GOAHEAD_XFRAME_HEADER) {
-            websWriteHeader(wp, "X-Frame-Options", "%s", ME_GOAHEAD_XFRAME_HEADER);
+        if (!(wp->flags & WEBS_RESPONSE_TRACED)) {
+            wp->flags |= WEBS_RESPONSE_TRACED;
+            traceHeaders(wp, start);
         }
-#endif
     }
 }
 
 
+/*
+    Trace the response headers written from the given output offset. The output buffer is a ring and the headers
+    may wrap, so they are copied to a contiguous string.
+ */
+static void traceHeaders(Webs *wp, ssize start)
+{
+    WebsBuf     *bp;
+    char        *headers, *cp;
+    ssize       len, first;
+
+    if (websGetLogLevel() < 3) {
+        return;
+    }
+    bp = &wp->output;
+    len = bufLen(bp) - start;
+    if ((headers = walloc(len + 1)) == 0) {
+        return;
+    }
+    cp = bp->servp + start;
+    if (cp >= bp->endbuf) {
+        cp -= bp->buflen;
+    }
+    first = min(len, (ssize) (bp->endbuf - cp));
+    memcpy(headers, cp, first);
+    memcpy(&headers[first], bp->buf, len - first);
+    headers[len] = '\0';
+    trace(3 | WEBS_RAW_MSG, "\n>>> Response\n%s", headers);
+    wfree(headers);
+}
+
+
 PUBLIC void websWriteEndHeaders(Webs *wp)
 {
     assert(wp);
@@ -1903,10 +3161,35 @@ PUBLIC void websWriteEndHeaders(Webs *wp)
     if (wp->txLen >= 0) {
         websWriteBlock(wp, "\r\n", 2);
     }
-    wp->flags |= WEBS_HEADERS_CREATED;
     if (wp->txLen < 0) {
+#if ME_GOAHEAD_DEFLATE
+        /*
+            Compress chunked responses unless the handler has already encoded the content
+         */
+        if ((wp->acceptEncoding & WEBS_ENCODE_GZIP) && !(wp->flags & WEBS_ENCODED) && !smatch(wp->method, "HEAD") &&
+                startDeflate(wp)) {
+            websWriteHeader(wp, "Content-Encoding", "gzip");
+            websWriteHeader(wp, "Vary", "Accept-Encoding");
+            wp->flags |= WEBS_DEFLATE;
+        }
+#endif
         wp->flags |= WEBS_CHUNKING;
     }
+    wp->flags |= WEBS_HEADERS_CREATED;
+}
+
+
+/*
+    Replace an arena-held request string. The prior value is reclaimed with the arena.
+ */
+PUBLIC char *websSetRequestString(Webs *wp, char **field, cchar *value)
+{
+    assert(wp);
+    assert(field);
+    assert((char*) field >= (char*) wp && (char*) field < (char*) &wp[1]);
+
+    *field = value ? arenaClone(wp, value) : 0;
+    return *field;
 }
 
 
@@ -1971,76 +3254,221 @@ PUBLIC ssize websWriteSocket(Webs *wp, cchar *buf, ssize size)
     if ((written = socketWrite(wp->sid, (void*) buf, size)) < 0) {
         return written;
     }
-    wp->written += written;
-    websNoteRequestActivity(wp);
+    websNoteWritten(wp, written);
     return written;
 }
 
 
+static cchar chunkTrailer[] = "\r\n0\r\n\r\n";
+
 /*
-    Write some output using transfer chunk encoding if required.
-    Returns true if all the data was written. Otherwise return zero.
+    Start the next transmit chunk once the prior chunk has been written. The chunk prefix and final trailer are written
+    directly from txChunkPrefix and chunkTrailer rather than being copied into the output buffer.
  */
-static bool flushChunkData(Webs *wp)
+static void prepChunk(Webs *wp)
 {
-    ssize   len, written, room;
+    if (wp->txChunkState == WEBS_CHUNK_HEADER || wp->txChunkState == WEBS_CHUNK_DATA ||
+            wp->txChunkState == WEBS_CHUNK_TRAILER) {
+        return;
+    }
+    if (bufLen(&wp->chunkbuf) > 0) {
+        wp->txChunkLen = bufLen(&wp->chunkbuf);
+        fmt(wp->txChunkPrefix, sizeof(wp->txChunkPrefix), "\r\n%x\r\n", wp->txChunkLen);
+        wp->txChunkPrefixNext = wp->txChunkPrefix;
+        wp->txChunkPrefixLen = slen(wp->txChunkPrefix);
+        wp->txChunkState = WEBS_CHUNK_HEADER;
 
-    assert(wp);
+    } else if (wp->finalized) {
+        wp->txChunkPrefixNext = (char*) chunkTrailer;
+        wp->txChunkPrefixLen = sizeof(chunkTrailer) - 1;
+        wp->txChunkState = WEBS_CHUNK_TRAILER;
+    }
+}
 
-    while (bufLen(&wp->chunkbuf) > 0) {
-        /*
-            Stop if there is not room for a reasonable size chunk.
-            Subtract 16 to allow for the final trailer.
-         */
-        if ((room = bufRoom(&wp->output) - 16) <= CHUNK_LOW) {
-            bufGrow(&wp->output, CHUNK_LOW - room + 1);
-            if ((room = bufRoom(&wp->output) - 16) <= CHUNK_LOW) {
-                return 0;
-            }
-        }
-        switch (wp->txChunkState) {
-        default:
-        case WEBS_CHUNK_START:
-            /* Select the chunk size so that both the prefix and data will fit */
-            wp->txChunkLen = min(bufLen(&wp->chunkbuf), room - 16);
-            fmt(wp->txChunkPrefix, sizeof(wp->txChunkPrefix), "\r\n%x\r\n", wp->txChunkLen);
-            wp->txChunkPrefixLen = slen(wp->txChunkPrefix);
-            wp->txChunkPrefixNext = wp->txChunkPrefix;
-            wp->txChunkState = WEBS_CHUNK_HEADER;
-            break;
 
+/*
+    Advance the transmit chunk state by the number of chunk bytes written
+ */
+static void consumeChunk(Webs *wp, ssize written)
+{
+    ssize   len;
+
+    while (written > 0) {
+        switch (wp->txChunkState) {
         case WEBS_CHUNK_HEADER:
-            if ((written = bufPutBlk(&wp->output, wp->txChunkPrefixNext, wp->txChunkPrefixLen)) < 0) {
-                return 0;
-            } else {
-                wp->txChunkPrefixNext += written;
-                wp->txChunkPrefixLen -= written;
-                if (wp->txChunkPrefixLen <= 0) {
-                    wp->txChunkState = WEBS_CHUNK_DATA;
-                } else {
-                    return 0;
+        case WEBS_CHUNK_TRAILER:
+            len = min(written, wp->txChunkPrefixLen);
+            wp->txChunkPrefixNext += len;
+            wp->txChunkPrefixLen -= len;
+            written -= len;
+            if (wp->txChunkPrefixLen <= 0) {
+                if (wp->txChunkState == WEBS_CHUNK_TRAILER) {
+                    wp->txChunkState = WEBS_CHUNK_START;
+                    wp->flags &= ~WEBS_CHUNKING;
+                    assert(written == 0);
+                    return;
                 }
+                wp->txChunkState = WEBS_CHUNK_DATA;
             }
             break;
 
         case WEBS_CHUNK_DATA:
-            if (wp->txChunkLen > 0) {
-                len = min(room, wp->txChunkLen);
-                if ((written = bufPutBlk(&wp->output, wp->chunkbuf.servp, len)) != len) {
-                    assert(0);
-                    return -1;
-                }
-                bufAdjustStart(&wp->chunkbuf, written);
-                wp->txChunkLen -= written;
-                if (wp->txChunkLen <= 0) {
-                    wp->txChunkState = WEBS_CHUNK_START;
-                    bufCompact(&wp->chunkbuf);
-                }
-                bufAddNull(&wp->output);
+            len = min(written, wp->txChunkLen);
+            bufAdjustStart(&wp->chunkbuf, len);
+            wp->txChunkLen -= len;
+            written -= len;
+            if (wp->txChunkLen <= 0) {
+                wp->txChunkState = WEBS_CHUNK_START;
+                bufCompact(&wp->chunkbuf);
+                prepChunk(wp);
+            }
+            break;
+
+        default:
+            assert(0);
+            return;
+        }
+    }
+}
+
+
+/*
+    Add up to two vector elements describing len bytes at the start of a buffer which may wrap
+ */
+static int addIovec(WebsIovec *iov, int count, WebsBuf *bp, ssize len)
+{
+    ssize   first;
+
+    if (len <= 0) {
+        return count;
+    }
+    first = min(len, bp->endbuf - bp->servp);
+    iov[count].iov_base = bp->servp;
+    iov[count].iov_len = first;
+    count++;
+    if (len > first) {
+        iov[count].iov_base = bp->buf;
+        iov[count].iov_len = len - first;
+        count++;
+    }
+    return count;
+}
+
+
+#if ME_COM_SSL
+/*
+    Coalesce the chunk framing and data, or the block from websSendBlock, described by the vector into the output
+    buffer so a TLS response is written as a single record rather than one record per element. Returns the count of elements describing the output buffer.
+ */
+static int coalesceOutput(Webs *wp, WebsIovec *iov, int count)
+{
+    WebsBuf     *op;
+    ssize       nbytes;
+    int         first, i;
+
+    op = &wp->output;
+    first = addIovec(iov, 0, op, bufLen(op));
+    if (count <= first) {
+        return count;
+    }
+    for (nbytes = 0, i = first; i < count; i++) {
+        nbytes += iov[i].iov_len;
+    }
+    bufCompact(op);
+    if (bufRoom(op) <= nbytes && !bufGrow(op, nbytes - bufRoom(op) + 1)) {
+        return -1;
+    }
+    for (i = first; i < count; i++) {
+        bufPutBlk(op, iov[i].iov_base, iov[i].iov_len);
+    }
+    bufAddNull(op);
+    if (wp->txBodyLen > 0) {
+        wp->txBody += nbytes;
+        wp->txBodyLen -= nbytes;
+    } else {
+        consumeChunk(wp, nbytes);
+    }
+    return addIovec(iov, 0, op, bufLen(op));
+}
+#endif
+
+
+/*
+    Describe the pending output as an I/O vector: buffered output (headers and unchunked body), then either the block
+    from websSendBlock or the current chunk prefix, chunk data and the final chunk trailer. The block, chunk framing and
+    data are referenced in place rather than copied into the output buffer. Returns the number of vector elements and
+    sets *total to the bytes described.
+ */
+static int gatherOutput(Webs *wp, WebsIovec *iov, ssize *total)
+{
+    ssize       nbytes;
+    int         count, i;
+
+    count = addIovec(iov, 0, &wp->output, bufLen(&wp->output));
+    if (wp->txBodyLen > 0) {
+        iov[count].iov_base = (char*) wp->txBody;
+        iov[count].iov_len = wp->txBodyLen;
+        count++;
+    } else if (wp->flags & WEBS_CHUNKING) {
+        prepChunk(wp);
+        if (wp->txChunkState == WEBS_CHUNK_HEADER || wp->txChunkState == WEBS_CHUNK_TRAILER) {
+            iov[count].iov_base = wp->txChunkPrefixNext;
+            iov[count].iov_len = wp->txChunkPrefixLen;
+            count++;
+        }
+        if (wp->txChunkState == WEBS_CHUNK_HEADER || wp->txChunkState == WEBS_CHUNK_DATA) {
+            count = addIovec(iov, count, &wp->chunkbuf, wp->txChunkLen);
+            if (wp->finalized && wp->txChunkLen == bufLen(&wp->chunkbuf)) {
+                iov[count].iov_base = (char*) chunkTrailer;
+                iov[count].iov_len = sizeof(chunkTrailer) - 1;
+                count++;
             }
         }
     }
-    return bufLen(&wp->chunkbuf) == 0;
+    assert(count <= MAX_IOVEC);
+#if ME_COM_SSL
+    if ((wp->flags & WEBS_SECURE) && (count = coalesceOutput(wp, iov, count)) < 0) {
+        *total = 0;
+        return -1;
+    }
+#endif
+    for (nbytes = 0, i = 0; i < count; i++) {
+        nbytes += iov[i].iov_len;
+    }
+    *total = nbytes;
+    return count;
+}
+
+
+/*
+    Discard written bytes from the output buffer and then from the websSendBlock block or the chunk framing and data
+ */
+static void consumeOutput(Webs *wp, ssize written)
+{
+    WebsBuf     *op;
+    ssize       len;
+
+    op = &wp->output;
+    if ((len = min(written, bufLen(op))) > 0) {
+        bufAdjustStart(op, len);
+        /*
+            Only move the remaining data down when it is smaller than the space it frees. Otherwise draining a large
+            buffer would copy the remainder after every partial write.
+         */
+        if (bufLen(op) < (op->servp - op->buf)) {
+            bufCompact(op);
+        }
+        written -= len;
+    }
+    if (written > 0 && wp->txBodyLen > 0) {
+        len = min(written, wp->txBodyLen);
+        wp->txBody += len;
+        wp->txBodyLen -= len;
+        written -= len;
+    }
+    if (written > 0) {
+        consumeChunk(wp, written);
+    }
 }
 
 
@@ -2052,27 +3480,39 @@ static bool flushChunkData(Webs *wp)
  */
 PUBLIC int websFlush(Webs *wp, bool block)
 {
-    WebsBuf     *op;
+#if ME_GOAHEAD_DEFLATE
+    if (wp->flags & WEBS_DEFLATE) {
+        /*
+            Emit all data buffered by the compressor. Once finalized, terminate the compressed stream.
+         */
+        if (wp->finalized) {
+            deflateBlock(wp, NULL, 0, Z_FINISH);
+            endDeflate(wp);
+        } else {
+            deflateBlock(wp, NULL, 0, Z_SYNC_FLUSH);
+        }
+    }
+#endif
+    return flushOutput(wp, block);
+}
+
+
+/*
+    Write buffered output to the socket without flushing the compressor
+ */
+static int flushOutput(Webs *wp, bool block)
+{
+    WebsIovec   iov[MAX_IOVEC];
     ssize       nbytes, written;
-    int         errCode, wasBlocking;
+    int         count, errCode, wasBlocking;
 
     if (block) {
         wasBlocking = socketSetBlock(wp->sid, 1);
     }
-    op = &wp->output;
-    if (wp->flags & WEBS_CHUNKING) {
-        trace(6, "websFlush chunking finalized %d", wp->finalized);
-        if (flushChunkData(wp) && wp->finalized) {
-            trace(6, "websFlush: write chunk trailer");
-            bufPutStr(op, "\r\n0\r\n\r\n");
-            bufAddNull(op);
-            wp->flags &= ~WEBS_CHUNKING;
-        }
-    }
-    trace(6, "websFlush: buflen %d", bufLen(op));
     written = 0;
-    while ((nbytes = bufLen(op)) > 0) {
-        if ((written = websWriteSocket(wp, op->servp, nbytes)) < 0) {
+    while ((count = gatherOutput(wp, iov, &nbytes)) > 0 && nbytes > 0) {
+        trace(6, "websFlush: write %d bytes in %d vectors, finalized %d", nbytes, count, wp->finalized);
+        if ((written = writeSocketVector(wp, iov, count)) < 0) {
             errCode = socketGetError(wp->sid);
             if (errCode == EWOULDBLOCK || errCode == EAGAIN) {
                 /* Not an error */
@@ -2083,30 +3523,90 @@ PUBLIC int websFlush(Webs *wp, bool block)
                 Connection Error
              */
             wp->flags &= ~WEBS_KEEP_ALIVE;
-            bufFlush(op);
+            bufFlush(&wp->output);
             wp->state = WEBS_COMPLETE;
             break;
         } else if (written == 0) {
             break;
         }
         trace(6, "websFlush: wrote %d to socket", written);
-        bufAdjustStart(op, written);
-        bufCompact(op);
-        nbytes = bufLen(op);
+        consumeOutput(wp, written);
+        if (written < nbytes && !block) {
+            /* The socket is full */
+            break;
+        }
     }
     assert(websValid(wp));
 
-    if (bufLen(op) == 0 && wp->finalized) {
+    if (count < 0) {
+        error("Cannot grow output buffer");
+        wp->flags &= ~WEBS_KEEP_ALIVE;
+        wp->state = WEBS_COMPLETE;
+        written = -1;
+    }
+    if (wp->finalized && !(wp->flags & WEBS_CHUNKING) && !outputPending(wp)) {
         wp->state = WEBS_COMPLETE;
     }
     if (block) {
         socketSetBlock(wp->sid, wasBlocking);
+    } else if (wp->state < WEBS_COMPLETE) {
+        updateWriteInterest(wp);
     }
     if (written < 0) {
         /* I/O Error */
         return -1;
     }
-    return bufLen(op) == 0;
+    return !outputPending(wp);
+}
+
+
+/*
+    Test if there is buffered output, chunk data or a chunk trailer still to be written
+ */
+static bool outputPending(Webs *wp)
+{
+    return bufLen(&wp->output) > 0 || wp->txBodyLen > 0 || bufLen(&wp->chunkbuf) > 0 ||
+        wp->txChunkState == WEBS_CHUNK_TRAILER;
+}
+
+
+/*
+    Non-blocking vectored write to the socket. Returns the number of bytes written which may be short.
+    Returns -1 on errors. TLS output is coalesced by gatherOutput, but the output buffer may still wrap around its
+    end, so the elements are written in turn until one is written short.
+ */
+static ssize writeSocketVector(Webs *wp, WebsIovec *iov, int count)
+{
+    ssize   written;
+
+    if (wp->flags & WEBS_CLOSED) {
+        return -1;
+    }
+#if ME_COM_SSL
+    if (wp->flags & WEBS_SECURE) {
+        ssize   total;
+        int     i;
+
+        for (total = 0, i = 0; i < count; i++) {
+            if (iov[i].iov_len == 0) {
+                continue;
+            }
+            if ((written = websWriteSocket(wp, iov[i].iov_base, iov[i].iov_len)) < 0) {
+                return total > 0 ? total : written;
+            }
+            total += written;
+            if (written < (ssize) iov[i].iov_len) {
+                break;
+            }
+        }
+        return total;
+    }
+#endif
+    if ((written = socketWritev(wp->sid, iov, count)) < 0) {
+        return written;
+    }
+    websNoteWritten(wp, written);
+    return written;
 }
 
 
@@ -2117,17 +3617,38 @@ PUBLIC int websFlush(Webs *wp, bool block)
  */
 static void writeEvent(Webs *wp)
 {
-    WebsBuf     *op;
-
-    op = &wp->output;
-    if (bufLen(op) > 0) {
+    if (outputPending(wp)) {
         websFlush(wp, 0);
     }
-    if (bufLen(op) == 0 && wp->writeData) {
+    if (!outputPending(wp) && wp->writeData) {
         (wp->writeData)(wp);
     }
     if (wp->state != WEBS_RUNNING) {
         websPump(wp);
+    } else {
+        updateWriteInterest(wp);
+    }
+}
+
+
+/*
+    Listen for writable events while a running request has buffered output or a background writer. Otherwise a running
+    request with nothing to write would receive continuous writable events.
+ */
+static void updateWriteInterest(Webs *wp)
+{
+    WebsSocket  *sp;
+    int         mask;
+
+    if (wp->sid < 0 || (sp = socketPtr(wp->sid)) == 0) {
+        return;
+    }
+    mask = sp->handlerMask & ~SOCKET_WRITABLE;
+    if (outputPending(wp) || wp->writeData) {
+        mask |= SOCKET_WRITABLE;
+    }
+    if (mask != sp->handlerMask) {
+        socketCreateHandler(wp->sid, mask, socketEvent, wp);
     }
 }
 
@@ -2135,17 +3656,14 @@ static void writeEvent(Webs *wp)
 PUBLIC void websSetBackgroundWriter(Webs *wp, WebsWriteProc proc)
 {
     WebsSocket  *sp;
-    WebsBuf     *op;
 
     assert(proc);
 
     wp->writeData = proc;
-    op = &wp->output;
-
-    if (bufLen(op) > 0) {
+    if (outputPending(wp)) {
         websFlush(wp, 0);
     }
-    if (bufLen(op) == 0) {
+    if (!outputPending(wp)) {
         (wp->writeData)(wp);
     }
     if (wp->sid >= 0 && wp->state < WEBS_COMPLETE) {
@@ -2157,149 +3675,1004 @@ PUBLIC void websSetBackgroundWriter(Webs *wp, WebsWriteProc proc)
 
 /*
     Write a block of data of length to the user's browser. Output is buffered and flushed via websFlush.
-    This routine will never return "short". i.e. it will return the requested size to write or -1.
-    Buffer data. Will flush as required. May return -1 on write errors.
+    This never blocks and will never return "short". Returns -1 on write errors or if the request has completed.
  */
 PUBLIC ssize websWriteBlock(Webs *wp, cchar *buf, ssize size)
 {
-    WebsBuf     *op;
-    ssize       written, thisWrite, len, room;
+    return writeBlock(wp, buf, size, 0);
+}
 
-    assert(wp);
-    assert(websValid(wp));
+
+/*
+    Write a block of data for handlers that stream output from another source such as CGI programs. Buffered output
+    is limited to ME_GOAHEAD_LIMIT_OUTPUT. If the client is slow, this will return "short" and may return zero.
+    Callers must retain the remainder and write it from a background writer.
+ */
+PUBLIC ssize websStreamBlock(Webs *wp, cchar *buf, ssize size)
+{
+    return writeBlock(wp, buf, size, 1);
+}
+
+
+/*
+    Write a block of memory that follows the buffered output, such as a cached document body. The block is referenced
+    in place by gatherOutput so the headers and block are written by one vectored write. The unwritten remainder is
+    copied to the output buffer so the caller may release the block on return.
+ */
+PUBLIC ssize websSendBlock(Webs *wp, cchar *buf, ssize size)
+{
+    ssize   remaining;
+    int     rc;
+
+    assert(wp);
+    assert(websValid(wp));
     assert(buf);
     assert(size >= 0);
 
+    if (wp->flags & (WEBS_CHUNKING | WEBS_DEFLATE)) {
+        return writeBlock(wp, buf, size, 0);
+    }
     if (wp->state >= WEBS_COMPLETE) {
         return -1;
     }
+    wp->txBody = buf;
+    wp->txBodyLen = size;
+    rc = flushOutput(wp, 0);
+    buf = wp->txBody;
+    remaining = wp->txBodyLen;
+    wp->txBody = 0;
+    wp->txBodyLen = 0;
+    if (rc < 0 || wp->state >= WEBS_COMPLETE) {
+        return -1;
+    }
+    if (remaining > 0 && writeBlock(wp, buf, remaining, 0) < 0) {
+        return -1;
+    }
+    return size;
+}
+
+
+static ssize writeBlock(Webs *wp, cchar *buf, ssize size, bool bounded)
+{
+    WebsBuf     *op;
+    ssize       room, limit;
+#if ME_GOAHEAD_DEFLATE
+    ssize       written, len;
+#endif
+
+    assert(wp);
+    assert(websValid(wp));
+    assert(buf);
+    assert(size >= 0);
+
+    if (wp->state >= WEBS_COMPLETE) {
+        return -1;
+    }
+#if ME_GOAHEAD_DEFLATE
+    if (wp->flags & WEBS_DEFLATE) {
+        for (written = 0; written < size && wp->state < WEBS_COMPLETE; written += len) {
+            if (bounded && websOutputFull(wp) && (flushOutput(wp, 0) < 0 || websOutputFull(wp))) {
+                updateWriteInterest(wp);
+                break;
+            }
+            len = min(size - written, DEFLATE_SLICE);
+            if (deflateBlock(wp, &buf[written], len, Z_NO_FLUSH) < 0) {
+                return -1;
+            }
+            if (bufLen(&wp->chunkbuf) >= ME_GOAHEAD_LIMIT_BUFFER && flushOutput(wp, 0) < 0) {
+                return -1;
+            }
+        }
+        return (wp->state >= WEBS_COMPLETE && written == 0) ? -1 : written;
+    }
+#endif
     op = (wp->flags & WEBS_CHUNKING) ? &wp->chunkbuf : &wp->output;
-    written = len = 0;
 
-    while (size > 0 && wp->state < WEBS_COMPLETE) {
-        if (bufRoom(op) < size) {
+    if (bufRoom(op) < size && bufLen(op) > 0) {
+        /*
+            Write what the socket will accept without blocking. The remainder stays buffered and is written by
+            writeEvent when the socket is writable.
+         */
+        if (flushOutput(wp, 0) < 0 || wp->state >= WEBS_COMPLETE) {
+            return -1;
+        }
+    }
+    if (bounded) {
+        /*
+            Accept no more than the output limit. The caller retains the remainder.
+         */
+        limit = ME_GOAHEAD_LIMIT_OUTPUT - bufLen(&wp->output) - bufLen(&wp->chunkbuf);
+        if ((size = min(size, limit)) <= 0) {
+            updateWriteInterest(wp);
+            return 0;
+        }
+    }
+    if ((room = bufRoom(op)) < size) {
+        bufCompact(op);
+        if ((room = bufRoom(op)) < size && !bufGrow(op, max(size - room + 1, min(op->buflen, size)))) {
+            error("Cannot grow output buffer");
+            return -1;
+        }
+    }
+    bufPutBlk(op, buf, size);
+    bufAddNull(op);
+    return size;
+}
+
+
+PUBLIC bool websOutputFull(Webs *wp)
+{
+    return (bufLen(&wp->output) + bufLen(&wp->chunkbuf)) >= ME_GOAHEAD_LIMIT_OUTPUT;
+}
+
+
+#if ME_GOAHEAD_DEFLATE
+/*
+    Create a gzip compression stream for the response body
+ */
+static bool startDeflate(Webs *wp)
+{
+    z_stream    *zs;
+
+    if ((zs = walloc(sizeof(z_stream))) == NULL) {
+        return 0;
+    }
+    memset(zs, 0, sizeof(z_stream));
+    /* Window bits of 15 + 16 selects a gzip wrapper */
+    if (deflateInit2(zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        wfree(zs);
+        return 0;
+    }
+    wp->deflate = zs;
+    return 1;
+}
+
+
+static void endDeflate(Webs *wp)
+{
+    if (wp->deflate) {
+        deflateEnd((z_stream*) wp->deflate);
+        wfree(wp->deflate);
+        wp->deflate = 0;
+    }
+    wp->flags &= ~WEBS_DEFLATE;
+}
+
+
+/*
+    Compress a block of data into the chunk buffer. Mode is Z_NO_FLUSH, Z_SYNC_FLUSH or Z_FINISH.
+    The chunk buffer is grown as required and is drained by the caller. Returns the number of bytes consumed or -1.
+ */
+static ssize deflateBlock(Webs *wp, cchar *buf, ssize size, int mode)
+{
+    z_stream    *zs;
+    WebsBuf     *bp;
+    ssize       room;
+    int         rc;
+
+    zs = (z_stream*) wp->deflate;
+    bp = &wp->chunkbuf;
+    zs->next_in = (Bytef*) buf;
+    zs->avail_in = (uInt) size;
+    do {
+        if ((room = bufRoom(bp)) <= 0) {
+            if (!bufGrow(bp, ME_GOAHEAD_LIMIT_BUFFER)) {
+                return -1;
+            }
+            room = bufRoom(bp);
+        }
+        zs->next_out = (Bytef*) bp->endp;
+        zs->avail_out = (uInt) room;
+        rc = deflate(zs, mode);
+        if (rc == Z_STREAM_ERROR) {
+            return -1;
+        }
+        if (room > (ssize) zs->avail_out) {
+            bufAdjustEnd(bp, room - zs->avail_out);
+        }
+        /* Continue until all input is consumed and the compressor has no more output for this mode */
+    } while (zs->avail_in > 0 || (mode != Z_NO_FLUSH && zs->avail_out == 0) || (mode == Z_FINISH && rc != Z_STREAM_END));
+    return size;
+}
+#endif
+
+
+/*
+    Decode a URL (or part thereof). Allows insitu decoding.
+ */
+PUBLIC void websDecodeUrl(char *decoded, char *input, ssize len)
+{
+    char    *ip,  *op;
+    int     num, i, c;
+
+    assert(decoded);
+    assert(input);
+
+    if (!decoded) {
+        return;
+    }
+    if (!input) {
+        *decoded = '\0';
+        return;
+    }
+    if (len < 0) {
+        len = strlen(input);
+    }
+    op = decoded;
+    for (ip = input; *ip && len > 0; ip++, op++) {
+        if (*ip == '+') {
+            *op = ' ';
+        } else if (*ip == '%' && isxdigit((uchar) ip[1]) && isxdigit((uchar) ip[2])) {
             /*
-                This will do a blocking I/O write. Will only ever fail for I/O errors.
+                Convert %nn to a single character
              */
-            if (websFlush(wp, 1) < 0) {
-                return -1;
+            ip++;
+            for (i = 0, num = 0; i < 2; i++, ip++) {
+                c = tolower((uchar) *ip);
+                if (c >= 'a' && c <= 'f') {
+                    num = (num * 16) + 10 + c - 'a';
+                } else {
+                    num = (num * 16) + c - '0';
+                }
             }
+            *op = (char) num;
+            ip--;
+
+        } else {
+            *op = *ip;
         }
-        if ((room = bufRoom(op)) == 0) {
-            break;
+        len--;
+    }
+    *op = '\0';
+}
+
+
+#if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
+PUBLIC int websSetAccessLog(cchar *path, cchar *format, ssize maxSize, int backups)
+{
+    int     kind;
+
+    kind = accessFormat;
+    if (format) {
+        if (smatch(format, "common")) {
+            kind = ACCESS_COMMON;
+        } else if (smatch(format, "combined")) {
+            kind = ACCESS_COMBINED;
+        } else if (smatch(format, "json")) {
+            kind = ACCESS_JSON;
+        } else {
+            error("Unknown access log format \"%s\"", format);
+            return -1;
         }
-        thisWrite = min(room, size);
-        bufPutBlk(op, buf, thisWrite);
-        size -= thisWrite;
-        buf += thisWrite;
-        written += thisWrite;
     }
-    bufAddNull(op);
-    if (wp->state >= WEBS_COMPLETE && written == 0) {
+    accessFormat = kind;
+    if (path) {
+        wfree(accessLog);
+        accessLog = sclone(path);
+    }
+    accessMaxSize = max(maxSize, 0);
+    accessBackups = max(backups, 0);
+    if (accessBuf.buf) {
+        accessReopen = 1;
+    }
+    return 0;
+}
+
+
+PUBLIC void websReopenAccessLog()
+{
+    accessReopen = 1;
+}
+
+
+static void accessLogEvent(void *data, int id)
+{
+    accessScheduled = 0;
+    if (accessFd < 0) {
+        /* Retry opening a log that could not be opened or written */
+        accessReopen = 1;
+    }
+    flushAccessLog();
+}
+
+
+/*
+    Open the access log. The log is truncated when first opened by websOpen and appended to when reopened.
+ */
+static int openAccessLog()
+{
+    WebsStat    sbuf;
+    int         flags;
+
+    if (accessFormat < 0 && websSetAccessLog(NULL, ME_GOAHEAD_ACCESS_LOG_FORMAT, accessMaxSize, accessBackups) < 0) {
+        accessFormat = ACCESS_COMMON;
+    }
+    if (!accessLog) {
+        accessLog = sclone("access.log");
+    }
+    flags = O_CREAT | O_APPEND | O_WRONLY;
+    if (accessBuf.buf == 0) {
+        flags |= O_TRUNC;
+        bufCreate(&accessBuf, ME_GOAHEAD_ACCESS_LOG_BUFFER + ME_GOAHEAD_LIMIT_BUFFER,
+            ACCESS_RETAIN + ME_GOAHEAD_LIMIT_BUFFER);
+        accessEvent = websStartEvent(ME_GOAHEAD_ACCESS_LOG_FLUSH, accessLogEvent, 0);
+        accessScheduled = 1;
+    }
+    if ((accessFd = open(accessLog, flags, 0666)) < 0) {
+        error("Cannot open access log %s", accessLog);
+        return -1;
+    }
+    /* Some platforms don't implement O_APPEND (VXWORKS) */
+    lseek(accessFd, 0, SEEK_END);
+    accessSize = (stat(accessLog, &sbuf) == 0) ? (ssize) sbuf.st_size : 0;
+    return 0;
+}
+
+
+static void closeAccessLog()
+{
+    flushAccessLog();
+    if (accessFd >= 0) {
+        close(accessFd);
+        accessFd = -1;
+    }
+    if (accessEvent >= 0) {
+        websStopEvent(accessEvent);
+        accessEvent = -1;
+    }
+    bufFree(&accessBuf);
+    wfree(accessLog);
+    accessLog = 0;
+}
+
+
+/*
+    Rename the log to path.1 after shifting prior logs up by one. The oldest log is removed.
+ */
+static void rotateAccessLog()
+{
+    char    *from, *to;
+    int     i;
+
+    close(accessFd);
+    accessFd = -1;
+    if (accessBackups <= 0) {
+        unlink(accessLog);
+    } else {
+        for (i = accessBackups - 1; i >= 1; i--) {
+            from = sfmt("%s.%d", accessLog, i);
+            to = sfmt("%s.%d", accessLog, i + 1);
+            unlink(to);
+            rename(from, to);
+            wfree(from);
+            wfree(to);
+        }
+        to = sfmt("%s.1", accessLog);
+        unlink(to);
+        rename(accessLog, to);
+        wfree(to);
+    }
+    openAccessLog();
+}
+
+
+/*
+    Write buffered log lines with a single write. Invoked when the buffer fills and by a timer so lines are never
+    buffered for longer than ME_GOAHEAD_ACCESS_LOG_FLUSH milliseconds. If the log cannot be opened or written, the
+    lines are retained and the timer retries until the log is writable again.
+ */
+static void flushAccessLog()
+{
+    WebsStat    sbuf;
+    ssize       len, written;
+
+#if ME_UNIX_LIKE
+    if (workerIndex >= 0 && accessFd >= 0 && bufLen(&accessBuf) > 0) {
+        /* Another worker may have rotated the log */
+        WebsStat    fbuf;
+        if (fstat(accessFd, &fbuf) == 0 && (stat(accessLog, &sbuf) < 0 || sbuf.st_ino != fbuf.st_ino)) {
+            accessReopen = 1;
+        }
+    }
+#endif
+    if (accessReopen && accessBuf.buf) {
+        accessReopen = 0;
+        if (accessFd >= 0) {
+            close(accessFd);
+            accessFd = -1;
+        }
+        openAccessLog();
+    }
+    if (accessFd >= 0) {
+        while ((len = bufGetBlkMax(&accessBuf)) > 0) {
+            if ((written = write(accessFd, accessBuf.servp, (uint) len)) <= 0) {
+                error("Cannot write access log %s, errno %d", accessLog, errno);
+                close(accessFd);
+                accessFd = -1;
+                break;
+            }
+            bufAdjustStart(&accessBuf, written);
+            accessSize += written;
+        }
+    }
+    if (accessFd < 0) {
+        if (bufLen(&accessBuf) > 0 && !accessScheduled && accessEvent >= 0) {
+            websRestartEvent(accessEvent, ME_GOAHEAD_ACCESS_LOG_FLUSH);
+            accessScheduled = 1;
+        }
+        return;
+    }
+    bufFlush(&accessBuf);
+    if (accessMaxSize > 0 && workerIndex >= 0 && fstat(accessFd, &sbuf) == 0) {
+        /* Workers share the log so use the actual size */
+        accessSize = (ssize) sbuf.st_size;
+    }
+    if (accessMaxSize > 0 && accessSize >= accessMaxSize) {
+        rotateAccessLog();
+    }
+}
+
+
+/*
+    Format the log times. The times only change once per second so they are cached.
+ */
+static void updateAccessTime()
+{
+    WebsTime    now;
+    struct tm   localt;
+    char        zoneStr[8];
+    int         zone;
+
+    now = time(0);
+    if (now == accessTime) {
+        return;
+    }
+    accessTime = now;
+#if WINDOWS
+    {
+        TIME_ZONE_INFORMATION tzi;
+        localtime_s(&localt, &now);
+        GetTimeZoneInformation(&tzi);
+        zone = -(int) tzi.Bias;
+    }
+#else
+    localtime_r(&now, &localt);
+    #if !VXWORKS
+        zone = (int) (localt.tm_gmtoff / 60);
+    #else
+        zone = 0;
+    #endif
+#endif
+    /* Zone offset in minutes formatted as +HHMM */
+    zoneStr[0] = (zone < 0) ? '-' : '+';
+    zone = abs(zone);
+    zoneStr[1] = (char) ('0' + (zone / 600) % 10);
+    zoneStr[2] = (char) ('0' + (zone / 60) % 10);
+    zoneStr[3] = (char) ('0' + (zone % 60) / 10);
+    zoneStr[4] = (char) ('0' + zone % 10);
+    zoneStr[5] = '\0';
+    strftime(accessDate, sizeof(accessDate), "%d/%b/%Y:%H:%M:%S ", &localt);
+    scopy(&accessDate[slen(accessDate)], sizeof(accessDate) - slen(accessDate), zoneStr);
+    strftime(accessIsoDate, sizeof(accessIsoDate), "%Y-%m-%dT%H:%M:%S", &localt);
+    scopy(&accessIsoDate[slen(accessIsoDate)], sizeof(accessIsoDate) - slen(accessIsoDate), zoneStr);
+}
+
+
+static void putLog(cchar *str)
+{
+    bufPutBlk(&accessBuf, str, slen(str));
+}
+
+
+static void putLogNumber(int64 value)
+{
+    char    num[32];
+
+    putLog(itosbuf(num, sizeof(num), value, 10));
+}
+
+
+/*
+    Append a string. Quotes, backslashes and control characters are escaped so a client cannot forge log lines.
+ */
+static void putLogEscaped(cchar *str)
+{
+    cchar   *cp, *start;
+    char    esc[8];
+
+    if (str) {
+        for (start = cp = str; *cp; cp++) {
+            if (*cp == '"' || *cp == '\\' || (uchar) *cp < 0x20 || *cp == 0x7f) {
+                bufPutBlk(&accessBuf, start, cp - start);
+                if (accessFormat == ACCESS_JSON) {
+                    fmt(esc, sizeof(esc), (*cp == '"' || *cp == '\\') ? "\\%c" : "\\u%04x", (uchar) *cp);
+                } else {
+                    fmt(esc, sizeof(esc), (*cp == '"' || *cp == '\\') ? "\\%c" : "\\x%02x", (uchar) *cp);
+                }
+                putLog(esc);
+                start = cp + 1;
+            }
+        }
+        bufPutBlk(&accessBuf, start, cp - start);
+    }
+}
+
+
+/*
+    Append an escaped and quoted string
+ */
+static void putLogString(cchar *str)
+{
+    bufPutc(&accessBuf, '"');
+    putLogEscaped(str);
+    bufPutc(&accessBuf, '"');
+}
+
+
+/*
+    Buffer a log line. Times are cached and fields are copied into the log buffer without formatting.
+    Common Log Format: See http://httpd.apache.org/docs/1.3/logs.html#common
+ */
+static void logRequest(Webs *wp, int code)
+{
+    assert(wp);
+
+    if (accessBuf.buf == 0 || (accessFd < 0 && bufLen(&accessBuf) >= ACCESS_RETAIN)) {
+        /* Lines are discarded once the retained lines reach the limit */
+        return;
+    }
+    updateAccessTime();
+    if (accessFormat == ACCESS_JSON) {
+        putLog("{\"time\":\"");
+        putLog(accessIsoDate);
+        putLog("\",\"ip\":");
+        putLogString(wp->ipaddr);
+        putLog(",\"user\":");
+        putLogString(wp->username ? wp->username : "");
+        putLog(",\"method\":");
+        putLogString(wp->method);
+        putLog(",\"uri\":");
+        putLogString(wp->path);
+        putLog(",\"protocol\":");
+        putLogString(wp->protoVersion);
+        putLog(",\"status\":");
+        putLogNumber(code);
+        putLog(",\"bytes\":");
+        putLogNumber(wp->written);
+        putLog(",\"referrer\":");
+        putLogString(wp->referrer);
+        putLog(",\"userAgent\":");
+        putLogString(wp->userAgent);
+        putLog(",\"latency\":");
+        putLogNumber(wp->started ? websGetTicks() - wp->started : 0);
+        putLog("}\n");
+
+    } else {
+        putLog(wp->ipaddr);
+        putLog(" - ");
+        putLogEscaped(wp->username ? wp->username : "-");
+        putLog(" [");
+        putLog(accessDate);
+        putLog("] \"");
+        putLogEscaped(wp->method ? wp->method : "-");
+        bufPutc(&accessBuf, ' ');
+        putLogEscaped(wp->path ? wp->path : "-");
+        bufPutc(&accessBuf, ' ');
+        putLogEscaped(wp->protoVersion ? wp->protoVersion : "-");
+        putLog("\" ");
+        putLogNumber(code);
+        bufPutc(&accessBuf, ' ');
+        if (wp->written != 0) {
+            putLogNumber(wp->written);
+        } else {
+            bufPutc(&accessBuf, '-');
+        }
+        if (accessFormat == ACCESS_COMBINED) {
+            bufPutc(&accessBuf, ' ');
+            putLogString(wp->referrer ? wp->referrer : "-");
+            bufPutc(&accessBuf, ' ');
+            putLogString(wp->userAgent ? wp->userAgent : "-");
+        }
+        bufPutc(&accessBuf, '\n');
+    }
+    if (bufLen(&accessBuf) >= ME_GOAHEAD_ACCESS_LOG_BUFFER) {
+        flushAccessLog();
+    } else if (!accessScheduled && accessEvent >= 0) {
+        websRestartEvent(accessEvent, ME_GOAHEAD_ACCESS_LOG_FLUSH);
+        accessScheduled = 1;
+    }
+}
+
+#else
+
+PUBLIC int websSetAccessLog(cchar *path, cchar *format, ssize maxSize, int backups)
+{
+    return -1;
+}
+
+
+PUBLIC void websReopenAccessLog()
+{
+}
+#endif
+
+
+#if ME_GOAHEAD_METRICS
+PUBLIC int websDefineMetric(cchar *name, cchar *help, int type, int64 *value)
+{
+    WebsMetric  *mp;
+
+    assert(name && *name);
+    assert(value);
+
+    if ((mp = wrealloc(appMetrics, (appMetricCount + 1) * sizeof(WebsMetric))) == 0) {
         return -1;
     }
-    return written;
+    appMetrics = mp;
+    mp = &appMetrics[appMetricCount++];
+    mp->name = sclone(name);
+    mp->help = sclone(help ? help : name);
+    mp->type = type;
+    mp->value = value;
+    return 0;
+}
+
+
+static void freeMetrics(void)
+{
+    int     i;
+
+    for (i = 0; i < appMetricCount; i++) {
+        wfree(appMetrics[i].name);
+        wfree(appMetrics[i].help);
+    }
+    wfree(appMetrics);
+    appMetrics = 0;
+    appMetricCount = 0;
+}
+
+
+static void observe(WebsHistogram *hp, int64 elapsed)
+{
+    int     i;
+
+    for (i = 0; i < WEBS_METRIC_BUCKETS - 1 && elapsed > metricBounds[i]; i++) ;
+    hp->buckets[i]++;
+    hp->count++;
+    hp->sum += elapsed;
+}
+
+
+/*
+    Record a completed request. Called from websDone.
+ */
+static void observeRequest(Webs *wp)
+{
+    WebsRoute   *route;
+    int64       elapsed;
+
+    elapsed = wp->started ? (int64) (websGetTicks() - wp->started) : 0;
+    metrics.requests++;
+    if (wp->code >= 100 && wp->code < 100 + METRIC_CODES) {
+        metrics.responses[wp->code - 100]++;
+    }
+    observe(&metrics.latency, elapsed);
+    if ((route = wp->route) != 0) {
+        observe(&route->latency, elapsed);
+        if (route->handler) {
+            observe(&route->handler->latency, elapsed);
+        }
+    }
+}
+
+
+/*
+    Add a quoted label or JSON string value
+ */
+static void putMetricString(WebsBuf *bp, cchar *str)
+{
+    cchar   *cp, *start;
+
+    bufPutc(bp, '"');
+    for (start = cp = str; *cp; cp++) {
+        if (*cp == '"' || *cp == '\\' || *cp == '\n') {
+            bufPutBlk(bp, start, cp - start);
+            bufPutStr(bp, *cp == '\n' ? "\\n" : (*cp == '"' ? "\\\"" : "\\\\"));
+            start = cp + 1;
+        } else if ((uchar) *cp < 0x20) {
+            bufPutBlk(bp, start, cp - start);
+            start = cp + 1;
+        }
+    }
+    bufPutBlk(bp, start, cp - start);
+    bufPutc(bp, '"');
+}
+
+
+#if ME_GOAHEAD_REPLACE_MALLOC
+static int64 memoryStat(int cls, int field)
+{
+    WebsAllocStats  stats;
+
+    wallocStats(cls, &stats);
+    switch (field) {
+    case MEMORY_FREE:
+        return stats.free;
+    case MEMORY_PEAK:
+        return stats.peak;
+    case MEMORY_BYTES:
+        return stats.bytes;
+    default:
+        return stats.allocated;
+    }
+}
+
+
+/*
+    Return the label for a block class. Blocks larger than the largest class are allocated via malloc.
+ */
+static cchar *memoryClass(int cls, char *buf)
+{
+    if (cls >= WEBS_MAX_CLASS) {
+        return "large";
+    }
+    return itosbuf(buf, 16, 1 << (WEBS_SHIFT + cls), 10);
+}
+#endif
+
+
+static void putMetricHeader(WebsBuf *bp, cchar *name, cchar *help, cchar *type)
+{
+    bufPut(bp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+
+/*
+    Add the histogram series for one label set in the Prometheus text format. Buckets are cumulative.
+ */
+static void putHistogram(WebsBuf *bp, cchar *name, cchar *labels, WebsHistogram *hp)
+{
+    cchar   *sep;
+    int64   total;
+    int     i;
+
+    sep = *labels ? "," : "";
+    for (total = 0, i = 0; i < WEBS_METRIC_BUCKETS; i++) {
+        total += hp->buckets[i];
+        if (i < WEBS_METRIC_BUCKETS - 1) {
+            bufPut(bp, "%s_bucket{%s%sle=\"%Ld\"} %Ld\n", name, labels, sep, metricBounds[i], total);
+        } else {
+            bufPut(bp, "%s_bucket{%s%sle=\"+Inf\"} %Ld\n", name, labels, sep, total);
+        }
+    }
+    if (*labels) {
+        bufPut(bp, "%s_sum{%s} %Ld\n%s_count{%s} %Ld\n", name, labels, hp->sum, name, labels, hp->count);
+    } else {
+        bufPut(bp, "%s_sum %Ld\n%s_count %Ld\n", name, hp->sum, name, hp->count);
+    }
+}
+
+
+static void putJsonHistogram(WebsBuf *bp, WebsHistogram *hp)
+{
+    int64   total;
+    int     i;
+
+    bufPut(bp, "{\"count\":%Ld,\"sum\":%Ld,\"buckets\":{", hp->count, hp->sum);
+    for (total = 0, i = 0; i < WEBS_METRIC_BUCKETS; i++) {
+        total += hp->buckets[i];
+        if (i < WEBS_METRIC_BUCKETS - 1) {
+            bufPut(bp, "\"%Ld\":%Ld,", metricBounds[i], total);
+        } else {
+            bufPut(bp, "\"+Inf\":%Ld}}", total);
+        }
+    }
+}
+
+
+static void putRouteHistogram(WebsBuf *bp, int index, WebsRoute *route)
+{
+    WebsBuf     labels;
+
+    bufCreate(&labels, 0, MAXINT);
+    bufPut(&labels, "index=\"%d\",route=", index);
+    putMetricString(&labels, route->prefix);
+    bufPutStr(&labels, ",handler=");
+    putMetricString(&labels, route->handler ? route->handler->name : "");
+    bufAddNull(&labels);
+    putHistogram(bp, "goahead_route_duration_milliseconds", bufStart(&labels), &route->latency);
+    bufFree(&labels);
+}
+
+
+/*
+    Prometheus text exposition format
+ */
+static void putPrometheus(WebsBuf *bp)
+{
+    WebsMetric  *mp;
+    WebsRoute   **routes;
+    WebsHandler *handler;
+    WebsKey     *key;
+    WebsBuf     labels;
+#if ME_GOAHEAD_REPLACE_MALLOC
+    MemoryMetric *m;
+    char        cbuf[16];
+#endif
+    int         i, count;
+
+    for (mp = serverMetrics; mp->name; mp++) {
+        putMetricHeader(bp, mp->name, mp->help, mp->type == WEBS_METRIC_GAUGE ? "gauge" : "counter");
+        bufPut(bp, "%s %Ld\n", mp->name, *mp->value);
+    }
+    for (i = 0; i < appMetricCount; i++) {
+        mp = &appMetrics[i];
+        putMetricHeader(bp, mp->name, mp->help, mp->type == WEBS_METRIC_GAUGE ? "gauge" : "counter");
+        bufPut(bp, "%s %Ld\n", mp->name, *mp->value);
+    }
+    putMetricHeader(bp, "goahead_responses_total", "Responses by status code", "counter");
+    for (i = 0; i < METRIC_CODES; i++) {
+        if (metrics.responses[i]) {
+            bufPut(bp, "goahead_responses_total{code=\"%d\"} %Ld\n", i + 100, metrics.responses[i]);
+        }
+    }
+    putMetricHeader(bp, "goahead_errors_total", "Error responses by status code", "counter");
+    for (i = 0; i < METRIC_CODES; i++) {
+        if (metrics.errors[i]) {
+            bufPut(bp, "goahead_errors_total{code=\"%d\"} %Ld\n", i + 100, metrics.errors[i]);
+        }
+    }
+#if ME_GOAHEAD_REPLACE_MALLOC
+    for (m = memoryMetrics; m->name; m++) {
+        putMetricHeader(bp, m->name, m->help, "gauge");
+        for (i = 0; i <= WEBS_MAX_CLASS; i++) {
+            bufPut(bp, "%s{class=\"%s\"} %Ld\n", m->name, memoryClass(i, cbuf), memoryStat(i, m->field));
+        }
+    }
+#endif
+    putMetricHeader(bp, "goahead_request_duration_milliseconds", "Request latency", "histogram");
+    putHistogram(bp, "goahead_request_duration_milliseconds", "", &metrics.latency);
+
+    putMetricHeader(bp, "goahead_route_duration_milliseconds", "Request latency by route", "histogram");
+    routes = websGetRoutes(&count);
+    for (i = 0; i < count; i++) {
+        putRouteHistogram(bp, i, routes[i]);
+    }
+    putMetricHeader(bp, "goahead_handler_duration_milliseconds", "Request latency by handler", "histogram");
+    bufCreate(&labels, 0, MAXINT);
+    for (key = hashFirst(websGetHandlers()); key; key = hashNext(websGetHandlers(), key)) {
+        handler = key->content.value.symbol;
+        bufFlush(&labels);
+        bufPutStr(&labels, "handler=");
+        putMetricString(&labels, handler->name);
+        bufAddNull(&labels);
+        putHistogram(bp, "goahead_handler_duration_milliseconds", bufStart(&labels), &handler->latency);
+    }
+    bufFree(&labels);
 }
 
 
 /*
-    Decode a URL (or part thereof). Allows insitu decoding.
+    JSON format. Scalar metrics use their Prometheus names. Histogram buckets are cumulative.
  */
-PUBLIC void websDecodeUrl(char *decoded, char *input, ssize len)
+static void putJson(WebsBuf *bp)
 {
-    char    *ip,  *op;
-    int     num, i, c;
-
-    assert(decoded);
-    assert(input);
-
-    if (!decoded) {
-        return;
-    }
-    if (!input) {
-        *decoded = '\0';
-        return;
+    WebsMetric  *mp;
+    WebsRoute   **routes, *route;
+    WebsHandler *handler;
+    WebsKey     *key;
+    cchar       *sep;
+#if ME_GOAHEAD_REPLACE_MALLOC
+    MemoryMetric *m;
+    char        cbuf[16];
+#endif
+    int         i, count;
+
+    bufPutc(bp, '{');
+    for (mp = serverMetrics; mp->name; mp++) {
+        bufPut(bp, "\"%s\":%Ld,", mp->name, *mp->value);
+    }
+    for (i = 0; i < appMetricCount; i++) {
+        mp = &appMetrics[i];
+        putMetricString(bp, mp->name);
+        bufPut(bp, ":%Ld,", *mp->value);
+    }
+    bufPutStr(bp, "\"goahead_responses_total\":{");
+    for (sep = "", i = 0; i < METRIC_CODES; i++) {
+        if (metrics.responses[i]) {
+            bufPut(bp, "%s\"%d\":%Ld", sep, i + 100, metrics.responses[i]);
+            sep = ",";
+        }
     }
-    if (len < 0) {
-        len = strlen(input);
+    bufPutStr(bp, "},\"goahead_errors_total\":{");
+    for (sep = "", i = 0; i < METRIC_CODES; i++) {
+        if (metrics.errors[i]) {
+            bufPut(bp, "%s\"%d\":%Ld", sep, i + 100, metrics.errors[i]);
+            sep = ",";
+        }
     }
-    op = decoded;
-    for (ip = input; *ip && len > 0; ip++, op++) {
-        if (*ip == '+') {
-            *op = ' ';
-        } else if (*ip == '%' && isxdigit((uchar) ip[1]) && isxdigit((uchar) ip[2])) {
-            /*
-                Convert %nn to a single character
-             */
-            ip++;
-            for (i = 0, num = 0; i < 2; i++, ip++) {
-                c = tolower((uchar) *ip);
-                if (c >= 'a' && c <= 'f') {
-                    num = (num * 16) + 10 + c - 'a';
-                } else {
-                    num = (num * 16) + c - '0';
-                }
-            }
-            *op = (char) num;
-            ip--;
-
-        } else {
-            *op = *ip;
+    bufPutStr(bp, "},");
+#if ME_GOAHEAD_REPLACE_MALLOC
+    for (m = memoryMetrics; m->name; m++) {
+        bufPut(bp, "\"%s\":{", m->name);
+        for (i = 0; i <= WEBS_MAX_CLASS; i++) {
+            bufPut(bp, "\"%s\":%Ld%s", memoryClass(i, cbuf), memoryStat(i, m->field), i < WEBS_MAX_CLASS ? "," : "},");
         }
-        len--;
     }
-    *op = '\0';
+#endif
+    bufPutStr(bp, "\"goahead_request_duration_milliseconds\":");
+    putJsonHistogram(bp, &metrics.latency);
+
+    bufPutStr(bp, ",\"routes\":[");
+    routes = websGetRoutes(&count);
+    for (i = 0; i < count; i++) {
+        route = routes[i];
+        bufPutStr(bp, i ? ",{\"route\":" : "{\"route\":");
+        putMetricString(bp, route->prefix);
+        bufPutStr(bp, ",\"handler\":");
+        putMetricString(bp, route->handler ? route->handler->name : "");
+        bufPutStr(bp, ",\"latency\":");
+        putJsonHistogram(bp, &route->latency);
+        bufPutc(bp, '}');
+    }
+    bufPutStr(bp, "],\"handlers\":{");
+    for (sep = "", key = hashFirst(websGetHandlers()); key; key = hashNext(websGetHandlers(), key)) {
+        handler = key->content.value.symbol;
+        bufPutStr(bp, sep);
+        putMetricString(bp, handler->name);
+        bufPutc(bp, ':');
+        putJsonHistogram(bp, &handler->latency);
+        sep = ",";
+    }
+    bufPutStr(bp, "}}\n");
 }
 
 
-#if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
 /*
-    Output a log message in Common Log Format: See http://httpd.apache.org/docs/1.3/logs.html#common
+    Report the server metrics. The whole report is rendered before writing so the response has a Content-Length.
  */
-static void logRequest(Webs *wp, int code)
+static bool metricsHandler(Webs *wp)
 {
-    char        *buf, timeStr[28], zoneStr[6], dataStr[16];
-    ssize       len;
-    WebsTime    timer;
-    struct tm   localt;
-#if WINDOWS
-    DWORD       dwRet;
-    TIME_ZONE_INFORMATION tzi;
-#endif
+    WebsBuf     buf;
+    bool        json;
 
     assert(wp);
-    time(&timer);
-#if WINDOWS
-    localtime_s(&localt, &timer);
-#else
-    localtime_r(&timer, &localt);
-#endif
-    strftime(timeStr, sizeof(timeStr), "%d/%b/%Y:%H:%M:%S", &localt);
-    timeStr[sizeof(timeStr) - 1] = '\0';
-#if WINDOWS
-    dwRet = GetTimeZoneInformation(&tzi);
-    fmt(zoneStr, sizeof(zoneStr), "%+03d00", -(int) (tzi.Bias/60));
-#elif !VXWORKS
-    fmt(zoneStr, sizeof(zoneStr), "%+03d00", (int) (localt.tm_gmtoff/3600));
-#else
-    zoneStr[0] = '\0';
-#endif
-    zoneStr[sizeof(zoneStr) - 1] = '\0';
-    if (wp->written != 0) {
-        fmt(dataStr, sizeof(dataStr), "%Ld", wp->written);
-        dataStr[sizeof(dataStr) - 1] = '\0';
+
+    if (!smatch(wp->method, "GET") && !smatch(wp->method, "HEAD")) {
+        websError(wp, HTTP_CODE_BAD_METHOD, "Unsupported method");
+        return 1;
+    }
+    if (bufCreate(&buf, 0, MAXINT) < 0) {
+        websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "Cannot allocate metrics buffer");
+        return 1;
+    }
+    metrics.sessions = sessionCount;
+    json = smatch(websGetVar(wp, "format", 0), "json");
+    if (json) {
+        putJson(&buf);
     } else {
-        dataStr[0] = '-'; dataStr[1] = '\0';
+        putPrometheus(&buf);
     }
-    buf = NULL;
-    buf = sfmt("%s - %s [%s %s] \"%s %s %s\" %d %s\n",
-        wp->ipaddr, wp->username == NULL ? "-" : wp->username,
-        timeStr, zoneStr, wp->method, wp->path, wp->protoVersion, code, dataStr);
-    len = strlen(buf);
-    write(accessFd, buf, len);
-    wfree(buf);
+    websSetStatus(wp, HTTP_CODE_OK);
+    websWriteHeaders(wp, bufLen(&buf), 0);
+    websWriteHeader(wp, "Content-Type", json ? "application/json" : "text/plain; version=0.0.4");
+    websWriteHeader(wp, "Cache-Control", "no-cache");
+    websWriteEndHeaders(wp);
+    if (!smatch(wp->method, "HEAD")) {
+        websWriteBlock(wp, bufStart(&buf), bufLen(&buf));
+    }
+    bufFree(&buf);
+    websDone(wp);
+    return 1;
 }
-#endif
+
+
+PUBLIC int websMetricsOpen()
+{
+    websDefineHandler("metrics", 0, metricsHandler, 0, 0);
+    return 0;
+}
+#endif /* ME_GOAHEAD_METRICS */
 
 
 /*
@@ -2474,33 +4847,19 @@ PUBLIC bool websValid(Webs *wp)
 
 
 /*
-    Build an ASCII time string.  If sbuf is NULL we use the current time, else we use the last modified time of sbuf;
+    Build an HTTP date string.  If sbuf is NULL we use the current time, else we use the last modified time of sbuf;
  */
 PUBLIC char *websGetDateString(WebsFileInfo *sbuf)
 {
-    WebsTime    now;
-    struct tm   tm;
-    char        *cp;
+    char    buf[WEBS_HTTP_DATE_SIZE];
 
     if (sbuf == NULL) {
-        time(&now);
-    } else {
-        now = sbuf->mtime;
-    }
-#if ME_UNIX_LIKE
-    gmtime_r(&now, &tm);
-#else
-    {
-        struct tm *tp;
-        tp = gmtime(&now);
-        tm = *tp;
+        return sclone(websGetHttpDate());
     }
-#endif
-    if ((cp = asctime(&tm)) != NULL) {
-        cp[strlen(cp) - 1] = '\0';
-        return sclone(cp);
+    if (websFormatHttpDate(buf, sizeof(buf), sbuf->mtime) < 0) {
+        return NULL;
     }
-    return NULL;
+    return sclone(buf);
 }
 
 
@@ -2514,6 +4873,19 @@ PUBLIC void websNoteRequestActivity(Webs *wp)
 }
 
 
+/*
+    Account for response data written to the client
+ */
+PUBLIC void websNoteWritten(Webs *wp, ssize written)
+{
+    wp->written += written;
+#if ME_GOAHEAD_METRICS
+    metrics.sent += written;
+#endif
+    websNoteRequestActivity(wp);
+}
+
+
 /*
     Get the number of seconds since the last mark.
  */
@@ -2990,20 +5362,350 @@ PUBLIC int websGetDebug()
 }
 
 
-PUBLIC void websSetDebug(int on)
+PUBLIC void websSetDebug(int on)
+{
+    websDebug = on;
+}
+
+
+/*
+    Create a session ID from random bytes. Random bytes are read in blocks to avoid a system call per session.
+ */
+static void makeSessionID(char *id, ssize size)
+{
+    static char     random[SESSION_RANDOM + 1];
+    static ssize    used = SESSION_RANDOM;
+    static int      nextSession = 0;
+    int             i;
+
+    assert(size > SESSION_ID_BYTES * 2);
+
+    if (used + SESSION_ID_BYTES > SESSION_RANDOM) {
+        if (websGetRandomBytes(random, sizeof(random), 0) < 0) {
+            /* The clock is predictable, so this fallback is logged */
+            error("Cannot get random bytes for session ID");
+            for (i = 0; i < SESSION_RANDOM; i += 8) {
+                fmt(&random[i], 9, "%08x", (int) (websGetTicks() + nextSession++ + i));
+            }
+        }
+        used = 0;
+    }
+    for (i = 0; i < SESSION_ID_BYTES; i++) {
+        fmt(&id[i * 2], 3, "%02x", (uchar) random[used + i]);
+    }
+    /* Do not reuse random bytes */
+    memset(&random[used], 0, SESSION_ID_BYTES);
+    used += SESSION_ID_BYTES;
+}
+
+
+/*
+    FNV-1a hash of a session ID
+ */
+static uint hashSessionID(cchar *id)
+{
+    uint    hash;
+
+    for (hash = 2166136261U; *id; id++) {
+        hash = (hash ^ (uchar) *id) * 16777619U;
+    }
+    return hash;
+}
+
+
+static WebsSession *lookupSession(cchar *id)
+{
+    WebsSession     *sp;
+
+    if (sessionIndex == 0 || id == 0) {
+        return 0;
+    }
+    for (sp = sessionIndex[hashSessionID(id) & (sessionBuckets - 1)]; sp; sp = sp->next) {
+        if (smatch(sp->id, id)) {
+            return sp;
+        }
+    }
+    return 0;
+}
+
+
+/*
+    Double the size of the session index and the expiry heap
+ */
+static int growSessions()
+{
+    WebsSession     **index, **heap, *sp, *next;
+    int             buckets, i, bucket;
+
+    buckets = sessionBuckets ? sessionBuckets * 2 : WEBS_SESSION_HASH;
+    if ((index = walloc(buckets * sizeof(WebsSession*))) == 0) {
+        return -1;
+    }
+    if ((heap = wrealloc(sessionHeap, buckets * sizeof(WebsSession*))) == 0) {
+        wfree(index);
+        return -1;
+    }
+    memset(index, 0, buckets * sizeof(WebsSession*));
+    for (i = 0; i < sessionBuckets; i++) {
+        for (sp = sessionIndex[i]; sp; sp = next) {
+            next = sp->next;
+            bucket = hashSessionID(sp->id) & (buckets - 1);
+            sp->next = index[bucket];
+            index[bucket] = sp;
+        }
+    }
+    wfree(sessionIndex);
+    sessionIndex = index;
+    sessionHeap = heap;
+    sessionBuckets = buckets;
+    return 0;
+}
+
+
+static void setHeap(int i, WebsSession *sp)
+{
+    sessionHeap[i] = sp;
+    sp->heapIndex = i;
+}
+
+
+static void siftUp(int i)
+{
+    WebsSession     *sp;
+    int             parent;
+
+    sp = sessionHeap[i];
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (sessionHeap[parent]->deadline <= sp->deadline) {
+            break;
+        }
+        setHeap(i, sessionHeap[parent]);
+        i = parent;
+    }
+    setHeap(i, sp);
+}
+
+
+static void siftDown(int i)
+{
+    WebsSession     *sp;
+    int             child;
+
+    sp = sessionHeap[i];
+    while ((child = i * 2 + 1) < sessionCount) {
+        if (child + 1 < sessionCount && sessionHeap[child + 1]->deadline < sessionHeap[child]->deadline) {
+            child++;
+        }
+        if (sp->deadline <= sessionHeap[child]->deadline) {
+            break;
+        }
+        setHeap(i, sessionHeap[child]);
+        i = child;
+    }
+    setHeap(i, sp);
+}
+
+
+/*
+    Restore the heap order after the deadline of a session has changed
+ */
+static void reheapSession(WebsSession *sp)
+{
+    int     i;
+
+    i = sp->heapIndex;
+    if (i > 0 && sessionHeap[(i - 1) / 2]->deadline > sp->deadline) {
+        siftUp(i);
+    } else {
+        siftDown(i);
+    }
+}
+
+
+/*
+    Add a session to the index and expiry heap
+ */
+static int indexSession(WebsSession *sp)
+{
+    int     bucket;
+
+    if (sessionCount >= sessionBuckets && growSessions() < 0) {
+        return -1;
+    }
+    bucket = hashSessionID(sp->id) & (sessionBuckets - 1);
+    sp->next = sessionIndex[bucket];
+    sessionIndex[bucket] = sp;
+    sp->deadline = sp->expires;
+    setHeap(sessionCount++, sp);
+    siftUp(sp->heapIndex);
+    return 0;
+}
+
+
+static void unindexSession(WebsSession *sp)
+{
+    WebsSession     **pp, *last;
+    int             i;
+
+    for (pp = &sessionIndex[hashSessionID(sp->id) & (sessionBuckets - 1)]; *pp; pp = &(*pp)->next) {
+        if (*pp == sp) {
+            *pp = sp->next;
+            break;
+        }
+    }
+    i = sp->heapIndex;
+    last = sessionHeap[--sessionCount];
+    if (i < sessionCount) {
+        setHeap(i, last);
+        reheapSession(last);
+    }
+    sp->heapIndex = -1;
+}
+
+
+static WebsSessionVar *lookupSessionVar(WebsSession *sp, cchar *name)
+{
+    WebsSessionVar  *vp;
+
+    for (vp = sp->vars; vp < &sp->vars[sp->varCount]; vp++) {
+        if (smatch(vp->name, name)) {
+            return vp;
+        }
+    }
+    return 0;
+}
+
+
+/*
+    Set a session variable. The name and value are held in one allocation.
+ */
+static int setSessionVar(WebsSession *sp, cchar *name, cchar *value)
+{
+    WebsSessionVar  *vp;
+    ssize           nlen, vlen;
+    char            *block;
+
+    nlen = slen(name);
+    vlen = slen(value);
+    if ((block = walloc(nlen + vlen + 2)) == 0) {
+        return -1;
+    }
+    memcpy(block, name, nlen + 1);
+    memcpy(&block[nlen + 1], value, vlen + 1);
+
+    if ((vp = lookupSessionVar(sp, name)) != 0) {
+        wfree(vp->name);
+    } else {
+        if (sp->varCount >= sp->varMax) {
+            if ((vp = wrealloc(sp->vars, (sp->varMax + SESSION_VARS) * sizeof(WebsSessionVar))) == 0) {
+                wfree(block);
+                return -1;
+            }
+            sp->vars = vp;
+            sp->varMax += SESSION_VARS;
+        }
+        vp = &sp->vars[sp->varCount++];
+    }
+    vp->name = block;
+    vp->value = &block[nlen + 1];
+    return 0;
+}
+
+
+static void removeSessionVar(WebsSession *sp, cchar *name)
+{
+    WebsSessionVar  *vp;
+
+    if ((vp = lookupSessionVar(sp, name)) != 0) {
+        wfree(vp->name);
+        *vp = sp->vars[--sp->varCount];
+    }
+}
+
+
+static void clearSessionVars(WebsSession *sp)
+{
+    int     i;
+
+    for (i = 0; i < sp->varCount; i++) {
+        wfree(sp->vars[i].name);
+    }
+    wfree(sp->vars);
+    sp->vars = 0;
+    sp->varCount = sp->varMax = 0;
+}
+
+
+static WebsSession *allocSession(cchar *id, int lifespan, WebsTime expires)
+{
+    WebsSession     *sp;
+    char            idBuf[SESSION_ID_BYTES * 2 + 1];
+    ssize           len;
+
+    if (id == 0) {
+        makeSessionID(idBuf, sizeof(idBuf));
+        id = idBuf;
+    } else if ((sp = lookupSession(id)) != 0) {
+        /*
+            Reset an existing session of the same ID in place. Requests may still reference the session.
+         */
+        clearSessionVars(sp);
+        sp->lifespan = lifespan;
+        sp->expires = expires;
+        sp->deadline = expires;
+        reheapSession(sp);
+        return sp;
+    }
+    len = slen(id);
+    if ((sp = walloc(sizeof(WebsSession) + len + 1)) == 0) {
+        return 0;
+    }
+    memset(sp, 0, sizeof(WebsSession));
+    sp->id = (char*) &sp[1];
+    memcpy(sp->id, id, len + 1);
+    sp->lifespan = lifespan;
+    sp->expires = expires;
+    if (indexSession(sp) < 0) {
+        wfree(sp);
+        return 0;
+    }
+    return sp;
+}
+
+
+PUBLIC WebsSession *websAllocSession(Webs *wp, cchar *id, int lifespan)
+{
+    WebsSession     *sp;
+
+    assert(wp);
+
+    if ((sp = allocSession(id, lifespan, time(0) + lifespan)) != 0) {
+        logSession(sp, 'C', 0, 0);
+    }
+    return sp;
+}
+
+
+static void freeSession(WebsSession *sp)
 {
-    websDebug = on;
+    assert(sp);
+
+    clearSessionVars(sp);
+    wfree(sp);
 }
 
 
-static char *makeSessionID(Webs *wp)
+/*
+    Remove a session. Sessions freed on shutdown are retained in the session store.
+ */
+static void destroySession(WebsSession *sp, bool log)
 {
-    char        idBuf[64];
-    static int  nextSession = 0;
-
-    assert(wp);
-    fmt(idBuf, sizeof(idBuf), "%08x%08x%d", PTOI(wp) + PTOI(wp->url), (int) time(0), nextSession++);
-    return websMD5Block(idBuf, slen(idBuf), "::webs.session::");
+    unindexSession(sp);
+    if (log) {
+        logSession(sp, 'D', 0, 0);
+    }
+    freeSession(sp);
 }
 
 
@@ -3011,9 +5713,7 @@ PUBLIC void websDestroySession(Webs *wp)
 {
     websGetSession(wp, 0);
     if (wp->session) {
-        hashDelete(sessions, wp->session->id);
-        sessionCount--;
-        freeSession(wp->session);
+        destroySession(wp->session, 1);
         wp->session = 0;
     }
 }
@@ -3026,83 +5726,48 @@ PUBLIC WebsSession *websCreateSession(Webs *wp)
 }
 
 
-WebsSession *websAllocSession(Webs *wp, cchar *id, int lifespan)
-{
-    WebsSession     *sp;
-
-    assert(wp);
-
-    if ((sp = walloc(sizeof(WebsSession))) == 0) {
-        return 0;
-    }
-    sp->lifespan = lifespan;
-    sp->expires = time(0) + lifespan;
-    if (id == 0) {
-        sp->id = makeSessionID(wp);
-    } else {
-        sp->id = sclone(id);
-    }
-    if ((sp->cache = hashCreate(WEBS_SESSION_HASH)) == 0) {
-        wfree(sp->id);
-        wfree(sp);
-        return 0;
-    }
-    if (hashEnter(sessions, sp->id, valueSymbol(sp), 0) == 0) {
-        wfree(sp->id);
-        wfree(sp);
-        return 0;
-    }
-    return sp;
-}
-
-
-static void freeSession(WebsSession *sp)
-{
-    assert(sp);
-
-    if (sp->cache >= 0) {
-        hashFree(sp->cache);
-        sp->cache = -1;
-    }
-    wfree(sp->id);
-    wfree(sp);
-}
-
-
+/*
+    Get the request session. A new session always gets a new random ID, even if the client supplied an unknown or
+    expired ID. Using a session only updates its expiry time. The expiry heap is adjusted lazily when the session is
+    pruned.
+ */
 WebsSession *websGetSession(Webs *wp, int create)
 {
-    WebsKey     *sym;
-    char        *id;
+    WebsSession     *sp;
+    char            *id;
 
     assert(wp);
 
-    if (!wp->session) {
+    if ((sp = wp->session) == 0) {
         id = websGetSessionID(wp);
-        if ((sym = hashLookup(sessions, id)) == 0) {
+        sp = lookupSession(id);
+        wfree(id);
+        if (sp && sp->expires <= time(0)) {
+            /* Expired but not yet pruned */
+            destroySession(sp, 1);
+            sp = 0;
+        }
+        if (sp == 0) {
             if (!create) {
-                wfree(id);
                 return 0;
             }
-            if (sessionCount > ME_GOAHEAD_LIMIT_SESSION_COUNT) {
+            if (sessionCount >= ME_GOAHEAD_LIMIT_SESSION_COUNT) {
                 error("Too many sessions %d/%d", sessionCount, ME_GOAHEAD_LIMIT_SESSION_COUNT);
-                wfree(id);
                 return 0;
             }
-            sessionCount++;
-            if ((wp->session = websAllocSession(wp, id, ME_GOAHEAD_LIMIT_SESSION_LIFE)) == 0) {
-                wfree(id);
+            if ((sp = websAllocSession(wp, 0, ME_GOAHEAD_LIMIT_SESSION_LIFE)) == 0) {
                 return 0;
             }
-            websSetCookie(wp, WEBS_SESSION, wp->session->id, "/", NULL, 0, 0);
-        } else {
-            wp->session = (WebsSession*) sym->content.value.symbol;
+            websSetCookie(wp, WEBS_SESSION, sp->id, "/", NULL, 0, 0);
         }
-        wfree(id);
+        wp->session = sp;
     }
-    if (wp->session) {
-        wp->session->expires = time(0) + wp->session->lifespan;
+    sp->expires = time(0) + sp->lifespan;
+    if ((sp->expires - sp->logged) * 1000 >= WEBS_SESSION_PRUNE) {
+        /* Record activity in the session store at most once per prune period */
+        logSession(sp, 'T', 0, 0);
     }
-    return wp->session;
+    return sp;
 }
 
 
@@ -3167,16 +5832,16 @@ PUBLIC char *websGetSessionID(Webs *wp)
 PUBLIC cchar *websGetSessionVar(Webs *wp, cchar *key, cchar *defaultValue)
 {
     WebsSession     *sp;
-    WebsKey         *sym;
+    WebsSessionVar  *vp;
 
     assert(wp);
     assert(key && *key);
 
     if ((sp = websGetSession(wp, 1)) != 0) {
-        if ((sym = hashLookup(sp->cache, key)) == 0) {
+        if ((vp = lookupSessionVar(sp, key)) == 0) {
             return defaultValue;
         }
-        return (char*) sym->content.value.symbol;
+        return vp->value;
     }
     return 0;
 }
@@ -3189,8 +5854,9 @@ PUBLIC void websRemoveSessionVar(Webs *wp, cchar *key)
     assert(wp);
     assert(key && *key);
 
-    if ((sp = websGetSession(wp, 1)) != 0) {
-        hashDelete(sp->cache, key);
+    if ((sp = websGetSession(wp, 1)) != 0 && lookupSessionVar(sp, key)) {
+        removeSessionVar(sp, key);
+        logSession(sp, 'R', key, 0);
     }
 }
 
@@ -3206,56 +5872,447 @@ PUBLIC int websSetSessionVar(Webs *wp, cchar *key, cchar *value)
     if ((sp = websGetSession(wp, 1)) == 0) {
         return 0;
     }
-    if (hashEnter(sp->cache, key, valueString(value, VALUE_ALLOCATE), 0) == 0) {
+    if (setSessionVar(sp, key, value) < 0) {
         return -1;
     }
+    logSession(sp, 'S', key, value);
     return 0;
 }
 
 
+/*
+    Free expired sessions. Only sessions whose expiry deadline has passed are visited. Sessions used since they were
+    scheduled are rescheduled for their new expiry time.
+ */
+static void expireSessions(WebsTime when)
+{
+    WebsSession     *sp;
+
+    while (sessionCount > 0 && (sp = sessionHeap[0])->deadline <= when) {
+        if (sp->expires <= when) {
+            destroySession(sp, 1);
+        } else {
+            sp->deadline = sp->expires;
+            siftDown(0);
+        }
+    }
+}
+
+
 static void pruneSessions()
+{
+    int     oldCount;
+
+    oldCount = sessionCount;
+    expireSessions(time(0));
+    if (oldCount != sessionCount || sessionCount) {
+        trace(4, "Prune %d sessions. Remaining: %d", oldCount - sessionCount, sessionCount);
+    }
+#if !ME_ROM
+    if (storeFd >= 0 && workerIndex < 0 && storeRecords > (sessionCount * 4) + SESSION_STORE_SLACK) {
+        compactSessionStore();
+    }
+#endif
+    websRestartEvent(pruneId, WEBS_SESSION_PRUNE);
+}
+
+
+static void freeSessions()
+{
+#if !ME_ROM
+    closeSessionStore();
+#endif
+    while (sessionCount > 0) {
+        destroySession(sessionHeap[0], 0);
+    }
+    wfree(sessionIndex);
+    wfree(sessionHeap);
+    sessionIndex = 0;
+    sessionHeap = 0;
+    sessionBuckets = 0;
+}
+
+
+#if !ME_ROM
+PUBLIC void websSetSessionStore(cchar *path)
+{
+    closeSessionStore();
+    wfree(sessionStore);
+    sessionStore = (path && *path) ? sclone(path) : 0;
+    if (sessionIndex) {
+        openSessionStore();
+    }
+}
+
+
+/*
+    Load the session store and rewrite it with the current sessions
+ */
+static int openSessionStore()
+{
+    if (!sessionStore) {
+        return 0;
+    }
+    if (!storeBuf.buf && bufCreate(&storeBuf, 0, MAXINT) < 0) {
+        return -1;
+    }
+    loadSessionStore();
+    expireSessions(time(0));
+    return compactSessionStore();
+}
+
+
+static void closeSessionStore()
+{
+    flushSessionStore();
+    if (storeEvent >= 0) {
+        websStopEvent(storeEvent);
+        storeEvent = -1;
+    }
+    storeScheduled = 0;
+    if (storeFd >= 0) {
+        close(storeFd);
+        storeFd = -1;
+    }
+    if (storeBuf.buf) {
+        bufFree(&storeBuf);
+    }
+}
+
+
+/*
+    Decode a store record field in situ
+ */
+static char *decodeStoreField(char *str)
+{
+    char    *ip, *op;
+    int     c, i;
+
+    if (str == 0) {
+        return 0;
+    }
+    for (ip = op = str; *ip; ip++) {
+        if (*ip == '%' && isxdigit((uchar) ip[1]) && isxdigit((uchar) ip[2])) {
+            for (c = 0, i = 1; i <= 2; i++) {
+                c = c * 16 + (isdigit((uchar) ip[i]) ? ip[i] - '0' : (tolower((uchar) ip[i]) - 'a' + 10));
+            }
+            *op++ = (char) c;
+            ip += 2;
+        } else {
+            *op++ = *ip;
+        }
+    }
+    *op = '\0';
+    return str;
+}
+
+
+/*
+    Replay the session store. Records are applied in order. Malformed records, such as a final record truncated by a
+    crash, are ignored.
+ */
+static void loadSessionStore()
 {
     WebsSession     *sp;
-    WebsTime        when;
-    WebsKey         *sym, *next;
-    int             oldCount;
+    char            *buf, *line, *nextLine, *kind, *id, *arg1, *arg2, *tok;
 
-    if (sessions >= 0) {
-        oldCount = sessionCount;
-        when = time(0);
-        for (sym = hashFirst(sessions); sym; sym = next) {
-            next = hashNext(sessions, sym);
-            sp = (WebsSession*) sym->content.value.symbol;
-            if (sp->expires <= when) {
-                hashDelete(sessions, sp->id);
-                sessionCount--;
-                freeSession(sp);
+    if ((buf = websReadWholeFile(sessionStore)) == 0) {
+        return;
+    }
+    for (line = stok(buf, "\n", &nextLine); line; line = stok(NULL, "\n", &nextLine)) {
+        kind = stok(line, " ", &tok);
+        id = decodeStoreField(stok(NULL, " ", &tok));
+        arg1 = decodeStoreField(stok(NULL, " ", &tok));
+        arg2 = decodeStoreField(stok(NULL, " ", &tok));
+        if (kind == 0 || kind[1] || id == 0) {
+            continue;
+        }
+        if (*kind == 'C') {
+            if (arg1 && arg2) {
+                allocSession(id, atoi(arg1), (WebsTime) strtoll(arg2, NULL, 10));
             }
+            continue;
+        }
+        if ((sp = lookupSession(id)) == 0) {
+            continue;
         }
-        if (oldCount != sessionCount || sessionCount) {
-            trace(4, "Prune %d sessions. Remaining: %d", oldCount - sessionCount, sessionCount);
+        if (*kind == 'T' && arg1) {
+            sp->expires = (WebsTime) strtoll(arg1, NULL, 10);
+        } else if (*kind == 'S' && arg1) {
+            setSessionVar(sp, arg1, arg2 ? arg2 : "");
+        } else if (*kind == 'R' && arg1) {
+            removeSessionVar(sp, arg1);
+        } else if (*kind == 'D') {
+            destroySession(sp, 0);
         }
     }
-    websRestartEvent(pruneId, WEBS_SESSION_PRUNE);
+    wfree(buf);
 }
 
 
-static void freeSessions()
+static void putStoreField(WebsBuf *bp, cchar *str)
+{
+    cchar   *cp, *start;
+    char    esc[4];
+
+    bufPutc(bp, ' ');
+    for (start = cp = str; *cp; cp++) {
+        if (*cp == '%' || *cp == ' ' || (uchar) *cp < 0x20 || *cp == 0x7f) {
+            bufPutBlk(bp, start, cp - start);
+            fmt(esc, sizeof(esc), "%%%02x", (uchar) *cp);
+            bufPutBlk(bp, esc, 3);
+            start = cp + 1;
+        }
+    }
+    bufPutBlk(bp, start, cp - start);
+}
+
+
+/*
+    Format a session store record. Records are: "C id lifespan expires", "T id expires", "S id name value",
+    "R id name" and "D id".
+ */
+static void putStoreRecord(WebsBuf *bp, WebsSession *sp, int kind, cchar *name, cchar *value)
+{
+    bufPutc(bp, (char) kind);
+    putStoreField(bp, sp->id);
+    if (kind == 'C') {
+        bufPut(bp, " %d %Ld", sp->lifespan, (int64) sp->expires);
+        sp->logged = sp->expires;
+    } else if (kind == 'T') {
+        bufPut(bp, " %Ld", (int64) sp->expires);
+        sp->logged = sp->expires;
+    } else if (kind == 'S' || kind == 'R') {
+        putStoreField(bp, name);
+        if (kind == 'S') {
+            putStoreField(bp, value);
+        }
+    }
+    bufPutc(bp, '\n');
+}
+
+
+static int writeStore(int fd, WebsBuf *bp)
+{
+    ssize   len;
+
+    len = bufLen(bp);
+    if (len > 0 && write(fd, bufStart(bp), len) != len) {
+        error("Cannot write session store %s, errno %d", sessionStore, errno);
+        bufFlush(bp);
+        return -1;
+    }
+    bufFlush(bp);
+    return 0;
+}
+
+
+static void sessionStoreEvent(void *data, int id)
+{
+    storeScheduled = 0;
+    flushSessionStore();
+}
+
+
+/*
+    Write buffered store records with a single write so records from worker processes do not interleave. Invoked when
+    the buffer fills and by a timer so records are never buffered for longer than SESSION_STORE_FLUSH milliseconds.
+    Workers hold a shared lock while writing so the supervisor does not replace the store during the write.
+ */
+static void flushSessionStore()
+{
+    if (storeFd < 0 || !storeBuf.buf || bufLen(&storeBuf) == 0) {
+        return;
+    }
+#if ME_UNIX_LIKE
+    if (workerIndex >= 0 && lockSessionStore() < 0) {
+        error("Cannot lock session store %s, errno %d", sessionStore, errno);
+        bufFlush(&storeBuf);
+        return;
+    }
+#endif
+    if (writeStore(storeFd, &storeBuf) < 0) {
+        close(storeFd);
+        storeFd = -1;
+    }
+#if ME_UNIX_LIKE
+    if (workerIndex >= 0 && storeFd >= 0) {
+        flock(storeFd, LOCK_UN);
+    }
+#endif
+}
+
+
+/*
+    Append a change to the session store
+ */
+static void logSession(WebsSession *sp, int kind, cchar *name, cchar *value)
+{
+    if (storeFd < 0) {
+        return;
+    }
+    putStoreRecord(&storeBuf, sp, kind, name, value);
+    storeRecords++;
+    if (bufLen(&storeBuf) >= SESSION_STORE_BUFFER) {
+        flushSessionStore();
+    } else if (storeEvent < 0) {
+        storeEvent = websStartEvent(SESSION_STORE_FLUSH, sessionStoreEvent, 0);
+        storeScheduled = 1;
+    } else if (!storeScheduled) {
+        websRestartEvent(storeEvent, SESSION_STORE_FLUSH);
+        storeScheduled = 1;
+    }
+}
+
+
+/*
+    Rewrite the session store with the current sessions and reopen it for appending
+ */
+static int compactSessionStore()
 {
     WebsSession     *sp;
-    WebsKey         *sym, *next;
+    char            *tmp;
+    int             fd, i, j, rc;
+
+    /*
+        Append buffered records to the current store first. They are superseded if the rewrite succeeds, but are
+        retained by the current store if it fails.
+     */
+    flushSessionStore();
+    tmp = sfmt("%s.tmp", sessionStore);
+    if ((fd = open(tmp, O_CREAT | O_TRUNC | O_WRONLY | O_BINARY, 0600)) < 0) {
+        error("Cannot create session store %s, errno %d", tmp, errno);
+        wfree(tmp);
+        return -1;
+    }
+    rc = 0;
+    for (i = 0; i < sessionCount && rc == 0; i++) {
+        sp = sessionHeap[i];
+        putStoreRecord(&storeBuf, sp, 'C', 0, 0);
+        for (j = 0; j < sp->varCount; j++) {
+            putStoreRecord(&storeBuf, sp, 'S', sp->vars[j].name, sp->vars[j].value);
+        }
+        if (bufLen(&storeBuf) >= SESSION_STORE_BUFFER) {
+            rc = writeStore(fd, &storeBuf);
+        }
+    }
+    if (rc == 0) {
+        rc = writeStore(fd, &storeBuf);
+    }
+    close(fd);
+    if (rc == 0 && rename(tmp, sessionStore) < 0) {
+        error("Cannot rename session store %s, errno %d", tmp, errno);
+        rc = -1;
+    }
+    if (rc < 0) {
+        unlink(tmp);
+    }
+    wfree(tmp);
+    if (storeFd >= 0) {
+        close(storeFd);
+    }
+    if ((storeFd = open(sessionStore, O_CREAT | O_APPEND | O_WRONLY | O_BINARY, 0600)) < 0) {
+        error("Cannot open session store %s, errno %d", sessionStore, errno);
+        return -1;
+    }
+    /* Some platforms don't implement O_APPEND (VXWORKS) */
+    storeSize = lseek(storeFd, 0, SEEK_END);
+    storeRecords = 0;
+    return rc;
+}
+
+
+#if ME_UNIX_LIKE
+/*
+    Rewrite the session store shared by worker processes. Workers do not rewrite the store as each has only its own
+    sessions. Instead, the supervisor periodically rebuilds the store from its records once it has doubled in size.
+    The store is locked so workers cannot append while it is read and replaced. The supervisor does not otherwise hold
+    sessions, so the loaded sessions are released afterwards.
+ */
+static void compactSharedStore()
+{
+    struct stat     sbuf;
+    int             fd;
+
+    if (!sessionStore || storeFd < 0) {
+        return;
+    }
+    if ((fd = open(sessionStore, O_RDONLY | O_BINARY)) < 0) {
+        return;
+    }
+    if (flock(fd, LOCK_EX) < 0) {
+        close(fd);
+        return;
+    }
+    if (fstat(fd, &sbuf) == 0 && sbuf.st_size > (storeSize * 2) + SESSION_STORE_BUFFER) {
+        trace(4, "Rewrite shared session store %s", sessionStore);
+        while (sessionCount > 0) {
+            destroySession(sessionHeap[0], 0);
+        }
+        loadSessionStore();
+        expireSessions(time(0));
+        compactSessionStore();
+        while (sessionCount > 0) {
+            destroySession(sessionHeap[0], 0);
+        }
+    }
+    /* Closing releases the lock after the store has been replaced */
+    close(fd);
+}
+
+
+/*
+    Lock the session store before a worker appends to it. If the supervisor has replaced the store while the worker
+    waited for the lock, reopen the new store.
+ */
+static int lockSessionStore()
+{
+    struct stat     fileInfo, pathInfo;
 
-    if (sessions >= 0) {
-        for (sym = hashFirst(sessions); sym; sym = next) {
-            next = hashNext(sessions, sym);
-            sp = (WebsSession*) sym->content.value.symbol;
-            hashDelete(sessions, sp->id);
-            freeSession(sp);
+    while (storeFd >= 0) {
+        if (flock(storeFd, LOCK_SH) < 0) {
+            return -1;
+        }
+        if (stat(sessionStore, &pathInfo) == 0 && fstat(storeFd, &fileInfo) == 0 &&
+                pathInfo.st_ino == fileInfo.st_ino && pathInfo.st_dev == fileInfo.st_dev) {
+            return 0;
         }
-        hashFree(sessions);
-        sessions = -1;
+        reopenSessionStore();
+    }
+    return -1;
+}
+
+
+/*
+    Reopen the session store. Workers call this when started so their lock is not shared with other processes via an
+    inherited file handle.
+ */
+static void reopenSessionStore()
+{
+    if (storeFd < 0) {
+        return;
+    }
+    close(storeFd);
+    if ((storeFd = open(sessionStore, O_CREAT | O_APPEND | O_WRONLY | O_BINARY, 0600)) < 0) {
+        error("Cannot open session store %s, errno %d", sessionStore, errno);
+        return;
     }
+    /* Some platforms don't implement O_APPEND (VXWORKS) */
+    lseek(storeFd, 0, SEEK_END);
+}
+#endif
+
+#else /* ME_ROM */
+
+PUBLIC void websSetSessionStore(cchar *path)
+{
+}
+
+
+static void logSession(WebsSession *sp, int kind, cchar *name, cchar *value)
+{
 }
+#endif /* ME_ROM */
 
 
 /*
@@ -3335,6 +6392,11 @@ PUBLIC void websError(Webs *wp, int code, cchar *fmt, ...)
         wp->connError++;
     }
     status = code & WEBS_CODE_MASK;
+#if ME_GOAHEAD_METRICS
+    if (status >= 100 && status < 100 + METRIC_CODES) {
+        metrics.errors[status - 100]++;
+    }
+#endif
 #if !ME_ROM
     if (wp->putfd >= 0) {
         close(wp->putfd);
@@ -3389,6 +6451,17 @@ PUBLIC cchar *websErrorMsg(int code)
 }
 
 
+PUBLIC cchar *websGetMimeType(cchar *ext)
+{
+    WebsKey     *key;
+
+    if ((key = hashLookup(websMime, ext)) != 0) {
+        return key->content.value.string;
+    }
+    return 0;
+}
+
+
 /*
     Accessors
  */
@@ -37,6 +37,7 @@ static bool jstHandler(Webs *wp)
     assert(wp->ext && *wp->ext);
 
     buf = 0;
+    websSetHeaderVars(wp);
     if ((jid = jsOpenEngine(wp->vars, websJstFunctions)) < 0) {
         websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "Cannot create JavaScript engine");
         goto done;
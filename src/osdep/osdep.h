@@ -394,6 +394,7 @@
     #include    <sys/types.h>
 #endif
 #if ME_UNIX_LIKE
+    #include    <sys/file.h>
     #include    <sys/ioctl.h>
     #include    <sys/mman.h>
     #include    <sys/poll.h>
@@ -25,12 +25,58 @@ static int routeMax = 0;
 
 #define WEBS_MAX_ROUTE 16               /* Maximum passes over route set */
 
+/*
+    Compiled route table. Route prefixes are held in a radix tree so a request path only visits the routes whose prefix
+    matches it. Each node lists, in route table order, the routes whose prefix ends at that node. The table is
+    compiled by websLoad and recompiled on demand after routes are added, removed or modified.
+ */
+typedef struct RouteNode {
+    cchar               *segment;       /* Edge label from the parent (references a route prefix) */
+    ssize               segmentLen;     /* Length of the edge label */
+    struct RouteNode    **children;     /* Child nodes. Each child label starts with a different character */
+    int                 childCount;     /* Number of children */
+    int                 *indexes;       /* Indexes of routes ending at this node in ascending order */
+    int                 indexCount;     /* Number of route indexes */
+} RouteNode;
+
+/*
+    Pre-resolved route match criteria indexed by route number
+ */
+typedef struct RouteMatch {
+    int                 methods;        /* Mask of ROUTE_METHOD_* values accepted */
+    int                 protocols;      /* Mask of ROUTE_PROTO_* values accepted */
+} RouteMatch;
+
+#define ROUTE_METHOD_GET        0x1
+#define ROUTE_METHOD_HEAD       0x2
+#define ROUTE_METHOD_POST       0x4
+#define ROUTE_METHOD_PUT        0x8
+#define ROUTE_METHOD_DELETE     0x10
+#define ROUTE_METHOD_OPTIONS    0x20
+#define ROUTE_METHOD_TRACE      0x40
+#define ROUTE_METHOD_PATCH      0x80
+#define ROUTE_METHOD_OTHER      0x100   /* Route methods include others that must be looked up by name */
+#define ROUTE_METHOD_SAFE       (ROUTE_METHOD_GET | ROUTE_METHOD_HEAD | ROUTE_METHOD_POST)
+
+#define ROUTE_PROTO_HTTP        0x1
+#define ROUTE_PROTO_HTTPS       0x2
+
+#define ROUTE_MAX_CANDIDATES    64      /* Candidate routes examined without allocating */
+
+static RouteNode *routeTree = 0;        /* Compiled route prefix tree */
+static RouteMatch *routeMatches = 0;    /* Pre-resolved match criteria for each route */
+static bool routesCompiled = 0;         /* Compiled table reflects the route list */
+
 /********************************** Forwards **********************************/
 
+static int compileRoutes();
 static bool continueHandler(Webs *wp);
 static void freeRoute(WebsRoute *route);
+static void freeRouteNode(RouteNode *node);
 static void growRoutes();
 static int lookupRoute(cchar *uri);
+static int matchRoutes(cchar *path, ssize plen, int start, int *candidates, int max);
+static int methodMask(cchar *method);
 static bool redirectHandler(Webs *wp);
 
 /************************************ Code ************************************/
@@ -42,17 +88,21 @@ PUBLIC void websRouteRequest(Webs *wp)
 {
     WebsRoute   *route;
     WebsHandler *handler;
-    ssize       plen, len;
-    bool        safeMethod;
-    int         i;
+    RouteMatch  *match;
+    ssize       plen;
+    int         c, i, count, method, protocol, buf[ROUTE_MAX_CANDIDATES], *candidates;
 
     assert(wp);
     assert(wp->path);
     assert(wp->method);
     assert(wp->protocol);
 
-    safeMethod = smatch(wp->method, "POST") || smatch(wp->method, "GET") || smatch(wp->method, "HEAD");
-    plen = slen(wp->path);
+    if (!routesCompiled && compileRoutes() < 0) {
+        websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "Cannot compile routes");
+        return;
+    }
+    method = methodMask(wp->method);
+    protocol = smatch(wp->protocol, "https") ? ROUTE_PROTO_HTTPS : ROUTE_PROTO_HTTP;
 
     /*
         Resume routine from last matched route. This permits the legacy service() callbacks to return false
@@ -73,66 +123,302 @@ PUBLIC void websRouteRequest(Webs *wp)
     }
     wp->route = 0;
 
-    for (; i < routeCount; i++) {
-        route = routes[i];
-        assert(route->prefix && route->prefixLen > 0);
-
-        if (plen < route->prefixLen) continue;
-        len = min(route->prefixLen, plen);
-        trace(5, "Examine route %s", route->prefix);
+    candidates = buf;
+    for (;;) {
         /*
-            Match route
+            Select the routes whose prefix matches the path (in route order) then test the remaining criteria
          */
-        if (strncmp(wp->path, route->prefix, len) != 0) {
-            continue;
-        }
-        if (route->protocol && !smatch(route->protocol, wp->protocol)) {
-            trace(5, "Route %s does not match protocol %s", route->prefix, wp->protocol);
-            continue;
+        plen = slen(wp->path);
+        count = matchRoutes(wp->path, plen, i, buf, ROUTE_MAX_CANDIDATES);
+        if (count > ROUTE_MAX_CANDIDATES) {
+            if ((candidates = walloc(count * sizeof(int))) == 0) {
+                break;
+            }
+            count = matchRoutes(wp->path, plen, i, candidates, count);
         }
-        if (route->methods >= 0) {
-            if (!hashLookup(route->methods, wp->method)) {
+        for (c = 0; c < count; c++) {
+            i = candidates[c];
+            route = routes[i];
+            match = &routeMatches[i];
+            trace(5, "Examine route %s", route->prefix);
+
+            if (!(match->protocols & protocol)) {
+                trace(5, "Route %s does not match protocol %s", route->prefix, wp->protocol);
+                continue;
+            }
+            if (method ? !(match->methods & method) :
+                    !((match->methods & ROUTE_METHOD_OTHER) && hashLookup(route->methods, wp->method))) {
                 trace(5, "Route %s does not match method %s", route->prefix, wp->method);
                 continue;
             }
-        } else if (!safeMethod) {
-            continue;
-        }
-        if (route->extensions >= 0 && (wp->ext == 0 || !hashLookup(route->extensions, &wp->ext[1]))) {
-            trace(5, "Route %s doesn match extension %s", route->prefix, wp->ext ? wp->ext : "");
-            continue;
-        }
+            if (route->extensions >= 0 && (wp->ext == 0 || !hashLookup(route->extensions, &wp->ext[1]))) {
+                trace(5, "Route %s doesn match extension %s", route->prefix, wp->ext ? wp->ext : "");
+                continue;
+            }
 
-        wp->route = route;
+            wp->route = route;
 #if ME_GOAHEAD_AUTH
-        if (route->authType && !websAuthenticate(wp)) {
-            return;
-        }
-        if (route->abilities >= 0 && !websCan(wp, route->abilities)) {
-            return;
-        }
+            if (route->authType && !websAuthenticate(wp)) {
+                goto done;
+            }
+            if (route->abilities >= 0 && !websCan(wp, route->abilities)) {
+                goto done;
+            }
 #endif
-        if ((handler = route->handler) == 0) {
-            continue;
-        }
-        if (!handler->match || (*handler->match)(wp)) {
-            /* Handler matches */
-            return;
-        }
-        wp->route = 0;
-        if (wp->flags & WEBS_REROUTE) {
-            wp->flags &= ~WEBS_REROUTE;
-            if (++wp->routeCount >= WEBS_MAX_ROUTE) {
+            if ((handler = route->handler) == 0) {
+                continue;
+            }
+            if (!handler->match || (*handler->match)(wp)) {
+                /* Handler matches */
+                goto done;
+            }
+            wp->route = 0;
+            if (wp->flags & WEBS_REROUTE) {
                 break;
             }
-            i = 0;
         }
+        if (candidates != buf) {
+            wfree(candidates);
+            candidates = buf;
+        }
+        if (c >= count || !(wp->flags & WEBS_REROUTE)) {
+            break;
+        }
+        /*
+            The handler rewrote the request, so restart matching from the first route
+         */
+        wp->flags &= ~WEBS_REROUTE;
+        if (++wp->routeCount >= WEBS_MAX_ROUTE) {
+            break;
+        }
+        i = 0;
     }
     if (wp->routeCount >= WEBS_MAX_ROUTE) {
         error("Route loop for %s", wp->url);
     }
     websError(wp, HTTP_CODE_NOT_FOUND, "Cannot find suitable route for request.");
     assert(wp->route == 0);
+    return;
+
+done:
+    if (candidates != buf) {
+        wfree(candidates);
+    }
+}
+
+
+/*
+    Collect the indexes (at or after start) of routes whose prefix matches the path. The indexes are returned in
+    ascending order. Returns the number of matching routes, which may exceed max in which case only max are stored.
+ */
+static int matchRoutes(cchar *path, ssize plen, int start, int *candidates, int max)
+{
+    RouteNode   *node, *child;
+    ssize       pos;
+    int         count, i, j, k, index;
+
+    count = 0;
+    pos = 0;
+    for (node = routeTree; node; node = child) {
+        for (j = 0; j < node->indexCount; j++) {
+            if ((index = node->indexes[j]) < start) {
+                continue;
+            }
+            if (count < max) {
+                /*
+                    Insert in order. Each node is sorted, so only merge across nodes moves entries.
+                 */
+                for (k = count; k > 0 && candidates[k - 1] > index; k--) {
+                    candidates[k] = candidates[k - 1];
+                }
+                candidates[k] = index;
+            }
+            count++;
+        }
+        child = 0;
+        if (pos < plen) {
+            for (i = 0; i < node->childCount; i++) {
+                child = node->children[i];
+                if (child->segment[0] == path[pos]) {
+                    break;
+                }
+            }
+            if (i >= node->childCount || child->segmentLen > (plen - pos) ||
+                    memcmp(child->segment, &path[pos], child->segmentLen) != 0) {
+                child = 0;
+            } else {
+                pos += child->segmentLen;
+            }
+        }
+    }
+    return count;
+}
+
+
+static int methodMask(cchar *method)
+{
+    switch (*method) {
+    case 'D':
+        return smatch(method, "DELETE") ? ROUTE_METHOD_DELETE : 0;
+    case 'G':
+        return smatch(method, "GET") ? ROUTE_METHOD_GET : 0;
+    case 'H':
+        return smatch(method, "HEAD") ? ROUTE_METHOD_HEAD : 0;
+    case 'O':
+        return smatch(method, "OPTIONS") ? ROUTE_METHOD_OPTIONS : 0;
+    case 'P':
+        if (smatch(method, "POST")) {
+            return ROUTE_METHOD_POST;
+        } else if (smatch(method, "PUT")) {
+            return ROUTE_METHOD_PUT;
+        }
+        return smatch(method, "PATCH") ? ROUTE_METHOD_PATCH : 0;
+    case 'T':
+        return smatch(method, "TRACE") ? ROUTE_METHOD_TRACE : 0;
+    }
+    return 0;
+}
+
+
+static RouteNode *allocRouteNode(cchar *segment, ssize len)
+{
+    RouteNode   *node;
+
+    if ((node = walloc(sizeof(RouteNode))) == 0) {
+        return 0;
+    }
+    memset(node, 0, sizeof(RouteNode));
+    node->segment = segment;
+    node->segmentLen = len;
+    return node;
+}
+
+
+static bool addRouteChild(RouteNode *parent, RouteNode *child)
+{
+    RouteNode   **children;
+
+    if ((children = wrealloc(parent->children, (parent->childCount + 1) * sizeof(RouteNode*))) == 0) {
+        return 0;
+    }
+    parent->children = children;
+    parent->children[parent->childCount++] = child;
+    return 1;
+}
+
+
+/*
+    Insert a route prefix into the tree and return the node at which the prefix ends. Edges are split as required so
+    every prefix ends on a node.
+ */
+static RouteNode *insertRouteNode(RouteNode *node, cchar *prefix, ssize len)
+{
+    RouteNode   *child, *split;
+    ssize       common;
+    int         i;
+
+    while (len > 0) {
+        for (i = 0; i < node->childCount; i++) {
+            if (node->children[i]->segment[0] == prefix[0]) {
+                break;
+            }
+        }
+        if (i >= node->childCount) {
+            if ((child = allocRouteNode(prefix, len)) == 0 || !addRouteChild(node, child)) {
+                wfree(child);
+                return 0;
+            }
+            return child;
+        }
+        child = node->children[i];
+        for (common = 1; common < child->segmentLen && common < len && child->segment[common] == prefix[common];
+                common++) {}
+        if (common < child->segmentLen) {
+            /*
+                Split the edge at the end of the common part
+             */
+            if ((split = allocRouteNode(child->segment, common)) == 0 || !addRouteChild(split, child)) {
+                wfree(split);
+                return 0;
+            }
+            child->segment += common;
+            child->segmentLen -= common;
+            node->children[i] = split;
+            child = split;
+        }
+        prefix += common;
+        len -= common;
+        node = child;
+    }
+    return node;
+}
+
+
+static void freeRouteNode(RouteNode *node)
+{
+    int     i;
+
+    if (node) {
+        for (i = 0; i < node->childCount; i++) {
+            freeRouteNode(node->children[i]);
+        }
+        wfree(node->children);
+        wfree(node->indexes);
+        wfree(node);
+    }
+}
+
+
+/*
+    Compile the route list into the route prefix tree and resolve the method and protocol criteria for each route
+ */
+static int compileRoutes()
+{
+    WebsRoute   *route;
+    RouteMatch  *match;
+    RouteNode   *node;
+    WebsKey     *key;
+    int         i, bit, *indexes;
+
+    freeRouteNode(routeTree);
+    wfree(routeMatches);
+    routeMatches = 0;
+    if ((routeTree = allocRouteNode("", 0)) == 0) {
+        return -1;
+    }
+    if (routeCount > 0 && (routeMatches = walloc(routeCount * sizeof(RouteMatch))) == 0) {
+        return -1;
+    }
+    for (i = 0; i < routeCount; i++) {
+        route = routes[i];
+        match = &routeMatches[i];
+        if ((node = insertRouteNode(routeTree, route->prefix, route->prefixLen)) == 0) {
+            return -1;
+        }
+        if ((indexes = wrealloc(node->indexes, (node->indexCount + 1) * sizeof(int))) == 0) {
+            return -1;
+        }
+        node->indexes = indexes;
+        node->indexes[node->indexCount++] = i;
+
+        if (route->protocol) {
+            match->protocols = smatch(route->protocol, "https") ? ROUTE_PROTO_HTTPS :
+                smatch(route->protocol, "http") ? ROUTE_PROTO_HTTP : 0;
+        } else {
+            match->protocols = ROUTE_PROTO_HTTP | ROUTE_PROTO_HTTPS;
+        }
+        if (route->methods >= 0) {
+            match->methods = 0;
+            for (key = hashFirst(route->methods); key; key = hashNext(route->methods, key)) {
+                bit = methodMask(key->name.value.string);
+                match->methods |= bit ? bit : ROUTE_METHOD_OTHER;
+            }
+        } else {
+            match->methods = ROUTE_METHOD_SAFE;
+        }
+    }
+    routesCompiled = 1;
+    return 0;
 }
 
 
@@ -315,10 +601,11 @@ PUBLIC WebsRoute *websAddRoute(cchar *uri, cchar *handler, int pos)
         pos = routeCount;
     }
     if (pos < routeCount) {
-        memmove(&routes[pos + 1], &routes[pos], sizeof(WebsRoute*) * routeCount - pos);
+        memmove(&routes[pos + 1], &routes[pos], sizeof(WebsRoute*) * (routeCount - pos));
     }
     routes[pos] = route;
     routeCount++;
+    routesCompiled = 0;
     return route;
 }
 
@@ -336,10 +623,25 @@ PUBLIC int websSetRouteMatch(WebsRoute *route, cchar *dir, cchar *protocol, Webs
     route->extensions = extensions;
     route->methods = methods;
     route->redirects = redirects;
+    routesCompiled = 0;
     return 0;
 }
 
 
+#if ME_GOAHEAD_CGI
+PUBLIC void websSetRouteFastCgi(WebsRoute *route, cchar *program, int processes, int multiplex, int queue)
+{
+    assert(route);
+
+    wfree(route->program);
+    route->program = program ? sclone(program) : 0;
+    route->processes = processes > 0 ? processes : ME_GOAHEAD_FASTCGI_PROCESSES;
+    route->multiplex = multiplex > 0 ? multiplex : ME_GOAHEAD_FASTCGI_MULTIPLEX;
+    route->queue = queue > 0 ? queue : ME_GOAHEAD_FASTCGI_QUEUE;
+}
+#endif
+
+
 static void growRoutes()
 {
     if (routeCount >= routeMax) {
@@ -388,6 +690,9 @@ static void freeRoute(WebsRoute *route)
     wfree(route->dir);
     wfree(route->protocol);
     wfree(route->authType);
+#if ME_GOAHEAD_CGI
+    wfree(route->program);
+#endif
     wfree(route);
 }
 
@@ -406,10 +711,24 @@ PUBLIC int websRemoveRoute(cchar *uri)
         routes[i] = routes[i+1];
     }
     routeCount--;
+    routesCompiled = 0;
     return 0;
 }
 
 
+PUBLIC WebsRoute **websGetRoutes(int *count)
+{
+    *count = routeCount;
+    return routes;
+}
+
+
+PUBLIC WebsHash websGetHandlers()
+{
+    return handlers;
+}
+
+
 PUBLIC int websOpenRoute()
 {
     if ((handlers = hashCreate(-1)) < 0) {
@@ -446,6 +765,11 @@ PUBLIC void websCloseRoute()
         wfree(routes);
         routes = 0;
     }
+    freeRouteNode(routeTree);
+    routeTree = 0;
+    wfree(routeMatches);
+    routeMatches = 0;
+    routesCompiled = 0;
     routeCount = routeMax = 0;
 }
 
@@ -502,6 +826,10 @@ PUBLIC int websLoad(cchar *path)
     char        *buf, *line, *kind, *next, *auth, *dir, *handler, *protocol, *uri, *option, *key, *value, *status;
     char        *redirectUri, *token;
     int         rc;
+#if ME_GOAHEAD_CGI
+    char        *program;
+    int         processes, multiplex, queue;
+#endif
 
     assert(path && *path);
 
@@ -518,6 +846,10 @@ PUBLIC int websLoad(cchar *path)
         if (smatch(kind, "route")) {
             auth = dir = handler = protocol = uri = 0;
             abilities = extensions = methods = redirects = -1;
+#if ME_GOAHEAD_CGI
+            program = 0;
+            processes = multiplex = queue = 0;
+#endif
             while ((option = stok(NULL, " \t\r\n", &next)) != 0) {
                 key = stok(option, "=", &value);
                 if (smatch(key, "abilities")) {
@@ -532,6 +864,14 @@ PUBLIC int websLoad(cchar *path)
                     handler = value;
                 } else if (smatch(key, "methods")) {
                     addOption(&methods, value, 0);
+#if ME_GOAHEAD_CGI
+                } else if (smatch(key, "multiplex")) {
+                    multiplex = atoi(value);
+                } else if (smatch(key, "processes")) {
+                    processes = atoi(value);
+                } else if (smatch(key, "program")) {
+                    program = value;
+#endif
                 } else if (smatch(key, "redirect")) {
                     if (strchr(value, '@')) {
                         status = stok(value, "@", &redirectUri);
@@ -547,6 +887,10 @@ PUBLIC int websLoad(cchar *path)
                     addOption(&redirects, status, redirectUri);
                 } else if (smatch(key, "protocol")) {
                     protocol = value;
+#if ME_GOAHEAD_CGI
+                } else if (smatch(key, "queue")) {
+                    queue = atoi(value);
+#endif
                 } else if (smatch(key, "uri")) {
                     uri = value;
                 } else {
@@ -559,6 +903,11 @@ PUBLIC int websLoad(cchar *path)
                 break;
             }
             websSetRouteMatch(route, dir, protocol, methods, extensions, abilities, redirects);
+#if ME_GOAHEAD_CGI
+            if (program || smatch(handler, "fastcgi")) {
+                websSetRouteFastCgi(route, program, processes, multiplex, queue);
+            }
+#endif
 #if ME_GOAHEAD_AUTH
             if (auth && websSetRouteAuth(route, auth) < 0) {
                 rc = -1;
@@ -601,6 +950,21 @@ PUBLIC int websLoad(cchar *path)
                 break;
             }
 #endif
+        } else if (smatch(kind, "cache")) {
+            ssize size, itemSize;
+            size = itemSize = -1;
+            while ((option = stok(NULL, " \t\r\n", &next)) != 0) {
+                key = stok(option, "=", &value);
+                if (smatch(key, "size")) {
+                    size = (ssize) atoi(value);
+                } else if (smatch(key, "item")) {
+                    itemSize = (ssize) atoi(value);
+                } else {
+                    error("Bad cache keyword %s", key);
+                    continue;
+                }
+            }
+            websSetFileCache(size, itemSize);
         } else {
             error("Unknown route keyword %s", kind);
             rc = -1;
@@ -611,6 +975,10 @@ PUBLIC int websLoad(cchar *path)
 #if ME_GOAHEAD_AUTH
     websComputeAllUserAbilities();
 #endif
+    if (rc == 0 && compileRoutes() < 0) {
+        error("Cannot compile routes");
+        rc = -1;
+    }
     return rc;
 }
 
@@ -15,8 +15,9 @@
 typedef struct Callback {
     void        (*routine)(void *arg, int id);
     void        *arg;
-    WebsTime    at;
+    Ticks       at;                     /* Due time in milliseconds */
     int         id;
+    int         index;                  /* Index in the event heap. Set to -1 if not scheduled */
 } Callback;
 
 /*********************************** Defines **********************************/
@@ -141,22 +142,36 @@ typedef struct Format {
     } while (0)
 
 /*
-    The handle list stores the length of the list and the number of used handles in the first two words.  These are
-    hidden from the caller by returning a pointer to the third word to the caller.
+    The handle list stores the length of the list, the number of used handles, the highest used handle plus one and
+    a search hint in the first four words. These are hidden from the caller by returning a pointer to the fifth word.
+    A bitmap of allocated handles follows the list so free handles are found a word at a time.
  */
 #define H_LEN       0       /* First entry holds length of list */
 #define H_USED      1       /* Second entry holds number of used */
-#define H_OFFSET    2       /* Offset to real start of list */
-#define H_INCR      16      /* Grow handle list in chunks this size */
+#define H_MAX       2       /* Highest allocated handle plus one */
+#define H_HINT      3       /* Lowest bitmap word that may have a free handle */
+#define H_OFFSET    4       /* Offset to real start of list */
+#define H_INCR      16      /* Initial handle list size. The list doubles when full */
+
+#define H_BITS      ((int) sizeof(size_t) * 8)
+#define H_WORDS(len) (((len) + H_BITS - 1) / H_BITS)
+#define H_MAP(mp)   ((size_t*) &(mp)[H_OFFSET + (mp)[H_LEN]])
 
 #define RINGQ_LEN(bp) ((bp->servp > bp->endp) ? (bp->buflen + (bp->endp - bp->servp)) : (bp->endp - bp->servp))
 
 typedef struct HashTable {              /* Symbol table descriptor */
     WebsKey     **hash_table;           /* Allocated at run time */
-    int         inuse;                  /* Is this entry in use */
-    int         size;                   /* Size of the table below */
+    int         count;                  /* Number of symbols in the table */
+    int         size;                   /* Size of the table below. Always a power of two */
+    int         initSize;               /* Initial size of the table. Restored by hashClear */
+    WebsKey     *first;                 /* First symbol in insertion order */
+    WebsKey     *last;                  /* Last symbol in insertion order */
+    WebsHashFill fill;                  /* Callback to populate the table before it is first walked */
+    void        *fillData;              /* Data argument for fill */
 } HashTable;
 
+#define HASH_MIN_SIZE   8               /* Minimum number of hash buckets */
+
 #ifndef LOG_ERR
     #define LOG_ERR 0
 #endif
@@ -171,6 +186,10 @@ PUBLIC int       logLevel;          /* Log verbosity level */
 static Callback  **callbacks;
 static int       callbackMax;
 
+static Callback  **eventHeap;       /* Scheduled events as a min-heap ordered by due time */
+static int       eventCount;        /* Number of scheduled events in eventHeap */
+static int       eventSize;         /* Allocated size of eventHeap */
+
 static HashTable **sym;             /* List of symbol tables */
 static int       symMax;            /* One past the max symbol table */
 
@@ -183,10 +202,14 @@ static int       logFd;             /* Log file handle */
 
 /********************************** Forwards **********************************/
 
-static int calcPrime(int size);
+static void eventDown(int index);
+static int eventInsert(Callback *cp);
+static void eventRemove(Callback *cp);
+static void eventUp(int index);
 static int getBinBlockSize(int size);
-static int hashIndex(HashTable *tp, cchar *name);
-static WebsKey *hash(HashTable *tp, cchar *name);
+static uint hashName(cchar *name, ssize *len);
+static WebsKey *hashFind(HashTable *tp, cchar *name, uint hashValue, WebsKey **prior);
+static void hashGrow(HashTable *tp);
 
 #if ME_GOAHEAD_LOGGING
 static void defaultLogHandler(int level, cchar *buf);
@@ -215,26 +238,123 @@ PUBLIC int websRuntimeOpen()
 
 PUBLIC void websRuntimeClose()
 {
+    wfree(eventHeap);
+    eventHeap = 0;
+    eventCount = eventSize = 0;
 }
 
 
 /*
-    This function is called when a scheduled process time has come.
+    Return the elapsed time in milliseconds from an arbitrary epoch. This is not affected by changes to the system time
+    where the platform has a monotonic clock. Otherwise it falls back to the time of day.
  */
-static void callEvent(int id)
+PUBLIC Ticks websGetTicks()
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec     ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (Ticks) ts.tv_sec * TPS + (ts.tv_nsec / 1000000);
+#elif ME_WIN_LIKE
+    /* GetTickCount wraps after 49.7 days */
+    return (Ticks) GetTickCount64();
+#else
+    struct timeval      tv;
+
+    gettimeofday(&tv, NULL);
+    return (Ticks) tv.tv_sec * TPS + (tv.tv_usec / 1000);
+#endif
+}
+
+
+/*
+    Move an event up the heap toward the root while it is due before its parent
+ */
+static void eventUp(int index)
 {
     Callback    *cp;
+    int         parent;
+
+    cp = eventHeap[index];
+    while (index > 0) {
+        parent = (index - 1) / 2;
+        if (eventHeap[parent]->at <= cp->at) {
+            break;
+        }
+        eventHeap[index] = eventHeap[parent];
+        eventHeap[index]->index = index;
+        index = parent;
+    }
+    eventHeap[index] = cp;
+    cp->index = index;
+}
 
-    assert(0 <= id && id < callbackMax);
-    cp = callbacks[id];
-    assert(cp);
 
-    (cp->routine)(cp->arg, cp->id);
+/*
+    Move an event down the heap while it is due after either child
+ */
+static void eventDown(int index)
+{
+    Callback    *cp;
+    int         child;
+
+    cp = eventHeap[index];
+    while ((child = index * 2 + 1) < eventCount) {
+        if ((child + 1) < eventCount && eventHeap[child + 1]->at < eventHeap[child]->at) {
+            child++;
+        }
+        if (cp->at <= eventHeap[child]->at) {
+            break;
+        }
+        eventHeap[index] = eventHeap[child];
+        eventHeap[index]->index = index;
+        index = child;
+    }
+    eventHeap[index] = cp;
+    cp->index = index;
+}
+
+
+static int eventInsert(Callback *cp)
+{
+    Callback    **heap;
+    int         size;
+
+    if (eventCount >= eventSize) {
+        size = max(eventSize * 2, H_INCR);
+        if ((heap = wrealloc(eventHeap, size * sizeof(Callback*))) == 0) {
+            return -1;
+        }
+        eventHeap = heap;
+        eventSize = size;
+    }
+    eventHeap[eventCount] = cp;
+    eventUp(eventCount++);
+    return 0;
+}
+
+
+static void eventRemove(Callback *cp)
+{
+    Callback    *last;
+    int         index;
+
+    if ((index = cp->index) < 0) {
+        return;
+    }
+    cp->index = -1;
+    if (--eventCount > index) {
+        last = eventHeap[eventCount];
+        eventHeap[index] = last;
+        last->index = index;
+        eventDown(index);
+        eventUp(last->index);
+    }
 }
 
 
 /*
-    Schedule an event in delay milliseconds time. We will use 1 second granularity for webServer.
+    Schedule an event in delay milliseconds time. Events are kept in a heap so scheduling and cancelling are O(log n).
  */
 PUBLIC int websStartEvent(int delay, WebsEventProc proc, void *arg)
 {
@@ -248,11 +368,12 @@ PUBLIC int websStartEvent(int delay, WebsEventProc proc, void *arg)
     s->routine = proc;
     s->arg = arg;
     s->id = id;
-
-    /*
-        Round the delay up to seconds.
-     */
-    s->at = ((delay + 500) / 1000) + time(0);
+    s->at = websGetTicks() + max(delay, 0);
+    if (eventInsert(s) < 0) {
+        wfree(s);
+        callbackMax = wfreeHandle(&callbacks, id);
+        return -1;
+    }
     return id;
 }
 
@@ -264,7 +385,13 @@ PUBLIC void websRestartEvent(int id, int delay)
     if (callbacks == NULL || id == -1 || id >= callbackMax || (s = callbacks[id]) == NULL) {
         return;
     }
-    s->at = ((delay + 500) / 1000) + time(0);
+    s->at = websGetTicks() + max(delay, 0);
+    if (s->index < 0) {
+        eventInsert(s);
+    } else {
+        eventDown(s->index);
+        eventUp(s->index);
+    }
 }
 
 
@@ -275,34 +402,36 @@ PUBLIC void websStopEvent(int id)
     if (callbacks == NULL || id == -1 || id >= callbackMax || (s = callbacks[id]) == NULL) {
         return;
     }
+    eventRemove(s);
     wfree(s);
     callbackMax = wfreeHandle(&callbacks, id);
 }
 
 
-int websRunEvents()
+/*
+    Run due events and return the delay in milliseconds till the next event is due.
+    An event runs once and is removed from the schedule before invoking the callback. The callback may
+    reschedule via websRestartEvent. Events due now that are rescheduled for now will run on the next call.
+ */
+PUBLIC int websRunEvents()
 {
     Callback    *s;
-    WebsTime    now;
-    int         i, delay, nextEvent;
-
-    nextEvent = (MAXINT / 1000);
-    now = time(0);
-
-    for (i = 0; i < callbackMax; i++) {
-        if ((s = callbacks[i]) != NULL) {
-            if (s->at <= now) {
-                callEvent(i);
-                delay = MAXINT / 1000;
-                /* Rescan incase event scheduled or modified an event */
-                i = -1;
-            } else {
-                delay = (int) min(s->at - now, MAXINT / 1000);
-            }
-            nextEvent = min(delay, nextEvent);
+    Ticks       now;
+    int         count;
+
+    now = websGetTicks();
+    for (count = eventCount; count > 0 && eventCount > 0; count--) {
+        s = eventHeap[0];
+        if (s->at > now) {
+            break;
         }
+        eventRemove(s);
+        (s->routine)(s->arg, s->id);
+    }
+    if (eventCount == 0) {
+        return MAXINT;
     }
-    return nextEvent * 1000;
+    return (int) min(max(eventHeap[0]->at - now, 0), MAXINT);
 }
 
 
@@ -344,6 +473,21 @@ PUBLIC char *fmt(char *buf, ssize bufsize, cchar *format, ...)
 }
 
 
+/*
+    Replacement for vsprintf
+ */
+PUBLIC char *fmtv(char *buf, ssize bufsize, cchar *format, va_list args)
+{
+    assert(buf);
+    assert(format);
+
+    if (bufsize <= 0) {
+        return 0;
+    }
+    return sprintfCore(buf, bufsize, format, args);
+}
+
+
 /*
     Scure vsprintf replacement
  */
@@ -1203,60 +1347,122 @@ PUBLIC char *itosbuf(char *buf, ssize size, int64 value, int radix)
 }
 
 
+/*
+    Return the index of the lowest set bit in a non-zero word
+ */
+static int lowestBit(size_t word)
+{
+#if __GNUC__
+    return __builtin_ctzll((uint64) word);
+#else
+    int     bit;
+
+    for (bit = 0; !(word & 1); bit++) {
+        word >>= 1;
+    }
+    return bit;
+#endif
+}
+
+
+/*
+    Return the index of the highest set bit in a non-zero word
+ */
+static int highestBit(size_t word)
+{
+#if __GNUC__
+    return 63 - __builtin_clzll((uint64) word);
+#else
+    int     bit;
+
+    for (bit = -1; word; bit++) {
+        word >>= 1;
+    }
+    return bit;
+#endif
+}
+
+
+/*
+    Grow a handle list to hold len handles. The bitmap is moved to follow the enlarged list.
+ */
+static ssize *growHandles(ssize *mp, int len)
+{
+    ssize   oldLen;
+    int     words, oldWords;
+
+    oldLen = mp ? mp[H_LEN] : 0;
+    oldWords = H_WORDS(oldLen);
+    words = H_WORDS(len);
+    if ((mp = wrealloc(mp, (H_OFFSET + len) * sizeof(void*) + words * sizeof(size_t))) == NULL) {
+        return NULL;
+    }
+    if (oldLen == 0) {
+        mp[H_USED] = mp[H_MAX] = mp[H_HINT] = 0;
+    } else {
+        memmove(&mp[H_OFFSET + len], &mp[H_OFFSET + oldLen], oldWords * sizeof(size_t));
+    }
+    memset(&mp[H_OFFSET + oldLen], 0, (len - oldLen) * sizeof(void*));
+    mp[H_LEN] = len;
+    memset(&H_MAP(mp)[oldWords], 0, (words - oldWords) * sizeof(size_t));
+    return mp;
+}
+
+
 /*
     Allocate a new file handle. On the first call, the caller must set the handle map to be a pointer to a null
-    pointer.  map points to the second element in the handle array.
+    pointer.  map points to the first handle in the handle array. The lowest free handle is returned.
  */
 PUBLIC int wallocHandle(void *mapArg)
 {
     void    ***map;
     ssize   *mp;
-    int     handle, len, memsize, incr;
+    size_t  *bits;
+    int     handle, len, word, words;
 
     map = (void***) mapArg;
     assert(map);
 
     if (*map == NULL) {
-        incr = H_INCR;
-        memsize = (incr + H_OFFSET) * sizeof(void*);
-        if ((mp = walloc(memsize)) == NULL) {
+        if ((mp = growHandles(NULL, H_INCR)) == NULL) {
             return -1;
         }
-        memset(mp, 0, memsize);
-        mp[H_LEN] = incr;
-        mp[H_USED] = 0;
         *map = (void*) &mp[H_OFFSET];
     } else {
         mp = &((*(ssize**)map)[-H_OFFSET]);
     }
     len = (int) mp[H_LEN];
+    handle = len;
 
     /*
-        Find the first null handle
+        Find the first free handle. All bitmap words below the hint are full.
      */
-    if (mp[H_USED] < mp[H_LEN]) {
-        for (handle = 0; handle < len; handle++) {
-            if (mp[handle + H_OFFSET] == 0) {
-                mp[H_USED]++;
-                return handle;
+    if (mp[H_USED] < len) {
+        bits = H_MAP(mp);
+        words = H_WORDS(len);
+        for (word = (int) mp[H_HINT]; word < words; word++) {
+            if (~bits[word]) {
+                handle = word * H_BITS + lowestBit(~bits[word]);
+                break;
             }
         }
-    } else {
-        handle = len;
     }
-
-    /*
-        No free handle so grow the handle list. Grow list in chunks of H_INCR.
-     */
-    len += H_INCR;
-    memsize = (len + H_OFFSET) * sizeof(void*);
-    if ((mp = wrealloc(mp, memsize)) == NULL) {
-        return -1;
+    if (handle >= len) {
+        /*
+            No free handle so double the handle list
+         */
+        handle = len;
+        if ((mp = growHandles(mp, len * 2)) == NULL) {
+            return -1;
+        }
+        *map = (void*) &mp[H_OFFSET];
     }
-    *map = (void*) &mp[H_OFFSET];
-    mp[H_LEN] = len;
-    memset(&mp[H_OFFSET + len - H_INCR], 0, sizeof(ssize*) * H_INCR);
+    H_MAP(mp)[handle / H_BITS] |= (size_t) 1 << (handle % H_BITS);
+    mp[H_HINT] = handle / H_BITS;
     mp[H_USED]++;
+    if (handle >= mp[H_MAX]) {
+        mp[H_MAX] = handle + 1;
+    }
     return handle;
 }
 
@@ -1268,37 +1474,41 @@ PUBLIC int wfreeHandle(void *mapArg, int handle)
 {
     void    ***map;
     ssize   *mp;
-    int     len;
+    size_t  *bits, mask;
+    int     word;
 
     map = (void***) mapArg;
     assert(map);
     mp = &((*(ssize**)map)[-H_OFFSET]);
     assert(mp[H_LEN] >= H_INCR);
+    assert(handle >= 0 && handle < mp[H_LEN]);
 
-    assert(mp[handle + H_OFFSET]);
+    bits = H_MAP(mp);
+    word = handle / H_BITS;
+    mask = (size_t) 1 << (handle % H_BITS);
+    assert(bits[word] & mask);
+    if (!(bits[word] & mask)) {
+        return (int) mp[H_MAX];
+    }
     assert(mp[H_USED]);
+    bits[word] &= ~mask;
     mp[handle + H_OFFSET] = 0;
     if (--(mp[H_USED]) == 0) {
         wfree((void*) mp);
         *map = NULL;
+        return 0;
+    }
+    if (word < mp[H_HINT]) {
+        mp[H_HINT] = word;
     }
     /*
-        Find the greatest handle number in use.
+        If freeing the highest handle, find the next highest handle in use
      */
-    if (*map == NULL) {
-        handle = -1;
-    } else {
-        len = (int) mp[H_LEN];
-        if (mp[H_USED] < mp[H_LEN]) {
-            for (handle = len - 1; handle >= 0; handle--) {
-                if (mp[handle + H_OFFSET])
-                    break;
-            }
-        } else {
-            handle = len;
-        }
+    if (handle + 1 == mp[H_MAX]) {
+        for (; word >= 0 && bits[word] == 0; word--) ;
+        mp[H_MAX] = (word >= 0) ? word * H_BITS + highestBit(bits[word]) + 1 : 0;
     }
-    return handle + 1;
+    return (int) mp[H_MAX];
 }
 
 
@@ -1501,6 +1711,7 @@ PUBLIC ssize bufPut(WebsBuf *bp, cchar *fmt, ...)
 
     rc = bufPutBlk(bp, str, strlen(str) * sizeof(char));
     *((char*) bp->endp) = (char) '\0';
+    wfree(str);
     return rc;
 }
 
@@ -1811,6 +2022,34 @@ PUBLIC void bufCompact(WebsBuf *bp)
 }
 
 
+/*
+    Empty a buf for reuse. Storage grown beyond the initial size is released so long lived connections do not pin
+    memory allocated for one large request.
+ */
+PUBLIC int bufRecycle(WebsBuf *bp, int initSize)
+{
+    int     size, maxsize;
+
+    assert(bp);
+
+    if (initSize <= 0) {
+        initSize = ME_GOAHEAD_LIMIT_BUFFER;
+    }
+    size = getBinBlockSize(initSize);
+    if (bp->buf && bp->buflen <= size) {
+        bp->increment = size;
+        bufFlush(bp);
+        return 0;
+    }
+    maxsize = (int) bp->maxsize;
+    if (bp->buf) {
+        wfree(bp->buf);
+        bp->buf = NULL;
+    }
+    return bufCreate(bp, initSize, maxsize);
+}
+
+
 /*
     Reset pointers if empty
  */
@@ -1883,6 +2122,7 @@ WebsHash hashCreate(int size)
 {
     WebsHash    sd;
     HashTable   *tp;
+    int         buckets;
 
     if (size < 0) {
         size = WEBS_SMALL_HASH;
@@ -1911,9 +2151,11 @@ WebsHash hashCreate(int size)
     sym[sd] = tp;
 
     /*
-        Now create the hash table for fast indexing.
+        Now create the hash table for fast indexing. The size is a power of two so the bucket index can be masked from
+        the hash. The table grows as symbols are added, so the size is only a hint.
      */
-    tp->size = calcPrime(size);
+    for (buckets = HASH_MIN_SIZE; buckets < size; buckets <<= 1) {}
+    tp->size = tp->initSize = buckets;
     if ((tp->hash_table = (WebsKey**) walloc(tp->size * sizeof(WebsKey*))) == 0) {
         wfreeHandle(&sym, sd);
         wfree(tp);
@@ -1951,7 +2193,6 @@ PUBLIC void hashFree(WebsHash sd)
             valueFree(&sp->name);
             valueFree(&sp->content);
             wfree((void*) sp);
-            sp = forw;
         }
     }
     wfree((void*) tp->hash_table);
@@ -1961,15 +2202,67 @@ PUBLIC void hashFree(WebsHash sd)
 
 
 /*
-    Return the first symbol in the hashtable if there is one. This call is used as the first step in traversing the
-    table. A call to hashFirst should be followed by calls to hashNext to get all the rest of the entries.
+    Remove all symbols but keep the hash table and its index for reuse. An index that has grown is shrunk to its
+    initial size so a table reused for many requests does not retain the index needed by the largest.
  */
-WebsKey *hashFirst(WebsHash sd)
+PUBLIC void hashClear(WebsHash sd)
 {
     HashTable   *tp;
-    WebsKey     *sp;
+    WebsKey     *sp, *forw, **table;
     int         i;
 
+    if (sd < 0) {
+        return;
+    }
+    assert(0 <= sd && sd < symMax);
+    tp = sym[sd];
+    assert(tp);
+
+    for (i = 0; i < tp->size; i++) {
+        for (sp = tp->hash_table[i]; sp; sp = forw) {
+            forw = sp->forw;
+            valueFree(&sp->name);
+            valueFree(&sp->content);
+            wfree((void*) sp);
+        }
+        tp->hash_table[i] = 0;
+    }
+    if (tp->size > tp->initSize && (table = (WebsKey**) walloc(tp->initSize * sizeof(WebsKey*))) != 0) {
+        memset(table, 0, tp->initSize * sizeof(WebsKey*));
+        wfree((void*) tp->hash_table);
+        tp->hash_table = table;
+        tp->size = tp->initSize;
+    }
+    tp->count = 0;
+    tp->first = tp->last = 0;
+    tp->fill = 0;
+    tp->fillData = 0;
+}
+
+
+PUBLIC void hashSetFill(WebsHash sd, WebsHashFill fill, void *data)
+{
+    HashTable   *tp;
+
+    assert(0 <= sd && sd < symMax);
+    tp = sym[sd];
+    assert(tp);
+
+    tp->fill = fill;
+    tp->fillData = data;
+}
+
+
+/*
+    Return the first symbol in the hashtable if there is one. This call is used as the first step in traversing the
+    table. A call to hashFirst should be followed by calls to hashNext to get all the rest of the entries. Symbols are
+    traversed in insertion order, independent of the index, so growing the index during a traversal is safe.
+ */
+WebsKey *hashFirst(WebsHash sd)
+{
+    HashTable       *tp;
+    WebsHashFill    fill;
+
     assert(0 <= sd && sd < symMax);
     if (sd < 0 || sd >=symMax) {
         return 0;
@@ -1977,15 +2270,12 @@ WebsKey *hashFirst(WebsHash sd)
     tp = sym[sd];
     assert(tp);
 
-    /*
-        Find the first symbol in the hashtable and return a pointer to it.
-     */
-    for (i = 0; i < tp->size; i++) {
-        if ((sp = tp->hash_table[i]) != 0) {
-            return sp;
-        }
+    if ((fill = tp->fill) != 0) {
+        /* Populate the table before the walk begins. Remove the callback first as it may use the table. */
+        tp->fill = 0;
+        fill(tp->fillData);
     }
-    return 0;
+    return tp->first;
 }
 
 
@@ -1994,28 +2284,14 @@ WebsKey *hashFirst(WebsHash sd)
  */
 WebsKey *hashNext(WebsHash sd, WebsKey *last)
 {
-    HashTable   *tp;
-    WebsKey     *sp;
-    int         i;
-
     assert(0 <= sd && sd < symMax);
     if (sd < 0) {
         return 0;
     }
-    tp = sym[sd];
-    assert(tp);
     if (last == 0) {
         return hashFirst(sd);
     }
-    if (last->forw) {
-        return last->forw;
-    }
-    for (i = last->bucket + 1; i < tp->size; i++) {
-        if ((sp = tp->hash_table[i]) != 0) {
-            return sp;
-        }
-    }
-    return NULL;
+    return last->next;
 }
 
 
@@ -2025,8 +2301,6 @@ WebsKey *hashNext(WebsHash sd, WebsKey *last)
 WebsKey *hashLookup(WebsHash sd, cchar *name)
 {
     HashTable   *tp;
-    WebsKey     *sp;
-    char        *cp;
 
     assert(0 <= sd && sd < symMax);
     if (sd < 0 || (tp = sym[sd]) == NULL) {
@@ -2035,16 +2309,7 @@ WebsKey *hashLookup(WebsHash sd, cchar *name)
     if (name == NULL || *name == '\0') {
         return NULL;
     }
-    /*
-        Do an initial hash and then follow the link chain to find the right entry
-     */
-    for (sp = hash(tp, name); sp; sp = sp->forw) {
-        cp = sp->name.value.string;
-        if (cp[0] == name[0] && strcmp(cp, name) == 0) {
-            break;
-        }
-    }
-    return sp;
+    return hashFind(tp, name, hashName(name, NULL), NULL);
 }
 
 
@@ -2060,78 +2325,65 @@ void *hashLookupSymbol(WebsHash sd, cchar *name)
 
 
 /*
-    Enter a symbol into the table. If already there, update its value.  Always succeeds if memory available. We allocate
-    a copy of "name" here so it can be a volatile variable. The value "v" is just a copy of the passed in value, so it
-    MUST be persistent.
+    Enter a symbol into the table. If already there, update its value.  Always succeeds if memory available. We store
+    a copy of "name" inline after the key so it can be a volatile variable. The value "v" is just a copy of the passed
+    in value, so it MUST be persistent.
  */
 WebsKey *hashEnter(WebsHash sd, cchar *name, WebsValue v, int arg)
 {
     HashTable   *tp;
     WebsKey     *sp, *last;
-    char        *cp;
-    int         hindex;
+    ssize       len;
+    uint        hashValue;
 
     assert(name);
     assert(0 <= sd && sd < symMax);
     tp = sym[sd];
     assert(tp);
 
-    /*
-        Calculate the first daisy-chain from the hash table. If non-zero, then we have daisy-chain, so scan it and look
-        for the symbol.
-     */
-    last = NULL;
-    hindex = hashIndex(tp, name);
-    if ((sp = tp->hash_table[hindex]) != NULL) {
-        for (; sp; sp = sp->forw) {
-            cp = sp->name.value.string;
-            if (cp[0] == name[0] && strcmp(cp, name) == 0) {
-                break;
-            }
-            last = sp;
-        }
-        if (sp) {
-            /*
-                Found, so update the value If the caller stores handles which require freeing, they will be lost here.
-                It is the callers responsibility to free resources before overwriting existing contents. We will here
-                free allocated strings which occur due to value_instring().  We should consider providing the cleanup
-                function on the open rather than the close and then we could call it here and solve the problem.
-             */
-            if (sp->content.valid) {
-                valueFree(&sp->content);
-            }
-            sp->content = v;
-            sp->arg = arg;
-            return sp;
-        }
+    hashValue = hashName(name, &len);
+    if ((sp = hashFind(tp, name, hashValue, &last)) != NULL) {
         /*
-            Not found so allocate and append to the daisy-chain
+            Found, so update the value If the caller stores handles which require freeing, they will be lost here.
+            It is the callers responsibility to free resources before overwriting existing contents. We will here
+            free allocated strings which occur due to value_instring().  We should consider providing the cleanup
+            function on the open rather than the close and then we could call it here and solve the problem.
          */
-        if ((sp = (WebsKey*) walloc(sizeof(WebsKey))) == 0) {
-            return NULL;
+        if (sp->content.valid) {
+            valueFree(&sp->content);
         }
-        sp->name = valueString(name, VALUE_ALLOCATE);
         sp->content = v;
-        sp->forw = (WebsKey*) NULL;
         sp->arg = arg;
-        sp->bucket = hindex;
+        return sp;
+    }
+    /*
+        Not found so allocate the key with the name stored immediately after it. Append to the bucket chain and to the
+        insertion order list.
+     */
+    if ((sp = (WebsKey*) walloc(sizeof(WebsKey) + len + 1)) == 0) {
+        return NULL;
+    }
+    memcpy(&sp[1], name, len + 1);
+    sp->name = valueString((cchar*) &sp[1], 0);
+    sp->content = v;
+    sp->arg = arg;
+    sp->hash = hashValue;
+    sp->bucket = hashValue & (tp->size - 1);
+    sp->forw = 0;
+    if (last) {
         last->forw = sp;
-
     } else {
-        /*
-            Daisy chain is empty so we need to start the chain
-         */
-        if ((sp = (WebsKey*) walloc(sizeof(WebsKey))) == 0) {
-            return NULL;
-        }
-        tp->hash_table[hindex] = sp;
-        tp->hash_table[hashIndex(tp, name)] = sp;
-
-        sp->forw = (WebsKey*) NULL;
-        sp->content = v;
-        sp->arg = arg;
-        sp->name = valueString(name, VALUE_ALLOCATE);
-        sp->bucket = hindex;
+        tp->hash_table[sp->bucket] = sp;
+    }
+    sp->next = 0;
+    if ((sp->prev = tp->last) != 0) {
+        tp->last->next = sp;
+    } else {
+        tp->first = sp;
+    }
+    tp->last = sp;
+    if (++tp->count > tp->size) {
+        hashGrow(tp);
     }
     return sp;
 }
@@ -2144,30 +2396,13 @@ PUBLIC int hashDelete(WebsHash sd, cchar *name)
 {
     HashTable   *tp;
     WebsKey     *sp, *last;
-    char        *cp;
-    int         hindex;
 
     assert(name && *name);
     assert(0 <= sd && sd < symMax);
     tp = sym[sd];
     assert(tp);
 
-    /*
-        Calculate the first daisy-chain from the hash table. If non-zero, then we have daisy-chain, so scan it and look
-        for the symbol.
-     */
-    last = NULL;
-    hindex = hashIndex(tp, name);
-    if ((sp = tp->hash_table[hindex]) != NULL) {
-        for ( ; sp; sp = sp->forw) {
-            cp = sp->name.value.string;
-            if (cp[0] == name[0] && strcmp(cp, name) == 0) {
-                break;
-            }
-            last = sp;
-        }
-    }
-    if (sp == (WebsKey*) NULL) {              /* Not Found */
+    if ((sp = hashFind(tp, name, hashName(name, NULL), &last)) == NULL) {
         return -1;
     }
     /*
@@ -2176,8 +2411,19 @@ PUBLIC int hashDelete(WebsHash sd, cchar *name)
     if (last) {
         last->forw = sp->forw;
     } else {
-        tp->hash_table[hindex] = sp->forw;
+        tp->hash_table[sp->bucket] = sp->forw;
     }
+    if (sp->prev) {
+        sp->prev->next = sp->next;
+    } else {
+        tp->first = sp->next;
+    }
+    if (sp->next) {
+        sp->next->prev = sp->prev;
+    } else {
+        tp->last = sp->prev;
+    }
+    tp->count--;
     valueFree(&sp->name);
     valueFree(&sp->content);
     wfree((void*) sp);
@@ -2186,75 +2432,73 @@ PUBLIC int hashDelete(WebsHash sd, cchar *name)
 
 
 /*
-    Hash a symbol and return a pointer to the hash daisy-chain list. All symbols reside on the chain (ie. none stored in
-    the hash table itself)
+    Find a symbol on its bucket chain. The full hash is compared before the name so most mismatches avoid strcmp.
+    If prior is supplied, it is set to the preceding symbol on the chain.
  */
-static WebsKey *hash(HashTable *tp, cchar *name)
+static WebsKey *hashFind(HashTable *tp, cchar *name, uint hashValue, WebsKey **prior)
 {
-    assert(tp);
-
-    return tp->hash_table[hashIndex(tp, name)];
-}
-
-
-/*
-    Compute the hash function and return an index into the hash table We use a basic additive function that is then made
-    modulo the size of the table.
- */
-static int hashIndex(HashTable *tp, cchar *name)
-{
-    uint        sum;
-    int         i;
+    WebsKey     *sp, *last;
 
     assert(tp);
-    /*
-        Add in each character shifted up progressively by 7 bits. The shift amount is rounded so as to not shift too
-        far. It thus cycles with each new cycle placing character shifted up by one bit.
-     */
-    i = 0;
-    sum = 0;
-    while (*name) {
-        sum += (((int) *name++) << i);
-        i = (i + 7) % (BITS(int) - BITSPERBYTE);
+
+    last = NULL;
+    for (sp = tp->hash_table[hashValue & (tp->size - 1)]; sp; sp = sp->forw) {
+        if (sp->hash == hashValue && strcmp(sp->name.value.string, name) == 0) {
+            break;
+        }
+        last = sp;
+    }
+    if (prior) {
+        *prior = last;
     }
-    return sum % tp->size;
+    return sp;
 }
 
 
 /*
-    Check if this number is a prime
+    Double the number of buckets once the table holds more symbols than buckets. Symbols are relinked using their
+    saved hash, so names are not rehashed and key addresses are unchanged. The chains are rebuilt from the insertion
+    order list, last first, so each chain remains in insertion order. Traversals use the insertion order list and are
+    not disturbed. If the index cannot be grown, the table continues with longer chains.
  */
-static int isPrime(int n)
+static void hashGrow(HashTable *tp)
 {
-    int     i, max;
-
-    assert(n > 0);
+    WebsKey     **table, *sp;
+    int         size;
 
-    max = n / 2;
-    for (i = 2; i <= max; i++) {
-        if (n % i == 0) {
-            return 0;
-        }
+    size = tp->size * 2;
+    if ((table = (WebsKey**) walloc(size * sizeof(WebsKey*))) == 0) {
+        return;
     }
-    return 1;
+    memset(table, 0, size * sizeof(WebsKey*));
+    for (sp = tp->last; sp; sp = sp->prev) {
+        sp->bucket = sp->hash & (size - 1);
+        sp->forw = table[sp->bucket];
+        table[sp->bucket] = sp;
+    }
+    wfree((void*) tp->hash_table);
+    tp->hash_table = table;
+    tp->size = size;
 }
 
 
 /*
-    Calculate the largest prime smaller than size.
+    Compute the 32-bit FNV-1a hash of a name. Optionally return the name length.
  */
-static int calcPrime(int size)
+static uint hashName(cchar *name, ssize *len)
 {
-    int count;
+    cchar       *cp;
+    uint        hashValue;
 
-    assert(size > 0);
-
-    for (count = size; count > 0; count--) {
-        if (isPrime(count)) {
-            return count;
-        }
+    hashValue = 2166136261U;
+    for (cp = name; *cp; cp++) {
+        hashValue ^= (uchar) *cp;
+        hashValue *= 16777619U;
     }
-    return 1;
+    if (len) {
+        *len = cp - name;
+    }
+    return hashValue;
 }
 
 
@@ -8,6 +8,22 @@
 
 #include    "goahead.h"
 
+/*********************************** Defines **********************************/
+
+#if ME_GOAHEAD_EPOLL && LINUX
+    #define SOCKET_EPOLL 1
+#else
+    #define SOCKET_EPOLL 0
+#endif
+
+#define SOCKET_MAX_EVENTS   128             /* Maximum events to retrieve per epoll_wait */
+#define SOCKET_LINGER_TIMEOUT 2000          /* Time to wait for the peer to close a half-closed socket (msec) */
+#define SOCKET_LINGER_READS 8               /* Maximum reads to drain a lingering socket per event */
+
+#ifndef SHUT_WR
+    #define SHUT_WR 1
+#endif
+
 /************************************ Locals **********************************/
 
 PUBLIC WebsSocket   **socketList;           /* List of open sockets */
@@ -15,13 +31,36 @@ PUBLIC int          socketMax;              /* Maximum size of socket */
 PUBLIC Socket       socketHighestFd = -1;   /* Highest socket fd opened */
 PUBLIC int          socketOpenCount = 0;    /* Number of task using sockets */
 
+static bool         highestFdStale;         /* The highest fd was closed and socketHighestFd must be recomputed */
+
 static int          hasIPv6;                /* System supports IPv6 */
 
+#if SOCKET_EPOLL
+static int          epollFd = -1;           /* Kernel event set. If -1, fallback to select() */
+static int          *readyList;             /* Sockets with events for socketProcess */
+static int          readyCount;             /* Number of entries in readyList */
+static int          readyMax;               /* Allocated size of readyList */
+static int          *reserviceList;         /* Sockets flagged by socketReservice */
+static int          reserviceCount;         /* Number of entries in reserviceList */
+static int          reserviceMax;           /* Allocated size of reserviceList */
+#endif
+
 /***************************** Forward Declarations ***************************/
 
 static int ipv6(cchar *ip);
 static void socketAccept(WebsSocket *sp);
 static void socketDoEvent(WebsSocket *sp);
+static void lingerEvent(int sid, int mask, void *data);
+static bool lingerSocket(WebsSocket *sp);
+static void lingerTimeout(void *data, int id);
+static void removeSocket(WebsSocket *sp);
+static void updateHighestFd();
+
+#if SOCKET_EPOLL
+static int addSocketToList(int **list, int *count, int *max, int sid);
+static int epollSelect(int timeout);
+static void epollUpdate(WebsSocket *sp, int mask);
+#endif
 
 /*********************************** Code *************************************/
 
@@ -48,12 +87,19 @@ PUBLIC int socketOpen()
     socketList = NULL;
     socketMax = 0;
     socketHighestFd = -1;
+    highestFdStale = 0;
     if ((fd = socket(AF_INET6, SOCK_STREAM, 0)) != -1) {
         hasIPv6 = 1;
         closesocket(fd);
     } else {
         trace(1, "This system does not have IPv6 support");
     }
+#if SOCKET_EPOLL
+    readyCount = reserviceCount = 0;
+    if ((epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        trace(1, "Cannot create epoll set, errno %d. Using select", errno);
+    }
+#endif
     return 0;
 }
 
@@ -63,11 +109,21 @@ PUBLIC void socketClose()
     int     i;
 
     if (--socketOpenCount <= 0) {
-        for (i = socketMax; i >= 0; i--) {
+        for (i = socketMax - 1; i >= 0; i--) {
             if (socketList && socketList[i]) {
                 socketCloseConnection(i);
             }
         }
+#if SOCKET_EPOLL
+        if (epollFd >= 0) {
+            close(epollFd);
+            epollFd = -1;
+        }
+        wfree(readyList);
+        wfree(reserviceList);
+        readyList = reserviceList = 0;
+        readyCount = readyMax = reserviceCount = reserviceMax = 0;
+#endif
         socketOpenCount = 0;
     }
 }
@@ -135,11 +191,12 @@ PUBLIC int socketListen(cchar *ip, int port, SocketAccept accept, int flags)
     if (setsockopt(sp->sock, SOL_SOCKET, SO_REUSEADDR, (char*) &enable, sizeof(enable)) != 0) {
         error("Cannot set reuseaddr, errno %d", errno);
     }
-#if defined(SO_REUSEPORT) && KEEP
+#if defined(SO_REUSEPORT)
     /*
-        This permits multiple servers listening on the same endpoint
+        This permits multiple servers listening on the same endpoint. Used by worker processes.
      */
-    if (setsockopt(sp->sock, SOL_SOCKET, SO_REUSEPORT, (char*) &enable, sizeof(enable)) != 0) {
+    if ((flags & SOCKET_REUSEPORT) &&
+            setsockopt(sp->sock, SOL_SOCKET, SO_REUSEPORT, (char*) &enable, sizeof(enable)) != 0) {
         error("Cannot set reuseport, errno %d", errno);
     }
 #endif
@@ -173,8 +230,17 @@ PUBLIC int socketListen(cchar *ip, int port, SocketAccept accept, int flags)
         socketFree(sid);
         return -1;
     }
+#if defined(TCP_DEFER_ACCEPT) && ME_GOAHEAD_DEFER_ACCEPT > 0
+    /*
+        Only signal the listener once request data has arrived on a new connection
+     */
+    enable = ME_GOAHEAD_DEFER_ACCEPT;
+    if (setsockopt(sp->sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, (char*) &enable, sizeof(enable)) != 0) {
+        error("Cannot set defer accept, errno %d", errno);
+    }
+#endif
     sp->flags |= SOCKET_LISTENING | SOCKET_NODELAY;
-    sp->handlerMask |= SOCKET_READABLE;
+    socketRegisterInterest(sid, sp->handlerMask | SOCKET_READABLE);
     socketSetBlock(sid, (flags & SOCKET_BLOCK));
     if (sp->flags & SOCKET_NODELAY) {
         socketSetNoDelay(sid, 1);
@@ -289,48 +355,69 @@ static void socketAccept(WebsSocket *sp)
     struct sockaddr         *addr;
     WebsSocket              *nsp;
     Socket                  newSock;
-    size_t                  len;
+    Socklen                 len;
     char                    ipbuf[1024];
-    int                     port, nid;
+    int                     port, nid, sid, count;
 
     assert(sp);
 
     /*
-        Accept the connection and prevent inheriting by children (F_SETFD)
+        Accept pending connections up to the batch limit. A blocking listener accepts one connection per event.
      */
-    len = sizeof(addrStorage);
+    sid = sp->sid;
     addr = (struct sockaddr*) &addrStorage;
-    if ((newSock = accept(sp->sock, addr, (Socklen*) &len)) == SOCKET_ERROR) {
-        return;
-    }
-#if ME_COMPILER_HAS_FCNTL
-    fcntl(newSock, F_SETFD, FD_CLOEXEC);
+    for (count = (sp->flags & SOCKET_BLOCK) ? 1 : ME_GOAHEAD_ACCEPT_BATCH; count > 0; count--) {
+        /*
+            Accept the connection and prevent inheriting by children (CLOEXEC)
+         */
+        len = sizeof(addrStorage);
+#if LINUX && defined(SOCK_CLOEXEC)
+        newSock = accept4(sp->sock, addr, &len, SOCK_CLOEXEC | ((sp->flags & SOCKET_BLOCK) ? 0 : SOCK_NONBLOCK));
+#else
+        newSock = accept(sp->sock, addr, &len);
 #endif
-    socketHighestFd = max(socketHighestFd, newSock);
-
-    /*
-        Create a socket structure and insert into the socket list
-     */
-    nid = socketAlloc(sp->ip, sp->port, sp->accept, sp->flags);
-    if ((nsp = socketList[nid]) == 0) {
-        return;
-    }
-    assert(nsp);
-    nsp->sock = newSock;
-    nsp->flags &= ~SOCKET_LISTENING;
-    socketSetBlock(nid, (nsp->flags & SOCKET_BLOCK));
-    if (nsp->flags & SOCKET_NODELAY) {
-        socketSetNoDelay(nid, 1);
-    }
+        if (newSock == SOCKET_ERROR) {
+            return;
+        }
+#if ME_COMPILER_HAS_FCNTL && !(LINUX && defined(SOCK_CLOEXEC))
+        fcntl(newSock, F_SETFD, FD_CLOEXEC);
+#endif
+        socketHighestFd = max(socketHighestFd, newSock);
 
-    /*
-        Call the user accept callback. The user must call socketCreateHandler to register for further events of interest.
-     */
-    if (sp->accept != NULL) {
-        /* Get the remote client address */
-        socketAddress(addr, (int) len, ipbuf, sizeof(ipbuf), &port);
-        if ((sp->accept)(nid, ipbuf, port, sp->sid) < 0) {
-            socketFree(nid);
+        /*
+            Create a socket structure and insert into the socket list
+         */
+        if ((nid = socketAlloc(sp->ip, sp->port, sp->accept, sp->flags)) < 0) {
+            closesocket(newSock);
+            return;
+        }
+        nsp = socketList[nid];
+        nsp->sock = newSock;
+        nsp->flags &= ~SOCKET_LISTENING;
+#if LINUX && defined(SOCK_CLOEXEC)
+        /* The blocking mode is set by accept4 and Linux connections inherit TCP_NODELAY from the listener */
+#else
+        socketSetBlock(nid, (nsp->flags & SOCKET_BLOCK));
+        if (nsp->flags & SOCKET_NODELAY) {
+            socketSetNoDelay(nid, 1);
+        }
+#endif
+        /*
+            Call the user accept callback. The user must call socketCreateHandler to register for further events of
+            interest.
+         */
+        if (sp->accept != NULL) {
+            /* Get the remote client address */
+            socketAddress(addr, (int) len, ipbuf, sizeof(ipbuf), &port);
+            if ((sp->accept)(nid, ipbuf, port, sid) < 0) {
+                socketFree(nid);
+            }
+        }
+        /*
+            The accept callback may close the listener
+         */
+        if (sid >= socketMax || socketList[sid] != sp) {
+            return;
         }
     }
 }
@@ -349,6 +436,9 @@ PUBLIC void socketRegisterInterest(int sid, int handlerMask)
     if (sp->flags & SOCKET_BUFFERED_WRITE) {
         sp->handlerMask |= SOCKET_WRITABLE;
     }
+#if SOCKET_EPOLL
+    epollUpdate(sp, sp->handlerMask);
+#endif
 }
 
 
@@ -505,6 +595,14 @@ PUBLIC int socketSelect(int sid, int timeout)
     fd_mask         *readFds, *writeFds, *exceptFds;
     int             all, len, nwords, index, bit, nEvents;
 
+#if SOCKET_EPOLL
+    if (epollFd >= 0 && sid < 0) {
+        return epollSelect(timeout);
+    }
+#endif
+    if (highestFdStale) {
+        updateHighestFd();
+    }
     /*
         Allocate and zero the select masks
      */
@@ -614,11 +712,144 @@ PUBLIC int socketSelect(int sid, int timeout)
 #endif /* WINDOWS || CE */
 
 
+#if SOCKET_EPOLL
+/*
+    Apply a change of interest to the kernel event set. The set is level triggered so handlers need not drain
+    all available I/O on each event. The sid is stored with the event so ready sockets are found without a scan.
+ */
+static void epollUpdate(WebsSocket *sp, int mask)
+{
+    struct epoll_event  ev;
+    int                 op;
+
+    if (epollFd < 0 || sp->sock == SOCKET_ERROR) {
+        return;
+    }
+    mask &= (SOCKET_READABLE | SOCKET_WRITABLE | SOCKET_EXCEPTION);
+    if (mask == sp->selectEvents) {
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    if (mask & SOCKET_READABLE) {
+        ev.events |= EPOLLIN;
+    }
+    if (mask & SOCKET_WRITABLE) {
+        ev.events |= EPOLLOUT;
+    }
+    if (mask & SOCKET_EXCEPTION) {
+        ev.events |= EPOLLPRI;
+    }
+    ev.data.u32 = (uint) sp->sid;
+    if (mask == 0) {
+        op = EPOLL_CTL_DEL;
+    } else if (sp->selectEvents == 0) {
+        op = EPOLL_CTL_ADD;
+    } else {
+        op = EPOLL_CTL_MOD;
+    }
+    if (epoll_ctl(epollFd, op, sp->sock, &ev) < 0) {
+        if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, sp->sock, &ev);
+        } else if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, sp->sock, &ev);
+        } else if (op != EPOLL_CTL_DEL) {
+            error("Cannot update epoll events for socket %d, errno %d", sp->sock, errno);
+        }
+    }
+    sp->selectEvents = mask;
+}
+
+
+/*
+    Wait for events on the kernel event set and collect the ready sockets (including re-serviced sockets)
+    for socketProcess. Cost is proportional to the number of ready sockets, not the number of open sockets.
+ */
+static int epollSelect(int timeout)
+{
+    struct epoll_event  events[SOCKET_MAX_EVENTS];
+    WebsSocket          *sp;
+    int                 i, sid, nfds, mask, revents;
+
+    readyCount = 0;
+    if (reserviceCount > 0) {
+        timeout = 0;
+    }
+    if ((nfds = epoll_wait(epollFd, events, SOCKET_MAX_EVENTS, timeout)) < 0) {
+        nfds = 0;
+    }
+    for (i = 0; i < nfds; i++) {
+        sid = (int) events[i].data.u32;
+        if (sid >= socketMax || (sp = socketList[sid]) == NULL) {
+            continue;
+        }
+        revents = events[i].events;
+        mask = 0;
+        if (revents & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            mask |= SOCKET_READABLE;
+        }
+        if (revents & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            mask |= SOCKET_WRITABLE;
+        }
+        if (revents & EPOLLPRI) {
+            mask |= SOCKET_EXCEPTION;
+        }
+        sp->currentEvents |= (mask & sp->handlerMask);
+        addSocketToList(&readyList, &readyCount, &readyMax, sid);
+    }
+    for (i = 0; i < reserviceCount; i++) {
+        sid = reserviceList[i];
+        if (sid >= socketMax || (sp = socketList[sid]) == NULL || !(sp->flags & SOCKET_RESERVICE)) {
+            continue;
+        }
+        sp->currentEvents |= (sp->handlerMask & (SOCKET_READABLE | SOCKET_WRITABLE));
+        sp->flags &= ~SOCKET_RESERVICE;
+        addSocketToList(&readyList, &readyCount, &readyMax, sid);
+    }
+    reserviceCount = 0;
+    return readyCount;
+}
+
+
+static int addSocketToList(int **list, int *count, int *max, int sid)
+{
+    int     *newList, size;
+
+    if (*count >= *max) {
+        size = max(*max * 2, SOCKET_MAX_EVENTS);
+        if ((newList = wrealloc(*list, size * sizeof(int))) == 0) {
+            return -1;
+        }
+        *list = newList;
+        *max = size;
+    }
+    (*list)[(*count)++] = sid;
+    return 0;
+}
+#endif /* SOCKET_EPOLL */
+
+
 PUBLIC void socketProcess()
 {
     WebsSocket    *sp;
     int         sid;
 
+#if SOCKET_EPOLL
+    if (epollFd >= 0) {
+        int     i;
+        /*
+            Only visit the sockets collected by epollSelect. The handler may free or reallocate a socket, so
+            revalidate each entry.
+         */
+        for (i = 0; i < readyCount; i++) {
+            sid = readyList[i];
+            if (sid < socketMax && (sp = socketList[sid]) != NULL && (sp->currentEvents & sp->handlerMask)) {
+                socketDoEvent(sp);
+            }
+        }
+        readyCount = 0;
+        return;
+    }
+#endif
     for (sid = 0; sid < socketMax; sid++) {
         if ((sp = socketList[sid]) != NULL) {
             if (sp->currentEvents & sp->handlerMask) {
@@ -798,6 +1029,54 @@ PUBLIC ssize socketWrite(int sid, void *buf, ssize bufsize)
 }
 
 
+/*
+    Write a vector of buffers with a single system call where possible. Returns the number of bytes written which may be
+    short in non-blocking mode. Returns a negative error code on errors.
+ */
+PUBLIC ssize socketWritev(int sid, WebsIovec *iov, int count)
+{
+    WebsSocket  *sp;
+    ssize       written;
+#if ME_UNIX_LIKE
+    int         errCode;
+#else
+    ssize       sofar;
+    int         i;
+#endif
+
+    if (iov == 0 || count <= 0 || (sp = socketPtr(sid)) == NULL) {
+        return -1;
+    }
+    if (sp->flags & SOCKET_EOF) {
+        return -1;
+    }
+#if ME_UNIX_LIKE
+    while ((written = writev(sp->sock, iov, count)) < 0) {
+        errCode = socketGetError(sid);
+        if (errCode != EINTR) {
+            return -errCode;
+        }
+    }
+    return written;
+#else
+    sofar = 0;
+    for (i = 0; i < count; i++) {
+        if (iov[i].iov_len == 0) {
+            continue;
+        }
+        if ((written = socketWrite(sid, iov[i].iov_base, (ssize) iov[i].iov_len)) < 0) {
+            return sofar ? sofar : written;
+        }
+        sofar += written;
+        if (written < (ssize) iov[i].iov_len) {
+            break;
+        }
+    }
+    return sofar;
+#endif
+}
+
+
 /*
     Read from a socket. Return the number of bytes read if successful. This may be less than the requested "bufsize" and
     may be zero. This routine may block if the socket is in blocking mode.
@@ -857,10 +1136,47 @@ PUBLIC void socketReservice(int sid)
     if ((sp = socketPtr(sid)) == NULL) {
         return;
     }
+#if SOCKET_EPOLL
+    if (epollFd >= 0 && !(sp->flags & SOCKET_RESERVICE)) {
+        addSocketToList(&reserviceList, &reserviceCount, &reserviceMax, sid);
+    }
+#endif
     sp->flags |= SOCKET_RESERVICE;
 }
 
 
+PUBLIC void socketRestartEvents()
+{
+#if SOCKET_EPOLL
+    WebsSocket  *sp;
+    int         sid;
+
+    if (epollFd < 0) {
+        return;
+    }
+    /*
+        The child holds a reference to the parent's epoll set. Drop it and register interests in a private set.
+     */
+    close(epollFd);
+    readyCount = reserviceCount = 0;
+    if ((epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        trace(1, "Cannot create epoll set, errno %d. Using select", errno);
+        return;
+    }
+    for (sid = 0; sid < socketMax; sid++) {
+        if ((sp = socketList[sid]) == NULL) {
+            continue;
+        }
+        sp->selectEvents = 0;
+        epollUpdate(sp, sp->handlerMask);
+        if (sp->flags & SOCKET_RESERVICE) {
+            addSocketToList(&reserviceList, &reserviceCount, &reserviceMax, sid);
+        }
+    }
+#endif
+}
+
+
 /*
     Create a user handler for this socket. The handler called whenever there
     is an event of interest as defined by handlerMask (SOCKET_READABLE, ...)
@@ -907,6 +1223,7 @@ PUBLIC int socketAlloc(cchar *ip, int port, SocketAccept accept, int flags)
     sp->port = port;
     sp->fileHandle = -1;
     sp->saveMask = -1;
+    sp->lingerEvent = -1;
     if (ip) {
         sp->ip = sclone(ip);
     }
@@ -916,45 +1233,175 @@ PUBLIC int socketAlloc(cchar *ip, int port, SocketAccept accept, int flags)
 
 
 /*
-    Free a socket structure
+    Allocate a socket structure for an existing descriptor (pipe) so it can be serviced by the event loop
+ */
+PUBLIC int socketAttach(Socket fd)
+{
+    WebsSocket  *sp;
+    int         sid;
+
+    if ((sid = socketAlloc(NULL, 0, NULL, 0)) < 0) {
+        return -1;
+    }
+    sp = socketList[sid];
+    sp->sock = fd;
+    sp->flags |= SOCKET_PIPE;
+    socketHighestFd = max(socketHighestFd, sp->sock);
+#if ME_COMPILER_HAS_FCNTL
+    fcntl(sp->sock, F_SETFD, FD_CLOEXEC);
+#endif
+    socketSetBlock(sid, 0);
+    return sid;
+}
+
+
+/*
+    Free a socket structure. Accepted connections are half-closed and drained asynchronously so the peer receives a
+    FIN rather than a RESET without blocking the event loop. See lingerSocket.
  */
 PUBLIC void socketFree(int sid)
 {
     WebsSocket  *sp;
-    char        buf[256];
-    int         i;
 
     if ((sp = socketPtr(sid)) == NULL) {
         return;
     }
-    /*
-        To close a socket, remove any registered interests, set it to non-blocking so that the recv which follows won't
-        block, do a shutdown on it so peers on the other end will receive a FIN, then read any data not yet retrieved
-        from the receive buffer, and finally close it.  If these steps are not all performed RESETs may be sent to the
-        other end causing problems.
-     */
+    if (sp->accept && sp->sock >= 0 && socketOpenCount > 0 &&
+            !(sp->flags & (SOCKET_LISTENING | SOCKET_PIPE | SOCKET_LINGER))) {
+        if (lingerSocket(sp)) {
+            return;
+        }
+    }
+    removeSocket(sp);
+}
+
+
+/*
+    Close a socket and free the socket structure
+ */
+static void removeSocket(WebsSocket *sp)
+{
+    char    buf[256];
+    int     sid;
+
+    sid = sp->sid;
     socketRegisterInterest(sid, 0);
-    if (sp->sock >= 0) {
-        socketSetBlock(sid, 0);
-        while (recv(sp->sock, buf, sizeof(buf), 0) > 0) {}
-        if (shutdown(sp->sock, SHUT_RDWR) >= 0) {
+#if SOCKET_EPOLL
+    /* Buffered I/O flags may keep interest in socketRegisterInterest. Always remove from the kernel set. */
+    epollUpdate(sp, 0);
+#endif
+    if (sp->lingerEvent >= 0) {
+        websStopEvent(sp->lingerEvent);
+    }
+    if (sp->flags & SOCKET_PIPE) {
+        close(sp->sock);
+    } else if (sp->sock >= 0) {
+        if (!(sp->flags & (SOCKET_LINGER | SOCKET_LISTENING))) {
+            /*
+                Listening sockets are never shut down as they may be shared with forked workers and a shutdown would
+                stop the listener in every process.
+
+                To close a socket, set it to non-blocking so that the recv which follows won't block, do a shutdown on
+                it so peers on the other end will receive a FIN, then read any data not yet retrieved from the receive
+                buffer, and finally close it. If these steps are not all performed RESETs may be sent to the other end
+                causing problems.
+             */
+            socketSetBlock(sid, 0);
             while (recv(sp->sock, buf, sizeof(buf), 0) > 0) {}
+            if (shutdown(sp->sock, SHUT_RDWR) >= 0) {
+                while (recv(sp->sock, buf, sizeof(buf), 0) > 0) {}
+            }
         }
         closesocket(sp->sock);
     }
+    if (sp->sock == socketHighestFd) {
+        highestFdStale = 1;
+    }
     wfree(sp->ip);
     wfree(sp);
     socketMax = wfreeHandle(&socketList, sid);
-    /*
-        Calculate the new highest socket number
-     */
+}
+
+
+/*
+    Half-close a connection so the peer receives a FIN, then drain incoming data from the event loop until the peer
+    closes or SOCKET_LINGER_TIMEOUT expires. The caller must not reference the socket afterwards.
+ */
+static bool lingerSocket(WebsSocket *sp)
+{
+    socketSetBlock(sp->sid, 0);
+    if (shutdown(sp->sock, SHUT_WR) < 0) {
+        return 0;
+    }
+    if ((sp->lingerEvent = websStartEvent(SOCKET_LINGER_TIMEOUT, lingerTimeout, (void*) (ssize) sp->sid)) < 0) {
+        return 0;
+    }
+    sp->flags &= ~(SOCKET_BUFFERED_READ | SOCKET_BUFFERED_WRITE | SOCKET_RESERVICE);
+    sp->flags |= SOCKET_LINGER;
+    sp->currentEvents = 0;
+    sp->handler = lingerEvent;
+    sp->handler_data = 0;
+    socketRegisterInterest(sp->sid, SOCKET_READABLE);
+    return 1;
+}
+
+
+/*
+    Drain a lingering socket and close when the peer has closed
+ */
+static void lingerEvent(int sid, int mask, void *data)
+{
+    WebsSocket  *sp;
+    char        buf[1024];
+    ssize       nbytes;
+    int         i, err;
+
+    sp = socketList[sid];
+    nbytes = 0;
+    for (i = 0; i < SOCKET_LINGER_READS; i++) {
+        if ((nbytes = recv(sp->sock, buf, sizeof(buf), 0)) <= 0) {
+            break;
+        }
+    }
+    if (nbytes < 0) {
+        err = socketGetError(sid);
+        if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR) {
+            return;
+        }
+    }
+    if (nbytes <= 0) {
+        removeSocket(sp);
+    }
+}
+
+
+static void lingerTimeout(void *data, int id)
+{
+    WebsSocket  *sp;
+    int         sid;
+
+    sid = (int) (ssize) data;
+    if (sid < socketMax && (sp = socketList[sid]) != NULL && sp->lingerEvent == id) {
+        removeSocket(sp);
+    }
+}
+
+
+/*
+    Recompute the highest socket handle. This is only required for select().
+ */
+static void updateHighestFd()
+{
+    WebsSocket  *sp;
+    int         sid;
+
     socketHighestFd = -1;
-    for (i = 0; i < socketMax; i++) {
-        if ((sp = socketList[i]) == NULL) {
-            continue;
+    for (sid = 0; sid < socketMax; sid++) {
+        if ((sp = socketList[sid]) != NULL) {
+            socketHighestFd = max(socketHighestFd, sp->sock);
         }
-        socketHighestFd = max(socketHighestFd, sp->sock);
     }
+    highestFdStale = 0;
 }
 
 
@@ -1184,13 +1631,43 @@ PUBLIC int socketInfo(char *ip, int port, int *family, int *protocol, struct soc
 #endif
 
 
+#if ME_UNIX_LIKE || ME_WIN_LIKE
+/*
+    Format an IPv4 address in dotted decimal
+ */
+static int formatAddress4(uchar *bytes, char *ip, int ipLen)
+{
+    char    *cp;
+    int     i, value;
+
+    if (ipLen < 16) {
+        return -1;
+    }
+    cp = ip;
+    for (i = 0; i < 4; i++) {
+        value = bytes[i];
+        if (value >= 100) {
+            *cp++ = '0' + value / 100;
+        }
+        if (value >= 10) {
+            *cp++ = '0' + (value / 10) % 10;
+        }
+        *cp++ = '0' + value % 10;
+        *cp++ = (i < 3) ? '.' : '\0';
+    }
+    return 0;
+}
+#endif
+
+
 /*
     Return a numerical IP address and port for the given socket info
  */
 PUBLIC int socketAddress(struct sockaddr *addr, int addrlen, char *ip, int ipLen, int *port)
 {
 #if (ME_UNIX_LIKE || ME_WIN_LIKE)
-    char    service[NI_MAXSERV];
+    struct sockaddr_in  *sa;
+    char                service[NI_MAXSERV];
 
 #if ME_WIN_LIKE || defined(IN6_IS_ADDR_V4MAPPED)
     if (addr->sa_family == AF_INET6) {
@@ -1205,6 +1682,31 @@ PUBLIC int socketAddress(struct sockaddr *addr, int addrlen, char *ip, int ipLen
             addrlen = sizeof(addr4);
         }
     }
+#endif
+    /*
+        Format numeric addresses directly rather than via getnameinfo
+     */
+    if (addr->sa_family == AF_INET) {
+        sa = (struct sockaddr_in*) addr;
+        if (formatAddress4((uchar*) &sa->sin_addr, ip, ipLen) < 0) {
+            return -1;
+        }
+        if (port) {
+            *port = ntohs(sa->sin_port);
+        }
+        return 0;
+    }
+#if ME_UNIX_LIKE
+    if (addr->sa_family == AF_INET6) {
+        struct sockaddr_in6 *sa6 = (struct sockaddr_in6*) addr;
+        if (inet_ntop(AF_INET6, &sa6->sin6_addr, ip, ipLen) == NULL) {
+            return -1;
+        }
+        if (port) {
+            *port = ntohs(sa6->sin6_port);
+        }
+        return 0;
+    }
 #endif
     if (getnameinfo(addr, addrlen, ip, ipLen, service, sizeof(service), NI_NUMERICHOST | NI_NUMERICSERV | NI_NOFQDN)) {
         return -1;
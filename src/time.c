@@ -121,6 +121,12 @@ static TimeToken offsets[] = {
 
 static int timeSep = ':';
 
+static cchar *httpDays[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+static cchar *httpMonths[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+static char     httpDate[32];           /* Cached IMF-fixdate for the current second */
+static WebsTime httpDateTime = -1;      /* Time of the cached date */
+
 static int normalMonthStart[] = {
     0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 0,
 };
@@ -172,6 +178,84 @@ PUBLIC void websTimeClose()
 }
 
 
+/*
+    Format two decimal digits
+ */
+static char *putDigits(char *cp, int value)
+{
+    *cp++ = (char) ('0' + (value / 10) % 10);
+    *cp++ = (char) ('0' + value % 10);
+    return cp;
+}
+
+
+/*
+    Format a time as an RFC 7231 IMF-fixdate: "Sun, 06 Nov 1994 08:49:37 GMT". Formatted directly without sfmt or
+    strftime so the result is independent of the locale.
+ */
+PUBLIC ssize websFormatHttpDate(char *buf, ssize size, WebsTime when)
+{
+    struct tm   tm;
+    char        *cp;
+    int         year;
+
+    if (buf == 0 || size < WEBS_HTTP_DATE_SIZE) {
+        return -1;
+    }
+#if ME_UNIX_LIKE
+    gmtime_r(&when, &tm);
+#else
+    {
+        struct tm *tp;
+        if ((tp = gmtime(&when)) == 0) {
+            return -1;
+        }
+        tm = *tp;
+    }
+#endif
+    cp = buf;
+    memcpy(cp, httpDays[tm.tm_wday % 7], 3);
+    cp += 3;
+    *cp++ = ',';
+    *cp++ = ' ';
+    cp = putDigits(cp, tm.tm_mday);
+    *cp++ = ' ';
+    memcpy(cp, httpMonths[tm.tm_mon % 12], 3);
+    cp += 3;
+    *cp++ = ' ';
+    year = tm.tm_year + 1900;
+    cp = putDigits(cp, year / 100);
+    cp = putDigits(cp, year % 100);
+    *cp++ = ' ';
+    cp = putDigits(cp, tm.tm_hour);
+    *cp++ = ':';
+    cp = putDigits(cp, tm.tm_min);
+    *cp++ = ':';
+    cp = putDigits(cp, tm.tm_sec);
+    memcpy(cp, " GMT", 5);
+    return cp - buf + 4;
+}
+
+
+/*
+    Return the current time as an IMF-fixdate. The string is formatted at most once per second and is shared. It must
+    not be freed and is only valid until the next call.
+ */
+PUBLIC cchar *websGetHttpDate()
+{
+    WebsTime    now;
+
+    now = time(0);
+    if (now != httpDateTime) {
+        if (websFormatHttpDate(httpDate, sizeof(httpDate), now) < 0) {
+            return "";
+        }
+        httpDateTime = now;
+    }
+    return httpDate;
+}
+
+
 static int leapYear(int year)
 {
     if (year % 4) {
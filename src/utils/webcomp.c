@@ -1,8 +1,9 @@
 /*
     webcomp -- Compile web pages into C source
 
-    Usage: webcomp --strip strip filelist >webrom.c
+    Usage: webcomp [--compress] --strip strip filelist >webrom.c
     Where: 
+        --compress adds precompressed .br and .gz variants of each web page
         filelist is a file containing the pathnames of all web pages
         strip is a path prefix to remove from all the web page pathnames
         webrom.c is the resulting C source file to compile and link.
@@ -14,9 +15,27 @@
 
 #include    "goahead.h"
 
+#if ME_COM_ZLIB
+    #include    <zlib.h>
+#endif
+
+/*********************************** Locals ***********************************/
+
+static int  precompress;                 /* Emit precompressed variants of each web page */
+
+/*
+    Precompressed variant extensions
+ */
+static char *variants[] = { ".br", ".gz", 0 };
+
 /**************************** Forward Declarations ****************************/
 
 static int  compile(char *fileList, char *strip);
+static void emitData(uchar *data, ssize len);
+static int  emitFile(char *file, int index, ssize *size);
+#if ME_COM_ZLIB
+static int  emitGzip(char *file, int index, ssize *size);
+#endif
 static void usage();
 
 /*********************************** Code *************************************/
@@ -36,6 +55,8 @@ int main(int argc, char* argv[])
         } else if (strcmp(argp, "--prefix") == 0 || strcmp(argp, "--strip") == 0) {
             if (argind >= argc) usage();
             strip = argv[++argind];
+        } else if (strcmp(argp, "--compress") == 0) {
+            precompress = 1;
         }
     }
     if (argind >= argc) {
@@ -51,7 +72,8 @@ int main(int argc, char* argv[])
 
 static void usage()
 {
-    fprintf(stdout, "usage: webcomp [--strip strip] filelist >output.c\n\
+    fprintf(stdout, "usage: webcomp [--compress] [--strip strip] filelist >output.c\n\
+        --compress adds precompressed .br and .gz variants of each web page\n\
         --strip specifies is a path prefix to remove from all the web page pathnames\n\
         filelist is a file containing the pathnames of all web pages\n\
         output.c is the resulting C source file to compile and link.\n");
@@ -64,10 +86,11 @@ static int compile(char *fileList, char *strip)
     WebsStat        sbuf;
     WebsTime        now;
     FILE            *lp;
-    char            buf[512], file[ME_GOAHEAD_LIMIT_FILENAME], *cp, *sl;
+    char            file[ME_GOAHEAD_LIMIT_FILENAME], variant[ME_GOAHEAD_LIMIT_FILENAME + 8], *cp, *sl, **vp;
+    char            **names;
     uchar           *p;
-    ssize           len;
-    int             j, i, fd, nFile;
+    ssize           *sizes, size;
+    int             i, nFile, maxFile;
 
     if ((lp = fopen(fileList, "r")) == NULL) {
         fprintf(stderr, "Cannot open file list %s\n", fileList);
@@ -80,9 +103,12 @@ static int compile(char *fileList, char *strip)
     fprintf(stdout, "#if ME_ROM\n\n");
 
     /*
-        Open each input file and compile each web page
+        Open each input file and compile each web page. The ROM path and size of each entry is saved for the index.
+        A size of -1 denotes a directory.
      */
-    nFile = 0;
+    nFile = maxFile = 0;
+    names = NULL;
+    sizes = NULL;
     while (fgets(file, sizeof(file), lp) != NULL) {
         if ((p = (uchar*) strchr(file, '\n')) || (p = (uchar*) strchr(file, '\r'))) {
             *p = '\0';
@@ -90,73 +116,79 @@ static int compile(char *fileList, char *strip)
         if (*file == '\0') {
             continue;
         }
-        if (stat(file, &sbuf) == 0 && sbuf.st_mode & S_IFDIR) {
-            continue;
-        } 
-        if ((fd = open(file, O_RDONLY | O_BINARY, 0644)) < 0) {
-            fprintf(stderr, "Cannot open file %s\n", file);
-            return -1;
-        }
-        fprintf(stdout, "/* %s */\n", file);
-        fprintf(stdout, "static uchar p%d[] = {\n", nFile);
-
-        while ((len = read(fd, buf, sizeof(buf))) > 0) {
-            p = (uchar*)buf;
-            for (i = 0; i < len; ) {
-                fprintf(stdout, "\t");
-                for (j = 0; p< (uchar*)(&buf[len]) && j < 16; j++, p++) {
-                    fprintf(stdout, "%4d,", *p);
-                }
-                i += j;
-                fprintf(stdout, "\n");
+        if (nFile + 4 > maxFile) {
+            maxFile = maxFile * 2 + 16;
+            names = realloc(names, maxFile * sizeof(char*));
+            sizes = realloc(sizes, maxFile * sizeof(ssize));
+            if (names == NULL || sizes == NULL) {
+                fprintf(stderr, "Cannot allocate memory\n");
+                return -1;
             }
         }
-        fprintf(stdout, "\t   0\n};\n\n");
-        close(fd);
-        nFile++;
-    }
-    fclose(lp);
-
-    /*
-        Output the page index
-     */
-    fprintf(stdout, "WebsRomIndex websRomIndex[] = {\n");
-
-    if ((lp = fopen(fileList, "r")) == NULL) {
-        fprintf(stderr, "Cannot open file list %s\n", fileList);
-        return -1;
-    }
-    nFile = 0;
-    while (fgets(file, sizeof(file), lp) != NULL) {
-        if ((p = (uchar*) strchr(file, '\n')) || (p = (uchar *) strchr(file, '\r'))) {
-            *p = '\0';
-        }
-        if (*file == '\0') {
-            continue;
-        }
         /*
             Remove the prefix and add a leading "/" when we print the path
          */
+        while ((sl = strchr(file, '\\')) != NULL) {
+            *sl = '/';
+        }
         if (strncmp(file, strip, strlen(strip)) == 0) {
             cp = &file[strlen(strip)];
         } else {
             cp = file;
         }
-        while ((sl = strchr(file, '\\')) != NULL) {
-            *sl = '/';
-        }
         if (*cp == '/') {
             cp++;
         }
-
         if (stat(file, &sbuf) == 0 && sbuf.st_mode & S_IFDIR) {
-            fprintf(stdout, "\t{ \"/%s\", 0, 0 },\n", cp);
+            names[nFile] = strdup(cp);
+            sizes[nFile++] = -1;
             continue;
         }
-        fprintf(stdout, "\t{ \"/%s\", p%d, %d },\n", cp, nFile, (int) sbuf.st_size);
-        nFile++;
+        if (emitFile(file, nFile, &size) < 0) {
+            return -1;
+        }
+        names[nFile] = strdup(cp);
+        sizes[nFile++] = size;
+
+        if (precompress) {
+            for (vp = variants; *vp; vp++) {
+                snprintf(variant, sizeof(variant), "%s%s", file, *vp);
+                if (stat(variant, &sbuf) == 0 && !(sbuf.st_mode & S_IFDIR)) {
+                    if (emitFile(variant, nFile, &size) < 0) {
+                        return -1;
+                    }
+#if ME_COM_ZLIB
+                } else if (strcmp(*vp, ".gz") == 0) {
+                    /* Create a gzip variant if none is supplied. Skipped if compression does not reduce the size. */
+                    if (emitGzip(file, nFile, &size) <= 0) {
+                        continue;
+                    }
+#endif
+                } else {
+                    continue;
+                }
+                snprintf(variant, sizeof(variant), "%s%s", cp, *vp);
+                names[nFile] = strdup(variant);
+                sizes[nFile++] = size;
+            }
+        }
     }
-    fclose(lp); 
+    fclose(lp);
+
+    /*
+        Output the page index
+     */
+    fprintf(stdout, "WebsRomIndex websRomIndex[] = {\n");
+    for (i = 0; i < nFile; i++) {
+        if (sizes[i] < 0) {
+            fprintf(stdout, "\t{ \"/%s\", 0, 0 },\n", names[i]);
+        } else {
+            fprintf(stdout, "\t{ \"/%s\", p%d, %d },\n", names[i], i, (int) sizes[i]);
+        }
+        free(names[i]);
+    }
+    free(names);
+    free(sizes);
     fprintf(stdout, "\t{ 0, 0, 0 }\n");
     fprintf(stdout, "};\n");
     fprintf(stdout, "#else\n");
@@ -167,6 +199,114 @@ static int compile(char *fileList, char *strip)
     return 0;
 }
 
+
+/*
+    Output a web page as a C byte array named p<index>
+ */
+static int emitFile(char *file, int index, ssize *size)
+{
+    char    buf[512];
+    ssize   len;
+    int     fd;
+
+    if ((fd = open(file, O_RDONLY | O_BINARY, 0644)) < 0) {
+        fprintf(stderr, "Cannot open file %s\n", file);
+        return -1;
+    }
+    fprintf(stdout, "/* %s */\n", file);
+    fprintf(stdout, "static uchar p%d[] = {\n", index);
+    *size = 0;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        emitData((uchar*) buf, len);
+        *size += len;
+    }
+    fprintf(stdout, "\t   0\n};\n\n");
+    close(fd);
+    return 0;
+}
+
+
+static void emitData(uchar *data, ssize len)
+{
+    uchar   *p;
+    ssize   i;
+    int     j;
+
+    p = data;
+    for (i = 0; i < len; ) {
+        fprintf(stdout, "\t");
+        for (j = 0; p < &data[len] && j < 16; j++, p++) {
+            fprintf(stdout, "%4d,", *p);
+        }
+        i += j;
+        fprintf(stdout, "\n");
+    }
+}
+
+
+#if ME_COM_ZLIB
+/*
+    Output a gzip compressed copy of a web page. Returns 1 if emitted, 0 if not worth compressing and -1 for errors.
+ */
+static int emitGzip(char *file, int index, ssize *size)
+{
+    z_stream    zs;
+    uchar       *data, *out;
+    ssize       len, max;
+    int         fd, rc;
+
+    if ((fd = open(file, O_RDONLY | O_BINARY, 0644)) < 0) {
+        fprintf(stderr, "Cannot open file %s\n", file);
+        return -1;
+    }
+    len = lseek(fd, 0, SEEK_END);
+    lseek(fd, 0, SEEK_SET);
+    if (len <= 0) {
+        close(fd);
+        return 0;
+    }
+    data = malloc(len);
+    if (data == NULL || read(fd, data, len) != len) {
+        fprintf(stderr, "Cannot read file %s\n", file);
+        close(fd);
+        free(data);
+        return -1;
+    }
+    close(fd);
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(data);
+        return -1;
+    }
+    max = deflateBound(&zs, len);
+    if ((out = malloc(max)) == NULL) {
+        deflateEnd(&zs);
+        free(data);
+        return -1;
+    }
+    zs.next_in = data;
+    zs.avail_in = (uInt) len;
+    zs.next_out = out;
+    zs.avail_out = (uInt) max;
+    rc = deflate(&zs, Z_FINISH);
+    *size = zs.total_out;
+    deflateEnd(&zs);
+    free(data);
+
+    if (rc != Z_STREAM_END || *size >= len) {
+        free(out);
+        return 0;
+    }
+    fprintf(stdout, "/* %s.gz */\n", file);
+    fprintf(stdout, "static uchar p%d[] = {\n", index);
+    emitData(out, *size);
+    fprintf(stdout, "\t   0\n};\n\n");
+    free(out);
+    return 1;
+}
+#endif
+
 /*
     Copyright (c) Embedthis Software. All Rights Reserved.
     This software is distributed under commercial and open source licenses.
@@ -14,4 +14,19 @@ if (thas('ME_GOAHEAD_AUTH')) {
     http.setCredentials('joshua', 'pass1')
     http.get(HTTP + '/auth/basic/basic.html')
     ttrue(http.status == 200)
+    http.close()
+
+    //  Repeated requests without the session cookie are verified from the credential cache
+    http = new Http
+    http.setCredentials('joshua', 'pass1')
+    http.get(HTTP + '/auth/basic/basic.html')
+    ttrue(http.status == 200)
+    http.close()
+
+    //  A cached user must not make other passwords acceptable
+    http = new Http
+    http.setCredentials('joshua', 'wrong')
+    http.get(HTTP + '/auth/basic/basic.html')
+    ttrue(http.status == 401)
+    http.close()
 }
@@ -0,0 +1,90 @@
+/*
+    accesslog.tst - Access log format and rotation tests
+ */
+
+const HTTP = tget('TM_HTTP') || "127.0.0.1:8080"
+const LOG = "tmp/access-test.log"
+const LOCAL = Path("../" + LOG)
+let http: Http = new Http
+
+/*
+    Issue a request and wait for the log to be flushed
+ */
+function logged(uri: String): String {
+    http.get(HTTP + uri)
+    ttrue(http.status == 200)
+    http.close()
+    App.sleep(1500)
+    return LOCAL.exists ? LOCAL.readString() : ""
+}
+
+if (thas('ME_GOAHEAD_ACCESS_LOG') && !thas('ME_ROM')) {
+    for each (path in LOCAL.parent.files("access-test.log*")) {
+        path.remove()
+    }
+
+    //  Common Log Format. The time zone is the offset in hours and minutes.
+    http.get(HTTP + "/action/accessLogTest?path=" + LOG + "&format=common")
+    ttrue(http.status == 200)
+    http.close()
+    let line = logged("/index.html?common").trim().split("\n").pop()
+    ttrue(line.match(/^127\.0\.0\.1 - - \[\d\d\/\w\w\w\/\d{4}:\d\d:\d\d:\d\d [+-]\d{4}\] "GET \/index.html HTTP\/1.1" 200 \d+$/))
+    let zone = line.match(/ ([+-])(\d\d)(\d\d)\]/)
+    let offset = -new Date().timezoneOffset
+    ttrue(zone && (zone[1] == "-" ? -1 : 1) * (zone[2] * 60 + zone[3] * 1) == offset)
+
+    //  Combined Log Format
+    http.get(HTTP + "/action/accessLogTest?format=combined")
+    ttrue(http.status == 200)
+    http.close()
+    http.setHeader("Referer", "http://example.com/\"quoted\"")
+    line = logged("/index.html?combined").trim().split("\n").pop()
+    ttrue(line.contains('"GET /index.html HTTP/1.1" 200 '))
+    ttrue(line.contains('"http://example.com/\\"quoted\\""'))
+
+    //  Control characters and quotes in the request line are escaped so a client cannot forge lines
+    http.get(HTTP + "/forged%0A127.0.0.1%20-%20-%20%22line")
+    ttrue(http.status == 404)
+    http.close()
+    App.sleep(1500)
+    line = LOCAL.readString().trim().split("\n").pop()
+    ttrue(line.contains('"GET /forged\\x0a127.0.0.1 - - \\"line HTTP/1.1" 404 '))
+
+    //  JSON
+    http.get(HTTP + "/action/accessLogTest?format=json")
+    ttrue(http.status == 200)
+    http.close()
+    line = logged("/index.html?json").trim().split("\n").pop()
+    let entry = deserialize(line)
+    ttrue(entry.method == "GET")
+    ttrue(entry.uri == "/index.html")
+    ttrue(entry.status == 200)
+    ttrue(entry.latency >= 0)
+    ttrue(entry.time.match(/^\d{4}-\d\d-\d\dT\d\d:\d\d:\d\d[+-]\d{4}$/))
+
+    //  Unknown formats are rejected
+    http.get(HTTP + "/action/accessLogTest?format=unknown")
+    ttrue(http.status == 400)
+    http.close()
+
+    //  Rotation keeps the configured number of backups
+    http.get(HTTP + "/action/accessLogTest?format=common&size=80&backups=2")
+    ttrue(http.status == 200)
+    http.close()
+    for (i in 4) {
+        logged("/index.html?rotate" + i)
+    }
+    ttrue(Path("../" + LOG + ".1").exists)
+    ttrue(Path("../" + LOG + ".2").exists)
+    ttrue(!Path("../" + LOG + ".3").exists)
+
+    //  Restore the default log
+    http.get(HTTP + "/action/accessLogTest?path=access.log&format=common")
+    ttrue(http.status == 200)
+    http.close()
+    for each (path in LOCAL.parent.files("access-test.log*")) {
+        path.remove()
+    }
+} else {
+    tskip("Access log not enabled")
+}
@@ -0,0 +1,20 @@
+/*
+    alloc.tst - Allocator tests
+ */
+
+const HTTP = tget('TM_HTTP') || "127.0.0.1:8080"
+let http: Http = new Http
+
+if (thas('ME_GOAHEAD_REPLACE_MALLOC') && Config.OS != "windows") {
+    //  Blocks freed by another thread, including a large malloced block, are reclaimed by the owner on its next allocation
+    http.get(HTTP + "/action/allocTest")
+    ttrue(http.status == 200)
+    let pending = http.response.replace(/.*PENDING=([^<]*).*/s, "$1")
+    ttrue(pending == "64" || pending == "0")
+    ttrue(http.response.contains("ALLOCATED=0"))
+    ttrue(http.response.contains("BYTES=0"))
+    http.close()
+
+} else {
+    tskip("Allocator not enabled")
+}
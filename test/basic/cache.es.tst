@@ -0,0 +1,30 @@
+/*
+    cache.tst - File cache invalidation tests
+ */
+
+const HTTP = tget('TM_HTTP') || "127.0.0.1:8080"
+const DOC = "tmp/cache-test.txt"
+const LOCAL = Path("../web/" + DOC)
+let http: Http = new Http
+
+LOCAL.write("original\n")
+
+//  Serve the document twice so the second response comes from the cache
+for (i in 2) {
+    http.get(HTTP + "/" + DOC)
+    ttrue(http.status == 200)
+    ttrue(http.response == "original\n")
+    http.close()
+}
+let etag = http.header("ETag")
+
+//  Modify the document. Cached entries are revalidated after ME_GOAHEAD_CACHE_REVALIDATE (2) seconds.
+LOCAL.write("modified document\n")
+App.sleep(2500)
+http.get(HTTP + "/" + DOC)
+ttrue(http.status == 200)
+ttrue(http.response == "modified document\n")
+ttrue(http.header("ETag") != etag)
+http.close()
+
+LOCAL.remove()
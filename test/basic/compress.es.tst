@@ -0,0 +1,27 @@
+/*
+    compress.tst - Precompressed document negotiation tests
+ */
+
+const HTTP = tget('TM_HTTP') || "127.0.0.1:8080"
+let http: Http = new Http
+
+if (thas('ME_GOAHEAD_COMPRESS')) {
+    //  Client accepting gzip gets the precompressed variant
+    http.setHeader("Accept-Encoding", "gzip")
+    http.get(HTTP + "/compress/precompressed.txt")
+    ttrue(http.status == 200)
+    ttrue(http.header("Content-Encoding") == "gzip")
+    ttrue(http.header("Vary") == "Accept-Encoding")
+    ttrue(http.contentType == "text/plain")
+    http.close()
+
+    //  Client without Accept-Encoding gets the identity document
+    http.reset()
+    http.get(HTTP + "/compress/precompressed.txt")
+    ttrue(http.status == 200)
+    ttrue(!http.header("Content-Encoding"))
+    ttrue(http.response == "Hello World\n")
+    http.close()
+} else {
+    tskip("Compression not enabled")
+}
@@ -0,0 +1,147 @@
+/*
+    fastcgi.tst - FastCGI tests
+ */
+
+const HTTP = tget('TM_HTTP') || "127.0.0.1:8080"
+let http: Http = new Http
+
+if (thas('ME_GOAHEAD_CGI') && Config.OS != "windows") {
+    /* Suport routines */
+
+    function contains(pat): Void {
+        ttrue(http.response.contains(pat))
+    }
+
+    function keyword(pat: String): String? {
+        pat.replace(/\//, "\\/").replace(/\[/, "\\[")
+        let reg = RegExp(".*" + pat + "=([^<]*).*", "s")
+        return http.response.replace(reg, "$1")
+    }
+
+    function match(key: String, value: String): Void {
+        if (keyword(key) != value) {
+            print(http.response)
+            print("\nKey \"" + key + "\"")
+            print("Expected: " + value)
+        }
+        ttrue(keyword(key) == value)
+    }
+
+
+    /* Tests */
+
+    function basic() {
+        http.get(HTTP + "/fcgi/extra/path?a=1")
+        ttrue(http.status == 200)
+        contains("fcgitest: Output")
+        match("SCRIPT_NAME", "/fcgi")
+        match("PATH_INFO", "/extra/path")
+        match("QUERY_STRING", "a=1")
+        match("CGI_a", "1")
+        http.close()
+    }
+
+    function persistent() {
+        //  Requests are serviced by the same process
+        http.get(HTTP + "/fcgi/")
+        ttrue(http.status == 200)
+        let pid = keyword("PID")
+        http.close()
+
+        http.get(HTTP + "/fcgi/")
+        ttrue(http.status == 200)
+        match("PID", pid)
+        http.close()
+    }
+
+    function post() {
+        http.post(HTTP + '/fcgi/', 'Some data')
+        ttrue(http.status == 200)
+        match('CONTENT_LENGTH', '9')
+        match('POST_DATA', 'Some data')
+        http.close()
+
+        http.form(HTTP + '/fcgi/', {name: 'John', address: '700 Park Ave'})
+        ttrue(http.status == 200)
+        match('CGI_name', 'John')
+        match('CGI_address', '700 Park Ave')
+        http.close()
+    }
+
+    function stream() {
+        //  A body that is not a form is streamed to the program as it is received
+        let data = "0123456789".times(1500)
+        http.setHeader("Content-Type", "text/plain")
+        http.post(HTTP + '/fcgi/', data)
+        ttrue(http.status == 200)
+        match('POST_LENGTH', '15000')
+        match('POST_DATA', data)
+        http.close()
+    }
+
+    function multiplex() {
+        //  Delayed requests are serviced concurrently by two processes, each running four requests
+        let requests = []
+        let mark = new Date
+        for (i in 8) {
+            let client = new Http
+            client.get(HTTP + "/fcgi/?delay=1000")
+            requests.push(client)
+        }
+        let pids = {}
+        for each (client in requests) {
+            ttrue(client.status == 200)
+            let pid = client.response.replace(/.*PID=([^<]*).*/s, "$1")
+            pids[pid] = (pids[pid] || 0) + 1
+            client.close()
+        }
+        ttrue(mark.elapsed < 4000)
+        ttrue(Object.getOwnPropertyCount(pids) == 2)
+        for each (count in pids) {
+            ttrue(count == 4)
+        }
+    }
+
+    function overflow() {
+        //  Eight requests are running and sixteen are queued. Further requests are rejected.
+        let requests = []
+        for (i in 26) {
+            let client = new Http
+            client.get(HTTP + "/fcgi/?delay=2000")
+            requests.push(client)
+        }
+        let ok = 0, busy = 0
+        for each (client in requests) {
+            if (client.status == 200) {
+                ok++
+            } else if (client.status == 503) {
+                busy++
+            }
+            client.close()
+        }
+        ttrue(ok == 24)
+        ttrue(busy == 2)
+    }
+
+    function recovery() {
+        //  The program exits without responding. A new process services the next request.
+        http.get(HTTP + "/fcgi/?exit=1")
+        ttrue(http.status == 502)
+        http.close()
+
+        http.get(HTTP + "/fcgi/")
+        ttrue(http.status == 200)
+        http.close()
+    }
+
+    basic()
+    persistent()
+    post()
+    stream()
+    multiplex()
+    overflow()
+    recovery()
+
+} else {
+    tskip("FastCGI not enabled")
+}
@@ -0,0 +1,50 @@
+/*
+    metrics.tst - Metrics handler tests
+ */
+
+const HTTP = tget('TM_HTTP') || "127.0.0.1:8080"
+let http: Http = new Http
+
+if (thas('ME_GOAHEAD_METRICS')) {
+    //  Prometheus text format
+    http.get(HTTP + "/index.html")
+    ttrue(http.status == 200)
+    http.close()
+
+    http.get(HTTP + "/metrics")
+    ttrue(http.status == 200)
+    ttrue(http.header("Content-Type").contains("text/plain"))
+    ttrue(http.response.contains("# TYPE goahead_requests_total counter"))
+    ttrue(http.response.contains('goahead_responses_total{code="200"}'))
+    ttrue(http.response.contains('goahead_handler_duration_milliseconds_count{handler="file"}'))
+    http.close()
+
+    //  JSON format
+    http.get(HTTP + "/metrics?format=json")
+    ttrue(http.status == 200)
+    ttrue(http.header("Content-Type").contains("application/json"))
+    let metrics = deserialize(http.response)
+    ttrue(metrics.goahead_requests_total > 0)
+    ttrue(metrics.goahead_connections_accepted_total > 0)
+    ttrue(metrics.handlers.file.count > 0)
+    http.close()
+
+    //  Sent bytes include file data written by sendfile and the file cache
+    let before = metrics.goahead_sent_bytes_total
+    http.get(HTTP + "/big.txt")
+    ttrue(http.status == 200)
+    let size = http.response.length
+    http.close()
+    http.get(HTTP + "/metrics?format=json")
+    metrics = deserialize(http.response)
+    ttrue(metrics.goahead_sent_bytes_total - before >= size)
+    http.close()
+
+    //  Only GET and HEAD are supported
+    http.post(HTTP + "/metrics", "data")
+    ttrue(http.status == 405)
+    http.close()
+
+} else {
+    tskip("Metrics not enabled")
+}
@@ -0,0 +1,70 @@
+/*
+    range.tst - Range and If-Range tests
+ */
+
+const HTTP = tget('TM_HTTP') || "127.0.0.1:8080"
+let http: Http = new Http
+
+http.get(HTTP + "/big.txt")
+ttrue(http.status == 200)
+let etag = http.header("ETag")
+let modified = http.header("Last-Modified")
+let size = http.response.length
+ttrue(etag && !etag.startsWith("W/"))
+http.close()
+
+//  Single range
+http.setHeader("Range", "bytes=0-4")
+http.get(HTTP + "/big.txt")
+ttrue(http.status == 206)
+ttrue(http.header("Content-Range") == "bytes 0-4/" + size)
+ttrue(http.response == "01234")
+http.close()
+
+//  Multiple ranges
+http.setHeader("Range", "bytes=0-5,25-30,-5")
+http.get(HTTP + "/big.txt")
+ttrue(http.status == 206)
+ttrue(http.header("Content-Type").contains("multipart/byteranges"))
+ttrue(http.response.contains("Content-Range: bytes 0-5/" + size))
+ttrue(http.response.contains("Content-Range: bytes 25-30/" + size))
+ttrue(http.response.contains("Content-Range: bytes " + (size - 5) + "-" + (size - 1) + "/" + size))
+ttrue(http.response.contains("012345"))
+http.close()
+
+//  If-Range with the current entity tag
+http.setHeader("Range", "bytes=0-4")
+http.setHeader("If-Range", etag)
+http.get(HTTP + "/big.txt")
+ttrue(http.status == 206)
+ttrue(http.response == "01234")
+http.close()
+
+//  If-Range with a value that only starts with the current entity tag
+http.setHeader("Range", "bytes=0-4")
+http.setHeader("If-Range", etag + ", \"other\"")
+http.get(HTTP + "/big.txt")
+ttrue(http.status == 200)
+ttrue(http.response.length == size)
+http.close()
+
+//  If-Range with a weak entity tag
+http.setHeader("Range", "bytes=0-4")
+http.setHeader("If-Range", "W/" + etag)
+http.get(HTTP + "/big.txt")
+ttrue(http.status == 200)
+http.close()
+
+//  If-Range with the modification date
+http.setHeader("Range", "bytes=0-4")
+http.setHeader("If-Range", modified)
+http.get(HTTP + "/big.txt")
+ttrue(http.status == 206)
+http.close()
+
+//  If-Range with a different date
+http.setHeader("Range", "bytes=0-4")
+http.setHeader("If-Range", "Thu, 01 Jan 1970 00:00:00 GMT")
+http.get(HTTP + "/big.txt")
+ttrue(http.status == 200)
+http.close()
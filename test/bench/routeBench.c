@@ -0,0 +1,126 @@
+/*
+    routeBench.c -- Route lookup benchmark
+
+    Measures the cost of websRouteRequest as the number of routes grows. The compiled route tree should make the
+    lookup cost independent of the route count, whereas a linear scan of the route prefixes grows with it.
+
+    Build and run from the build output directory:
+        cc -I inc ../../test/bench/routeBench.c -o routeBench -Lbin -lgo && ./routeBench
+
+    Copyright (c) All Rights Reserved. See details at the end of the file.
+ */
+
+/********************************* Includes ***********************************/
+
+#include    "goahead.h"
+
+/*********************************** Locals ***********************************/
+
+#define BENCH_ITERATIONS    200000      /* Lookups per measurement */
+#define BENCH_WORK          20000000    /* Bound on prefixes compared by each linear measurement */
+
+static char **prefixes;
+
+/************************************ Code ************************************/
+
+static bool benchHandler(Webs *wp)
+{
+    return 1;
+}
+
+
+/*
+    Route by scanning every prefix in order. This is the strategy used before routes were compiled.
+ */
+static int linearRoute(cchar *path, int count)
+{
+    ssize   plen, len;
+    int     i;
+
+    plen = slen(path);
+    for (i = 0; i < count; i++) {
+        len = slen(prefixes[i]);
+        if (plen >= len && strncmp(path, prefixes[i], len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+static double bench(Webs *wp, cchar *path, int count, bool linear)
+{
+    Ticks   mark;
+    int     i, iterations;
+
+    iterations = linear ? min(BENCH_ITERATIONS, BENCH_WORK / count) : BENCH_ITERATIONS;
+    wp->path = (char*) path;
+    mark = websGetTicks();
+    for (i = 0; i < iterations; i++) {
+        if (linear) {
+            linearRoute(path, count);
+        } else {
+            wp->route = 0;
+            websRouteRequest(wp);
+        }
+    }
+    return (websGetTicks() - mark) * 1000000.0 / iterations;
+}
+
+
+int main(int argc, char **argv)
+{
+    Webs        webs;
+    char        path[ME_GOAHEAD_LIMIT_STRING];
+    int         sizes[] = { 10, 100, 1000, 10000 };
+    int         i, s, count;
+
+    websRuntimeOpen();
+    websOpenRoute();
+    websDefineHandler("bench", benchHandler, 0, 0, 0);
+
+    memset(&webs, 0, sizeof(Webs));
+    webs.method = "GET";
+    webs.protocol = "http";
+
+    printf("%8s %14s %14s %14s %14s\n", "routes", "tree-hit(ns)", "tree-miss(ns)", "linear-hit(ns)", "linear-miss(ns)");
+    for (s = 0; s < (int) (sizeof(sizes) / sizeof(int)); s++) {
+        count = sizes[s];
+        websCloseRoute();
+        websOpenRoute();
+        websDefineHandler("bench", benchHandler, 0, 0, 0);
+        prefixes = wrealloc(prefixes, (count + 1) * sizeof(char*));
+        for (i = 0; i < count; i++) {
+            prefixes[i] = sfmt("/api/v1/resource%d/", i);
+            websAddRoute(prefixes[i], "bench", -1);
+        }
+        prefixes[count] = sclone("/");
+        websAddRoute("/", "bench", -1);
+
+        /*
+            Hit a route in the middle of the table and miss all but the final catch-all route
+         */
+        fmt(path, sizeof(path), "/api/v1/resource%d/item", count / 2);
+        printf("%8d %14.1f %14.1f %14.1f %14.1f\n", count,
+            bench(&webs, path, count, 0), bench(&webs, "/static/index.html", count, 0),
+            bench(&webs, path, count + 1, 1), bench(&webs, "/static/index.html", count + 1, 1));
+        fflush(stdout);
+
+        for (i = 0; i <= count; i++) {
+            wfree(prefixes[i]);
+        }
+    }
+    wfree(prefixes);
+    websCloseRoute();
+    return 0;
+}
+
+
+/*
+    Copyright (c) Embedthis Software. All Rights Reserved.
+    This software is distributed under commercial and open source licenses.
+    You may use the Embedthis GoAhead open source license or you may acquire
+    a commercial license from Embedthis Software. You agree to be fully bound
+    by the terms of either license. Consult the LICENSE.md distributed with
+    this software for full details and other copyrights.
+ */
@@ -0,0 +1,430 @@
+/*
+    fcgitest.c - Test FastCGI program
+
+    Copyright (c) All Rights Reserved. See details at the end of the file.
+
+    The program is started by the web server with a listening socket as stdin (FCGI_LISTENSOCK_FILENO). It accepts
+    connections and services multiplexed responder requests on each connection. The response is HTML with the request
+    parameters and post data in "<P>NAME=VALUE</P>" form as output by cgitest.
+
+    Query switches:
+        delay=msec          Delay the response. Other requests on the connection are serviced meanwhile.
+        exit=1              Exit without responding to test server recovery
+ */
+
+/********************************** Includes **********************************/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/*********************************** Locals ***********************************/
+
+#define FCGI_VERSION            1
+#define FCGI_BEGIN_REQUEST      1
+#define FCGI_ABORT_REQUEST      2
+#define FCGI_END_REQUEST        3
+#define FCGI_PARAMS             4
+#define FCGI_STDIN              5
+#define FCGI_STDOUT             6
+#define FCGI_KEEP_CONN          1
+#define FCGI_HEADER_LEN         8
+#define FCGI_MAX_RECORD         65535
+
+#define MAX_CONNS               16
+#define MAX_REQUESTS            256
+
+typedef struct Buf {
+    char    *data;
+    size_t  len;
+    size_t  size;
+} Buf;
+
+typedef struct Request {
+    int     active;
+    int     keepConn;
+    int     paramsDone;
+    Buf     params;
+    Buf     input;
+    long    due;                /* Time to respond in msec. Zero until the request is complete */
+} Request;
+
+typedef struct Conn {
+    int     fd;
+    Buf     rx;
+    Request requests[MAX_REQUESTS];
+} Conn;
+
+static Conn     conns[MAX_CONNS];
+static int      requestCount;
+
+/***************************** Forward Declarations ***************************/
+
+static void addBuf(Buf *bp, const char *data, size_t len);
+static void closeConn(Conn *cp);
+static void endRequest(Conn *cp, int id, int status);
+static char *getParam(Request *rp, const char *name, char *buf, size_t size);
+static long getQueryInt(Request *rp, const char *key);
+static long now(void);
+static void parseRecords(Conn *cp);
+static void respond(Conn *cp, int id);
+static void writeAll(int fd, const char *buf, size_t len);
+static void writeRecord(int fd, int type, int id, const char *buf, size_t len);
+
+/*********************************** Code *************************************/
+
+int main(int argc, char **argv)
+{
+    struct pollfd   fds[MAX_CONNS + 1];
+    Conn            *cp;
+    char            buf[16384];
+    ssize_t         nbytes;
+    long            timeout, remaining;
+    int             i, id, fd, nfds;
+
+    for (i = 0; i < MAX_CONNS; i++) {
+        conns[i].fd = -1;
+    }
+    while (1) {
+        /*
+            Respond to delayed requests that are due and compute the poll timeout for the next
+         */
+        timeout = -1;
+        for (i = 0; i < MAX_CONNS; i++) {
+            cp = &conns[i];
+            for (id = 0; cp->fd >= 0 && id < MAX_REQUESTS; id++) {
+                if (cp->requests[id].active && cp->requests[id].due) {
+                    if ((remaining = cp->requests[id].due - now()) <= 0) {
+                        respond(cp, id);
+                    } else if (timeout < 0 || remaining < timeout) {
+                        timeout = remaining;
+                    }
+                }
+            }
+        }
+        fds[0].fd = 0;
+        fds[0].events = POLLIN;
+        for (i = 0, nfds = 1; i < MAX_CONNS; i++) {
+            fds[nfds].fd = conns[i].fd;
+            fds[nfds].events = POLLIN;
+            nfds++;
+        }
+        if (poll(fds, nfds, (int) timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        if (fds[0].revents & POLLIN) {
+            if ((fd = accept(0, NULL, NULL)) >= 0) {
+                for (i = 0; i < MAX_CONNS && conns[i].fd >= 0; i++) {}
+                if (i < MAX_CONNS) {
+                    memset(&conns[i], 0, sizeof(Conn));
+                    conns[i].fd = fd;
+                } else {
+                    close(fd);
+                }
+            }
+        }
+        for (i = 0; i < MAX_CONNS; i++) {
+            cp = &conns[i];
+            if (cp->fd < 0 || !(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            if ((nbytes = read(cp->fd, buf, sizeof(buf))) <= 0) {
+                if (nbytes < 0 && errno == EINTR) {
+                    continue;
+                }
+                closeConn(cp);
+                continue;
+            }
+            addBuf(&cp->rx, buf, nbytes);
+            parseRecords(cp);
+        }
+    }
+    return 0;
+}
+
+
+static void parseRecords(Conn *cp)
+{
+    Request         *rp;
+    unsigned char   *hp;
+    char            *content;
+    size_t          contentLen, recordLen, pos;
+    int             type, id;
+
+    pos = 0;
+    while (cp->fd >= 0 && cp->rx.len - pos >= FCGI_HEADER_LEN) {
+        hp = (unsigned char*) &cp->rx.data[pos];
+        type = hp[1];
+        id = (hp[2] << 8) | hp[3];
+        contentLen = (hp[4] << 8) | hp[5];
+        recordLen = FCGI_HEADER_LEN + contentLen + hp[6];
+        if (cp->rx.len - pos < recordLen) {
+            break;
+        }
+        content = (char*) &hp[FCGI_HEADER_LEN];
+        pos += recordLen;
+        if (id <= 0 || id >= MAX_REQUESTS) {
+            continue;
+        }
+        rp = &cp->requests[id];
+
+        switch (type) {
+        case FCGI_BEGIN_REQUEST:
+            free(rp->params.data);
+            free(rp->input.data);
+            memset(rp, 0, sizeof(Request));
+            rp->active = 1;
+            rp->keepConn = contentLen >= 3 && (content[2] & FCGI_KEEP_CONN);
+            break;
+
+        case FCGI_PARAMS:
+            if (contentLen == 0) {
+                rp->paramsDone = 1;
+            } else {
+                addBuf(&rp->params, content, contentLen);
+            }
+            break;
+
+        case FCGI_STDIN:
+            if (contentLen > 0) {
+                addBuf(&rp->input, content, contentLen);
+            } else if (rp->active) {
+                requestCount++;
+                if (getQueryInt(rp, "exit")) {
+                    exit(2);
+                }
+                rp->due = now() + getQueryInt(rp, "delay");
+                if (rp->due - now() <= 0) {
+                    respond(cp, id);
+                }
+            }
+            break;
+
+        case FCGI_ABORT_REQUEST:
+            if (rp->active) {
+                endRequest(cp, id, 1);
+            }
+            break;
+        }
+    }
+    if (cp->fd >= 0) {
+        memmove(cp->rx.data, &cp->rx.data[pos], cp->rx.len - pos);
+        cp->rx.len -= pos;
+    }
+}
+
+
+static void respond(Conn *cp, int id)
+{
+    Request         *rp;
+    Buf             out;
+    unsigned char   *pp, *end;
+    char            line[8192];
+    size_t          nameLen, valueLen, i;
+    int             len;
+
+    rp = &cp->requests[id];
+    memset(&out, 0, sizeof(out));
+
+    len = snprintf(line, sizeof(line), "Content-Type: text/html\r\n\r\n"
+        "<HTML><TITLE>fcgitest: Output</TITLE><BODY>\r\n<H2>Request</H2>\r\n"
+        "<P>PID=%d</P>\r\n<P>REQUEST_ID=%d</P>\r\n<P>REQUEST_COUNT=%d</P>\r\n<H2>Params</H2>\r\n",
+        (int) getpid(), id, requestCount);
+    addBuf(&out, line, len);
+
+    pp = (unsigned char*) rp->params.data;
+    end = pp + rp->params.len;
+    while (pp && pp < end) {
+        for (i = 0; i < 2; i++) {
+            if (*pp & 0x80) {
+                len = ((pp[0] & 0x7F) << 24) | (pp[1] << 16) | (pp[2] << 8) | pp[3];
+                pp += 4;
+            } else {
+                len = *pp++;
+            }
+            if (i == 0) {
+                nameLen = len;
+            } else {
+                valueLen = len;
+            }
+        }
+        len = snprintf(line, sizeof(line), "<P>%.*s=%.*s</P>\r\n", (int) nameLen, pp, (int) valueLen, pp + nameLen);
+        addBuf(&out, line, (size_t) len < sizeof(line) ? (size_t) len : sizeof(line) - 1);
+        pp += nameLen + valueLen;
+    }
+    len = snprintf(line, sizeof(line), "<H2>Post Data</H2>\r\n<P>POST_LENGTH=%d</P>\r\n<P>POST_DATA=",
+        (int) rp->input.len);
+    addBuf(&out, line, len);
+    addBuf(&out, rp->input.data, rp->input.len);
+    addBuf(&out, "</P>\r\n</BODY></HTML>\r\n", 22);
+
+    for (i = 0; i < out.len; i += len) {
+        len = (int) ((out.len - i) < FCGI_MAX_RECORD ? (out.len - i) : FCGI_MAX_RECORD);
+        writeRecord(cp->fd, FCGI_STDOUT, id, &out.data[i], len);
+    }
+    writeRecord(cp->fd, FCGI_STDOUT, id, NULL, 0);
+    free(out.data);
+    endRequest(cp, id, 0);
+}
+
+
+static void endRequest(Conn *cp, int id, int status)
+{
+    Request     *rp;
+    char        body[8];
+    int         keepConn;
+
+    rp = &cp->requests[id];
+    memset(body, 0, sizeof(body));
+    body[3] = (char) status;
+    writeRecord(cp->fd, FCGI_END_REQUEST, id, body, sizeof(body));
+    keepConn = rp->keepConn;
+    free(rp->params.data);
+    free(rp->input.data);
+    memset(rp, 0, sizeof(Request));
+    if (!keepConn) {
+        closeConn(cp);
+    }
+}
+
+
+static void closeConn(Conn *cp)
+{
+    int     id;
+
+    for (id = 0; id < MAX_REQUESTS; id++) {
+        free(cp->requests[id].params.data);
+        free(cp->requests[id].input.data);
+    }
+    free(cp->rx.data);
+    close(cp->fd);
+    memset(cp, 0, sizeof(Conn));
+    cp->fd = -1;
+}
+
+
+/*
+    Get a decimal query value from the QUERY_STRING parameter
+ */
+static long getQueryInt(Request *rp, const char *key)
+{
+    char    query[1024], *cp;
+    size_t  len;
+
+    if (getParam(rp, "QUERY_STRING", query, sizeof(query)) == 0) {
+        return 0;
+    }
+    len = strlen(key);
+    for (cp = query; cp && *cp; ) {
+        if (strncmp(cp, key, len) == 0 && cp[len] == '=') {
+            return atol(&cp[len + 1]);
+        }
+        if ((cp = strchr(cp, '&')) != 0) {
+            cp++;
+        }
+    }
+    return 0;
+}
+
+
+static char *getParam(Request *rp, const char *name, char *buf, size_t size)
+{
+    unsigned char   *pp, *end;
+    size_t          lens[2], i;
+
+    pp = (unsigned char*) rp->params.data;
+    end = pp + rp->params.len;
+    while (pp && pp < end) {
+        for (i = 0; i < 2; i++) {
+            if (*pp & 0x80) {
+                lens[i] = ((pp[0] & 0x7F) << 24) | (pp[1] << 16) | (pp[2] << 8) | pp[3];
+                pp += 4;
+            } else {
+                lens[i] = *pp++;
+            }
+        }
+        if (lens[0] == strlen(name) && memcmp(pp, name, lens[0]) == 0 && lens[1] < size) {
+            memcpy(buf, pp + lens[0], lens[1]);
+            buf[lens[1]] = '\0';
+            return buf;
+        }
+        pp += lens[0] + lens[1];
+    }
+    return 0;
+}
+
+
+static void writeRecord(int fd, int type, int id, const char *buf, size_t len)
+{
+    unsigned char   header[FCGI_HEADER_LEN];
+
+    header[0] = FCGI_VERSION;
+    header[1] = (unsigned char) type;
+    header[2] = (unsigned char) ((id >> 8) & 0xFF);
+    header[3] = (unsigned char) (id & 0xFF);
+    header[4] = (unsigned char) ((len >> 8) & 0xFF);
+    header[5] = (unsigned char) (len & 0xFF);
+    header[6] = 0;
+    header[7] = 0;
+    writeAll(fd, (char*) header, sizeof(header));
+    if (len > 0) {
+        writeAll(fd, buf, len);
+    }
+}
+
+
+static void writeAll(int fd, const char *buf, size_t len)
+{
+    ssize_t     written;
+
+    while (len > 0) {
+        if ((written = write(fd, buf, len)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        buf += written;
+        len -= written;
+    }
+}
+
+
+static void addBuf(Buf *bp, const char *data, size_t len)
+{
+    if (bp->len + len + 1 > bp->size) {
+        bp->size = (bp->len + len + 1) * 2;
+        if ((bp->data = realloc(bp->data, bp->size)) == 0) {
+            exit(1);
+        }
+    }
+    memcpy(&bp->data[bp->len], data, len);
+    bp->len += len;
+    bp->data[bp->len] = '\0';
+}
+
+
+static long now(void)
+{
+    struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/*
+    Copyright (c) Embedthis Software. All Rights Reserved.
+    This software is distributed under commercial and open source licenses.
+    You may use the Embedthis GoAhead open source license or you may acquire
+    a commercial license from Embedthis Software. You agree to be fully bound
+    by the terms of either license. Consult the LICENSE.md distributed with
+    this software for full details and other copyrights.
+ */
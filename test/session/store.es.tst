@@ -0,0 +1,82 @@
+/*
+    store.tst - Session store reload and session expiry tests
+ */
+
+const HTTP = tget('TM_HTTP') || "127.0.0.1:8080"
+const STORE = "tmp/session.store"
+const LOCAL = Path("../" + STORE)
+let http: Http = new Http
+
+if (thas('ME_ROM')) {
+    tskip("Session store not supported for ROM builds")
+
+} else {
+    let now = Date.now() / 1000
+    let live = "a0000000000000000000000000000001"
+    let short = "a0000000000000000000000000000002"
+    let old = "a0000000000000000000000000000003"
+
+    //  Sessions are loaded from the store. Expired sessions are discarded when the store is rewritten.
+    LOCAL.write("C " + live + " 3600 " + (now + 3600).toFixed() + "\n" +
+        "S " + live + " number 77\n" +
+        "C " + short + " 1 " + (now + 1).toFixed() + "\n" +
+        "S " + short + " number 55\n" +
+        "C " + old + " 60 " + (now - 60).toFixed() + "\n" +
+        "S " + old + " number 33\n")
+    http.get(HTTP + "/action/sessionStoreTest?path=" + STORE)
+    ttrue(http.status == 200)
+    http.close()
+    let store = LOCAL.readString()
+    ttrue(store.contains(live))
+    ttrue(!store.contains(old))
+
+    http.setCookie("-goahead-session-=" + live)
+    http.get(HTTP + "/action/sessionTest")
+    ttrue(http.status == 200)
+    ttrue(http.response.contains("Number 77"))
+    ttrue(!http.header("Set-Cookie"))
+    http.close()
+
+    //  A session that expired while the server was down is not restored
+    http.setCookie("-goahead-session-=" + old)
+    http.get(HTTP + "/action/sessionTest")
+    ttrue(http.status == 200)
+    ttrue(http.response.contains("Number null"))
+    ttrue(http.header("Set-Cookie"))
+    http.close()
+
+    //  A session expires when unused for its lifespan
+    http.setCookie("-goahead-session-=" + short)
+    http.get(HTTP + "/action/sessionTest")
+    ttrue(http.response.contains("Number 55"))
+    http.close()
+    App.sleep(2500)
+    http.setCookie("-goahead-session-=" + short)
+    http.get(HTTP + "/action/sessionTest")
+    ttrue(http.response.contains("Number null"))
+    let cookie = http.header("Set-Cookie")
+    ttrue(cookie && !cookie.contains(short))
+    http.close()
+
+    //  Changes are written to the store within a second
+    http.setCookie("-goahead-session-=" + live)
+    http.form(HTTP + "/action/sessionTest", {number: "88"})
+    ttrue(http.status == 200)
+    http.close()
+    App.sleep(1500)
+    ttrue(LOCAL.readString().contains("S " + live + " number 88"))
+
+    //  Reloading the store restores the latest value
+    http.get(HTTP + "/action/sessionStoreTest?path=" + STORE)
+    ttrue(http.status == 200)
+    http.close()
+    http.setCookie("-goahead-session-=" + live)
+    http.get(HTTP + "/action/sessionTest")
+    ttrue(http.response.contains("Number 88"))
+    http.close()
+
+    http.get(HTTP + "/action/sessionStoreTest?path=")
+    ttrue(http.status == 200)
+    http.close()
+    LOCAL.remove()
+}
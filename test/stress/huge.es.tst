@@ -51,6 +51,13 @@ if (tdepth() >= 5) {
     ttrue(http.status == 200)
     http.close()
 
+    //  A last byte position beyond the document (and beyond 64 bits) is clamped to the document
+    http.setHeader("Range", "bytes=0-99999999999999999999")
+    http.get(HTTP + "/big.txt")
+    ttrue(http.status == 206)
+    ttrue(http.header("Content-Range") == "bytes 0-117015/117016")
+    http.close()
+
 /*
     //  Get first 5 bytes
     http.setHeader("Range", "bytes=0-4")
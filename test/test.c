@@ -52,7 +52,18 @@ static int aspTest(int eid, Webs *wp, int argc, char **argv);
 static int bigTest(int eid, Webs *wp, int argc, char **argv);
 #endif
 static void actionTest(Webs *wp);
+#if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
+static void accessLogTest(Webs *wp);
+#endif
+#if ME_GOAHEAD_REPLACE_MALLOC && ME_UNIX_LIKE
+static int64 allocatedBlocks(int64 *bytes);
+static void allocTest(Webs *wp);
+static void *freeBlocks(void *data);
+#endif
 static void sessionTest(Webs *wp);
+#if !ME_ROM
+static void sessionStoreTest(Webs *wp);
+#endif
 static void showTest(Webs *wp);
 #if ME_GOAHEAD_UPLOAD && !ME_ROM
 static void uploadTest(Webs *wp);
@@ -61,6 +72,7 @@ static void uploadTest(Webs *wp);
 static int legacyTest(Webs *wp, char *prefix, char *dir, int flags);
 #endif
 #if ME_UNIX_LIKE
+static void hupHandler(int signo);
 static void sigHandler(int signo);
 #endif
 static void exitProc(void *data, int id);
@@ -174,7 +186,16 @@ MAIN(goahead, int argc, char **argv, char **envp)
     websDefineJst("bigTest", bigTest);
 #endif
     websDefineAction("test", actionTest);
+#if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
+    websDefineAction("accessLogTest", accessLogTest);
+#endif
+#if ME_GOAHEAD_REPLACE_MALLOC && ME_UNIX_LIKE
+    websDefineAction("allocTest", allocTest);
+#endif
     websDefineAction("sessionTest", sessionTest);
+#if !ME_ROM
+    websDefineAction("sessionStoreTest", sessionStoreTest);
+#endif
     websDefineAction("showTest", showTest);
 #if ME_GOAHEAD_UPLOAD && !ME_ROM
     websDefineAction("uploadTest", uploadTest);
@@ -253,6 +274,7 @@ void initPlatform()
     signal(SIGINT, sigHandler);
     signal(SIGTERM, sigHandler);
     signal(SIGKILL, sigHandler);
+    signal(SIGHUP, hupHandler);
     #ifdef SIGPIPE
         signal(SIGPIPE, SIG_IGN);
     #endif
@@ -267,6 +289,12 @@ static void sigHandler(int signo)
 {
     finished = 1;
 }
+
+
+static void hupHandler(int signo)
+{
+    websReopenAccessLog();
+}
 #endif
 
 
@@ -357,6 +385,117 @@ static void sessionTest(Webs *wp)
 }
 
 
+#if ME_GOAHEAD_ACCESS_LOG && !ME_ROM
+/*
+    Configure the access log from the "path", "format", "size" and "backups" parameters
+ */
+static void accessLogTest(Webs *wp)
+{
+    int     rc;
+
+    rc = websSetAccessLog(websGetVar(wp, "path", NULL), websGetVar(wp, "format", NULL),
+        atoi(websGetVar(wp, "size", "0")), atoi(websGetVar(wp, "backups", "0")));
+    websSetStatus(wp, rc < 0 ? 400 : 200);
+    websWriteHeaders(wp, -1, 0);
+    websWriteEndHeaders(wp);
+    websWrite(wp, "<html><body><p>Access log %d</p></body></html>\n", rc);
+    websDone(wp);
+}
+#endif
+
+
+#if ME_GOAHEAD_REPLACE_MALLOC && ME_UNIX_LIKE
+#define ALLOC_TEST_BLOCKS   64
+#define ALLOC_TEST_LARGE    (256 * 1024)
+
+/*
+    Sum the allocated blocks and bytes over all classes
+ */
+static int64 allocatedBlocks(int64 *bytes)
+{
+    WebsAllocStats  stats;
+    int64           count;
+    int             cls;
+
+    for (count = 0, *bytes = 0, cls = 0; cls <= WEBS_MAX_CLASS; cls++) {
+        wallocStats(cls, &stats);
+        count += stats.allocated;
+        *bytes += stats.bytes;
+    }
+    return count;
+}
+
+
+/*
+    Free blocks on another thread and then reclaim them on this thread. The last block is larger than the largest
+    class. Emit the blocks pending after the free and the blocks and bytes still allocated after the next allocation,
+    which must be zero.
+ */
+static void allocTest(Webs *wp)
+{
+    pthread_t   tid;
+    void        *blocks[ALLOC_TEST_BLOCKS];
+    int64       before, pending, allocated, beforeBytes, bytes;
+    int         i;
+
+    before = allocatedBlocks(&beforeBytes);
+    for (i = 0; i < ALLOC_TEST_BLOCKS; i++) {
+        blocks[i] = walloc(i == ALLOC_TEST_BLOCKS - 1 ? ALLOC_TEST_LARGE : 100);
+    }
+    if (pthread_create(&tid, NULL, freeBlocks, blocks) != 0) {
+        websError(wp, HTTP_CODE_INTERNAL_SERVER_ERROR, "Cannot create thread");
+        return;
+    }
+    pthread_join(tid, NULL);
+    pending = allocatedBlocks(&bytes) - before;
+
+    /* The next allocation reclaims the blocks freed by the other thread */
+    wfree(walloc(100));
+    allocated = allocatedBlocks(&bytes) - before;
+    bytes -= beforeBytes;
+
+    websSetStatus(wp, 200);
+    websWriteHeaders(wp, -1, 0);
+    websWriteEndHeaders(wp);
+    websWrite(wp, "<html><body><p>PENDING=%d</p><p>ALLOCATED=%d</p><p>BYTES=%d</p></body></html>\n", (int) pending,
+        (int) allocated, (int) bytes);
+    websDone(wp);
+}
+
+
+static void *freeBlocks(void *data)
+{
+    void    **blocks;
+    int     i;
+
+    blocks = data;
+    for (i = 0; i < ALLOC_TEST_BLOCKS; i++) {
+        wfree(blocks[i]);
+    }
+    return NULL;
+}
+#endif
+
+
+#if !ME_ROM
+/*
+    Define the session store. This loads any sessions in the store. Set "path" to empty to disable the store.
+ */
+static void sessionStoreTest(Webs *wp)
+{
+    cchar   *path;
+
+    path = websGetVar(wp, "path", "");
+    websSetSessionStore(path);
+    websSetStatus(wp, 200);
+    websWriteHeaders(wp, -1, 0);
+    websWriteEndHeaders(wp);
+    websWrite(wp, "<html><body><p>Store %s</p></body></html>\n", path);
+    websDone(wp);
+}
+#endif
+
+
 static void showTest(Webs *wp)
 {
     WebsKey     *s;